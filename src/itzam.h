@@ -207,7 +207,12 @@ typedef enum
     ITZAM_ERROR_SHMEM,                  // 40
     ITZAM_ERROR_ALREADY_CREATED,
     ITZAM_ERROR_READ_ONLY,
-    ITZAM_ERROR_TOO_LONG
+    ITZAM_ERROR_TOO_LONG,
+    ITZAM_ERROR_LOG_FAILED,
+    ITZAM_ERROR_MAP_FAILED,
+    ITZAM_ERROR_VARKEY,
+    ITZAM_ERROR_VALUES,
+    ITZAM_ERROR_CHECKSUM
 } itzam_error;
 
 typedef enum
@@ -223,18 +228,29 @@ typedef enum
     ITZAM_DATA_WRITE_FAILED,
     ITZAM_REF_SIZE_MISMATCH,
     ITZAM_READ_ONLY,
-    ITZAM_OVERWRITE_TOO_LONG
+    ITZAM_OVERWRITE_TOO_LONG,
+    ITZAM_NOT_SORTED
 } itzam_state;
 
 /*-----------------------------------------------------------------------------
- * shared memory
+ * general function types
+ */
+
+typedef void itzam_error_handler(const char * function_name, itzam_error error);
+
+extern itzam_error_handler * default_error_handler;
+
+void itzam_set_default_error_handler(itzam_error_handler * handler);
+
+/*-----------------------------------------------------------------------------
+ * shared memory; errors go to error_handler, or to the default handler if it is NULL
  */
 
-ITZAM_SHMEM_TYPE itzam_shmem_obtain(const char * name, size_t len, itzam_bool * creator);
+ITZAM_SHMEM_TYPE itzam_shmem_obtain(const char * name, size_t len, itzam_bool * creator, itzam_error_handler * error_handler);
 
 void itzam_shmem_close(ITZAM_SHMEM_TYPE shmem, const char * name);
 
-void * itzam_shmem_getptr(ITZAM_SHMEM_TYPE shmem, size_t len);
+void * itzam_shmem_getptr(ITZAM_SHMEM_TYPE shmem, size_t len, itzam_error_handler * error_handler);
 
 itzam_bool itzam_shmem_commit(void * shmem_ptr);
 
@@ -254,12 +270,51 @@ itzam_bool itzam_file_read(ITZAM_FILE_TYPE datafile, void * data, size_t len);
 
 itzam_bool itzam_file_write(ITZAM_FILE_TYPE datafile, const void * data, size_t len);
 
+/* positional I/O; these neither use nor move the file position
+ */
+typedef struct t_itzam_file_vec
+{
+    void * m_data;
+    size_t m_len;
+}
+itzam_file_vec;
+
+itzam_bool itzam_file_pread(ITZAM_FILE_TYPE datafile, void * data, size_t len, itzam_ref pos);
+
+itzam_bool itzam_file_pwrite(ITZAM_FILE_TYPE datafile, const void * data, size_t len, itzam_ref pos);
+
+itzam_bool itzam_file_preadv(ITZAM_FILE_TYPE datafile, const itzam_file_vec * vec, int count, itzam_ref pos);
+
+itzam_bool itzam_file_pwritev(ITZAM_FILE_TYPE datafile, const itzam_file_vec * vec, int count, itzam_ref pos);
+
 itzam_ref itzam_file_seek(ITZAM_FILE_TYPE datafile, itzam_ref pos, int mode);
 
 itzam_ref itzam_file_tell(ITZAM_FILE_TYPE datafile);
 
 itzam_bool itzam_file_commit(ITZAM_FILE_TYPE datafile);
 
+itzam_bool itzam_file_truncate(ITZAM_FILE_TYPE datafile, itzam_ref len);
+
+itzam_bool itzam_file_write_behind(ITZAM_FILE_TYPE datafile);
+
+const void * itzam_file_map(ITZAM_FILE_TYPE datafile, itzam_ref len);
+
+itzam_bool itzam_file_unmap(const void * map, itzam_ref len);
+
+/* reads kept in flight together; io_uring on Linux, and done one at a time elsewhere
+ */
+typedef struct t_itzam_file_ring itzam_file_ring;
+
+itzam_file_ring * itzam_file_ring_create(uint32_t depth);
+
+void itzam_file_ring_destroy(itzam_file_ring * ring);
+
+itzam_bool itzam_file_ring_is_async(const itzam_file_ring * ring);
+
+itzam_bool itzam_file_ring_read(itzam_file_ring * ring, ITZAM_FILE_TYPE file, void * data, size_t len, itzam_ref pos, uint64_t tag);
+
+uint32_t itzam_file_ring_reap(itzam_file_ring * ring, uint64_t * tags, itzam_bool * results, uint32_t max, itzam_bool wait);
+
 itzam_bool itzam_file_remove(const char * filename);
 
 itzam_bool itzam_file_lock(ITZAM_FILE_TYPE datafile);
@@ -267,14 +322,13 @@ itzam_bool itzam_file_lock(ITZAM_FILE_TYPE datafile);
 itzam_bool itzam_file_unlock(ITZAM_FILE_TYPE datafile);
 
 /*-----------------------------------------------------------------------------
- * general function types
+ * checksums
  */
 
-typedef void itzam_error_handler(const char * function_name, itzam_error error);
-
-extern itzam_error_handler * default_error_handler;
-
-void itzam_set_default_error_handler(itzam_error_handler * handler);
+/* CRC-32C (Castagnoli) of len bytes, continuing from crc, which is 0 for the first
+ * piece; uses the SSE4.2 instruction where the processor has it
+ */
+uint32_t itzam_crc32c(uint32_t crc, const void * data, size_t len);
 
 /*-----------------------------------------------------------------------------
  * utility function for normalizing system objects' names (mutex, shm, ...)
@@ -295,12 +349,55 @@ typedef int itzam_key_comparator(const void * key1, const void * key2);
  */
 typedef itzam_bool itzam_key_selector(const void * key);
 
+/* function that supplies keys to a bulk load, one per call, in ascending order
+ *      itzam_true    key has been filled in
+ *      itzam_false   no more keys
+ */
+typedef itzam_bool itzam_key_source(void * context, void * key);
+
+/* function that returns the length in bytes of a variable-length key
+ */
+typedef itzam_int itzam_key_size(const void * key);
+
 /* built-in key comparisons
  */
 int itzam_comparator_int32(const void * key1, const void * key2);
 int itzam_comparator_uint32(const void * key1, const void * key2);
+int itzam_comparator_int64(const void * key1, const void * key2);
+int itzam_comparator_uint64(const void * key1, const void * key2);
 int itzam_comparator_string(const void * key1, const void * key2);
 
+/* built-in key sizes
+ */
+itzam_int itzam_key_size_string(const void * key);
+
+/* normalized keys; values are encoded as strings of bytes from 0x01 to 0xFF whose order
+ * under strcmp (or memcmp) is the order of the values, so that a key built by appending
+ * several encodings sorts as a tuple of them does, by itzam_comparator_string. Each append
+ * writes at offset in key, ends the key with a null, and returns the offset of the null; each
+ * read returns the offset just past the value it decoded, or -1 if none is there
+ */
+static const itzam_int ITZAM_KEY_INT32_LENGTH = 5;   /* bytes an encoded 32-bit integer takes */
+static const itzam_int ITZAM_KEY_INT64_LENGTH = 10;  /* bytes an encoded 64-bit integer takes */
+
+itzam_int itzam_key_append_int32(void * key, itzam_int offset, int32_t value);
+itzam_int itzam_key_append_uint32(void * key, itzam_int offset, uint32_t value);
+itzam_int itzam_key_append_int64(void * key, itzam_int offset, int64_t value);
+itzam_int itzam_key_append_uint64(void * key, itzam_int offset, uint64_t value);
+
+/* a string takes at most twice its length, plus one byte
+ */
+itzam_int itzam_key_append_string(void * key, itzam_int offset, const char * value);
+
+itzam_int itzam_key_read_int32(const void * key, itzam_int offset, int32_t * value);
+itzam_int itzam_key_read_uint32(const void * key, itzam_int offset, uint32_t * value);
+itzam_int itzam_key_read_int64(const void * key, itzam_int offset, int64_t * value);
+itzam_int itzam_key_read_uint64(const void * key, itzam_int offset, uint64_t * value);
+
+/* copies at most max_length - 1 bytes of the string, and a null
+ */
+itzam_int itzam_key_read_string(const void * key, itzam_int offset, char * value, itzam_int max_length);
+
 /* a callback function used to retrieve whatever data is associated with a reference
  */
 typedef itzam_bool itzam_export_callback(itzam_ref ref, void ** record, itzam_int * rec_len);
@@ -315,9 +412,11 @@ static const uint32_t  ITZAM_DATAFILE_SIGNATURE   = 0x4D5A5449; /* ITZM */
 static const uint32_t  ITZAM_RECORD_SIGNATURE     = 0x525A5449; /* ITZR */
 
 #if defined(ITZAM64)
-static const uint32_t ITZAM_DATAFILE_VERSION      = 0x40050100; /* 64.MM.MM.MM */
+static const uint32_t ITZAM_DATAFILE_VERSION      = 0x40050200; /* 64.MM.MM.MM */
+static const uint32_t ITZAM_DATAFILE_VERSION_0501 = 0x40050100; /* record headers without checksums */
 #else
-static const uint32_t ITZAM_DATAFILE_VERSION      = 0x20050100; /* 32.MM.MM.MM */
+static const uint32_t ITZAM_DATAFILE_VERSION      = 0x20050200; /* 32.MM.MM.MM */
+static const uint32_t ITZAM_DATAFILE_VERSION_0501 = 0x20050100; /* record headers without checksums */
 #endif
 
 static const itzam_int ITZAM_DELLIST_BLOCK_SIZE   = 256;
@@ -330,6 +429,7 @@ static const int32_t ITZAM_RECORD_DELLIST         = 0x00000002;
 static const int32_t ITZAM_RECORD_SCHEMA          = 0x00000004;
 static const int32_t ITZAM_RECORD_TRAN_HEADER     = 0x00000010;
 static const int32_t ITZAM_RECORD_TRAN_RECORD     = 0x00000020;
+static const int32_t ITZAM_RECORD_CHECKSUM        = 0x00000040;
 
 static const int32_t ITZAM_RECORD_FLAGS_BTREE     = 0x00000f00;
 static const int32_t ITZAM_RECORD_BTREE_HEADER    = 0x00000100;
@@ -346,7 +446,8 @@ static const int32_t ITZAM_RECORD_HASH_TABLE      = 0x00020000;
 static const int32_t ITZAM_RECORD_HASH_KEY        = 0x00040000;
 static const int32_t ITZAM_RECORD_HASH_LIST_ENTRY = 0x00080000;
 
-/* record header, prefix for every record in a datafile
+/* record header, prefix for every record in a datafile; in files of version 5.1 it ends
+ * before m_checksum
  */
 typedef struct t_itzam_record_header
 {
@@ -354,6 +455,8 @@ typedef struct t_itzam_record_header
     uint32_t  m_flags;     /* a set of ITZAM_RECORD_* bit settings */
     itzam_int m_length;    /* record length */
     itzam_int m_rec_len;   /* number of bytes in use by actual data */
+    uint32_t  m_checksum;  /* with ITZAM_RECORD_CHECKSUM, CRC-32C of the header up to here and the data */
+    uint32_t  m_reserved;  /* zero */
 }
 itzam_record_header;
 
@@ -372,15 +475,41 @@ typedef struct t_itzam_dellist_entry
 }
 itzam_dellist_entry;
 
-/* transaction definitions
+/* in-memory index of deleted records; each free record is found by size class
+ * for allocation, and by position for coalescing with its neighbors
  */
-typedef enum
+#define ITZAM_FREEMAP_SUBCLASSES 8
+#define ITZAM_FREEMAP_CLASSES    (64 * ITZAM_FREEMAP_SUBCLASSES)
+
+typedef struct t_itzam_free_extent
+{
+    itzam_ref                    m_where;      /* position of the free record */
+    itzam_int                    m_length;     /* length of the free record, excluding its header */
+    itzam_int                    m_slot;       /* entry in the deleted list on disk */
+    struct t_itzam_free_extent * m_prev;       /* size class list */
+    struct t_itzam_free_extent * m_next;
+    struct t_itzam_free_extent * m_start_next; /* hash chain, by position */
+    struct t_itzam_free_extent * m_end_next;   /* hash chain, by position of the following record */
+}
+itzam_free_extent;
+
+typedef struct t_itzam_freemap
 {
-    ITZAM_TRAN_OP_WRITE,
-    ITZAM_TRAN_OP_REMOVE,
-    ITZAM_TRAN_OP_OVERWRITE
+    itzam_free_extent *  m_classes[ITZAM_FREEMAP_CLASSES];         /* free records by size class */
+    uint64_t             m_class_bits[ITZAM_FREEMAP_CLASSES / 64]; /* non-empty size classes */
+    itzam_free_extent ** m_by_start;   /* hash table, by position */
+    itzam_free_extent ** m_by_end;     /* hash table, by end position */
+    uint32_t             m_bucket_mask;/* number of hash buckets - 1 */
+    uint32_t             m_count;      /* number of free records */
+    itzam_int            m_table_size; /* entries in the deleted list on disk */
+    itzam_int *          m_open_slots; /* stack of unused entries in the deleted list */
+    itzam_int            m_open_count;
+    itzam_free_extent *  m_spare;      /* extents no longer in use, kept for reuse */
+    size_t               m_sizeof_header; /* bytes in the header of each free record */
+    uint64_t             m_serial;     /* shared serial number when the map was loaded */
+    itzam_bool           m_loaded;     /* does the map reflect the file? */
 }
-itzam_op_type;
+itzam_freemap;
 
 /* data file header
  */
@@ -391,21 +520,125 @@ typedef struct t_itzam_datafile_header
     itzam_ref m_dellist_ref;      /* position of deleted list in file */
     itzam_ref m_schema_ref;       /* position of XML schema that describes this file */
     itzam_ref m_index_list_ref;   /* position of index reference list */
-    itzam_ref m_transaction_tail; /* last item in the current transaction */
+    itzam_ref m_transaction_tail; /* unused; transactions are recorded in the write-ahead log */
 }
 itzam_datafile_header;
 
-/* transaction operation header
+/* write-ahead log; every change to a datafile is appended to the log before
+ * it is written in place, so that transactions can be rolled back and
+ * committed transactions recovered after a crash
+ */
+typedef uint64_t itzam_lsn;
+
+static const uint32_t  ITZAM_LOG_SIGNATURE        = 0x4C5A5449; /* ITZL */
+static const uint32_t  ITZAM_LOG_RECORD_SIGNATURE = 0x525A5449; /* ITZR */
+static const itzam_lsn ITZAM_NULL_LSN             = 0;
+static const itzam_lsn ITZAM_LOG_CHECKPOINT_SIZE  = 16 * 1024 * 1024; /* log length that triggers a checkpoint */
+
+#define ITZAM_LOG_MAX_IMAGES 7 /* before image, plus the pieces of an after image */
+#define ITZAM_LOG_GUARDS    64 /* regions remembered as having a before image on stable storage */
+
+/* how hard a datafile works to put committed changes on stable storage; set
+ * for each open datafile
+ */
+typedef enum
+{
+    ITZAM_DURABILITY_NONE,         /* never flush; the operating system writes changes when it chooses */
+    ITZAM_DURABILITY_COMMIT,       /* flush the log before a commit returns (the default) */
+    ITZAM_DURABILITY_PERIODIC,     /* commits return at once; the log is flushed in the background */
+    ITZAM_DURABILITY_WRITE_BEHIND  /* commits return at once, after starting to write the log */
+}
+itzam_durability;
+
+static const uint32_t ITZAM_DURABILITY_DEFAULT_INTERVAL = 100; /* milliseconds between periodic flushes */
+
+/* how records are checked against their checksums; set for each open datafile. Every record
+ * written to a file of the current version carries a checksum, which a change to part of it
+ * recomputes; files of version 5.1 have no room for them, and are never checked
+ */
+typedef enum
+{
+    ITZAM_CHECKSUM_NONE,    /* checksums are written, but not verified */
+    ITZAM_CHECKSUM_VERIFY,  /* checksums are verified when records are read into memory (the default) */
+    ITZAM_CHECKSUM_MAPPED   /* also verified each time a record is read in place from the map */
+}
+itzam_checksum_mode;
+
+typedef enum
+{
+    ITZAM_LOG_UPDATE = 1, /* a change to the datafile, with before and after images */
+    ITZAM_LOG_COMMIT,     /* end of a committed transaction */
+    ITZAM_LOG_ABORT       /* end of a transaction that was rolled back */
+}
+itzam_log_type;
+
+/* log file header
  */
-typedef struct t_itzam_op_header
+typedef struct t_itzam_log_header
 {
-    itzam_op_type         m_type;
-    itzam_ref             m_where;
-    itzam_ref             m_prev_tran;
-    itzam_record_header   m_record_header;
-    itzam_ref             m_record_where;
+    uint32_t  m_signature;        /* file type signature */
+    uint32_t  m_version;          /* version of this file type */
+    itzam_lsn m_base;             /* LSN of the first record in the file */
 }
-itzam_op_header;
+itzam_log_header;
+
+/* log record header; followed by m_undo_length bytes of before image, then
+ * m_length bytes of after image
+ */
+typedef struct t_itzam_log_record
+{
+    uint32_t  m_signature;        /* ITZAM_LOG_RECORD_SIGNATURE */
+    uint32_t  m_type;             /* an itzam_log_type */
+    itzam_lsn m_lsn;              /* position of this record in the log */
+    itzam_lsn m_prev_lsn;         /* previous record of the same transaction */
+    uint64_t  m_txn;              /* transaction; 0 for a change made outside any transaction */
+    itzam_ref m_where;            /* position of the change in the datafile */
+    itzam_ref m_old_size;         /* length of the datafile before the change */
+    itzam_int m_undo_length;      /* length of the before image */
+    itzam_int m_length;           /* length of the after image */
+    uint32_t  m_checksum;         /* covers this header and both images */
+    uint32_t  m_reserved;
+}
+itzam_log_record;
+
+/* working storage for the log of one datafile instance
+ */
+typedef struct t_itzam_log
+{
+    ITZAM_FILE_TYPE           m_file;              /* log file, opened when first needed */
+    char *                    m_filename;          /* filename for the log */
+    itzam_bool                m_is_open;           /* has the log file been opened? */
+    uint64_t                  m_txn;               /* current transaction, or 0 */
+    itzam_lsn                 m_last_lsn;          /* last record of the current transaction */
+    void *                    m_undo;              /* before-image buffer, reused by every update */
+    itzam_int                 m_undo_size;         /* size of m_undo */
+    itzam_ref                 m_txn_size;          /* datafile length when the current transaction began */
+    itzam_ref                 m_guard_where[ITZAM_LOG_GUARDS];  /* regions of the datafile this transaction */
+    itzam_int                 m_guard_length[ITZAM_LOG_GUARDS]; /* may overwrite without flushing the log */
+
+    /* group commit; committers wait for a single thread that flushes the log */
+#if defined(ITZAM_UNIX)
+    pthread_mutex_t           m_lock;              /* guards the fields below */
+    pthread_cond_t            m_work;              /* signals the flush thread */
+    pthread_cond_t            m_done;              /* signals committers when a flush completes */
+    pthread_t                 m_thread;            /* flush thread */
+#else
+    CRITICAL_SECTION          m_lock;
+    CONDITION_VARIABLE        m_work;
+    CONDITION_VARIABLE        m_done;
+    HANDLE                    m_thread;
+#endif
+    itzam_durability          m_durability;        /* when commits are flushed */
+    uint32_t                  m_interval;          /* milliseconds between periodic flushes */
+    itzam_bool                m_running;           /* is the flush thread running? */
+    itzam_bool                m_failed;            /* did a flush fail? */
+    itzam_lsn                 m_written;           /* end of the last commit */
+    itzam_lsn                 m_requested;         /* highest LSN a committer is waiting for */
+    itzam_lsn                 m_durable;           /* log is on stable storage up to here */
+    uint64_t                  m_flushes;           /* statistics: number of log flushes */
+    uint64_t                  m_commits;           /* statistics: number of commits */
+}
+itzam_log;
 
 /* definition of shared memory used by all isnatnces of a datafile
  */
@@ -413,8 +646,17 @@ typedef struct t_itzam_datafile_shared
 {
     int                       m_count;             /* header information */
     itzam_datafile_header     m_header;            /* header information */
+    uint64_t                  m_generation;        /* incremented whenever cached structures are modified */
+    uint64_t                  m_dellist_serial;    /* incremented whenever the deleted list changes */
+    itzam_lsn                 m_log_base;          /* LSN of the first record in the log file */
+    itzam_lsn                 m_log_end;           /* LSN of the next record appended to the log */
+    uint64_t                  m_next_txn;          /* last transaction number assigned */
 #if defined(ITZAM_UNIX)
     pthread_mutex_t           m_mutex;             /* shared mutex */
+    pthread_rwlock_t          m_rwlock;            /* shared by readers; writers also hold m_mutex */
+    pthread_t                 m_writer;            /* thread holding m_rwlock for writing */
+    pid_t                     m_writer_pid;        /* process containing m_writer */
+    int                       m_write_depth;       /* nesting count of write locks held by m_writer */
 #endif
 }
 itzam_datafile_shared;
@@ -427,13 +669,11 @@ typedef struct t_itzam_datafile
     ITZAM_FILE_TYPE           m_file;              /* file associated with this datafile */
     char *                    m_filename;          /* filename for this datafile */
 
-    /* list of deleted records */
-    itzam_dellist_header      m_dellist_header;    /* header for current deleted record list */
-    itzam_dellist_entry *     m_dellist;           /* pointer to list of deleted records */
+    /* index of deleted records */
+    itzam_freemap             m_freemap;           /* free space available for new records */
 
-    /* transaction tracking file information */
-    char *                    m_tran_file_name;    /* transaction filename */
-    struct t_itzam_datafile * m_tran_file;         /* transaction file */
+    /* write-ahead log */
+    itzam_log                 m_log;               /* changes not yet known to be in the datafile */
 
 #if defined(ITZAM_WINDOWS)
     /* shared (named) mutex */
@@ -445,15 +685,27 @@ typedef struct t_itzam_datafile
     char *                    m_shmem_name;        /* name of shared memory block */
     itzam_datafile_shared *   m_shared;            /* items shared among all instances */
 
+    /* position used by sequential reads; all file access is positional */
+    itzam_ref                 m_position;          /* offset of the next record to read */
+
+#if defined(ITZAM_UNIX)
+    /* read-only view of the file, when reads are mapped */
+    pthread_rwlock_t          m_map_lock;          /* shared while reading the map; exclusive to change it */
+    const itzam_byte *        m_map;               /* the mapping, or NULL when reads use the file */
+    itzam_ref                 m_map_size;          /* bytes mapped, which may reach past the end of the file */
+    itzam_ref                 m_map_len;           /* bytes known to be in the file, and safe to read */
+#endif
+
     /* error handling */
     itzam_error_handler *     m_error_handler;     /* function to handle errors that occur */
+    itzam_checksum_mode       m_checksums;         /* when records are verified */
+    size_t                    m_sizeof_header;     /* bytes in each record header, which depends on the version */
 
     /* flags */
     itzam_bool                m_is_open;           /* is the file currently open? */
     itzam_bool                m_read_only;         /* is the file open read-only? */
     itzam_bool                m_file_locked;       /* is the file currently locked? */
     itzam_bool                m_in_transaction;    /* are we journalizing a transaction? */
-    itzam_bool                m_tran_replacing;    /* set when a write replaces a record during a write */
 
     /* file locking */
 #if defined(ITZAM_UNIX)
@@ -476,12 +728,33 @@ itzam_state itzam_datafile_open(itzam_datafile * datafile,
                                 itzam_bool recover,
                                 itzam_bool read_only);
 
+/* as above, reporting every error to error_handler, including those found before the file is
+ * open; a NULL error_handler selects the default handler
+ */
+itzam_state itzam_datafile_create_ex(itzam_datafile * datafile,
+                                     const char * filename,
+                                     itzam_error_handler * error_handler);
+
+itzam_state itzam_datafile_open_ex(itzam_datafile * datafile,
+                                   const char * filename,
+                                   itzam_bool recover,
+                                   itzam_bool read_only,
+                                   itzam_error_handler * error_handler);
+
 itzam_state itzam_datafile_close(itzam_datafile * datafile);
 
 void itzam_datafile_mutex_lock(itzam_datafile * datafile);
 
 void itzam_datafile_mutex_unlock(itzam_datafile * datafile);
 
+void itzam_datafile_read_lock(itzam_datafile * datafile);
+
+void itzam_datafile_read_unlock(itzam_datafile * datafile);
+
+void itzam_datafile_write_lock(itzam_datafile * datafile);
+
+void itzam_datafile_write_unlock(itzam_datafile * datafile);
+
 itzam_bool itzam_datafile_file_lock(itzam_datafile * datafile);
 
 itzam_bool itzam_datafile_file_unlock(itzam_datafile * datafile);
@@ -525,6 +798,11 @@ itzam_state itzam_datafile_read(itzam_datafile * datafile,
                                 void * data,
                                 itzam_int max_length);
 
+itzam_state itzam_datafile_read_at(itzam_datafile * datafile,
+                                   itzam_ref where,
+                                   void * data,
+                                   itzam_int max_length);
+
 itzam_state itzam_datafile_read_alloc(itzam_datafile * datafile,
                                       void ** data,
                                       itzam_int * length);
@@ -537,6 +815,147 @@ itzam_state itzam_datafile_transaction_commit(itzam_datafile * datafile);
 
 itzam_state itzam_datafile_transaction_rollback(itzam_datafile * datafile);
 
+itzam_state itzam_datafile_set_durability(itzam_datafile * datafile,
+                                          itzam_durability durability,
+                                          uint32_t interval);
+
+itzam_state itzam_datafile_set_mapped(itzam_datafile * datafile, itzam_bool mapped);
+
+itzam_bool itzam_datafile_map_lock(itzam_datafile * datafile);
+
+void itzam_datafile_map_unlock(itzam_datafile * datafile);
+
+const void * itzam_datafile_map_record(itzam_datafile * datafile, itzam_ref where, itzam_int length);
+
+const void * itzam_datafile_record_data(itzam_datafile * datafile, const void * buffer, itzam_int length);
+
+itzam_state itzam_datafile_set_checksums(itzam_datafile * datafile, itzam_checksum_mode mode);
+
+/*-----------------------------------------------------------------------------
+ * prototypes for write-ahead log; used by datafiles, which call these with
+ * their mutex held
+ */
+
+void itzam_log_init(itzam_datafile * datafile, const char * filename);
+
+void itzam_log_close(itzam_datafile * datafile, itzam_bool last_owner);
+
+itzam_bool itzam_log_is_active(itzam_datafile * datafile);
+
+itzam_state itzam_log_begin(itzam_datafile * datafile);
+
+itzam_state itzam_log_update(itzam_datafile * datafile,
+                             itzam_ref where,
+                             const itzam_file_vec * vec,
+                             int count);
+
+itzam_state itzam_log_commit(itzam_datafile * datafile, itzam_lsn * flush_to);
+
+itzam_state itzam_log_rollback(itzam_datafile * datafile);
+
+itzam_state itzam_log_force(itzam_datafile * datafile, itzam_lsn lsn);
+
+itzam_state itzam_log_set_durability(itzam_datafile * datafile,
+                                     itzam_durability durability,
+                                     uint32_t interval);
+
+itzam_state itzam_log_checkpoint(itzam_datafile * datafile);
+
+itzam_state itzam_log_recover(itzam_datafile * datafile);
+
+void itzam_log_get_stats(itzam_datafile * datafile,
+                         uint64_t * commits,
+                         uint64_t * flushes);
+
+/*-----------------------------------------------------------------------------
+ * page cache (buffer pool) for fixed-length datafile records
+ */
+
+static const uint32_t ITZAM_CACHE_DEFAULT_PAGES = 256;
+
+/* a cached record; pinned frames are never evicted
+ */
+typedef struct t_itzam_cache_frame
+{
+    itzam_ref                    m_where;      /* location of the cached record, or ITZAM_NULL_REF if empty */
+    itzam_byte *                 m_data;       /* record data */
+    void *                       m_user;       /* zero-filled area for the owner's use, allocated with the frame */
+    uint32_t                     m_pins;       /* number of active users */
+    itzam_bool                   m_dirty;      /* modified since it was last written? */
+    itzam_bool                   m_referenced; /* CLOCK reference bit */
+    itzam_bool                   m_orphan;     /* discarded while pinned; emptied when released */
+    itzam_bool                   m_loading;    /* being read from the file by another thread */
+    struct t_itzam_cache_frame * m_hash_next;  /* next frame in hash chain */
+}
+itzam_cache_frame;
+
+/* working storage for a cache
+ */
+typedef struct t_itzam_cache
+{
+    itzam_datafile *      m_datafile;     /* datafile holding the cached records */
+    int32_t               m_flags;        /* record flags used when writing frames */
+    uint32_t              m_frame_size;   /* bytes of record data per frame */
+    uint32_t              m_user_size;    /* bytes of owner data per frame */
+    uint32_t              m_capacity;     /* number of frames kept when unpinned */
+    uint32_t              m_count;        /* number of frames allocated */
+    uint32_t              m_hand;         /* CLOCK hand */
+    uint32_t              m_frames_size;  /* allocated length of m_frames */
+    itzam_cache_frame **  m_frames;       /* every allocated frame, swept by the CLOCK hand */
+    uint32_t              m_bucket_mask;  /* number of hash buckets - 1 */
+    itzam_cache_frame **  m_buckets;      /* hash table, by record location */
+    uint64_t              m_generation;   /* last datafile generation seen */
+    itzam_bool            m_modified;     /* has the file been changed since the last flush? */
+    uint64_t              m_hits;         /* statistics */
+    uint64_t              m_misses;
+#if defined(ITZAM_UNIX)
+    pthread_mutex_t       m_latch;        /* guards the cache among concurrent readers */
+#else
+    CRITICAL_SECTION      m_latch;
+#endif
+}
+itzam_cache;
+
+/*-----------------------------------------------------------------------------
+ * prototypes for page cache; callers must hold at least a datafile read lock,
+ * and a write lock to modify records
+ */
+
+itzam_state itzam_cache_create(itzam_cache * cache,
+                               itzam_datafile * datafile,
+                               uint32_t frame_size,
+                               uint32_t user_size,
+                               uint32_t capacity,
+                               int32_t flags);
+
+void itzam_cache_destroy(itzam_cache * cache);
+
+void itzam_cache_set_capacity(itzam_cache * cache, uint32_t capacity);
+
+itzam_cache_frame * itzam_cache_fetch(itzam_cache * cache, itzam_ref where);
+
+void itzam_cache_release(itzam_cache * cache, itzam_cache_frame * frame);
+
+itzam_state itzam_cache_peek(itzam_cache * cache, itzam_ref where, void * data);
+
+itzam_cache_frame * itzam_cache_probe(itzam_cache * cache, itzam_ref where);
+
+void itzam_cache_fill(itzam_cache * cache, itzam_ref where, const void * data);
+
+void itzam_cache_mark_dirty(itzam_cache_frame * frame);
+
+itzam_state itzam_cache_store(itzam_cache * cache, itzam_ref where, const void * data);
+
+itzam_state itzam_cache_write_through(itzam_cache * cache, itzam_ref where, const void * data);
+
+void itzam_cache_discard(itzam_cache * cache, itzam_ref where);
+
+itzam_state itzam_cache_flush(itzam_cache * cache);
+
+void itzam_cache_sync(itzam_cache * cache);
+
+void itzam_cache_invalidate(itzam_cache * cache);
+
 /*-----------------------------------------------------------------------------
  * B-tree types data structures
  */
@@ -546,7 +965,7 @@ itzam_state itzam_datafile_transaction_rollback(itzam_datafile * datafile);
 typedef struct t_itzam_btree_page_header
 {
     itzam_ref  m_where;     /* location in page file */
-    itzam_ref  m_parent;    /* parent in page file */
+    itzam_ref  m_parent;    /* parent in page file; ITZAM_NULL_REF in trees without parent links */
     uint16_t   m_key_count; /* actual  # of keys */
 }
 itzam_btree_page_header;
@@ -565,8 +984,21 @@ typedef struct t_itzam_btree_page
 
     /* these elements are pointers into m_data
      */
-    itzam_byte * m_keys;  /* array of key/data objects */
+    itzam_byte * m_keys;  /* array of key/data objects; NULL in slotted pages */
     itzam_ref  * m_links; /* links to other pages */
+
+    /* free space and key offsets in slotted pages, for variable-length keys; otherwise NULL
+     */
+    struct t_itzam_btree_slots * m_slots;
+    uint16_t   * m_offsets;
+
+    /* previous and next leaves, in trees created with linked leaves; otherwise NULL
+     */
+    itzam_ref  * m_siblings;
+
+    /* cache frame that owns m_data, or NULL for private pages
+     */
+    itzam_cache_frame * m_frame;
 }
 itzam_btree_page;
 
@@ -576,6 +1008,82 @@ static const uint32_t ITZAM_BTREE_VERSION        = 0x00040000;
 static const uint16_t ITZAM_BTREE_ORDER_MINIMUM  =  4;
 static const uint16_t ITZAM_BTREE_ORDER_DEFAULT  = 25;
 
+/* orders at or above this use binary search within pages when the strategy is automatic
+ */
+static const uint16_t ITZAM_BTREE_BINARY_SEARCH_ORDER = 16;
+
+/* how keys are located within a page
+ */
+typedef enum
+{
+    ITZAM_SEARCH_AUTO,      /* linear for small orders, binary otherwise */
+    ITZAM_SEARCH_LINEAR,    /* compare keys in order until one is not less than the target */
+    ITZAM_SEARCH_BINARY     /* bisect the keys in a page */
+}
+itzam_search_strategy;
+
+/* keys the B-tree compares itself; each is the integer, in native byte order, that begins a
+ * fixed-length key, and pages of them are searched without calling a comparator
+ */
+typedef enum
+{
+    ITZAM_KEY_CUSTOM,       /* compared by the key_comparator given */
+    ITZAM_KEY_INT32,        /* as itzam_comparator_int32 compares them */
+    ITZAM_KEY_UINT32,       /* as itzam_comparator_uint32 compares them */
+    ITZAM_KEY_INT64,        /* as itzam_comparator_int64 compares them */
+    ITZAM_KEY_UINT64,       /* as itzam_comparator_uint64 compares them */
+    ITZAM_KEY_STRING        /* as itzam_comparator_string compares them; normalized keys are such strings */
+}
+itzam_key_type;
+
+/* B-tree header flags
+ */
+static const uint16_t ITZAM_BTREE_FLAG_SEARCH_MASK   = 0x0003; /* itzam_search_strategy */
+static const uint16_t ITZAM_BTREE_FLAG_LINKED_LEAVES = 0x0004; /* all keys in leaves, which are chained in order */
+static const uint16_t ITZAM_BTREE_FLAG_NO_PARENTS    = 0x0008; /* pages do not record their parents */
+static const uint16_t ITZAM_BTREE_FLAG_VARKEY        = 0x0010; /* keys of varying length, in slotted pages; implies linked leaves */
+static const uint16_t ITZAM_BTREE_FLAG_PREFIX        = 0x0020; /* slotted pages store a common prefix once, and separators are cut short */
+static const uint16_t ITZAM_BTREE_FLAG_VALUES        = 0x0040; /* each key in a leaf carries a value; see itzam_btree_put */
+static const uint16_t ITZAM_BTREE_FLAG_KEY_TYPE_MASK = 0x0380; /* itzam_key_type, shifted by ITZAM_BTREE_KEY_TYPE_SHIFT */
+
+#define ITZAM_BTREE_KEY_TYPE_SHIFT 7
+
+/* slotted pages follow the page header with this, then the child and sibling links, then
+ * an array of offsets to the keys; each key is stored at the end of the page, preceded by
+ * its length as a uint16_t. In a page with a prefix, every key begins with the prefix,
+ * which is stored once in the same way, and the keys hold only what follows it
+ */
+typedef struct t_itzam_btree_slots
+{
+    uint16_t   m_heap;         /* offset of the lowest key in the page */
+    uint16_t   m_garbage;      /* bytes above m_heap left by keys that were removed */
+    uint16_t   m_prefix;       /* offset of the prefix shared by every key in the page, or 0 for none */
+    uint16_t   m_reserved;
+}
+itzam_btree_slots;
+
+/* page sizes for variable-length keys; offsets within a page are 16 bits
+ */
+static const uint32_t ITZAM_BTREE_VARKEY_PAGE_DEFAULT = 8192;
+static const uint32_t ITZAM_BTREE_VARKEY_PAGE_MAXIMUM = 32768;
+
+/* deepest tree a writer can descend; far beyond any tree of order ITZAM_BTREE_ORDER_MINIMUM or more
+ */
+#define ITZAM_BTREE_MAX_DEPTH 64
+
+/* options for creating a B-tree
+ */
+typedef struct t_itzam_btree_options
+{
+    itzam_search_strategy m_search;         /* within-page search strategy */
+    itzam_bool            m_linked_leaves;  /* keep every key in the leaves, and chain the leaves (a B+tree) */
+    itzam_bool            m_parent_links;   /* store each page's parent in the page, as older versions require */
+    itzam_bool            m_compress_keys;  /* variable-length string keys only: store prefixes once per page, and shorten separators */
+    itzam_int             m_inline_values;  /* variable-length keys only: keys carry values, and values of up to this many bytes stay in the page */
+    itzam_key_type        m_key_type;       /* fixed-length keys only: a built-in integer key, searched without a comparator */
+}
+itzam_btree_options;
+
 /* B-tree header
  */
 typedef struct t_itzam_btree_header
@@ -584,6 +1092,7 @@ typedef struct t_itzam_btree_header
     uint32_t   m_sizeof_page;  /* sizeof(itzam_btree_page) used in creating this btreefile */
     uint32_t   m_sizeof_key;   /* size of data being stored in pages */
     uint16_t   m_order;        /* number of keys per page */
+    uint16_t   m_flags;        /* ITZAM_BTREE_FLAG_* options chosen at creation */
     uint64_t   m_count;        /* counts number of active records */
     uint64_t   m_ticker;       /* counts the total number of new records added over the life of this btree datafile*/
     itzam_ref  m_where;        /* pointer to location of this header */
@@ -592,6 +1101,19 @@ typedef struct t_itzam_btree_header
 }
 itzam_btree_header;
 
+/* the contents a page had before a write changed it, kept while a snapshot may still need them
+ */
+typedef struct t_itzam_page_version
+{
+    struct t_itzam_page_version * m_next;   /* next version in the same hash bucket */
+    itzam_ref    m_where;                   /* page these contents belong to */
+    uint64_t     m_epoch;                   /* write that replaced these contents */
+    itzam_byte * m_data;                    /* the old page contents */
+}
+itzam_page_version;
+
+struct t_itzam_btree_snapshot;
+
 /* working storage for a loaded B-tree
  */
 typedef struct t_itzam_btree
@@ -608,8 +1130,30 @@ typedef struct t_itzam_btree
     uint16_t                 m_links_size;        /* number of links per page; order + 1; calculated at creation time */
     uint16_t                 m_min_keys;          /* minimum # of keys; order / 2; calculated at creation time */
     uint16_t                 m_cursor_count;      /* Number of active cursors */
+    itzam_bool               m_binary_search;     /* search pages by bisection; resolved from header flags */
+    itzam_bool               m_linked_leaves;     /* keys live only in leaves, which link to their neighbours; resolved from header flags */
+    itzam_bool               m_parent_links;      /* pages record their parents on disk; resolved from header flags */
+    itzam_bool               m_varkeys;           /* keys vary in length, and pages are slotted; resolved from header flags */
+    itzam_bool               m_compress;          /* slotted pages share prefixes and shorten separators; resolved from header flags */
+    itzam_bool               m_values;            /* keys in leaves are followed by values; resolved from header flags */
+    itzam_key_type           m_key_type;          /* built-in integer keys, or ITZAM_KEY_CUSTOM; resolved from header flags or the comparator */
+    itzam_key_size *         m_key_size;          /* length of a variable-length key passed in by the caller */
+    uint32_t                 m_heap_base;         /* offset of the first byte slotted pages can give to keys */
+    uint32_t                 m_heap_limit;        /* bytes of keys a slotted page holds between changes */
+    itzam_ref                m_path[ITZAM_BTREE_MAX_DEPTH]; /* pages the current writer passed through, from the root */
+    int                      m_path_length;
     itzam_key_comparator *   m_key_comparator;    /* function to compare keys */
-    itzam_ref                m_saved_header;      /* temporary header saved  during transaction, for use in a rollback */
+    itzam_cache              m_cache;             /* buffer pool for pages */
+#if defined(ITZAM_UNIX)
+    pthread_rwlock_t         m_version_lock;      /* guards versions and snapshots; shared by snapshot readers */
+#else
+    SRWLOCK                  m_version_lock;
+#endif
+    itzam_page_version **    m_versions;          /* hash of old page contents kept for snapshots */
+    struct t_itzam_btree_snapshot * m_snapshots;  /* active snapshots */
+    uint64_t                 m_epoch;             /* number of writes made while snapshots were active */
+    itzam_bool               m_versioning;        /* the write in progress keeps old page contents */
+    void *                   m_slab;              /* free blocks for private pages and split temporaries; guarded by the write lock */
 }
 itzam_btree;
 
@@ -624,6 +1168,25 @@ itzam_state itzam_btree_create(itzam_btree * btree,
                                itzam_key_comparator * key_comparator,
                                itzam_error_handler * error_handler);
 
+void itzam_btree_options_init(itzam_btree_options * options);
+
+itzam_state itzam_btree_create_ex(itzam_btree * btree,
+                                  const char * filename,
+                                  uint16_t order,
+                                  itzam_int key_size,
+                                  itzam_key_comparator * key_comparator,
+                                  itzam_error_handler * error_handler,
+                                  const itzam_btree_options * options);
+
+itzam_state itzam_btree_create_varkey(itzam_btree * btree,
+                                      const char * filename,
+                                      uint32_t page_size,
+                                      itzam_int max_key_size,
+                                      itzam_key_comparator * key_comparator,
+                                      itzam_key_size * key_size,
+                                      itzam_error_handler * error_handler,
+                                      const itzam_btree_options * options);
+
 itzam_state itzam_btree_open(itzam_btree * btree,
                              const char * filename,
                              itzam_key_comparator * key_comparator,
@@ -650,12 +1213,49 @@ itzam_bool itzam_btree_is_open(itzam_btree * btree);
 void itzam_btree_set_error_handler(itzam_btree * btree,
                                    itzam_error_handler * error_handler);
 
+void itzam_btree_set_cache_size(itzam_btree * btree, uint32_t pages);
+
+itzam_state itzam_btree_set_mapped(itzam_btree * btree, itzam_bool mapped);
+
+itzam_state itzam_btree_set_checksums(itzam_btree * btree, itzam_checksum_mode mode);
+
+void itzam_btree_set_key_size(itzam_btree * btree, itzam_key_size * key_size);
+
+itzam_state itzam_btree_set_durability(itzam_btree * btree,
+                                       itzam_durability durability,
+                                       uint32_t interval);
+
 itzam_state itzam_btree_insert(itzam_btree * btree, const void * key);
 
 itzam_bool itzam_btree_find(itzam_btree * btree, const void * search_key, void * result);
 
+itzam_state itzam_btree_bulk_load(itzam_btree * btree,
+                                  itzam_key_source * source,
+                                  void * context,
+                                  double fill_factor);
+
 itzam_state itzam_btree_remove(itzam_btree * btree, const void * key);
 
+itzam_state itzam_btree_put(itzam_btree * btree, const void * key, const void * value, itzam_int length);
+
+itzam_state itzam_btree_get(itzam_btree * btree, const void * key, void * value, itzam_int max_length, itzam_int * length);
+
+itzam_state itzam_btree_insert_batch(itzam_btree * btree,
+                                     const void * keys,
+                                     size_t count,
+                                     itzam_state * results);
+
+size_t itzam_btree_find_batch(itzam_btree * btree,
+                              const void * keys,
+                              size_t count,
+                              void * returned_keys,
+                              itzam_bool * found);
+
+itzam_state itzam_btree_remove_batch(itzam_btree * btree,
+                                     const void * keys,
+                                     size_t count,
+                                     itzam_state * results);
+
 uint16_t itzam_btree_cursor_count(itzam_btree * btree);
 
 itzam_state itzam_btree_transaction_start(itzam_btree * btree);
@@ -668,11 +1268,29 @@ itzam_state itzam_btree_transaction_rollback(itzam_btree * btree);
  * B-tree cursor structures
  */
 
+/* where itzam_btree_cursor_seek leaves a cursor, relative to the search key
+ */
+typedef enum
+{
+    ITZAM_KEY_GE,   /* first key greater than or equal to the search key */
+    ITZAM_KEY_GT,   /* first key greater than the search key */
+    ITZAM_KEY_LE,   /* last key less than or equal to the search key */
+    ITZAM_KEY_LT    /* last key less than the search key */
+}
+itzam_seek_mode;
+
+/* function called for each key in a range scan
+ *      itzam_true    continue the scan
+ *      itzam_false   stop the scan
+ */
+typedef itzam_bool itzam_key_visitor(void * context, const void * key);
+
 typedef struct t_itzam_btree_cursor_memory
 {
     struct t_itzam_btree_cursor_memory * m_prev;
     itzam_bool   m_done;
     size_t m_index;
+    itzam_ref    m_where;   /* the parent page, which pages need not record */
 }
 itzam_btree_cursor_memory;
 
@@ -682,6 +1300,10 @@ typedef struct t_itzam_btree_cursor
     itzam_btree_page * m_page;
     size_t             m_index;
     itzam_btree_cursor_memory * m_parent_memory;
+    itzam_byte       * m_key;         /* copy of the current key, for finding it again after the tree changes */
+    itzam_bool         m_on_key;      /* false once the cursor has moved past either end of the keys */
+    uint64_t           m_generation;  /* datafile generation when the cursor was last positioned */
+    itzam_btree_cursor_memory * m_spare_memory; /* positions released by the cursor, kept for reuse */
 }
 itzam_btree_cursor;
 
@@ -696,10 +1318,110 @@ itzam_state itzam_btree_cursor_free(itzam_btree_cursor * cursor);
 
 itzam_bool itzam_btree_cursor_next(itzam_btree_cursor * cursor);
 
+itzam_bool itzam_btree_cursor_prev(itzam_btree_cursor * cursor);
+
 itzam_bool itzam_btree_cursor_reset(itzam_btree_cursor * cursor);
 
+itzam_bool itzam_btree_cursor_last(itzam_btree_cursor * cursor);
+
 itzam_state itzam_btree_cursor_read(itzam_btree_cursor * cursor, void * returned_key);
 
+itzam_bool itzam_btree_cursor_seek(itzam_btree_cursor * cursor, const void * key, itzam_seek_mode mode);
+
+uint64_t itzam_btree_scan_range(itzam_btree * btree,
+                                const void * low_key,
+                                const void * high_key,
+                                itzam_key_visitor * visitor,
+                                void * context);
+
+uint64_t itzam_btree_scan_range_reverse(itzam_btree * btree,
+                                        const void * low_key,
+                                        const void * high_key,
+                                        itzam_key_visitor * visitor,
+                                        void * context);
+
+/*-----------------------------------------------------------------------------
+ * B-tree snapshots
+ */
+
+/* a read-only view of a B-tree as it stood when the snapshot began
+ */
+typedef struct t_itzam_btree_snapshot
+{
+    itzam_btree * m_btree;
+    uint64_t      m_epoch;        /* writes made after this epoch are invisible */
+    itzam_ref     m_root_where;   /* root page when the snapshot began */
+    uint64_t      m_count;        /* number of keys when the snapshot began */
+    struct t_itzam_btree_snapshot * m_next;  /* next active snapshot of the same B-tree */
+}
+itzam_btree_snapshot;
+
+itzam_state itzam_btree_snapshot_begin(itzam_btree * btree, itzam_btree_snapshot * snapshot);
+
+itzam_state itzam_btree_snapshot_end(itzam_btree_snapshot * snapshot);
+
+uint64_t itzam_btree_snapshot_count(itzam_btree_snapshot * snapshot);
+
+itzam_bool itzam_btree_snapshot_find(itzam_btree_snapshot * snapshot, const void * search_key, void * result);
+
+uint64_t itzam_btree_snapshot_scan(itzam_btree_snapshot * snapshot,
+                                   const void * low_key,
+                                   const void * high_key,
+                                   itzam_key_visitor * visitor,
+                                   void * context);
+
+/*-----------------------------------------------------------------------------
+ * asynchronous B-tree lookups
+ */
+
+/* called when an asynchronous lookup finishes; found_key is NULL if the key is not in the
+ * tree, and both keys are only valid during the call
+ */
+typedef void itzam_find_callback(void * context, const void * key, const void * found_key);
+
+/* a lookup waiting for a page to be read
+ */
+typedef struct t_itzam_btree_lookup
+{
+    itzam_find_callback * m_callback;
+    void *                m_context;
+    itzam_ref             m_where;        /* page being read */
+    uint64_t              m_generation;   /* file generation when the read was queued */
+    itzam_bool            m_found;
+    itzam_byte *          m_key;          /* copy of the search key */
+    itzam_byte *          m_found_key;    /* the key found, when m_found is true */
+    itzam_byte *          m_buffer;       /* record header and page, as read from the file */
+}
+itzam_btree_lookup;
+
+/* lookups whose page reads are in flight together; used by one thread at a time
+ */
+typedef struct t_itzam_btree_async
+{
+    itzam_btree *         m_btree;
+    itzam_file_ring *     m_ring;
+    itzam_btree_lookup *  m_lookups;
+    uint32_t              m_depth;        /* most lookups in flight */
+    uint32_t              m_active;       /* lookups in flight */
+    uint32_t *            m_free;         /* stack of unused lookups */
+    uint32_t              m_free_count;
+    itzam_byte *          m_memory;       /* keys and buffers for every lookup */
+}
+itzam_btree_async;
+
+itzam_state itzam_btree_async_create(itzam_btree_async * async, itzam_btree * btree, uint32_t depth);
+
+itzam_state itzam_btree_async_free(itzam_btree_async * async);
+
+itzam_state itzam_btree_find_async(itzam_btree_async * async,
+                                   const void * key,
+                                   itzam_find_callback * callback,
+                                   void * context);
+
+uint32_t itzam_btree_async_poll(itzam_btree_async * async, itzam_bool wait);
+
+uint32_t itzam_btree_async_pending(const itzam_btree_async * async);
+
 #pragma pack(pop)
 
 #if defined(__cplusplus)
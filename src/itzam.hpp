@@ -0,0 +1,602 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#if !defined(LIBITZAM_ITZAM_HPP)
+#define LIBITZAM_ITZAM_HPP
+
+#include "itzam.h"
+
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/*-----------------------------------------------------------------------------
+ * C++17 interface; B-trees of fixed-length keys of one type, ordered by a comparison
+ * object, that close themselves when they go out of scope
+ */
+namespace itzam
+{
+    /* a failed operation, and the state Itzam reported for it; when Itzam reported an error
+     * through its error handler, the function that reported it and the error
+     */
+    class error : public std::runtime_error
+    {
+    public:
+        error(const char * operation, itzam_state state)
+          : std::runtime_error(std::string(operation) + ": " + state_name(state)),
+            m_state(state)
+        {
+        }
+
+        error(const char * operation, const char * function_name, itzam_error code)
+          : std::runtime_error(std::string(operation) + ": " + function_name + " reported error " + std::to_string((int)code)),
+            m_state(ITZAM_FAILED),
+            m_error(code)
+        {
+        }
+
+        itzam_state state() const noexcept
+        {
+            return m_state;
+        }
+
+        std::optional<itzam_error> reported() const noexcept
+        {
+            return m_error;
+        }
+
+    private:
+        static const char * state_name(itzam_state state)
+        {
+            static const char * names[] = { "okay", "operation failed", "version mismatch in files",
+                                            "iterator at end", "iterator at beginning", "key not found",
+                                            "duplicate key", "exceeded maximum file size on 32-bit system",
+                                            "unable to write data record for index",
+                                            "sizeof(size_t) smaller than required for file references",
+                                            "invalid operation for read only file",
+                                            "record too long for overwrite", "keys not in sorted order" };
+
+            return ((size_t)state < sizeof(names) / sizeof(names[0])) ? names[state] : "unknown state";
+        }
+
+        itzam_state                m_state;
+        std::optional<itzam_error> m_error;
+    };
+
+    namespace detail
+    {
+        /* the first error Itzam reported to this thread since the last check; the handler
+         * records it and returns, so the C call can fail normally before anything is thrown
+         */
+        struct reported_error
+        {
+            const char * m_function = nullptr;
+            itzam_error  m_code     = ITZAM_ERROR_SIGNATURE;
+        };
+
+        inline thread_local reported_error last_error;
+
+        inline void record_error(const char * function_name, itzam_error code)
+        {
+            if (last_error.m_function == nullptr)
+            {
+                last_error.m_function = function_name;
+                last_error.m_code     = code;
+            }
+        }
+
+        inline void clear_error() noexcept
+        {
+            last_error = reported_error();
+        }
+
+        /* throws for an error reported during the call, or for a state the caller does not accept
+         */
+        inline void check(const char * operation, itzam_state state = ITZAM_OKAY, itzam_state accepted = ITZAM_OKAY)
+        {
+            reported_error reported = last_error;
+            clear_error();
+
+            if (reported.m_function != nullptr)
+                throw error(operation, reported.m_function, reported.m_code);
+
+            if ((state != ITZAM_OKAY) && (state != accepted))
+                throw error(operation, state);
+        }
+
+        /* integer keys in their natural order are searched by Itzam itself, without calling a
+         * comparator; any other order is compared by a function made for the key and order
+         */
+        template <typename Key, typename Compare>
+        constexpr itzam_key_type builtin_key_type()
+        {
+            if constexpr ((std::is_same_v<Compare, std::less<Key>> || std::is_same_v<Compare, std::less<>>)
+                       && std::is_integral_v<Key> && !std::is_same_v<Key, bool>)
+            {
+                if constexpr (sizeof(Key) == sizeof(int32_t))
+                    return std::is_signed_v<Key> ? ITZAM_KEY_INT32 : ITZAM_KEY_UINT32;
+                else if constexpr (sizeof(Key) == sizeof(int64_t))
+                    return std::is_signed_v<Key> ? ITZAM_KEY_INT64 : ITZAM_KEY_UINT64;
+            }
+
+            return ITZAM_KEY_CUSTOM;
+        }
+
+        /* keys in pages need not be aligned, so they are copied before being compared
+         */
+        template <typename Key, typename Compare>
+        int compare_keys(const void * key1, const void * key2)
+        {
+            Key k1, k2;
+            Compare less;
+
+            std::memcpy(&k1, key1, sizeof(Key));
+            std::memcpy(&k2, key2, sizeof(Key));
+
+            return less(k1, k2) ? -1 : (less(k2, k1) ? 1 : 0);
+        }
+
+        template <typename Key, typename Compare>
+        constexpr itzam_key_comparator * comparator()
+        {
+            switch (builtin_key_type<Key, Compare>())
+            {
+                case ITZAM_KEY_INT32:
+                    return itzam_comparator_int32;
+                case ITZAM_KEY_UINT32:
+                    return itzam_comparator_uint32;
+                case ITZAM_KEY_INT64:
+                    return itzam_comparator_int64;
+                case ITZAM_KEY_UINT64:
+                    return itzam_comparator_uint64;
+                default:
+                    return compare_keys<Key, Compare>;
+            }
+        }
+    }
+
+    /* a B-tree of keys of type Key, ordered by Compare, which must be default-constructible and
+     * hold no state; each key is stored as sizeof(Key) bytes. Iterators and transactions must
+     * end before the tree closes. Unless a tree is given an error handler, errors Itzam
+     * reports are thrown as itzam::error once the call that found them returns
+     */
+    template <typename Key, typename Compare = std::less<Key>>
+    class btree
+    {
+        static_assert(std::is_trivially_copyable_v<Key>, "B-tree keys are stored as bytes");
+        static_assert(std::is_default_constructible_v<Compare>, "comparisons are made by default-constructed objects");
+
+    public:
+        using key_type    = Key;
+        using value_type  = Key;
+        using key_compare = Compare;
+        using size_type   = uint64_t;
+
+        /* the built-in key type Itzam searches pages by, or ITZAM_KEY_CUSTOM
+         */
+        static constexpr itzam_key_type builtin_key_type = detail::builtin_key_type<Key, Compare>();
+
+        class iterator;
+        using const_iterator = iterator;
+
+        class transaction;
+
+        static btree create(const std::string & filename,
+                            uint16_t order = ITZAM_BTREE_ORDER_DEFAULT,
+                            const itzam_btree_options * options = nullptr,
+                            itzam_error_handler * error_handler = nullptr)
+        {
+            itzam_btree_options choices;
+
+            if (options != nullptr)
+                choices = *options;
+            else
+                itzam_btree_options_init(&choices);
+
+            choices.m_key_type = builtin_key_type;
+
+            if (error_handler == nullptr)
+                error_handler = detail::record_error;
+
+            std::unique_ptr<itzam_btree> tree(new itzam_btree);
+
+            // the handler receives errors found while the file is created, too
+            detail::clear_error();
+
+            itzam_state state = itzam_btree_create_ex(tree.get(), filename.c_str(), order, sizeof(Key),
+                                                      detail::comparator<Key, Compare>(), error_handler, &choices);
+
+            detail::check("itzam::btree::create", state);
+
+            return btree(std::move(tree));
+        }
+
+        static btree open(const std::string & filename,
+                          bool read_only = false,
+                          bool recover = false,
+                          itzam_error_handler * error_handler = nullptr)
+        {
+            if (error_handler == nullptr)
+                error_handler = detail::record_error;
+
+            std::unique_ptr<itzam_btree> tree(new itzam_btree);
+
+            // the handler receives errors found while the file is opened, too
+            detail::clear_error();
+
+            itzam_state state = itzam_btree_open(tree.get(), filename.c_str(), detail::comparator<Key, Compare>(), error_handler,
+                                                 recover ? itzam_true : itzam_false, read_only ? itzam_true : itzam_false);
+
+            detail::check("itzam::btree::open", state);
+
+            btree result(std::move(tree));
+
+            // a file of other keys, or of keys in another order, can not be read as this one
+            if ((result.m_btree->m_header->m_sizeof_key != sizeof(Key)) || result.m_btree->m_varkeys
+             || (result.m_btree->m_key_type != builtin_key_type))
+                throw error("itzam::btree::open", ITZAM_VERSION_ERROR);
+
+            return result;
+        }
+
+        btree(btree && other) noexcept = default;
+
+        btree & operator=(btree && other) noexcept
+        {
+            if (this != &other)
+            {
+                close();
+                m_btree = std::move(other.m_btree);
+            }
+
+            return *this;
+        }
+
+        btree(const btree &) = delete;
+        btree & operator=(const btree &) = delete;
+
+        ~btree()
+        {
+            close();
+        }
+
+        void close() noexcept
+        {
+            if (m_btree)
+            {
+                itzam_btree_close(m_btree.get());
+                m_btree.reset();
+                detail::clear_error();
+            }
+        }
+
+        bool is_open() const noexcept
+        {
+            return (bool)m_btree;
+        }
+
+        /* true if the key was added, false if it was already there
+         */
+        bool insert(const Key & key)
+        {
+            detail::clear_error();
+            itzam_state state = itzam_btree_insert(m_btree.get(), &key);
+            detail::check("itzam::btree::insert", state, ITZAM_DUPLICATE);
+
+            return state == ITZAM_OKAY;
+        }
+
+        /* true if the key was removed, false if it was not there
+         */
+        bool erase(const Key & key)
+        {
+            detail::clear_error();
+            itzam_state state = itzam_btree_remove(m_btree.get(), &key);
+            detail::check("itzam::btree::erase", state, ITZAM_NOT_FOUND);
+
+            return state == ITZAM_OKAY;
+        }
+
+        /* the stored key equal to key, which may differ in the parts the order ignores
+         */
+        std::optional<Key> find(const Key & key) const
+        {
+            Key result;
+
+            detail::clear_error();
+            bool found = itzam_btree_find(m_btree.get(), &key, &result) ? true : false;
+            detail::check("itzam::btree::find");
+
+            if (found)
+                return result;
+
+            return std::nullopt;
+        }
+
+        bool contains(const Key & key) const
+        {
+            detail::clear_error();
+            bool found = itzam_btree_find(m_btree.get(), &key, nullptr) ? true : false;
+            detail::check("itzam::btree::contains");
+
+            return found;
+        }
+
+        size_type size() const
+        {
+            detail::clear_error();
+            size_type result = itzam_btree_count(m_btree.get());
+            detail::check("itzam::btree::size");
+
+            return result;
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        iterator begin() const
+        {
+            return iterator(m_btree.get(), nullptr, ITZAM_KEY_GE);
+        }
+
+        iterator end() const noexcept
+        {
+            return iterator();
+        }
+
+        /* the first key not less than key, and the first greater than it
+         */
+        iterator lower_bound(const Key & key) const
+        {
+            return iterator(m_btree.get(), &key, ITZAM_KEY_GE);
+        }
+
+        iterator upper_bound(const Key & key) const
+        {
+            return iterator(m_btree.get(), &key, ITZAM_KEY_GT);
+        }
+
+        /* the underlying B-tree, for functions this class does not cover
+         */
+        itzam_btree * native() const noexcept
+        {
+            return m_btree.get();
+        }
+
+    private:
+        explicit btree(std::unique_ptr<itzam_btree> tree) noexcept
+          : m_btree(std::move(tree))
+        {
+        }
+
+        std::unique_ptr<itzam_btree> m_btree;
+    };
+
+    /* an input iterator over a cursor; copies share the cursor, and the end of the keys is
+     * an iterator without one
+     */
+    template <typename Key, typename Compare>
+    class btree<Key, Compare>::iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = Key;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const Key *;
+        using reference         = const Key &;
+
+        iterator() noexcept = default;
+
+        reference operator*() const
+        {
+            return m_position->m_key;
+        }
+
+        pointer operator->() const
+        {
+            return &m_position->m_key;
+        }
+
+        iterator & operator++()
+        {
+            detail::clear_error();
+
+            if (itzam_btree_cursor_next(&m_position->m_cursor))
+                itzam_btree_cursor_read(&m_position->m_cursor, &m_position->m_key);
+            else
+                m_position.reset();
+
+            detail::check("itzam::btree::iterator");
+
+            return *this;
+        }
+
+        /* the key passed over, kept so that *it++ reads it
+         */
+        class postfix
+        {
+        public:
+            explicit postfix(const Key & key) : m_key(key) { }
+
+            const Key & operator*() const noexcept
+            {
+                return m_key;
+            }
+
+        private:
+            Key m_key;
+        };
+
+        postfix operator++(int)
+        {
+            postfix result(**this);
+            ++*this;
+            return result;
+        }
+
+        friend bool operator==(const iterator & a, const iterator & b) noexcept
+        {
+            return a.m_position == b.m_position;
+        }
+
+        friend bool operator!=(const iterator & a, const iterator & b) noexcept
+        {
+            return a.m_position != b.m_position;
+        }
+
+    private:
+        friend class btree;
+
+        struct position
+        {
+            itzam_btree_cursor m_cursor;
+            Key                m_key;
+
+            ~position()
+            {
+                itzam_btree_cursor_free(&m_cursor);
+            }
+        };
+
+        /* a cursor on the first key, or on the first key the seek mode finds; an empty tree,
+         * or a seek that finds nothing, gives the end
+         */
+        iterator(itzam_btree * tree, const Key * key, itzam_seek_mode mode)
+        {
+            std::shared_ptr<position> start = std::make_shared<position>();
+
+            detail::clear_error();
+
+            if (itzam_btree_cursor_create(&start->m_cursor, tree) != ITZAM_OKAY)
+            {
+                std::memset(&start->m_cursor, 0, sizeof(start->m_cursor));
+                detail::check("itzam::btree::iterator");
+                return;
+            }
+
+            if (itzam_btree_cursor_valid(&start->m_cursor) && ((key == nullptr) || itzam_btree_cursor_seek(&start->m_cursor, key, mode)))
+            {
+                itzam_btree_cursor_read(&start->m_cursor, &start->m_key);
+                m_position = std::move(start);
+            }
+
+            detail::check("itzam::btree::iterator");
+        }
+
+        std::shared_ptr<position> m_position;
+    };
+
+    /* changes made while a transaction lives are rolled back, unless it is committed
+     */
+    template <typename Key, typename Compare>
+    class btree<Key, Compare>::transaction
+    {
+    public:
+        explicit transaction(btree & tree)
+          : m_btree(tree.native()),
+            m_active(true)
+        {
+            detail::clear_error();
+            itzam_state state = itzam_btree_transaction_start(m_btree);
+            detail::check("itzam::btree::transaction", state);
+        }
+
+        transaction(const transaction &) = delete;
+        transaction & operator=(const transaction &) = delete;
+
+        ~transaction()
+        {
+            if (m_active)
+            {
+                itzam_btree_transaction_rollback(m_btree);
+                detail::clear_error();
+            }
+        }
+
+        void commit()
+        {
+            m_active = false;
+
+            detail::clear_error();
+            itzam_state state = itzam_btree_transaction_commit(m_btree);
+            detail::check("itzam::btree::transaction::commit", state);
+        }
+
+        void rollback()
+        {
+            m_active = false;
+
+            detail::clear_error();
+            itzam_state state = itzam_btree_transaction_rollback(m_btree);
+            detail::check("itzam::btree::transaction::rollback", state);
+        }
+
+    private:
+        itzam_btree * m_btree;
+        bool          m_active;
+    };
+}
+
+#endif
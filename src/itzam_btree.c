@@ -61,8 +61,29 @@
 #include <stdlib.h>
 #include <ctype.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static pthread_mutex_t global_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* indexes into m_siblings for trees with linked leaves
+ */
+#define PREV_LEAF 0
+#define NEXT_LEAF 1
+
+/* buckets in the hash of page versions kept for snapshots
+ */
+#define ITZAM_VERSION_BUCKETS 1021
+
+/* deepest tree a snapshot scan will walk
+ */
+#define ITZAM_SNAPSHOT_MAX_LEVELS 64
+
 static itzam_state update_header(itzam_btree * btree)
 {
     itzam_state result = ITZAM_FAILED;
@@ -81,42 +102,232 @@ static itzam_state update_header(itzam_btree * btree)
     return result;
 }
 
-static itzam_btree_page * dupe_page(const itzam_btree * btree, const itzam_btree_page * source_page)
+static void set_page_pointers(const itzam_btree * btree, itzam_btree_page * page)
 {
-    itzam_btree_page * page = NULL;
-
-    /* allocate page
-     */
-    page = (itzam_btree_page *)malloc(sizeof(itzam_btree_page));
+    page->m_header = (itzam_btree_page_header *)page->m_data;
 
-    if (page != NULL)
+    if (btree->m_varkeys)
     {
-        /* allocate data space
+        /* slotted pages put their links first, then the offsets of keys packed at the end
          */
-        page->m_data = (itzam_byte *)malloc(btree->m_header->m_sizeof_page);
+        page->m_slots    = (itzam_btree_slots *)(page->m_data + sizeof(itzam_btree_page_header));
+        page->m_keys     = NULL;
+        page->m_links    = (itzam_ref *)(page->m_data + sizeof(itzam_btree_page_header) + sizeof(itzam_btree_slots));
+        page->m_siblings = page->m_links + btree->m_links_size;
+        page->m_offsets  = (uint16_t *)(page->m_siblings + 2);
+        return;
+    }
 
-        if (page->m_data != NULL)
-        {
-            page->m_header = (itzam_btree_page_header *)page->m_data;
-            page->m_keys   = (itzam_byte *)(page->m_data + sizeof(itzam_btree_page_header));
-            page->m_links  = (itzam_ref *)(page->m_data + sizeof(itzam_btree_page_header) + btree->m_header->m_sizeof_key * btree->m_header->m_order);
-            memcpy(page->m_data, source_page->m_data, btree->m_header->m_sizeof_page);
-        }
-        else
-        {
-            free(page);
-            page = NULL;
-        }
+    page->m_slots   = NULL;
+    page->m_offsets = NULL;
+    page->m_keys    = (itzam_byte *)(page->m_data + sizeof(itzam_btree_page_header));
+    page->m_links   = (itzam_ref *)(page->m_data + sizeof(itzam_btree_page_header) + btree->m_header->m_sizeof_key * btree->m_header->m_order);
+
+    /* leaf links follow the child links
+     */
+    if (btree->m_linked_leaves)
+        page->m_siblings = page->m_links + btree->m_links_size;
+    else
+        page->m_siblings = NULL;
+}
+
+/* a key in a slotted page is preceded by its length
+ */
+#define CELL_SIZE(length) ((uint32_t)sizeof(uint16_t) + (uint32_t)(length))
+
+/* the nth key in a page
+ */
+static const itzam_byte * key_at(const itzam_btree * btree, const itzam_btree_page * page, int n)
+{
+    if (btree->m_varkeys)
+        return page->m_data + page->m_offsets[n] + sizeof(uint16_t);
+
+    return page->m_keys + n * btree->m_header->m_sizeof_key;
+}
+
+/* the length of a key in a page, which in a slotted page is stored just before it
+ */
+static itzam_int stored_key_size(const itzam_btree * btree, const itzam_byte * key)
+{
+    uint16_t length;
+
+    if (!btree->m_varkeys)
+        return btree->m_header->m_sizeof_key;
+
+    memcpy(&length, key - sizeof(uint16_t), sizeof(uint16_t));
+
+    return length;
+}
+
+/* the length of a key passed in by the caller
+ */
+static itzam_int input_key_size(const itzam_btree * btree, const void * key)
+{
+    if (btree->m_varkeys)
+        return btree->m_key_size(key);
+
+    return btree->m_header->m_sizeof_key;
+}
+
+/* the prefix every key in a slotted page begins with, if the page has one
+ */
+static itzam_int prefix_length(const itzam_btree * btree, const itzam_btree_page * page)
+{
+    uint16_t length = 0;
+
+    if (btree->m_varkeys && (page->m_slots->m_prefix != 0))
+        memcpy(&length, page->m_data + page->m_slots->m_prefix, sizeof(uint16_t));
+
+    return length;
+}
+
+static const itzam_byte * prefix_of(const itzam_btree_page * page)
+{
+    return page->m_data + page->m_slots->m_prefix + sizeof(uint16_t);
+}
+
+/* in a tree of values, each key in a leaf is followed by its value and then a trailer
+ * giving the value's length; a value too long to stay in the page is replaced by the
+ * reference of the datafile record holding it, and the trailer says so
+ */
+#define VALUE_TRAILER_SIZE ((itzam_int)sizeof(uint32_t))
+#define VALUE_OUTLINE      0x80000000u
+
+static uint32_t value_trailer(const itzam_byte * key, itzam_int stored)
+{
+    uint32_t result;
+
+    memcpy(&result, key + stored - VALUE_TRAILER_SIZE, sizeof(uint32_t));
+
+    return result;
+}
+
+/* bytes the value takes in the page: the value itself, or a reference
+ */
+static itzam_int value_space(uint32_t trailer)
+{
+    return (trailer & VALUE_OUTLINE) ? (itzam_int)sizeof(itzam_ref) : (itzam_int)trailer;
+}
+
+/* copy out the whole of the nth key in a page, without any value that follows it
+ */
+static void copy_key(const itzam_btree * btree, void * dest, const itzam_btree_page * page, int n)
+{
+    const itzam_byte * key = key_at(btree, page, n);
+    itzam_int prefix = prefix_length(btree, page);
+    itzam_int length = stored_key_size(btree, key);
+
+    if (btree->m_values && (page->m_links[0] == ITZAM_NULL_REF))
+        length -= VALUE_TRAILER_SIZE + value_space(value_trailer(key, length));
+
+    if (prefix > 0)
+        memcpy(dest, prefix_of(page), prefix);
+
+    memcpy((itzam_byte *)dest + prefix, key, length);
+}
+
+/* the whole of the nth key in a page; a key stored after a prefix is put back together
+ * in buffer
+ */
+static const itzam_byte * full_key(const itzam_btree * btree, const itzam_btree_page * page, int n, itzam_byte * buffer)
+{
+    if (prefix_length(btree, page) == 0)
+        return key_at(btree, page, n);
+
+    copy_key(btree, buffer, page, n);
+
+    return buffer;
+}
+
+/* a key being moved between slotted pages: the prefix of the page it came from, and the
+ * rest of it
+ */
+typedef struct
+{
+    const itzam_byte * m_prefix;
+    const itzam_byte * m_suffix;
+    uint16_t           m_prefix_length;
+    uint16_t           m_suffix_length;
+}
+key_ref;
+
+/* the keys that one or two slotted pages are rebuilt from, and for inner pages the links
+ * around them
+ */
+typedef struct
+{
+    key_ref *   m_keys;
+    itzam_ref * m_links;
+    int         m_count;
+}
+key_sequence;
+
+/* private pages and the temporaries of a split come from blocks big enough for a page
+ * structure followed by its data; freed blocks are kept for reuse, so that writers make
+ * no allocations once the slab has grown to the deepest split they need
+ */
+#define SLAB_DATA_OFFSET ((sizeof(itzam_btree_page) + 15) & ~(size_t)15)
+
+static size_t block_size(const itzam_btree * btree)
+{
+    size_t page = SLAB_DATA_OFFSET + btree->m_header->m_sizeof_page;
+    size_t temp = sizeof(itzam_ref) * (btree->m_header->m_order + 2) + btree->m_header->m_sizeof_key * (btree->m_header->m_order + 1);
+
+    /* slotted pages are rebuilt from private copies, with a sequence of the keys of two
+     * neighbours and the separator between them
+     */
+    if (btree->m_varkeys)
+        temp = sizeof(key_ref) * (2 * btree->m_header->m_order + 2) + sizeof(itzam_ref) * (2 * btree->m_header->m_order + 3);
+
+    return (page > temp) ? page : temp;
+}
+
+static void * take_block(itzam_btree * btree)
+{
+    void * block = btree->m_slab;
+
+    if (block != NULL)
+        btree->m_slab = *(void **)block;
+    else
+        block = malloc(block_size(btree));
+
+    return block;
+}
+
+static void give_block(itzam_btree * btree, void * block)
+{
+    if (block != NULL)
+    {
+        *(void **)block = btree->m_slab;
+        btree->m_slab = block;
     }
+}
 
-    return page;
+static void free_slab(itzam_btree * btree)
+{
+    void * block;
+
+    while (btree->m_slab != NULL)
+    {
+        block = btree->m_slab;
+        btree->m_slab = *(void **)block;
+        free(block);
+    }
 }
 
-static void set_page_pointers(const itzam_btree * btree, itzam_btree_page * page)
+static itzam_btree_page * dupe_page(itzam_btree * btree, const itzam_btree_page * source_page)
 {
-    page->m_header = (itzam_btree_page_header *)page->m_data;
-    page->m_keys   = (itzam_byte *)(page->m_data + sizeof(itzam_btree_page_header));
-    page->m_links  = (itzam_ref *)(page->m_data + sizeof(itzam_btree_page_header) + btree->m_header->m_sizeof_key * btree->m_header->m_order);
+    itzam_btree_page * page = (itzam_btree_page *)take_block(btree);
+
+    if (page != NULL)
+    {
+        page->m_data = (itzam_byte *)page + SLAB_DATA_OFFSET;
+        set_page_pointers(btree,page);
+        page->m_frame  = NULL;
+        memcpy(page->m_data, source_page->m_data, btree->m_header->m_sizeof_page);
+    }
+
+    return page;
 }
 
 static void init_page(const itzam_btree * btree, itzam_btree_page * page)
@@ -127,10 +338,23 @@ static void init_page(const itzam_btree * btree, itzam_btree_page * page)
     page->m_header->m_parent    = ITZAM_NULL_REF;
     page->m_header->m_key_count = 0;
 
-    memset(page->m_keys, 0, btree->m_header->m_sizeof_key * btree->m_header->m_order);
+    if (btree->m_varkeys)
+    {
+        memset(page->m_slots, 0, sizeof(itzam_btree_slots));
+        page->m_slots->m_heap = (uint16_t)btree->m_header->m_sizeof_page;
+        memset(page->m_offsets, 0, btree->m_header->m_sizeof_page - ((itzam_byte *)page->m_offsets - page->m_data));
+    }
+    else
+        memset(page->m_keys, 0, btree->m_header->m_sizeof_key * btree->m_header->m_order);
 
     for (n = 0; n < btree->m_header->m_order + 1; ++n)
         page->m_links[n] = ITZAM_NULL_REF;
+
+    if (page->m_siblings != NULL)
+    {
+        page->m_siblings[PREV_LEAF] = ITZAM_NULL_REF;
+        page->m_siblings[NEXT_LEAF] = ITZAM_NULL_REF;
+    }
 }
 
 static void set_page(const itzam_btree * btree, itzam_btree_page * page, itzam_byte * memory)
@@ -142,1852 +366,6136 @@ static void set_page(const itzam_btree * btree, itzam_btree_page * page, itzam_b
     }
 }
 
-static itzam_btree_page * alloc_page(const itzam_btree * btree)
+static itzam_btree_page * alloc_page(itzam_btree * btree)
 {
-    itzam_btree_page * page = NULL;
-
-    /* allocate page
-     */
-    page = (itzam_btree_page *)malloc(sizeof(itzam_btree_page));
+    itzam_btree_page * page = (itzam_btree_page *)take_block(btree);
 
     if (page != NULL)
     {
-        /* allocate data space
-         */
-        page->m_data = (itzam_byte *)malloc(btree->m_header->m_sizeof_page);
-
-        if (page->m_data != NULL)
-        {
-            set_page_pointers(btree,page);
-            init_page(btree,page);
-        }
-        else
-        {
-            /* error; clean up and return NULL
-             */
-            free(page);
-            page = NULL;
-        }
+        page->m_data = (itzam_byte *)page + SLAB_DATA_OFFSET;
+        set_page_pointers(btree,page);
+        init_page(btree,page);
+        page->m_frame = NULL;
     }
 
     return page;
 }
 
-static void free_page(itzam_btree_page * page)
+/* releases a page obtained from read_page, alloc_page or dupe_page; the root is never released
+ */
+static void free_page(itzam_btree * btree, itzam_btree_page * page)
 {
-    if ((page != NULL) && (page->m_header->m_parent != ITZAM_NULL_REF))
+    if ((page != NULL) && (page != &btree->m_root))
     {
-        if (page->m_data != NULL)
-            free(page->m_data);
-
-        free(page);
+        if (page->m_frame != NULL)
+            itzam_cache_release(&btree->m_cache, page->m_frame);
+        else
+            give_block(btree, page);
     }
 }
 
 static void set_root(itzam_btree * btree, itzam_btree_page * new_root)
 {
-    memcpy(btree->m_root_data, new_root->m_data, btree->m_header->m_sizeof_page);
+    if (new_root != &btree->m_root)
+        memcpy(btree->m_root_data, new_root->m_data, btree->m_header->m_sizeof_page);
+
     btree->m_header->m_root_where = new_root->m_header->m_where;
     update_header(btree);
-    new_root->m_data = NULL;
 }
 
-/* can't be static because it's useful for debug/analysis routines
+/* the oldest contents of a page replaced after the given epoch; the version lock must be held
  */
-itzam_btree_page * read_page(itzam_btree * btree, itzam_ref where)
+static itzam_page_version * find_version(itzam_btree * btree, itzam_ref where, uint64_t epoch)
 {
-    itzam_btree_page * page = NULL;
+    itzam_page_version * version;
+    itzam_page_version * result = NULL;
 
-    /* position datafile
-     */
-    if (ITZAM_OKAY == itzam_datafile_seek(btree->m_datafile,where))
+    for (version = btree->m_versions[(uint64_t)where % ITZAM_VERSION_BUCKETS]; version != NULL; version = version->m_next)
     {
-        /* allocate a buffer
-         */
-        page = alloc_page(btree);
-
-        if (page != NULL)
-        {
-            /* read the ref
-             */
-            if (ITZAM_OKAY != itzam_datafile_read(btree->m_datafile,page->m_data,btree->m_header->m_sizeof_page))
-            {
-                free_page(page);
-                page = NULL;
-            }
-        }
+        if ((version->m_where == where) && (version->m_epoch > epoch)
+         && ((result == NULL) || (version->m_epoch < result->m_epoch)))
+            result = version;
     }
 
-    return page;
+    return result;
 }
 
-static itzam_ref write_page(itzam_btree * btree, itzam_btree_page * page)
+/* the lock over page versions and snapshots; a POSIX reader/writer lock, or a
+ * slim reader/writer lock on Windows, which needs nothing to destroy it
+ */
+static void version_lock_init(itzam_btree * btree)
 {
-    itzam_ref where;
+#if defined(ITZAM_UNIX)
+    pthread_rwlock_init(&btree->m_version_lock, NULL);
+#else
+    InitializeSRWLock(&btree->m_version_lock);
+#endif
+}
 
-    /* does this page have a location, i.e., is it new?
-     */
-    if (page->m_header->m_where == ITZAM_NULL_REF)
-        page->m_header->m_where = itzam_datafile_get_next_open(btree->m_datafile, btree->m_header->m_sizeof_page);
+static void version_lock_destroy(itzam_btree * btree)
+{
+#if defined(ITZAM_UNIX)
+    pthread_rwlock_destroy(&btree->m_version_lock);
+#endif
+}
 
-    where = itzam_datafile_write_flags(btree->m_datafile,
-                                        page->m_data,
-                                        btree->m_header->m_sizeof_page,
-                                        page->m_header->m_where,
-                                        ITZAM_RECORD_BTREE_PAGE);
+static void version_read_lock(itzam_btree * btree)
+{
+#if defined(ITZAM_UNIX)
+    pthread_rwlock_rdlock(&btree->m_version_lock);
+#else
+    AcquireSRWLockShared(&btree->m_version_lock);
+#endif
+}
 
-    /* make sure things got put where we thought they did
-     */
-    if (where != page->m_header->m_where)
-        where = ITZAM_NULL_REF;
+static void version_read_unlock(itzam_btree * btree)
+{
+#if defined(ITZAM_UNIX)
+    pthread_rwlock_unlock(&btree->m_version_lock);
+#else
+    ReleaseSRWLockShared(&btree->m_version_lock);
+#endif
+}
 
-    return where;
+static void version_write_lock(itzam_btree * btree)
+{
+#if defined(ITZAM_UNIX)
+    pthread_rwlock_wrlock(&btree->m_version_lock);
+#else
+    AcquireSRWLockExclusive(&btree->m_version_lock);
+#endif
 }
 
-int itzam_comparator_int32(const void * key1, const void * key2)
+static void version_write_unlock(itzam_btree * btree)
 {
-    int result = 0;
+#if defined(ITZAM_UNIX)
+    pthread_rwlock_unlock(&btree->m_version_lock);
+#else
+    ReleaseSRWLockExclusive(&btree->m_version_lock);
+#endif
+}
 
-    int32_t * k1 = (int32_t *)key1;
-    int32_t * k2 = (int32_t *)key2;
+/* keep a page's contents before the current write changes them; a page is kept once per write
+ */
+static void keep_version(itzam_btree * btree, itzam_ref where, const itzam_byte * data)
+{
+    itzam_page_version ** bucket;
+    itzam_page_version * version;
 
-    if (*k1 < *k2)
-        result = -1;
-    else if (*k1 > *k2)
-        result = 1;
+    version_write_lock(btree);
 
-    return result;
-}
+    bucket = &btree->m_versions[(uint64_t)where % ITZAM_VERSION_BUCKETS];
 
-int itzam_comparator_uint32(const void * key1, const void * key2)
-{
-    int result = 0;
+    for (version = *bucket; version != NULL; version = version->m_next)
+    {
+        if ((version->m_where == where) && (version->m_epoch == btree->m_epoch))
+            break;
+    }
 
-    uint32_t * k1 = (uint32_t *)key1;
-    uint32_t * k2 = (uint32_t *)key2;
+    if (version == NULL)
+    {
+        version = (itzam_page_version *)malloc(sizeof(itzam_page_version) + btree->m_header->m_sizeof_page);
 
-    if (*k1 < *k2)
-        result = -1;
-    else if (*k1 > *k2)
-        result = 1;
+        if (version != NULL)
+        {
+            version->m_where = where;
+            version->m_epoch = btree->m_epoch;
+            version->m_data  = (itzam_byte *)(version + 1);
+            memcpy(version->m_data, data, btree->m_header->m_sizeof_page);
 
-    return result;
-}
+            version->m_next = *bucket;
+            *bucket = version;
+        }
+        else
+            btree->m_datafile->m_error_handler("keep_version", ITZAM_ERROR_MALLOC);
+    }
 
-int itzam_comparator_string(const void * key1, const void * key2)
-{
-    return strcmp((const char *)key1,(const char *)key2);
+    version_write_unlock(btree);
 }
 
-static char * get_shared_name(const char * fmt, const char * filename)
+/* drop versions that no active snapshot can see; the version lock must be held
+ */
+static void reclaim_versions(itzam_btree * btree)
 {
-    char * result = (char *)malloc(strlen(fmt) + strlen(filename) + 1);
+    uint64_t oldest = btree->m_epoch;
+    itzam_btree_snapshot * snapshot;
+    itzam_page_version ** link;
+    itzam_page_version * version;
+    int n;
 
-    char * norm = strdup(filename);
-    char * c = norm;
+    for (snapshot = btree->m_snapshots; snapshot != NULL; snapshot = snapshot->m_next)
+    {
+        if (snapshot->m_epoch < oldest)
+            oldest = snapshot->m_epoch;
+    }
 
-    while (*c)
+    for (n = 0; n < ITZAM_VERSION_BUCKETS; ++n)
     {
-        if (!isalnum(*c))
-            *c = '_';
-        else
-            if (isalpha(*c))
-                *c = tolower(*c);
+        link = &btree->m_versions[n];
 
-        ++c;
+        while (*link != NULL)
+        {
+            version = *link;
+
+            if (version->m_epoch <= oldest)
+            {
+                *link = version->m_next;
+                free(version);
+            }
+            else
+                link = &version->m_next;
+        }
     }
+}
 
-    sprintf(result, fmt, norm);
+/* called by writers holding the write lock; while snapshots are active, each write is a new
+ * epoch and keeps the pages it changes, starting with the root
+ */
+static void begin_versions(itzam_btree * btree)
+{
+    version_write_lock(btree);
 
-    free(norm);
+    btree->m_versioning = (btree->m_snapshots != NULL) ? itzam_true : itzam_false;
 
-    return result;
-}
+    if (btree->m_versioning)
+        ++btree->m_epoch;
 
-#if defined(ITZAM_UNIX)
-static const char * HDR_NAME_MASK = "/%s-ItzamBTreeHeader";
-static const char * ROOT_NAME_MASK = "/%s-ItzamBTreeRoot";
-#else
-static const char * HDR_NAME_MASK = "Global\\%s-ItzamBTreeHeader";
-static const char * ROOT_NAME_MASK = "Global\\%s-ItzamBTreeRoot";
-#endif
+    version_write_unlock(btree);
 
-#define MAKE_ITZAM_BHNAME(basename) get_shared_name(HDR_NAME_MASK,basename)
-#define MAKE_ITZAM_ROOT_NAME(basename) get_shared_name(ROOT_NAME_MASK,basename)
+    if (btree->m_versioning)
+        keep_version(btree, btree->m_header->m_root_where, btree->m_root_data);
+}
 
-itzam_state itzam_btree_create(itzam_btree * btree,
-                               const char * filename,
-                               uint16_t order,
-                               itzam_int key_size,
-                               itzam_key_comparator * key_comparator,
-                               itzam_error_handler * error_handler)
+static void end_versions(itzam_btree * btree)
 {
-    itzam_state result = ITZAM_FAILED;
-    itzam_bool creator;
+    btree->m_versioning = itzam_false;
+}
 
-    pthread_mutex_lock(&global_mutex);
+/* can't be static because it's useful for debug/analysis routines; the returned
+ * page is pinned in the cache until it is released
+ */
+itzam_btree_page * read_page(itzam_btree * btree, itzam_ref where)
+{
+    itzam_btree_page * page = NULL;
+    itzam_cache_frame * frame = itzam_cache_fetch(&btree->m_cache, where);
 
-    /* make sure the arguments make sense
-     */
-    if ((btree != NULL) && (filename != NULL) && (key_size > 0) && (key_comparator != NULL))
+    if (frame != NULL)
     {
-        /* allocate datafile
+        /* the page structure lives in the frame, and frames keep their buffers
          */
-        btree->m_datafile = (itzam_datafile *)malloc(sizeof(itzam_datafile));
+        page = (itzam_btree_page *)frame->m_user;
 
-        if (btree->m_datafile != NULL)
+        if (page->m_frame != frame)
         {
-            /* create data file
-             */
-            result = itzam_datafile_create(btree->m_datafile,filename);
-
-            if (ITZAM_OKAY == result)
-            {
-                /* If an error handler was provided, assign it to the datafile
-                */
-                if (error_handler != NULL)
-                    itzam_datafile_set_error_handler(btree->m_datafile,error_handler);
+            set_page(btree, page, frame->m_data);
+            page->m_frame = frame;
+        }
 
-                /* allocate memory for shared header
-                 */
-                btree->m_shmem_header_name = MAKE_ITZAM_BHNAME(filename);
+        /* writers only change pages they have read, so this sees every page before it changes
+         */
+        if (btree->m_versioning)
+            keep_version(btree, where, frame->m_data);
+    }
 
-                btree->m_shmem_header = itzam_shmem_obtain(btree->m_shmem_header_name, sizeof(itzam_btree_header),&creator);
-                btree->m_header = (itzam_btree_header *)itzam_shmem_getptr(btree->m_shmem_header, sizeof(itzam_btree_header));
+    return page;
+}
 
-                /* fill in structure
-                 */
-                if (order < ITZAM_BTREE_ORDER_MINIMUM)
-                    order = ITZAM_BTREE_ORDER_MINIMUM;
+/* pages are written to the cache, and reach the file when the cache is flushed
+ */
+static itzam_ref write_page(itzam_btree * btree, itzam_btree_page * page)
+{
+    itzam_ref where = ITZAM_NULL_REF;
 
-                btree->m_header->m_version     = ITZAM_BTREE_VERSION;
-                btree->m_header->m_order       = order;
-                btree->m_header->m_count       = 0;
-                btree->m_header->m_ticker      = 0;
-                btree->m_header->m_schema_ref  = ITZAM_NULL_REF;
+    /* does this page have a location, i.e., is it new?
+     */
+    if (page->m_header->m_where == ITZAM_NULL_REF)
+    {
+        /* new pages are written immediately to reserve their space in the file
+         */
+        page->m_header->m_where = itzam_datafile_get_next_open(btree->m_datafile, btree->m_header->m_sizeof_page);
 
-                btree->m_free_datafile         = itzam_true;
-                btree->m_links_size            = btree->m_header->m_order + 1;
-                btree->m_min_keys              = btree->m_header->m_order / 2;
-                btree->m_key_comparator        = key_comparator;
-                btree->m_cursor_count          = 0;
+        if ((page->m_header->m_where != ITZAM_NULL_REF)
+         && (ITZAM_OKAY == itzam_cache_write_through(&btree->m_cache, page->m_header->m_where, page->m_data)))
+            where = page->m_header->m_where;
+    }
+    else
+    {
+        if (page->m_frame != NULL)
+        {
+            itzam_cache_mark_dirty(page->m_frame);
+            where = page->m_header->m_where;
+        }
+        else
+        {
+            if (ITZAM_OKAY == itzam_cache_store(&btree->m_cache, page->m_header->m_where, page->m_data))
+                where = page->m_header->m_where;
+        }
+    }
 
-                btree->m_header->m_where       = itzam_datafile_get_next_open(btree->m_datafile,sizeof(itzam_btree_header));
-                btree->m_header->m_root_where  = 0;
-                btree->m_header->m_sizeof_key  = key_size;
-                btree->m_header->m_sizeof_page = sizeof(itzam_btree_page_header)
-                                               + btree->m_header->m_sizeof_key * btree->m_header->m_order
-                                               + sizeof(itzam_ref) * btree->m_links_size;
+    return where;
+}
 
-                /* write header for first time (lacks root pointer info, but needs to occupy space in the file)
-                 */
-                if (btree->m_header->m_where == itzam_datafile_write_flags(btree->m_datafile, btree->m_header, sizeof(itzam_btree_header), btree->m_header->m_where, ITZAM_RECORD_BTREE_HEADER))
-                {
-                    /* allocate memory for shared header
-                     */
-                    btree->m_shmem_root_name = MAKE_ITZAM_ROOT_NAME(filename);
-                    btree->m_shmem_root = itzam_shmem_obtain(btree->m_shmem_root_name, btree->m_header->m_sizeof_page, &creator);
-                    btree->m_root_data  = (itzam_byte *)itzam_shmem_getptr(btree->m_shmem_root, btree->m_header->m_sizeof_page);
-                    set_page(btree, &btree->m_root, btree->m_root_data);
-                    init_page(btree, &btree->m_root);
+/* remove a page from the file
+ */
+static void remove_page(itzam_btree * btree, itzam_btree_page * page)
+{
+    itzam_cache_discard(&btree->m_cache, page->m_header->m_where);
+    itzam_datafile_seek(btree->m_datafile,page->m_header->m_where);
+    itzam_datafile_remove(btree->m_datafile);
+}
 
-                    /* assign root a file position
-                     */
-                    btree->m_root.m_header->m_where = itzam_datafile_get_next_open(btree->m_datafile, btree->m_header->m_sizeof_page);
+/* writers note each page they pass on the way down, so that a page's parent can be found
+ * without storing it in the page
+ */
+static void note_path(itzam_btree * btree, int depth, const itzam_btree_page * page)
+{
+    if (depth < ITZAM_BTREE_MAX_DEPTH)
+    {
+        btree->m_path[depth] = page->m_header->m_where;
+        btree->m_path_length = depth + 1;
+    }
+}
 
-                    if (btree->m_root.m_header->m_where != ITZAM_NULL_REF)
-                    {
-                        /* write root page
-                         */
-                        btree->m_header->m_root_where = itzam_datafile_write_flags(btree->m_datafile,
-                                                                                   btree->m_root.m_data,
-                                                                                   btree->m_header->m_sizeof_page,
-                                                                                   btree->m_root.m_header->m_where,
-                                                                                   ITZAM_RECORD_BTREE_PAGE);
+/* the parent of a page on the writer's path, or ITZAM_NULL_REF for the root
+ */
+static itzam_ref parent_of(const itzam_btree * btree, const itzam_btree_page * page)
+{
+    int n;
 
+    for (n = btree->m_path_length - 1; n > 0; --n)
+    {
+        if (btree->m_path[n] == page->m_header->m_where)
+            return btree->m_path[n - 1];
+    }
 
-                        /* make certain that the root was written where we expect it to be
-                         */
-                        if ((btree->m_header->m_root_where == btree->m_root.m_header->m_where) &&  (btree->m_header->m_root_where != ITZAM_NULL_REF))
-                            result = update_header(btree);
+    return ITZAM_NULL_REF;
+}
 
-                        /* make certain root was written
-                         */
-                        itzam_file_commit(btree->m_datafile->m_file);
-                    }
-                }
+/* in trees that keep parent links, point a child at its new parent; other trees never
+ * rewrite a child just because its parent moved
+ */
+static void relink_child(itzam_btree * btree, itzam_ref where, itzam_ref parent, const char * function_name)
+{
+    itzam_btree_page * child;
 
-                /* remember to deallocate this datafile at closing
-                 */
-                btree->m_free_datafile = itzam_true;
+    if (btree->m_parent_links)
+    {
+        child = read_page(btree,where);
 
-                result = ITZAM_OKAY;
-            }
+        if (child != NULL)
+        {
+            child->m_header->m_parent = parent;
+            write_page(btree,child);
+            free_page(btree,child);
         }
+        else
+            btree->m_datafile->m_error_handler(function_name,ITZAM_ERROR_PAGE_NOT_FOUND);
     }
-    else
-        default_error_handler("itzam_btree_create",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
-
-    pthread_mutex_unlock(&global_mutex);
+}
 
-    return result;
+/* a new page's parent, recorded only in trees that keep parent links
+ */
+static void link_parent(const itzam_btree * btree, itzam_btree_page * page, itzam_ref parent)
+{
+    page->m_header->m_parent = btree->m_parent_links ? parent : ITZAM_NULL_REF;
 }
 
-itzam_state itzam_btree_open(itzam_btree * btree,
-                             const char * filename,
-                             itzam_key_comparator * key_comparator,
-                             itzam_error_handler * error_handler,
-                             itzam_bool recover,
-                             itzam_bool read_only)
+int itzam_comparator_int32(const void * key1, const void * key2)
 {
-    /* what we return
-     */
-    itzam_state result = ITZAM_FAILED;
-    itzam_bool creator;
+    int result = 0;
 
-    pthread_mutex_lock(&global_mutex);
+    int32_t * k1 = (int32_t *)key1;
+    int32_t * k2 = (int32_t *)key2;
 
-    /* make sure the arguments make sense
-     */
-    if ((btree != NULL) && (filename != NULL) && (key_comparator != NULL))
-    {
-        /* allocate datafile
-         */
-        btree->m_datafile = (itzam_datafile *)malloc(sizeof(itzam_datafile));
+    if (*k1 < *k2)
+        result = -1;
+    else if (*k1 > *k2)
+        result = 1;
 
-        if (btree->m_datafile != NULL)
-        {
-            /* create data file
-             */
-            result = itzam_datafile_open(btree->m_datafile,filename,recover,read_only);
+    return result;
+}
 
-            if (ITZAM_OKAY == result)
-            {
-                /* If an error handler was provided, assign it to the datafile
-                 */
-                if (error_handler != NULL)
-                    itzam_datafile_set_error_handler(btree->m_datafile,error_handler);
+int itzam_comparator_uint32(const void * key1, const void * key2)
+{
+    int result = 0;
 
-                /* do the actual create
-                 */
-                btree->m_free_datafile = itzam_true;
-                btree->m_key_comparator = key_comparator;
-                btree->m_cursor_count = 0;
+    uint32_t * k1 = (uint32_t *)key1;
+    uint32_t * k2 = (uint32_t *)key2;
 
-                /* allocate memory for embedded header
-                 */
-                btree->m_shmem_header_name = MAKE_ITZAM_BHNAME(filename);
-                btree->m_shmem_header = itzam_shmem_obtain(btree->m_shmem_header_name, sizeof(itzam_btree_header),&creator);
-                btree->m_header = (itzam_btree_header *)itzam_shmem_getptr(btree->m_shmem_header, sizeof(itzam_btree_header));
+    if (*k1 < *k2)
+        result = -1;
+    else if (*k1 > *k2)
+        result = 1;
 
-                /* assumes first record is header
-                 */
-                if (ITZAM_OKAY == itzam_datafile_rewind(btree->m_datafile))
-                {
-                    if (creator)
-                        result = itzam_datafile_read(btree->m_datafile,btree->m_header,sizeof(itzam_btree_header));
+    return result;
+}
 
-                    if (ITZAM_OKAY == result)
-                    {
-                        /* verify version
-                         */
-                        if (btree->m_header->m_version == ITZAM_BTREE_VERSION)
-                        {
-                            /* finish intializing btree
-                             */
-                            btree->m_links_size = btree->m_header->m_order + 1;
-                            btree->m_min_keys   = btree->m_header->m_order / 2;
+int itzam_comparator_int64(const void * key1, const void * key2)
+{
+    int result = 0;
 
-                            /* allocate memory for shared header
-                             */
-                            btree->m_shmem_root_name = MAKE_ITZAM_ROOT_NAME(filename);
-                            btree->m_shmem_root = itzam_shmem_obtain(btree->m_shmem_root_name, btree->m_header->m_sizeof_page,&creator);
-                            btree->m_root_data  = (itzam_byte *)itzam_shmem_getptr(btree->m_shmem_root, btree->m_header->m_sizeof_page);
-                            set_page(btree, &btree->m_root, btree->m_root_data);
+    int64_t * k1 = (int64_t *)key1;
+    int64_t * k2 = (int64_t *)key2;
 
-                            /* read root
-                             */
-                            if (creator)
-                            {
-                                itzam_datafile_seek(btree->m_datafile, btree->m_header->m_root_where);
-                                itzam_datafile_read(btree->m_datafile, btree->m_root_data, btree->m_header->m_sizeof_page);
-                            }
+    if (*k1 < *k2)
+        result = -1;
+    else if (*k1 > *k2)
+        result = 1;
 
-                            result = ITZAM_OKAY;
-                        }
-                        else
-                            result = ITZAM_VERSION_ERROR;
-                    }
-                }
+    return result;
+}
 
-                result = ITZAM_OKAY;
-            }
-        }
-    }
-    else
-        default_error_handler("itzam_btree_open",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+int itzam_comparator_uint64(const void * key1, const void * key2)
+{
+    int result = 0;
 
-    pthread_mutex_unlock(&global_mutex);
+    uint64_t * k1 = (uint64_t *)key1;
+    uint64_t * k2 = (uint64_t *)key2;
+
+    if (*k1 < *k2)
+        result = -1;
+    else if (*k1 > *k2)
+        result = 1;
 
     return result;
 }
 
-/* return number of active records in database
+/* the comparator for a built-in key type, and the bytes of the integer it compares
  */
-uint64_t itzam_btree_count(itzam_btree * btree)
+static itzam_key_comparator * key_type_comparator(itzam_key_type key_type)
 {
-    uint64_t result = 0;
-
-    if (btree != NULL)
+    switch (key_type)
     {
-        itzam_datafile_mutex_lock(btree->m_datafile);
-
-        if (ITZAM_OKAY == result)
-            result = btree->m_header->m_count;
-
-        itzam_datafile_mutex_unlock(btree->m_datafile);
+        case ITZAM_KEY_INT32:
+            return itzam_comparator_int32;
+        case ITZAM_KEY_UINT32:
+            return itzam_comparator_uint32;
+        case ITZAM_KEY_INT64:
+            return itzam_comparator_int64;
+        case ITZAM_KEY_UINT64:
+            return itzam_comparator_uint64;
+        case ITZAM_KEY_STRING:
+            return itzam_comparator_string;
+        default:
+            return NULL;
     }
-
-    return result;
 }
 
-/* return ticker, which is a count of every record ever added to the database
+/* built-in keys that are not integers have no width
  */
-uint64_t itzam_btree_ticker(itzam_btree * btree)
+static itzam_int key_type_width(itzam_key_type key_type)
 {
-    uint64_t result = 0;
+    if ((key_type == ITZAM_KEY_INT32) || (key_type == ITZAM_KEY_UINT32))
+        return sizeof(int32_t);
 
-    if (btree != NULL)
-    {
-        itzam_datafile_mutex_lock(btree->m_datafile);
+    if ((key_type == ITZAM_KEY_INT64) || (key_type == ITZAM_KEY_UINT64))
+        return sizeof(int64_t);
 
-        if (ITZAM_OKAY == result)
-            result = btree->m_header->m_ticker;
+    return 0;
+}
 
-        itzam_datafile_mutex_unlock(btree->m_datafile);
-    }
-    else
-    {
-        default_error_handler("itzam_btree_ticker",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
-    }
+int itzam_comparator_string(const void * key1, const void * key2)
+{
+    return strcmp((const char *)key1,(const char *)key2);
+}
 
-    return result;
+itzam_int itzam_key_size_string(const void * key)
+{
+    return (itzam_int)strlen((const char *)key) + 1;
 }
 
-/* close file
+/*-----------------------------------------------------------------------------
+ * normalized keys; an integer is offset so that it orders as unsigned, then written seven
+ * bits to a byte, most significant first, with the top bit of each byte set. A string is
+ * copied with 0x01 and 0x02 escaped by a 0x02, and ends with a 0x01, which sorts below
+ * every byte that can follow it; so no encoding contains a null
  */
-itzam_state itzam_btree_close(itzam_btree * btree)
+static itzam_int append_bits(itzam_byte * key, itzam_int offset, uint64_t value, itzam_int length)
 {
-    itzam_state result = ITZAM_FAILED;
+    itzam_int n;
 
-    pthread_mutex_lock(&global_mutex);
+    for (n = length - 1; n >= 0; --n)
+        key[offset++] = (itzam_byte)(0x80 | ((value >> (7 * n)) & 0x7f));
 
-    /* make sure the arguments make sense
-     */
-    if ((btree != NULL) && (btree->m_cursor_count == 0))
-    {
-        if (!btree->m_datafile->m_read_only)
-        {
-            itzam_datafile_mutex_unlock(btree->m_datafile);
-            update_header(btree);
-            itzam_datafile_mutex_unlock(btree->m_datafile);
-        }
+    key[offset] = 0;
 
-        if (result == ITZAM_OKAY)
-        {
-            free(btree->m_datafile);
-            btree->m_datafile = NULL;
-        }
+    return offset;
+}
 
-        itzam_shmem_freeptr(btree->m_root_data, btree->m_header->m_sizeof_page);
-        itzam_shmem_close(btree->m_shmem_root, btree->m_shmem_root_name);
-        free(btree->m_shmem_root_name);
+static itzam_int read_bits(const itzam_byte * key, itzam_int offset, uint64_t * value, itzam_int length)
+{
+    uint64_t result = 0;
+    itzam_int n;
 
-        itzam_shmem_freeptr(btree->m_header, sizeof(itzam_btree_header));
-        itzam_shmem_close(btree->m_shmem_header,btree->m_shmem_header_name);
-        free(btree->m_shmem_header_name);
+    if ((key == NULL) || (offset < 0))
+        return -1;
 
-        result = ITZAM_OKAY;
+    for (n = 0; n < length; ++n)
+    {
+        if ((key[offset] & 0x80) == 0)
+            return -1;
+
+        result = (result << 7) | (key[offset++] & 0x7f);
     }
-    else
-        default_error_handler("itzam_btree_close",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
-    pthread_mutex_unlock(&global_mutex);
+    *value = result;
 
-    return result;
+    return offset;
 }
 
-void itzam_btree_mutex_lock(itzam_btree * btree)
+itzam_int itzam_key_append_int32(void * key, itzam_int offset, int32_t value)
 {
-    if (btree != NULL)
-        itzam_datafile_mutex_lock(btree->m_datafile);
-    else
-        default_error_handler("itzam_btree_lock",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    return append_bits((itzam_byte *)key, offset, (uint32_t)value ^ 0x80000000u, ITZAM_KEY_INT32_LENGTH);
 }
 
-void itzam_btree_mutex_unlock(itzam_btree * btree)
+itzam_int itzam_key_append_uint32(void * key, itzam_int offset, uint32_t value)
 {
-    if (btree != NULL)
-        itzam_datafile_mutex_unlock(btree->m_datafile);
-    else
-        default_error_handler("itzam_btree_unlock",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    return append_bits((itzam_byte *)key, offset, value, ITZAM_KEY_INT32_LENGTH);
 }
 
-/* lock btree file
- */
-itzam_bool itzam_btree_file_lock(itzam_btree * btree)
+itzam_int itzam_key_append_int64(void * key, itzam_int offset, int64_t value)
 {
-    itzam_bool result = itzam_false;
-
-    if (btree != NULL)
-    {
-        itzam_datafile_mutex_lock(btree->m_datafile);
-        result = itzam_datafile_file_lock(btree->m_datafile);
-        itzam_datafile_mutex_unlock(btree->m_datafile);
-    }
-    else
-        default_error_handler("itzam_btree_lock",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    return append_bits((itzam_byte *)key, offset, (uint64_t)value ^ 0x8000000000000000ull, ITZAM_KEY_INT64_LENGTH);
+}
 
-    return result;
+itzam_int itzam_key_append_uint64(void * key, itzam_int offset, uint64_t value)
+{
+    return append_bits((itzam_byte *)key, offset, value, ITZAM_KEY_INT64_LENGTH);
 }
 
-/* unlock btree file
- */
-itzam_bool itzam_btree_file_unlock(itzam_btree * btree)
+itzam_int itzam_key_append_string(void * key, itzam_int offset, const char * value)
 {
-    itzam_bool result = itzam_false;
+    itzam_byte * bytes = (itzam_byte *)key;
+    const itzam_byte * c = (const itzam_byte *)value;
 
-    if (btree != NULL)
+    for (; *c != 0; ++c)
     {
-        itzam_datafile_mutex_lock(btree->m_datafile);
-        result = itzam_datafile_file_unlock(btree->m_datafile);
-        itzam_datafile_mutex_unlock(btree->m_datafile);
+        if (*c <= 0x02)
+        {
+            bytes[offset++] = 0x02;
+            bytes[offset++] = *c + 1;
+        }
+        else
+            bytes[offset++] = *c;
     }
-    else
-        default_error_handler("itzam_btree_unlock",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
-    return result;
+    bytes[offset++] = 0x01;
+    bytes[offset] = 0;
+
+    return offset;
 }
 
-itzam_bool itzam_btree_is_open(itzam_btree * btree)
+itzam_int itzam_key_read_int32(const void * key, itzam_int offset, int32_t * value)
 {
-    itzam_bool result = itzam_false;
+    uint64_t bits = 0;
 
-    if (btree != NULL)
-    {
-        itzam_datafile_mutex_lock(btree->m_datafile);
-        result = itzam_datafile_is_open(btree->m_datafile);
-        itzam_datafile_mutex_unlock(btree->m_datafile);
-    }
-    else
-    {
-        default_error_handler("itzam_btree_is_open",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
-    }
+    offset = read_bits((const itzam_byte *)key, offset, &bits, ITZAM_KEY_INT32_LENGTH);
 
-    return result;
+    if ((offset >= 0) && (value != NULL))
+        *value = (int32_t)((uint32_t)bits ^ 0x80000000u);
+
+    return offset;
 }
 
-void itzam_btree_set_error_handler(itzam_btree * btree,
-                                   itzam_error_handler * error_handler)
+itzam_int itzam_key_read_uint32(const void * key, itzam_int offset, uint32_t * value)
 {
-    if (btree != NULL)
-    {
-        itzam_datafile_mutex_lock(btree->m_datafile);
-        itzam_datafile_set_error_handler(btree->m_datafile,error_handler);
-        itzam_datafile_mutex_unlock(btree->m_datafile);
-    }
-    else
-    {
-        default_error_handler("itzam_btree_set_error_handler",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
-    }
+    uint64_t bits = 0;
+
+    offset = read_bits((const itzam_byte *)key, offset, &bits, ITZAM_KEY_INT32_LENGTH);
+
+    if ((offset >= 0) && (value != NULL))
+        *value = (uint32_t)bits;
+
+    return offset;
 }
 
-/* structure used to return search information
- */
-typedef struct
+itzam_int itzam_key_read_int64(const void * key, itzam_int offset, int64_t * value)
 {
-    itzam_btree_page * m_page;
-    int                m_index;
-    itzam_bool         m_found;
-} search_result;
+    uint64_t bits = 0;
 
-static void search(itzam_btree * btree, const void * key, search_result * result)
-{
-    int index;
+    offset = read_bits((const itzam_byte *)key, offset, &bits, ITZAM_KEY_INT64_LENGTH);
 
-    /* duplicate root
-     */
-    itzam_btree_page * page = &btree->m_root;
+    if ((offset >= 0) && (value != NULL))
+        *value = (int64_t)(bits ^ 0x8000000000000000ull);
 
-    while (itzam_true)
-    {
-       index = 0;
+    return offset;
+}
 
-        /* if page is empty, we didn't find the key
-         */
-        if ((page == NULL) || (page->m_header->m_key_count == 0))
-        {
-            result->m_page  = page;
-            result->m_index = index;
-            result->m_found = itzam_false;
-            return;
-        }
-        else
-        {
-            /* loop through keys
-             */
-            while (index < page->m_header->m_key_count)
-            {
-                int comp = btree->m_key_comparator(key,(const void *)(page->m_keys + index * btree->m_header->m_sizeof_key));
+itzam_int itzam_key_read_uint64(const void * key, itzam_int offset, uint64_t * value)
+{
+    uint64_t bits = 0;
 
-                /* do we move on, or have we found it?
-                 */
-                if (comp > 0)
-                    ++index;
-                else
-                {
-                    if (comp == 0)
-                    {
-                        result->m_page  = page;
-                        result->m_index = index;
-                        result->m_found = itzam_true;
-                        return;
-                    }
+    offset = read_bits((const itzam_byte *)key, offset, &bits, ITZAM_KEY_INT64_LENGTH);
 
-                    break;
-                }
-            }
+    if ((offset >= 0) && (value != NULL))
+        *value = bits;
 
-            /* if we're in a leaf, the key hasn't been found
-             */
-            if (page->m_links[index] == ITZAM_NULL_REF)
-            {
-                result->m_page  = page;
-                result->m_index = index;
-                result->m_found = itzam_false;
-                return;
-            }
-            else
-            {
-                /* read and search next page
-                 */
-                itzam_btree_page * next_page = read_page(btree,page->m_links[index]);
+    return offset;
+}
 
-                if (page->m_header->m_parent != ITZAM_NULL_REF)
-                    free_page(page);
+itzam_int itzam_key_read_string(const void * key, itzam_int offset, char * value, itzam_int max_length)
+{
+    const itzam_byte * bytes = (const itzam_byte *)key;
+    itzam_int length = 0;
+    itzam_byte c;
 
-                page = next_page;
-            }
+    if ((bytes == NULL) || (offset < 0))
+        return -1;
+
+    /* a key that ends, or has a bad escape, before the string's end holds no string
+     */
+    while ((c = bytes[offset++]) != 0x01)
+    {
+        if (c == 0x02)
+        {
+            c = bytes[offset++] - 1;
+
+            if ((c != 0x01) && (c != 0x02))
+                return -1;
         }
+        else if (c == 0)
+            return -1;
+
+        if ((value != NULL) && (length + 1 < max_length))
+            value[length++] = (char)c;
     }
+
+    if ((value != NULL) && (max_length > 0))
+        value[length] = 0;
+
+    return offset;
 }
 
-itzam_bool itzam_btree_find(itzam_btree * btree, const void * key, void * returned_key)
+static char * get_shared_name(const char * fmt, const char * filename)
 {
-    search_result s;
+    char * result = (char *)malloc(strlen(fmt) + strlen(filename) + 1);
 
-    s.m_found = itzam_false;
-    s.m_index = 0;
-    s.m_page  = NULL;
+    char * norm = strdup(filename);
+    char * c = norm;
 
-    if ((btree != NULL) && (key != NULL))
+    while (*c)
     {
-        itzam_datafile_mutex_lock(btree->m_datafile);
-
-        search(btree,key,&s);
+        if (!isalnum(*c))
+            *c = '_';
+        else
+            if (isalpha(*c))
+                *c = tolower(*c);
 
-        if ((s.m_found) && (returned_key != NULL))
-            memcpy(returned_key,s.m_page->m_keys + s.m_index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+        ++c;
+    }
 
-        if (s.m_page->m_header->m_parent != ITZAM_NULL_REF)
-            free_page(s.m_page);
+    sprintf(result, fmt, norm);
 
-        itzam_datafile_mutex_unlock(btree->m_datafile);
-    }
-    else
-    {
-        default_error_handler("itzam_btree_find",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
-    }
+    free(norm);
 
-    return s.m_found;
+    return result;
 }
 
-/* promote key by creating new root
+#if defined(ITZAM_UNIX)
+static const char * HDR_NAME_MASK = "/%s-ItzamBTreeHeader";
+static const char * ROOT_NAME_MASK = "/%s-ItzamBTreeRoot";
+#else
+static const char * HDR_NAME_MASK = "Global\\%s-ItzamBTreeHeader";
+static const char * ROOT_NAME_MASK = "Global\\%s-ItzamBTreeRoot";
+#endif
+
+#define MAKE_ITZAM_BHNAME(basename) get_shared_name(HDR_NAME_MASK,basename)
+#define MAKE_ITZAM_ROOT_NAME(basename) get_shared_name(ROOT_NAME_MASK,basename)
+
+/* pick the within-page search and the page layout from the header flags
  */
-static void promote_root(itzam_btree * btree,
-                         itzam_byte * key,
-                         itzam_btree_page * page_after)
+static void resolve_flags(itzam_btree * btree)
 {
-    /* create a new root page
+    btree->m_linked_leaves = (btree->m_header->m_flags & ITZAM_BTREE_FLAG_LINKED_LEAVES) ? itzam_true : itzam_false;
+    btree->m_parent_links  = (btree->m_header->m_flags & ITZAM_BTREE_FLAG_NO_PARENTS) ? itzam_false : itzam_true;
+    btree->m_varkeys       = (btree->m_header->m_flags & ITZAM_BTREE_FLAG_VARKEY) ? itzam_true : itzam_false;
+    btree->m_compress      = (btree->m_varkeys && (btree->m_header->m_flags & ITZAM_BTREE_FLAG_PREFIX)) ? itzam_true : itzam_false;
+    btree->m_values        = (btree->m_varkeys && (btree->m_header->m_flags & ITZAM_BTREE_FLAG_VALUES)) ? itzam_true : itzam_false;
+    btree->m_path_length   = 0;
+
+    /* a built-in key type is recorded by trees created with one; trees given a built-in
+     * comparator are recognized by it, though only fixed-length keys can be integers
      */
-    itzam_btree_page * new_root   = alloc_page(btree);
-    itzam_btree_page * new_before = dupe_page(btree, &btree->m_root);
+    btree->m_key_type = (itzam_key_type)((btree->m_header->m_flags & ITZAM_BTREE_FLAG_KEY_TYPE_MASK) >> ITZAM_BTREE_KEY_TYPE_SHIFT);
 
-    /* add key and links to root
-     */
-    memcpy(new_root->m_keys,key,btree->m_header->m_sizeof_key);
-    new_root->m_links[0] = new_before->m_header->m_where;
-    new_root->m_links[1] = page_after->m_header->m_where;
-    new_root->m_header->m_key_count = 1;
+    if (btree->m_key_type == ITZAM_KEY_CUSTOM)
+    {
+        if (btree->m_key_comparator == itzam_comparator_string)
+            btree->m_key_type = ITZAM_KEY_STRING;
+        else if (btree->m_varkeys)
+            btree->m_key_type = ITZAM_KEY_CUSTOM;
+        else if (btree->m_key_comparator == itzam_comparator_int32)
+            btree->m_key_type = ITZAM_KEY_INT32;
+        else if (btree->m_key_comparator == itzam_comparator_uint32)
+            btree->m_key_type = ITZAM_KEY_UINT32;
+        else if (btree->m_key_comparator == itzam_comparator_int64)
+            btree->m_key_type = ITZAM_KEY_INT64;
+        else if (btree->m_key_comparator == itzam_comparator_uint64)
+            btree->m_key_type = ITZAM_KEY_UINT64;
+    }
 
-    /* write new root to tree, and make it actual root internally
-     */
-    write_page(btree,new_root);
-    set_root(btree,new_root);
+    if ((btree->m_key_type != ITZAM_KEY_CUSTOM) && (key_type_width(btree->m_key_type) <= (itzam_int)btree->m_header->m_sizeof_key))
+        btree->m_key_comparator = key_type_comparator(btree->m_key_type);
+    else
+        btree->m_key_type = ITZAM_KEY_CUSTOM;
 
-    /* update children
+    /* a slotted page always has room left for the longest key
      */
-    new_before->m_header->m_parent = new_root->m_header->m_where;
-    page_after->m_header->m_parent = new_root->m_header->m_where;
+    if (btree->m_varkeys)
+    {
+        btree->m_heap_base  = sizeof(itzam_btree_page_header) + sizeof(itzam_btree_slots)
+                            + sizeof(itzam_ref) * (btree->m_header->m_order + 3)
+                            + sizeof(uint16_t) * btree->m_header->m_order;
+        btree->m_heap_limit = btree->m_header->m_sizeof_page - btree->m_heap_base - CELL_SIZE(btree->m_header->m_sizeof_key);
+    }
+    else
+    {
+        btree->m_heap_base  = 0;
+        btree->m_heap_limit = 0;
+    }
 
-    write_page(btree,new_before);
-    write_page(btree,page_after);
+    switch ((itzam_search_strategy)(btree->m_header->m_flags & ITZAM_BTREE_FLAG_SEARCH_MASK))
+    {
+        case ITZAM_SEARCH_LINEAR:
+            btree->m_binary_search = itzam_false;
+            break;
+        case ITZAM_SEARCH_BINARY:
+            btree->m_binary_search = itzam_true;
+            break;
+        default:
+            btree->m_binary_search = (btree->m_header->m_order >= ITZAM_BTREE_BINARY_SEARCH_ORDER) ? itzam_true : itzam_false;
+            break;
+    }
+}
 
-    free_page(new_before);
-    free_page(new_root);
+void itzam_btree_options_init(itzam_btree_options * options)
+{
+    if (options != NULL)
+    {
+        options->m_search        = ITZAM_SEARCH_AUTO;
+        options->m_linked_leaves = itzam_false;
+        options->m_parent_links  = itzam_true;
+        options->m_compress_keys = itzam_false;
+        options->m_inline_values = 0;
+        options->m_key_type      = ITZAM_KEY_CUSTOM;
+    }
+}
+
+static itzam_state create_btree(itzam_btree * btree,
+                                const char * filename,
+                                uint16_t order,
+                                itzam_int key_size,
+                                uint32_t page_size,
+                                itzam_key_comparator * key_comparator,
+                                itzam_error_handler * error_handler,
+                                const itzam_btree_options * options);
+
+itzam_state itzam_btree_create(itzam_btree * btree,
+                               const char * filename,
+                               uint16_t order,
+                               itzam_int key_size,
+                               itzam_key_comparator * key_comparator,
+                               itzam_error_handler * error_handler)
+{
+    return itzam_btree_create_ex(btree, filename, order, key_size, key_comparator, error_handler, NULL);
+}
+
+itzam_state itzam_btree_create_ex(itzam_btree * btree,
+                                  const char * filename,
+                                  uint16_t order,
+                                  itzam_int key_size,
+                                  itzam_key_comparator * key_comparator,
+                                  itzam_error_handler * error_handler,
+                                  const itzam_btree_options * options)
+{
+    return create_btree(btree, filename, order, key_size, 0, key_comparator, error_handler, options);
+}
+
+itzam_state itzam_btree_create_varkey(itzam_btree * btree,
+                                      const char * filename,
+                                      uint32_t page_size,
+                                      itzam_int max_key_size,
+                                      itzam_key_comparator * key_comparator,
+                                      itzam_key_size * key_size,
+                                      itzam_error_handler * error_handler,
+                                      const itzam_btree_options * options)
+{
+    itzam_error_handler * report = (error_handler != NULL) ? error_handler : default_error_handler;
+    itzam_state result = ITZAM_FAILED;
+    itzam_btree_options choices;
+    uint32_t fixed = sizeof(itzam_btree_page_header) + sizeof(itzam_btree_slots) + 3 * sizeof(itzam_ref);
+    uint32_t slot = sizeof(itzam_ref) + sizeof(uint16_t);
+    itzam_int entry = max_key_size;
+    uint32_t order;
+
+    /* only the search strategy, key compression and values can be chosen
+     */
+    if (options != NULL)
+        choices = *options;
+    else
+        itzam_btree_options_init(&choices);
+
+    choices.m_linked_leaves = itzam_true;
+    choices.m_parent_links  = itzam_false;
+
+    /* a key with a value is followed by the value, or by the reference of the record
+     * holding it, and then its length
+     */
+    if (choices.m_inline_values > 0)
+        entry += VALUE_TRAILER_SIZE + ((choices.m_inline_values > (itzam_int)sizeof(itzam_ref)) ? choices.m_inline_values : (itzam_int)sizeof(itzam_ref));
+
+    if (page_size == 0)
+        page_size = ITZAM_BTREE_VARKEY_PAGE_DEFAULT;
+
+    /* a page must hold at least six of the longest keys, so that the halves of a split
+     * and the pages left by a merge never run short of room
+     */
+    if ((max_key_size <= 0) || (choices.m_inline_values < 0) || (page_size > ITZAM_BTREE_VARKEY_PAGE_MAXIMUM)
+     || (page_size < fixed + 6 * CELL_SIZE(entry) + slot * ITZAM_BTREE_ORDER_MINIMUM))
+    {
+        report("itzam_btree_create_varkey",ITZAM_ERROR_TOO_LONG);
+        return result;
+    }
+
+    /* as many slots as keys of a few bytes would fill, leaving the rest of the page for keys
+     */
+    order = page_size / (4 * slot);
+
+    if (order > (page_size - fixed - 6 * CELL_SIZE(entry)) / slot)
+        order = (page_size - fixed - 6 * CELL_SIZE(entry)) / slot;
+
+    result = create_btree(btree, filename, (uint16_t)order, entry, page_size, key_comparator, error_handler, &choices);
+
+    if ((ITZAM_OKAY == result) && (key_size != NULL))
+        btree->m_key_size = key_size;
+
+    return result;
+}
+
+/* page_size is zero for fixed-length keys, or the size of the slotted pages that hold
+ * keys of up to key_size bytes
+ */
+static itzam_state create_btree(itzam_btree * btree,
+                                const char * filename,
+                                uint16_t order,
+                                itzam_int key_size,
+                                uint32_t page_size,
+                                itzam_key_comparator * key_comparator,
+                                itzam_error_handler * error_handler,
+                                const itzam_btree_options * options)
+{
+    itzam_error_handler * report = (error_handler != NULL) ? error_handler : default_error_handler;
+    itzam_state result = ITZAM_FAILED;
+    itzam_bool creator;
+    itzam_btree_options defaults;
+
+    /* a NULL options pointer selects the defaults
+     */
+    if (options == NULL)
+    {
+        itzam_btree_options_init(&defaults);
+        options = &defaults;
+    }
+
+    /* a built-in key type brings its own comparator
+     */
+    if (options->m_key_type != ITZAM_KEY_CUSTOM)
+        key_comparator = key_type_comparator(options->m_key_type);
+
+    pthread_mutex_lock(&global_mutex);
+
+    /* make sure the arguments make sense
+     */
+    if ((btree != NULL) && (filename != NULL) && (key_size > 0) && (key_comparator != NULL)
+     && ((key_type_width(options->m_key_type) == 0) || ((page_size == 0) && (key_type_width(options->m_key_type) <= key_size))))
+    {
+        /* allocate datafile
+         */
+        btree->m_datafile = (itzam_datafile *)malloc(sizeof(itzam_datafile));
+
+        if (btree->m_datafile != NULL)
+        {
+            /* create data file, which reports errors to the handler provided, if any
+             */
+            result = itzam_datafile_create_ex(btree->m_datafile,filename,error_handler);
+
+            if (ITZAM_OKAY == result)
+            {
+                /* allocate memory for shared header
+                 */
+                btree->m_shmem_header_name = MAKE_ITZAM_BHNAME(filename);
+
+                btree->m_shmem_header = itzam_shmem_obtain(btree->m_shmem_header_name, sizeof(itzam_btree_header), &creator, btree->m_datafile->m_error_handler);
+                btree->m_header = (itzam_btree_header *)itzam_shmem_getptr(btree->m_shmem_header, sizeof(itzam_btree_header), btree->m_datafile->m_error_handler);
+
+                /* fill in structure
+                 */
+                if (order < ITZAM_BTREE_ORDER_MINIMUM)
+                    order = ITZAM_BTREE_ORDER_MINIMUM;
+
+                btree->m_header->m_version     = ITZAM_BTREE_VERSION;
+                btree->m_header->m_order       = order;
+                btree->m_header->m_flags       = (uint16_t)options->m_search & ITZAM_BTREE_FLAG_SEARCH_MASK;
+
+                if (options->m_linked_leaves)
+                    btree->m_header->m_flags  |= ITZAM_BTREE_FLAG_LINKED_LEAVES;
+
+                if (!options->m_parent_links)
+                    btree->m_header->m_flags  |= ITZAM_BTREE_FLAG_NO_PARENTS;
+
+                if (page_size != 0)
+                    btree->m_header->m_flags  |= ITZAM_BTREE_FLAG_VARKEY;
+
+                if ((page_size != 0) && options->m_compress_keys)
+                    btree->m_header->m_flags  |= ITZAM_BTREE_FLAG_PREFIX;
+
+                if ((page_size != 0) && (options->m_inline_values > 0))
+                    btree->m_header->m_flags  |= ITZAM_BTREE_FLAG_VALUES;
+
+                btree->m_header->m_flags      |= ((uint16_t)options->m_key_type << ITZAM_BTREE_KEY_TYPE_SHIFT) & ITZAM_BTREE_FLAG_KEY_TYPE_MASK;
+
+                btree->m_header->m_count       = 0;
+                btree->m_header->m_ticker      = 0;
+                btree->m_header->m_schema_ref  = ITZAM_NULL_REF;
+
+                btree->m_free_datafile         = itzam_true;
+                btree->m_links_size            = btree->m_header->m_order + 1;
+                btree->m_min_keys              = btree->m_header->m_order / 2;
+                btree->m_key_comparator        = key_comparator;
+                btree->m_key_size              = itzam_key_size_string;
+                btree->m_cursor_count          = 0;
+                btree->m_versions              = NULL;
+                btree->m_snapshots             = NULL;
+                btree->m_epoch                 = 0;
+                btree->m_versioning            = itzam_false;
+                btree->m_slab                  = NULL;
+
+                version_lock_init(btree);
+
+                btree->m_header->m_where       = itzam_datafile_get_next_open(btree->m_datafile,sizeof(itzam_btree_header));
+                btree->m_header->m_root_where  = 0;
+                btree->m_header->m_sizeof_key  = key_size;
+                btree->m_header->m_sizeof_page = sizeof(itzam_btree_page_header)
+                                               + btree->m_header->m_sizeof_key * btree->m_header->m_order
+                                               + sizeof(itzam_ref) * btree->m_links_size;
+
+                if (options->m_linked_leaves)
+                    btree->m_header->m_sizeof_page += 2 * sizeof(itzam_ref);
+
+                if (page_size != 0)
+                    btree->m_header->m_sizeof_page = page_size;
+
+                resolve_flags(btree);
+
+                /* write header for first time (lacks root pointer info, but needs to occupy space in the file)
+                 */
+                if (btree->m_header->m_where == itzam_datafile_write_flags(btree->m_datafile, btree->m_header, sizeof(itzam_btree_header), btree->m_header->m_where, ITZAM_RECORD_BTREE_HEADER))
+                {
+                    /* allocate memory for shared header
+                     */
+                    btree->m_shmem_root_name = MAKE_ITZAM_ROOT_NAME(filename);
+                    btree->m_shmem_root = itzam_shmem_obtain(btree->m_shmem_root_name, btree->m_header->m_sizeof_page, &creator, btree->m_datafile->m_error_handler);
+                    btree->m_root_data  = (itzam_byte *)itzam_shmem_getptr(btree->m_shmem_root, btree->m_header->m_sizeof_page, btree->m_datafile->m_error_handler);
+                    set_page(btree, &btree->m_root, btree->m_root_data);
+                    init_page(btree, &btree->m_root);
+                    btree->m_root.m_frame = NULL;
+
+                    /* create the page cache
+                     */
+                    itzam_cache_create(&btree->m_cache, btree->m_datafile, btree->m_header->m_sizeof_page, sizeof(itzam_btree_page), ITZAM_CACHE_DEFAULT_PAGES, ITZAM_RECORD_BTREE_PAGE);
+
+                    /* assign root a file position
+                     */
+                    btree->m_root.m_header->m_where = itzam_datafile_get_next_open(btree->m_datafile, btree->m_header->m_sizeof_page);
+
+                    if (btree->m_root.m_header->m_where != ITZAM_NULL_REF)
+                    {
+                        /* write root page
+                         */
+                        btree->m_header->m_root_where = itzam_datafile_write_flags(btree->m_datafile,
+                                                                                   btree->m_root.m_data,
+                                                                                   btree->m_header->m_sizeof_page,
+                                                                                   btree->m_root.m_header->m_where,
+                                                                                   ITZAM_RECORD_BTREE_PAGE);
+
+
+                        /* make certain that the root was written where we expect it to be
+                         */
+                        if ((btree->m_header->m_root_where == btree->m_root.m_header->m_where) &&  (btree->m_header->m_root_where != ITZAM_NULL_REF))
+                            result = update_header(btree);
+
+                        /* make certain root was written
+                         */
+                        itzam_file_commit(btree->m_datafile->m_file);
+                    }
+                }
+
+                /* remember to deallocate this datafile at closing
+                 */
+                btree->m_free_datafile = itzam_true;
+
+                result = ITZAM_OKAY;
+            }
+        }
+    }
+    else
+        report("itzam_btree_create",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    pthread_mutex_unlock(&global_mutex);
+
+    return result;
+}
+
+itzam_state itzam_btree_open(itzam_btree * btree,
+                             const char * filename,
+                             itzam_key_comparator * key_comparator,
+                             itzam_error_handler * error_handler,
+                             itzam_bool recover,
+                             itzam_bool read_only)
+{
+    itzam_error_handler * report = (error_handler != NULL) ? error_handler : default_error_handler;
+
+    /* what we return
+     */
+    itzam_state result = ITZAM_FAILED;
+    itzam_bool creator;
+
+    pthread_mutex_lock(&global_mutex);
+
+    /* make sure the arguments make sense
+     */
+    if ((btree != NULL) && (filename != NULL) && (key_comparator != NULL))
+    {
+        /* allocate datafile
+         */
+        btree->m_datafile = (itzam_datafile *)malloc(sizeof(itzam_datafile));
+
+        if (btree->m_datafile != NULL)
+        {
+            /* open data file, which reports errors to the handler provided, if any
+             */
+            result = itzam_datafile_open_ex(btree->m_datafile,filename,recover,read_only,error_handler);
+
+            if (ITZAM_OKAY == result)
+            {
+                /* do the actual create
+                 */
+                btree->m_free_datafile = itzam_true;
+                btree->m_key_comparator = key_comparator;
+                btree->m_key_size = itzam_key_size_string;
+                btree->m_cursor_count = 0;
+                btree->m_versions = NULL;
+                btree->m_snapshots = NULL;
+                btree->m_epoch = 0;
+                btree->m_versioning = itzam_false;
+                btree->m_slab = NULL;
+
+                version_lock_init(btree);
+
+                /* allocate memory for embedded header
+                 */
+                btree->m_shmem_header_name = MAKE_ITZAM_BHNAME(filename);
+                btree->m_shmem_header = itzam_shmem_obtain(btree->m_shmem_header_name, sizeof(itzam_btree_header), &creator, btree->m_datafile->m_error_handler);
+                btree->m_header = (itzam_btree_header *)itzam_shmem_getptr(btree->m_shmem_header, sizeof(itzam_btree_header), btree->m_datafile->m_error_handler);
+
+                /* assumes first record is header
+                 */
+                if (ITZAM_OKAY == itzam_datafile_rewind(btree->m_datafile))
+                {
+                    if (creator)
+                        result = itzam_datafile_read(btree->m_datafile,btree->m_header,sizeof(itzam_btree_header));
+
+                    if (ITZAM_OKAY == result)
+                    {
+                        /* verify version
+                         */
+                        if (btree->m_header->m_version == ITZAM_BTREE_VERSION)
+                        {
+                            /* finish intializing btree
+                             */
+                            btree->m_links_size = btree->m_header->m_order + 1;
+                            btree->m_min_keys   = btree->m_header->m_order / 2;
+
+                            resolve_flags(btree);
+
+                            /* allocate memory for shared header
+                             */
+                            btree->m_shmem_root_name = MAKE_ITZAM_ROOT_NAME(filename);
+                            btree->m_shmem_root = itzam_shmem_obtain(btree->m_shmem_root_name, btree->m_header->m_sizeof_page, &creator, btree->m_datafile->m_error_handler);
+                            btree->m_root_data  = (itzam_byte *)itzam_shmem_getptr(btree->m_shmem_root, btree->m_header->m_sizeof_page, btree->m_datafile->m_error_handler);
+                            set_page(btree, &btree->m_root, btree->m_root_data);
+                            btree->m_root.m_frame = NULL;
+
+                            /* create the page cache
+                             */
+                            itzam_cache_create(&btree->m_cache, btree->m_datafile, btree->m_header->m_sizeof_page, sizeof(itzam_btree_page), ITZAM_CACHE_DEFAULT_PAGES, ITZAM_RECORD_BTREE_PAGE);
+
+                            /* read root
+                             */
+                            if (creator)
+                            {
+                                itzam_datafile_read_at(btree->m_datafile, btree->m_header->m_root_where, btree->m_root_data, btree->m_header->m_sizeof_page);
+                            }
+
+                            result = ITZAM_OKAY;
+                        }
+                        else
+                            result = ITZAM_VERSION_ERROR;
+                    }
+                }
+
+                result = ITZAM_OKAY;
+            }
+        }
+    }
+    else
+        report("itzam_btree_open",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    pthread_mutex_unlock(&global_mutex);
+
+    return result;
+}
+
+/* return number of active records in database
+ */
+uint64_t itzam_btree_count(itzam_btree * btree)
+{
+    uint64_t result = 0;
+
+    if (btree != NULL)
+    {
+        itzam_datafile_read_lock(btree->m_datafile);
+
+        if (ITZAM_OKAY == result)
+            result = btree->m_header->m_count;
+
+        itzam_datafile_read_unlock(btree->m_datafile);
+    }
+
+    return result;
+}
+
+/* return ticker, which is a count of every record ever added to the database
+ */
+uint64_t itzam_btree_ticker(itzam_btree * btree)
+{
+    uint64_t result = 0;
+
+    if (btree != NULL)
+    {
+        itzam_datafile_read_lock(btree->m_datafile);
+
+        if (ITZAM_OKAY == result)
+            result = btree->m_header->m_ticker;
+
+        itzam_datafile_read_unlock(btree->m_datafile);
+    }
+    else
+    {
+        default_error_handler("itzam_btree_ticker",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    }
+
+    return result;
+}
+
+/* close file
+ */
+itzam_state itzam_btree_close(itzam_btree * btree)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    pthread_mutex_lock(&global_mutex);
+
+    /* make sure the arguments make sense
+     */
+    if ((btree != NULL) && (btree->m_cursor_count == 0) && (btree->m_snapshots == NULL))
+    {
+        itzam_datafile_write_lock(btree->m_datafile);
+
+        if (!btree->m_datafile->m_read_only)
+        {
+            itzam_cache_flush(&btree->m_cache);
+            update_header(btree);
+        }
+
+        itzam_cache_destroy(&btree->m_cache);
+
+        itzam_datafile_write_unlock(btree->m_datafile);
+
+        /* the last snapshot to end dropped every version, leaving only the buckets
+         */
+        free(btree->m_versions);
+        btree->m_versions = NULL;
+        version_lock_destroy(btree);
+
+        free_slab(btree);
+
+        /* the last instance to close empties the write-ahead log
+         */
+        itzam_datafile_close(btree->m_datafile);
+        free(btree->m_datafile);
+        btree->m_datafile = NULL;
+
+        itzam_shmem_freeptr(btree->m_root_data, btree->m_header->m_sizeof_page);
+        itzam_shmem_close(btree->m_shmem_root, btree->m_shmem_root_name);
+        free(btree->m_shmem_root_name);
+
+        itzam_shmem_freeptr(btree->m_header, sizeof(itzam_btree_header));
+        itzam_shmem_close(btree->m_shmem_header,btree->m_shmem_header_name);
+        free(btree->m_shmem_header_name);
+
+        result = ITZAM_OKAY;
+    }
+    else
+        default_error_handler("itzam_btree_close",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    pthread_mutex_unlock(&global_mutex);
+
+    return result;
+}
+
+void itzam_btree_mutex_lock(itzam_btree * btree)
+{
+    if (btree != NULL)
+        itzam_datafile_write_lock(btree->m_datafile);
+    else
+        default_error_handler("itzam_btree_lock",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+}
+
+void itzam_btree_mutex_unlock(itzam_btree * btree)
+{
+    if (btree != NULL)
+        itzam_datafile_write_unlock(btree->m_datafile);
+    else
+        default_error_handler("itzam_btree_unlock",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+}
+
+/* lock btree file
+ */
+itzam_bool itzam_btree_file_lock(itzam_btree * btree)
+{
+    itzam_bool result = itzam_false;
+
+    if (btree != NULL)
+    {
+        itzam_datafile_mutex_lock(btree->m_datafile);
+        result = itzam_datafile_file_lock(btree->m_datafile);
+        itzam_datafile_mutex_unlock(btree->m_datafile);
+    }
+    else
+        default_error_handler("itzam_btree_lock",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+/* unlock btree file
+ */
+itzam_bool itzam_btree_file_unlock(itzam_btree * btree)
+{
+    itzam_bool result = itzam_false;
+
+    if (btree != NULL)
+    {
+        itzam_datafile_mutex_lock(btree->m_datafile);
+        result = itzam_datafile_file_unlock(btree->m_datafile);
+        itzam_datafile_mutex_unlock(btree->m_datafile);
+    }
+    else
+        default_error_handler("itzam_btree_unlock",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+itzam_bool itzam_btree_is_open(itzam_btree * btree)
+{
+    itzam_bool result = itzam_false;
+
+    if (btree != NULL)
+    {
+        itzam_datafile_mutex_lock(btree->m_datafile);
+        result = itzam_datafile_is_open(btree->m_datafile);
+        itzam_datafile_mutex_unlock(btree->m_datafile);
+    }
+    else
+    {
+        default_error_handler("itzam_btree_is_open",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    }
+
+    return result;
+}
+
+void itzam_btree_set_error_handler(itzam_btree * btree,
+                                   itzam_error_handler * error_handler)
+{
+    if (btree != NULL)
+    {
+        itzam_datafile_mutex_lock(btree->m_datafile);
+        itzam_datafile_set_error_handler(btree->m_datafile,error_handler);
+        itzam_datafile_mutex_unlock(btree->m_datafile);
+    }
+    else
+    {
+        default_error_handler("itzam_btree_set_error_handler",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    }
+}
+
+/* set the number of pages kept in memory by this B-tree instance
+ */
+void itzam_btree_set_cache_size(itzam_btree * btree, uint32_t pages)
+{
+    if (btree != NULL)
+    {
+        itzam_datafile_write_lock(btree->m_datafile);
+        itzam_cache_set_capacity(&btree->m_cache, pages);
+        itzam_datafile_write_unlock(btree->m_datafile);
+    }
+    else
+    {
+        default_error_handler("itzam_btree_set_cache_size",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    }
+}
+
+itzam_state itzam_btree_set_durability(itzam_btree * btree, itzam_durability durability, uint32_t interval)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    if (btree != NULL)
+        result = itzam_datafile_set_durability(btree->m_datafile, durability, interval);
+    else
+        default_error_handler("itzam_btree_set_durability",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+/* read pages in place from a map of the file, rather than copying them into the cache
+ */
+itzam_state itzam_btree_set_mapped(itzam_btree * btree, itzam_bool mapped)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    if (btree != NULL)
+        result = itzam_datafile_set_mapped(btree->m_datafile, mapped);
+    else
+        default_error_handler("itzam_btree_set_mapped",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+/* pages are written with checksums, and verified when read, unless told otherwise
+ */
+itzam_state itzam_btree_set_checksums(itzam_btree * btree, itzam_checksum_mode mode)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    if (btree != NULL)
+        result = itzam_datafile_set_checksums(btree->m_datafile, mode);
+    else
+        default_error_handler("itzam_btree_set_checksums",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+/* how to measure the keys passed to a tree with variable-length keys; trees are opened
+ * measuring keys as strings
+ */
+void itzam_btree_set_key_size(itzam_btree * btree, itzam_key_size * key_size)
+{
+    if ((btree != NULL) && (key_size != NULL))
+    {
+        itzam_datafile_write_lock(btree->m_datafile);
+        btree->m_key_size = key_size;
+        itzam_datafile_write_unlock(btree->m_datafile);
+    }
+    else
+    {
+        default_error_handler("itzam_btree_set_key_size",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    }
+}
+
+/* structure used to return search information
+ */
+typedef struct
+{
+    itzam_btree_page * m_page;
+    int                m_index;
+    itzam_bool         m_found;
+} search_result;
+
+/*-----------------------------------------------------------------------------
+ * built-in integer keys; a page is bisected without branches until few keys are left, and
+ * those are counted, several at a time where keys are packed and the processor can compare
+ * them in vectors. Unsigned keys have their top bit flipped, so that they order as signed
+ */
+
+/* keys left to count once bisection stops
+ */
+#define INTEGER_SPAN 16
+
+static int32_t load_int32(const itzam_byte * key, uint32_t bias)
+{
+    uint32_t value;
+
+    memcpy(&value, key, sizeof(uint32_t));
+
+    return (int32_t)(value ^ bias);
+}
+
+static int64_t load_int64(const itzam_byte * key, uint64_t bias)
+{
+    uint64_t value;
+
+    memcpy(&value, key, sizeof(uint64_t));
+
+    return (int64_t)(value ^ bias);
+}
+
+/* the number of n keys, each stride bytes from the last, that are less than target
+ */
+static int count_below_int32(const itzam_byte * keys, size_t stride, int n, int32_t target, uint32_t bias)
+{
+    int result = 0;
+    int i = 0;
+
+#if defined(__AVX2__)
+    if (stride == sizeof(int32_t))
+    {
+        const __m256i flip  = _mm256_set1_epi32((int)bias);
+        const __m256i limit = _mm256_set1_epi32(target);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(keys + i * sizeof(int32_t))), flip);
+            result += __builtin_popcount((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(limit, block))));
+        }
+    }
+#elif defined(__SSE2__)
+    if (stride == sizeof(int32_t))
+    {
+        const __m128i flip  = _mm_set1_epi32((int)bias);
+        const __m128i limit = _mm_set1_epi32(target);
+
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(keys + i * sizeof(int32_t))), flip);
+            result += __builtin_popcount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, limit))));
+        }
+    }
+#endif
+
+    for (; i < n; ++i)
+        result += (load_int32(keys + i * stride, bias) < target);
+
+    return result;
+}
+
+static int count_below_int64(const itzam_byte * keys, size_t stride, int n, int64_t target, uint64_t bias)
+{
+    int result = 0;
+    int i = 0;
+
+#if defined(__AVX2__)
+    if (stride == sizeof(int64_t))
+    {
+        const __m256i flip  = _mm256_set1_epi64x((long long)bias);
+        const __m256i limit = _mm256_set1_epi64x(target);
+
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(keys + i * sizeof(int64_t))), flip);
+            result += __builtin_popcount((unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(limit, block))));
+        }
+    }
+#elif defined(__SSE4_2__)
+    if (stride == sizeof(int64_t))
+    {
+        const __m128i flip  = _mm_set1_epi64x((long long)bias);
+        const __m128i limit = _mm_set1_epi64x(target);
+
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(keys + i * sizeof(int64_t))), flip);
+            result += __builtin_popcount((unsigned)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(limit, block))));
+        }
+    }
+#endif
+
+    for (; i < n; ++i)
+        result += (load_int64(keys + i * stride, bias) < target);
+
+    return result;
+}
+
+/* as search_page, for a page of built-in integer keys; the first key not less than the
+ * target lies between base and base + n, and each step halves n
+ */
+static int search_integers(const itzam_btree * btree, const itzam_btree_page * page, const void * key, itzam_bool * found)
+{
+    const itzam_byte * keys = page->m_keys;
+    size_t stride = btree->m_header->m_sizeof_key;
+    int count = page->m_header->m_key_count;
+    int base = 0;
+    int n = count;
+    int half;
+
+    if (key_type_width(btree->m_key_type) == sizeof(int32_t))
+    {
+        uint32_t bias  = (btree->m_key_type == ITZAM_KEY_UINT32) ? 0x80000000u : 0;
+        int32_t target = load_int32((const itzam_byte *)key, bias);
+
+        while (n > INTEGER_SPAN)
+        {
+            half  = n / 2;
+            base += (load_int32(keys + (base + half) * stride, bias) < target) ? half : 0;
+            n    -= half;
+        }
+
+        base  += count_below_int32(keys + base * stride, stride, n, target, bias);
+        *found = ((base < count) && (load_int32(keys + base * stride, bias) == target)) ? itzam_true : itzam_false;
+    }
+    else
+    {
+        uint64_t bias  = (btree->m_key_type == ITZAM_KEY_UINT64) ? 0x8000000000000000ull : 0;
+        int64_t target = load_int64((const itzam_byte *)key, bias);
+
+        while (n > INTEGER_SPAN)
+        {
+            half  = n / 2;
+            base += (load_int64(keys + (base + half) * stride, bias) < target) ? half : 0;
+            n    -= half;
+        }
+
+        base  += count_below_int64(keys + base * stride, stride, n, target, bias);
+        *found = ((base < count) && (load_int64(keys + base * stride, bias) == target)) ? itzam_true : itzam_false;
+    }
+
+    return base;
+}
+
+/* compare a key with one in a page; string keys, normalized or not, are compared in place,
+ * and others through the comparator
+ */
+static int compare_key(const itzam_btree * btree, const void * key, const void * other)
+{
+    if (btree->m_key_type == ITZAM_KEY_STRING)
+        return strcmp((const char *)key, (const char *)other);
+
+    return btree->m_key_comparator(key, other);
+}
+
+/* locate a key within a page; returns the index of the first key that is not
+ * less than the search key, and sets found when that key is equal
+ */
+static int search_page(itzam_btree * btree, const itzam_btree_page * page, const void * key, itzam_bool * found)
+{
+    int lo = 0;
+    int hi = page->m_header->m_key_count;
+    int prefix = prefix_length(btree, page);
+    int comp;
+
+    if (key_type_width(btree->m_key_type) != 0)
+        return search_integers(btree, page, key, found);
+
+    *found = itzam_false;
+
+    /* a key without the page's prefix is below or above every key in it; one with the
+     * prefix is compared by what follows it
+     */
+    if (prefix > 0)
+    {
+        comp = strncmp((const char *)key, (const char *)prefix_of(page), prefix);
+
+        if (comp != 0)
+            return (comp < 0) ? 0 : hi;
+
+        key = (const char *)key + prefix;
+    }
+
+    if (btree->m_binary_search)
+    {
+        while (lo < hi)
+        {
+            int mid = lo + (hi - lo) / 2;
+
+            comp = compare_key(btree, key, (const void *)key_at(btree, page, mid));
+
+            if (comp > 0)
+                lo = mid + 1;
+            else if (comp < 0)
+                hi = mid;
+            else
+            {
+                *found = itzam_true;
+                return mid;
+            }
+        }
+    }
+    else
+    {
+        while (lo < hi)
+        {
+            comp = compare_key(btree, key, (const void *)key_at(btree, page, lo));
+
+            if (comp > 0)
+                ++lo;
+            else
+            {
+                if (comp == 0)
+                    *found = itzam_true;
+
+                break;
+            }
+        }
+    }
+
+    return lo;
+}
+
+/* writers record the path to the page found, for finding parents later
+ */
+static void search(itzam_btree * btree, const void * key, search_result * result, itzam_bool writing)
+{
+    itzam_bool found;
+
+    int index;
+    int depth = 0;
+
+    /* duplicate root
+     */
+    itzam_btree_page * page = &btree->m_root;
+
+    if (writing)
+        btree->m_path_length = 0;
+
+    while (itzam_true)
+    {
+       index = 0;
+
+        if (writing && (page != NULL))
+            note_path(btree, depth++, page);
+
+        /* if page is empty, we didn't find the key
+         */
+        if ((page == NULL) || (page->m_header->m_key_count == 0))
+        {
+            result->m_page  = page;
+            result->m_index = index;
+            result->m_found = itzam_false;
+            return;
+        }
+        else
+        {
+            /* look for the key in this page
+             */
+            index = search_page(btree, page, key, &found);
+
+            /* with linked leaves, the keys in inner pages are only separators; an equal
+             * key is in the subtree to the right
+             */
+            if (found && btree->m_linked_leaves && (page->m_links[0] != ITZAM_NULL_REF))
+            {
+                ++index;
+                found = itzam_false;
+            }
+
+            if (found)
+            {
+                result->m_page  = page;
+                result->m_index = index;
+                result->m_found = itzam_true;
+                return;
+            }
+
+            /* if we're in a leaf, the key hasn't been found
+             */
+            if (page->m_links[index] == ITZAM_NULL_REF)
+            {
+                result->m_page  = page;
+                result->m_index = index;
+                result->m_found = itzam_false;
+                return;
+            }
+            else
+            {
+                /* read and search next page
+                 */
+                itzam_btree_page * next_page = read_page(btree,page->m_links[index]);
+
+                free_page(btree,page);
+
+                page = next_page;
+            }
+        }
+    }
+}
+
+/* look for a key in pages read in place from the datafile's map; with the read lock held,
+ * writers have flushed everything, so the file matches the cache. Returns itzam_false if
+ * the map could not supply every page, leaving the caller to search through the cache
+ */
+static itzam_bool find_mapped(itzam_btree * btree, const void * key, void * returned_key, itzam_bool * found)
+{
+    itzam_btree_page page = btree->m_root;
+    itzam_bool result = itzam_true;
+    const void * data;
+    int index;
+
+    *found = itzam_false;
+
+    if (!itzam_datafile_map_lock(btree->m_datafile))
+        return itzam_false;
+
+    while (page.m_header->m_key_count > 0)
+    {
+        index = search_page(btree, &page, key, found);
+
+        if (*found && btree->m_linked_leaves && (page.m_links[0] != ITZAM_NULL_REF))
+        {
+            ++index;
+            *found = itzam_false;
+        }
+
+        if (*found)
+        {
+            if (returned_key != NULL)
+                copy_key(btree, returned_key, &page, index);
+
+            break;
+        }
+
+        if (page.m_links[index] == ITZAM_NULL_REF)
+            break;
+
+        data = itzam_datafile_map_record(btree->m_datafile, page.m_links[index], btree->m_header->m_sizeof_page);
+
+        if (data == NULL)
+        {
+            result = itzam_false;
+            break;
+        }
+
+        /* the map is read-only, and so is this page
+         */
+        set_page(btree, &page, (itzam_byte *)data);
+    }
+
+    itzam_datafile_map_unlock(btree->m_datafile);
+
+    return result;
+}
+
+itzam_bool itzam_btree_find(itzam_btree * btree, const void * key, void * returned_key)
+{
+    search_result s;
+
+    s.m_found = itzam_false;
+    s.m_index = 0;
+    s.m_page  = NULL;
+
+    if ((btree != NULL) && (key != NULL))
+    {
+        itzam_datafile_read_lock(btree->m_datafile);
+        itzam_cache_sync(&btree->m_cache);
+
+        if (!find_mapped(btree, key, returned_key, &s.m_found))
+        {
+            search(btree,key,&s,itzam_false);
+
+            if ((s.m_found) && (returned_key != NULL))
+                copy_key(btree, returned_key, s.m_page, s.m_index);
+
+            free_page(btree,s.m_page);
+        }
+
+        itzam_datafile_read_unlock(btree->m_datafile);
+    }
+    else
+    {
+        default_error_handler("itzam_btree_find",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    }
+
+    return s.m_found;
+}
+
+/*-----------------------------------------------------------------------------
+ * slotted pages, for variable-length keys
+ *
+ * keys are packed at the end of a page, each preceded by its length, and found through
+ * an array of offsets in key order. Trees with variable-length keys keep their keys in
+ * linked leaves; a page holds at most m_heap_limit bytes of keys between changes, which
+ * leaves room for the longest key, so that replacing a separator always fits and a page
+ * pushed past the limit can be split at once
+ */
+
+
+static uint32_t heap_used(const itzam_btree * btree, const itzam_btree_page * page)
+{
+    return btree->m_header->m_sizeof_page - page->m_slots->m_heap - page->m_slots->m_garbage;
+}
+
+/* a page below a quarter full is merged with a neighbour, or takes keys from it
+ */
+static itzam_bool underfull(const itzam_btree * btree, const itzam_btree_page * page)
+{
+    return (4 * heap_used(btree, page) < btree->m_header->m_sizeof_page - btree->m_heap_base);
+}
+
+static itzam_bool cell_fits(const itzam_btree * btree, const itzam_btree_page * page, itzam_int length)
+{
+    return (page->m_header->m_key_count < btree->m_header->m_order)
+        && (heap_used(btree, page) + CELL_SIZE(length) <= btree->m_heap_limit);
+}
+
+static void clear_cells(const itzam_btree * btree, itzam_btree_page * page)
+{
+    page->m_slots->m_heap    = (uint16_t)btree->m_header->m_sizeof_page;
+    page->m_slots->m_garbage = 0;
+    page->m_slots->m_prefix  = 0;
+    page->m_header->m_key_count = 0;
+
+    memset(page->m_offsets, 0, sizeof(uint16_t) * btree->m_header->m_order);
+}
+
+/* squeeze out the space left by removed keys
+ */
+static void compact_page(itzam_btree * btree, itzam_btree_page * page)
+{
+    itzam_byte * scratch = (itzam_byte *)take_block(btree);
+    uint32_t heap = btree->m_header->m_sizeof_page;
+    uint32_t cell;
+    int n;
+
+    if (scratch == NULL)
+    {
+        btree->m_datafile->m_error_handler("compact_page", ITZAM_ERROR_MALLOC);
+        return;
+    }
+
+    for (n = 0; n < page->m_header->m_key_count; ++n)
+    {
+        cell = CELL_SIZE(stored_key_size(btree, key_at(btree, page, n)));
+        heap -= cell;
+        memcpy(scratch + heap, page->m_data + page->m_offsets[n], cell);
+        page->m_offsets[n] = (uint16_t)heap;
+    }
+
+    if (page->m_slots->m_prefix != 0)
+    {
+        cell = CELL_SIZE(prefix_length(btree, page));
+        heap -= cell;
+        memcpy(scratch + heap, page->m_data + page->m_slots->m_prefix, cell);
+        page->m_slots->m_prefix = (uint16_t)heap;
+    }
+
+    memcpy(page->m_data + heap, scratch + heap, btree->m_header->m_sizeof_page - heap);
+
+    page->m_slots->m_heap    = (uint16_t)heap;
+    page->m_slots->m_garbage = 0;
+
+    give_block(btree, scratch);
+}
+
+/* store a key at index; the caller has made sure it fits, and the key is not in this page
+ */
+static void insert_cell(itzam_btree * btree, itzam_btree_page * page, int index, const itzam_byte * key, itzam_int length)
+{
+    uint16_t size = (uint16_t)length;
+
+    if (page->m_slots->m_heap < btree->m_heap_base + CELL_SIZE(length))
+        compact_page(btree, page);
+
+    page->m_slots->m_heap -= (uint16_t)CELL_SIZE(length);
+
+    memcpy(page->m_data + page->m_slots->m_heap, &size, sizeof(uint16_t));
+    memcpy(page->m_data + page->m_slots->m_heap + sizeof(uint16_t), key, length);
+
+    memmove(page->m_offsets + index + 1, page->m_offsets + index, sizeof(uint16_t) * (page->m_header->m_key_count - index));
+    page->m_offsets[index] = page->m_slots->m_heap;
+
+    ++page->m_header->m_key_count;
+}
+
+static void delete_cell(const itzam_btree * btree, itzam_btree_page * page, int index)
+{
+    uint16_t offset = page->m_offsets[index];
+    uint32_t cell = CELL_SIZE(stored_key_size(btree, page->m_data + offset + sizeof(uint16_t)));
+
+    /* the lowest key gives its space straight back
+     */
+    if (offset == page->m_slots->m_heap)
+        page->m_slots->m_heap += (uint16_t)cell;
+    else
+        page->m_slots->m_garbage += (uint16_t)cell;
+
+    --page->m_header->m_key_count;
+
+    memmove(page->m_offsets + index, page->m_offsets + index + 1, sizeof(uint16_t) * (page->m_header->m_key_count - index));
+    page->m_offsets[page->m_header->m_key_count] = 0;
+}
+
+/* gathering the keys of slotted pages; a page that changes shape is rebuilt from a
+ * sequence of its keys, with any key being added in its place, and split in two if they
+ * do not fit. Keys are gathered whole, since the pages they are rebuilt into may share
+ * a different prefix than the pages they came from
+ */
+static itzam_bool start_sequence(itzam_btree * btree, key_sequence * keys)
+{
+    keys->m_keys  = (key_ref *)take_block(btree);
+    keys->m_count = 0;
+
+    if (keys->m_keys == NULL)
+    {
+        btree->m_datafile->m_error_handler("start_sequence", ITZAM_ERROR_MALLOC);
+        return itzam_false;
+    }
+
+    keys->m_links = (itzam_ref *)(keys->m_keys + 2 * btree->m_header->m_order + 2);
+
+    return itzam_true;
+}
+
+static void end_sequence(itzam_btree * btree, key_sequence * keys)
+{
+    give_block(btree, keys->m_keys);
+}
+
+static void append_key(key_sequence * keys, const itzam_byte * prefix, itzam_int prefix_length, const itzam_byte * suffix, itzam_int suffix_length)
+{
+    key_ref * key = &keys->m_keys[keys->m_count++];
+
+    key->m_prefix        = prefix;
+    key->m_prefix_length = (uint16_t)prefix_length;
+    key->m_suffix        = suffix;
+    key->m_suffix_length = (uint16_t)suffix_length;
+}
+
+/* append keys [from, to) of a page
+ */
+static void append_keys(const itzam_btree * btree, key_sequence * keys, const itzam_btree_page * page, int from, int to)
+{
+    itzam_int prefix = prefix_length(btree, page);
+    const itzam_byte * key;
+    int n;
+
+    for (n = from; n < to; ++n)
+    {
+        key = key_at(btree, page, n);
+        append_key(keys, (prefix > 0) ? prefix_of(page) : NULL, prefix, key, stored_key_size(btree, key));
+    }
+}
+
+static itzam_int ref_length(const key_ref * key)
+{
+    return key->m_prefix_length + key->m_suffix_length;
+}
+
+static itzam_byte ref_byte(const key_ref * key, itzam_int n)
+{
+    return (n < key->m_prefix_length) ? key->m_prefix[n] : key->m_suffix[n - key->m_prefix_length];
+}
+
+/* copy length bytes of a key, starting at from
+ */
+static void copy_ref(itzam_byte * dest, const key_ref * key, itzam_int from, itzam_int length)
+{
+    itzam_int part;
+
+    if (from < key->m_prefix_length)
+    {
+        part = key->m_prefix_length - from;
+
+        if (part > length)
+            part = length;
+
+        memcpy(dest, key->m_prefix + from, part);
+
+        dest   += part;
+        from   += part;
+        length -= part;
+    }
+
+    memcpy(dest, key->m_suffix + (from - key->m_prefix_length), length);
+}
+
+/* the number of leading bytes two keys have in common
+ */
+static itzam_int common_length(const key_ref * key1, const key_ref * key2)
+{
+    itzam_int limit = ref_length(key1);
+    itzam_int result = 0;
+
+    if (limit > ref_length(key2))
+        limit = ref_length(key2);
+
+    /* keys from the same page share its prefix
+     */
+    if ((key1->m_prefix == key2->m_prefix) && (key1->m_prefix_length == key2->m_prefix_length))
+        result = key1->m_prefix_length;
+
+    while ((result < limit) && (ref_byte(key1, result) == ref_byte(key2, result)))
+        ++result;
+
+    return result;
+}
+
+/* the prefix keys [from, to) would share in one page, which is as much as the first and
+ * last have in common; kept only when storing it once saves room
+ */
+static itzam_int shared_length(const itzam_btree * btree, const key_sequence * keys, int from, int to)
+{
+    itzam_int result = 0;
+
+    if (btree->m_compress && (to - from > 1))
+    {
+        result = common_length(&keys->m_keys[from], &keys->m_keys[to - 1]);
+
+        /* every key keeps at least one byte of its own
+         */
+        if (result >= ref_length(&keys->m_keys[from]))
+            result = ref_length(&keys->m_keys[from]) - 1;
+
+        if ((to - from - 1) * result <= (itzam_int)sizeof(uint16_t))
+            result = 0;
+    }
+
+    return result;
+}
+
+/* the bytes keys [from, to) take from the heap of one page, given their total length
+ */
+static uint32_t group_size(const itzam_btree * btree, const key_sequence * keys, int from, int to, uint32_t length)
+{
+    itzam_int prefix = shared_length(btree, keys, from, to);
+    uint32_t result = length + (uint32_t)(to - from) * sizeof(uint16_t) - (uint32_t)((to - from) * prefix);
+
+    if (prefix > 0)
+        result += CELL_SIZE(prefix);
+
+    return result;
+}
+
+static itzam_bool group_fits(const itzam_btree * btree, const key_sequence * keys, int from, int to, uint32_t length)
+{
+    return (to - from <= btree->m_header->m_order)
+        && (group_size(btree, keys, from, to, length) <= btree->m_heap_limit);
+}
+
+static uint32_t sequence_length(const key_sequence * keys)
+{
+    uint32_t result = 0;
+    int n;
+
+    for (n = 0; n < keys->m_count; ++n)
+        result += ref_length(&keys->m_keys[n]);
+
+    return result;
+}
+
+/* where to divide a sequence between two pages, keeping the larger as small as it can
+ * be. The key at the result is the first on the right of a leaf split, and goes up to
+ * the parent from an inner split
+ */
+static int best_split(const itzam_btree * btree, const key_sequence * keys, itzam_bool inner)
+{
+    uint32_t total = sequence_length(keys);
+    uint32_t best = UINT32_MAX;
+    uint32_t left = 0;
+    uint32_t right;
+    uint32_t larger;
+    int result = keys->m_count / 2;
+    int first;
+    int n;
+
+    for (n = 1; n < keys->m_count - (inner ? 1 : 0); ++n)
+    {
+        left += ref_length(&keys->m_keys[n - 1]);
+        first = inner ? n + 1 : n;
+
+        if ((n > btree->m_header->m_order) || (keys->m_count - first > btree->m_header->m_order))
+            continue;
+
+        right  = total - left - (inner ? ref_length(&keys->m_keys[n]) : 0);
+        larger = group_size(btree, keys, 0, n, left);
+
+        if (larger < group_size(btree, keys, first, keys->m_count, right))
+            larger = group_size(btree, keys, first, keys->m_count, right);
+
+        if (larger < best)
+        {
+            best   = larger;
+            result = n;
+        }
+    }
+
+    return result;
+}
+
+/* rebuild a slotted page from keys [from, to), storing what they share once; an inner
+ * page takes the links on either side of those keys
+ */
+static void fill_page(const itzam_btree * btree, itzam_btree_page * page, const key_sequence * keys, int from, int to, itzam_bool inner)
+{
+    itzam_int prefix = shared_length(btree, keys, from, to);
+    itzam_int length;
+    uint16_t size;
+    int n;
+
+    clear_cells(btree, page);
+
+    if (prefix > 0)
+    {
+        size = (uint16_t)prefix;
+        page->m_slots->m_heap -= (uint16_t)CELL_SIZE(prefix);
+        page->m_slots->m_prefix = page->m_slots->m_heap;
+
+        memcpy(page->m_data + page->m_slots->m_heap, &size, sizeof(uint16_t));
+        copy_ref(page->m_data + page->m_slots->m_heap + sizeof(uint16_t), &keys->m_keys[from], 0, prefix);
+    }
+
+    for (n = from; n < to; ++n)
+    {
+        length = ref_length(&keys->m_keys[n]) - prefix;
+        size = (uint16_t)length;
+        page->m_slots->m_heap -= (uint16_t)CELL_SIZE(length);
+        page->m_offsets[n - from] = page->m_slots->m_heap;
+
+        memcpy(page->m_data + page->m_slots->m_heap, &size, sizeof(uint16_t));
+        copy_ref(page->m_data + page->m_slots->m_heap + sizeof(uint16_t), &keys->m_keys[n], prefix, length);
+    }
+
+    page->m_header->m_key_count = (uint16_t)(to - from);
+
+    if (inner)
+        memcpy(page->m_links, keys->m_links + from, sizeof(itzam_ref) * (to - from + 1));
+
+    for (n = inner ? (to - from + 1) : 0; n < btree->m_links_size; ++n)
+        page->m_links[n] = ITZAM_NULL_REF;
+}
+
+/* the first length bytes of a key, stored in a slab block as they would be in a page;
+ * the key begins sizeof(uint16_t) bytes in
+ */
+static itzam_byte * make_cell(itzam_btree * btree, const key_ref * key, itzam_int length)
+{
+    itzam_byte * result = (itzam_byte *)take_block(btree);
+    uint16_t size = (uint16_t)length;
+
+    if (result != NULL)
+    {
+        memcpy(result, &size, sizeof(uint16_t));
+        copy_ref(result + sizeof(uint16_t), key, 0, length);
+    }
+
+    return result;
+}
+
+/* the length of a key from a leaf, leaving out any value
+ */
+static itzam_int ref_key_length(const itzam_btree * btree, const key_ref * key)
+{
+    itzam_int result = ref_length(key);
+    uint32_t trailer;
+
+    if (btree->m_values)
+    {
+        copy_ref((itzam_byte *)&trailer, key, result - VALUE_TRAILER_SIZE, VALUE_TRAILER_SIZE);
+        result -= VALUE_TRAILER_SIZE + value_space(trailer);
+    }
+
+    return result;
+}
+
+/* the separator between leaves divided before key n; with compressed keys, the shortest
+ * string above the key before it and not above key n, and otherwise key n itself
+ */
+static itzam_byte * separator_cell(itzam_btree * btree, const key_sequence * keys, int n)
+{
+    const key_ref * key = &keys->m_keys[n];
+    itzam_int key_length = ref_key_length(btree, key);
+    itzam_byte * result;
+    itzam_int length;
+
+    if (!btree->m_compress)
+        return make_cell(btree, key, key_length);
+
+    /* one byte past what the keys share, then the terminator
+     */
+    length = common_length(&keys->m_keys[n - 1], key) + 1;
+
+    if (length + 1 >= key_length)
+        return make_cell(btree, key, key_length);
+
+    result = make_cell(btree, key, length + 1);
+
+    if (result != NULL)
+        result[sizeof(uint16_t) + length] = 0;
+
+    return result;
+}
+
+/* promote key by creating new root
+ */
+static void promote_root(itzam_btree * btree,
+                         itzam_byte * key,
+                         itzam_btree_page * page_after)
+{
+    /* create a new root page
+     */
+    itzam_btree_page * new_root   = alloc_page(btree);
+    itzam_btree_page * new_before = dupe_page(btree, &btree->m_root);
+
+    /* add key and links to root
+     */
+    if (btree->m_varkeys)
+        insert_cell(btree, new_root, 0, key, stored_key_size(btree, key));
+    else
+    {
+        memcpy(new_root->m_keys,key,btree->m_header->m_sizeof_key);
+        new_root->m_header->m_key_count = 1;
+    }
+
+    new_root->m_links[0] = new_before->m_header->m_where;
+    new_root->m_links[1] = page_after->m_header->m_where;
+
+    /* write new root to tree, and make it actual root internally
+     */
+    write_page(btree,new_root);
+    set_root(btree,new_root);
+
+    /* update children; without parent links, neither has changed
+     */
+    if (btree->m_parent_links)
+    {
+        new_before->m_header->m_parent = new_root->m_header->m_where;
+        page_after->m_header->m_parent = new_root->m_header->m_where;
+
+        write_page(btree,new_before);
+        write_page(btree,page_after);
+    }
+
+    free_page(btree,new_before);
+    free_page(btree,new_root);
 }
 
 /* promote key into parent
  */
-static void promote_internal(itzam_btree * btree,
-                             itzam_btree_page * page_insert,
-                             itzam_byte * key,
-                             itzam_ref link)
+static void promote_internal(itzam_btree * btree,
+                             itzam_btree_page * page_insert,
+                             itzam_byte * key,
+                             itzam_ref link)
+{
+    itzam_bool found;
+    itzam_ref parent = parent_of(btree, page_insert);
+
+    if (page_insert->m_header->m_key_count == btree->m_header->m_order)
+    {
+        int nt  = 0;
+        int ni  = 0;
+        int insert_index = 0;
+
+        itzam_btree_page * page_sibling;
+
+        /* temporary arrays, sharing one block; the links come first to keep them aligned
+         */
+        itzam_ref * temp_links = (itzam_ref *)take_block(btree);
+        itzam_byte * temp_keys  = (itzam_byte *)(temp_links + btree->m_header->m_order + 2);
+
+        if (temp_links == NULL)
+            btree->m_datafile->m_error_handler("promote_internal", ITZAM_ERROR_MALLOC);
+
+        temp_links[0] = page_insert->m_links[0];
+
+        /* find insertion point
+         */
+        insert_index = search_page(btree, page_insert, key, &found);
+
+        /* store new info
+         */
+        memcpy(temp_keys + insert_index * btree->m_header->m_sizeof_key, key, btree->m_header->m_sizeof_key);
+        temp_links[insert_index + 1] = link;
+
+        /* copy existing keys
+         */
+        while (ni < btree->m_header->m_order)
+        {
+            if (ni == insert_index)
+                ++nt;
+
+            memcpy(temp_keys + nt * btree->m_header->m_sizeof_key, page_insert->m_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+            temp_links[nt + 1] = page_insert->m_links[ni + 1];
+
+            ++ni;
+            ++nt;
+        }
+
+        /* generate a new leaf node
+         */
+        page_sibling = alloc_page(btree);
+        link_parent(btree, page_sibling, parent);
+
+        /* clear key counts
+         */
+        page_insert->m_header->m_key_count = 0;
+        page_sibling->m_header->m_key_count = 0;
+        page_insert->m_links[0] = temp_links[0];
+
+        /* copy keys from temp to pages
+         */
+        for (ni = 0; ni < btree->m_min_keys; ++ni)
+        {
+            memcpy(page_insert->m_keys + ni * btree->m_header->m_sizeof_key, temp_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+            page_insert->m_links[ni + 1] = temp_links[ni + 1];
+            ++page_insert->m_header->m_key_count;
+        }
+
+        page_sibling->m_links[0] = temp_links[btree->m_min_keys + 1];
+
+        for (ni = btree->m_min_keys + 1; ni <= btree->m_header->m_order; ++ni)
+        {
+            memcpy(page_sibling->m_keys + (ni - 1 - btree->m_min_keys) * btree->m_header->m_sizeof_key, temp_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+            page_sibling->m_links[ni - btree->m_min_keys]    = temp_links[ni + 1];
+            ++page_sibling->m_header->m_key_count;
+        }
+
+        /* replace unused entries with null
+         */
+        for (ni = btree->m_min_keys; ni < btree->m_header->m_order; ++ni)
+        {
+            memset(page_insert->m_keys + ni * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+            page_insert->m_links[ni + 1] = ITZAM_NULL_REF;
+        }
+
+        /* write pages
+         */
+        write_page(btree,page_insert);
+        write_page(btree,page_sibling);
+
+        if (parent == ITZAM_NULL_REF)
+            set_root(btree,page_insert);
+
+        /* update parent links in child nodes
+         */
+        for (ni = 0; ni <= page_sibling->m_header->m_key_count; ++ni)
+            relink_child(btree, page_sibling->m_links[ni], page_sibling->m_header->m_where, "promote_internal");
+
+        /* promote key and pointer
+         */
+        if (parent == ITZAM_NULL_REF)
+        {
+            /* create a new root
+             */
+            promote_root(btree,
+                         temp_keys + btree->m_min_keys * btree->m_header->m_sizeof_key,
+                         page_sibling);
+        }
+        else
+        {
+            /* read parent and promote key
+             */
+            itzam_btree_page * parent_page = read_page(btree,parent);
+
+            promote_internal(btree,
+                             parent_page,
+                             temp_keys + btree->m_min_keys * btree->m_header->m_sizeof_key,
+                             page_sibling->m_header->m_where);
+
+            free_page(btree,parent_page);
+        }
+
+        /* release resources
+         */
+        free_page(btree,page_sibling);
+        give_block(btree, temp_links);
+    }
+    else
+    {
+        int n, insert_index = 0;
+
+        /* find insertion point
+         */
+        insert_index = search_page(btree, page_insert, key, &found);
+
+        /* shift keys right
+         */
+        for (n = page_insert->m_header->m_key_count; n > insert_index; --n)
+        {
+            memcpy(page_insert->m_keys + n * btree->m_header->m_sizeof_key, page_insert->m_keys + (n - 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+            page_insert->m_links[n + 1] = page_insert->m_links[n];
+        }
+
+        memcpy(page_insert->m_keys + insert_index * btree->m_header->m_sizeof_key, key, btree->m_header->m_sizeof_key);
+        page_insert->m_links[insert_index + 1] = link;
+
+        ++page_insert->m_header->m_key_count;
+
+        /* write updated page
+         */
+        write_page(btree,page_insert);
+
+        if (parent == ITZAM_NULL_REF)
+            set_root(btree, page_insert);
+    }
+}
+
+/* with linked leaves, a full leaf splits in two, and a copy of the first key in the new
+ * right-hand leaf becomes the separator in the parent
+ */
+static void split_leaf(itzam_btree * btree,
+                       search_result * insert_info,
+                       const itzam_byte * key)
+{
+    const uint32_t sizeof_key = btree->m_header->m_sizeof_key;
+    const int order = btree->m_header->m_order;
+    const int left_count = (order + 1) / 2;
+    itzam_btree_page * page = insert_info->m_page;
+    itzam_btree_page * page_sibling;
+    itzam_btree_page * page_other;
+    itzam_byte * temp_keys = (itzam_byte *)take_block(btree);
+
+    if (temp_keys == NULL)
+    {
+        btree->m_datafile->m_error_handler("split_leaf", ITZAM_ERROR_MALLOC);
+        return;
+    }
+
+    /* the full set of keys, in order
+     */
+    memcpy(temp_keys, page->m_keys, insert_info->m_index * sizeof_key);
+    memcpy(temp_keys + insert_info->m_index * sizeof_key, key, sizeof_key);
+    memcpy(temp_keys + (insert_info->m_index + 1) * sizeof_key, page->m_keys + insert_info->m_index * sizeof_key, (order - insert_info->m_index) * sizeof_key);
+
+    /* divide them between the two leaves
+     */
+    page_sibling = alloc_page(btree);
+    link_parent(btree, page_sibling, parent_of(btree, page));
+
+    memcpy(page->m_keys, temp_keys, left_count * sizeof_key);
+    memset(page->m_keys + left_count * sizeof_key, 0, (order - left_count) * sizeof_key);
+    page->m_header->m_key_count = left_count;
+
+    memcpy(page_sibling->m_keys, temp_keys + left_count * sizeof_key, (order + 1 - left_count) * sizeof_key);
+    page_sibling->m_header->m_key_count = order + 1 - left_count;
+
+    /* chain the new leaf in after the old one
+     */
+    page_sibling->m_siblings[PREV_LEAF] = page->m_header->m_where;
+    page_sibling->m_siblings[NEXT_LEAF] = page->m_siblings[NEXT_LEAF];
+    write_page(btree,page_sibling);
+
+    if (page->m_siblings[NEXT_LEAF] != ITZAM_NULL_REF)
+    {
+        page_other = read_page(btree,page->m_siblings[NEXT_LEAF]);
+
+        if (page_other != NULL)
+        {
+            page_other->m_siblings[PREV_LEAF] = page_sibling->m_header->m_where;
+            write_page(btree,page_other);
+            free_page(btree,page_other);
+        }
+        else
+            btree->m_datafile->m_error_handler("split_leaf",ITZAM_ERROR_PAGE_NOT_FOUND);
+    }
+
+    page->m_siblings[NEXT_LEAF] = page_sibling->m_header->m_where;
+    write_page(btree,page);
+
+    /* promote the separator
+     */
+    if (parent_of(btree, page) == ITZAM_NULL_REF)
+        promote_root(btree, page_sibling->m_keys, page_sibling);
+    else
+    {
+        page_other = read_page(btree,parent_of(btree, page));
+        promote_internal(btree, page_other, page_sibling->m_keys, page_sibling->m_header->m_where);
+        free_page(btree,page_other);
+    }
+
+    free_page(btree,page_sibling);
+    give_block(btree, temp_keys);
+}
+
+/* does a key begin with the prefix of a slotted page?
+ */
+static itzam_bool shares_prefix(const itzam_btree * btree, const itzam_btree_page * page, const itzam_byte * key)
+{
+    itzam_int prefix = prefix_length(btree, page);
+
+    return (prefix == 0) || (strncmp((const char *)key, (const char *)prefix_of(page), prefix) == 0);
+}
+
+static void add_separator(itzam_btree * btree, itzam_btree_page * page, int index, const itzam_byte * key, itzam_ref link);
+
+/* rebuild a slotted page from a sequence of keys, splitting it if they do not fit; the
+ * separator of a split goes up to the parent, or to a new root. Trees with variable-length
+ * keys never keep parent links, so children are not told of their new parents
+ */
+static void store_keys(itzam_btree * btree, itzam_btree_page * page, const key_sequence * keys, itzam_bool inner)
+{
+    itzam_ref parent = parent_of(btree, page);
+    itzam_btree_page * image = dupe_page(btree, page);
+    itzam_btree_page * page_sibling = NULL;
+    itzam_btree_page * page_other;
+    itzam_byte * separator = NULL;
+    itzam_bool found;
+    int split;
+
+    if ((image != NULL) && group_fits(btree, keys, 0, keys->m_count, sequence_length(keys)))
+    {
+        fill_page(btree, image, keys, 0, keys->m_count, inner);
+        memcpy(page->m_data, image->m_data, btree->m_header->m_sizeof_page);
+        write_page(btree,page);
+
+        if (parent == ITZAM_NULL_REF)
+            set_root(btree,page);
+
+        free_page(btree,image);
+        return;
+    }
+
+    split = best_split(btree, keys, inner);
+
+    if (image != NULL)
+        page_sibling = alloc_page(btree);
+
+    /* the separator is copied out before the keys it came from are overwritten
+     */
+    if (page_sibling != NULL)
+        separator = inner ? make_cell(btree, &keys->m_keys[split], ref_length(&keys->m_keys[split])) : separator_cell(btree, keys, split);
+
+    if (separator == NULL)
+    {
+        btree->m_datafile->m_error_handler("store_keys", ITZAM_ERROR_MALLOC);
+        free_page(btree, image);
+        free_page(btree, page_sibling);
+        return;
+    }
+
+    fill_page(btree, image, keys, 0, split, inner);
+    fill_page(btree, page_sibling, keys, inner ? split + 1 : split, keys->m_count, inner);
+    memcpy(page->m_data, image->m_data, btree->m_header->m_sizeof_page);
+
+    /* chain a new leaf in after the old one
+     */
+    if (!inner)
+    {
+        page_sibling->m_siblings[PREV_LEAF] = page->m_header->m_where;
+        page_sibling->m_siblings[NEXT_LEAF] = page->m_siblings[NEXT_LEAF];
+    }
+
+    write_page(btree,page_sibling);
+
+    if (!inner)
+    {
+        if (page->m_siblings[NEXT_LEAF] != ITZAM_NULL_REF)
+        {
+            page_other = read_page(btree,page->m_siblings[NEXT_LEAF]);
+
+            if (page_other != NULL)
+            {
+                page_other->m_siblings[PREV_LEAF] = page_sibling->m_header->m_where;
+                write_page(btree,page_other);
+                free_page(btree,page_other);
+            }
+            else
+                btree->m_datafile->m_error_handler("store_keys",ITZAM_ERROR_PAGE_NOT_FOUND);
+        }
+
+        page->m_siblings[NEXT_LEAF] = page_sibling->m_header->m_where;
+    }
+
+    write_page(btree,page);
+
+    if (parent == ITZAM_NULL_REF)
+    {
+        set_root(btree,page);
+        promote_root(btree, separator + sizeof(uint16_t), page_sibling);
+    }
+    else
+    {
+        page_other = read_page(btree,parent);
+
+        if (page_other != NULL)
+        {
+            add_separator(btree, page_other, search_page(btree, page_other, separator + sizeof(uint16_t), &found),
+                          separator + sizeof(uint16_t), page_sibling->m_header->m_where);
+            free_page(btree,page_other);
+        }
+        else
+            btree->m_datafile->m_error_handler("store_keys",ITZAM_ERROR_PAGE_NOT_FOUND);
+    }
+
+    give_block(btree, separator);
+    free_page(btree,page_sibling);
+    free_page(btree,image);
+}
+
+/* put a separator into an inner page at index, with link to its right unless that is
+ * ITZAM_NULL_REF (when the separator replaces one the caller has removed)
+ */
+static void add_separator(itzam_btree * btree, itzam_btree_page * page, int index, const itzam_byte * key, itzam_ref link)
+{
+    itzam_int length = stored_key_size(btree, key);
+    itzam_int prefix = prefix_length(btree, page);
+    int count = page->m_header->m_key_count;
+    key_sequence keys;
+    int n, m;
+
+    if (shares_prefix(btree, page, key) && cell_fits(btree, page, length - prefix))
+    {
+        if (link != ITZAM_NULL_REF)
+        {
+            memmove(page->m_links + index + 2, page->m_links + index + 1, sizeof(itzam_ref) * (count - index));
+            page->m_links[index + 1] = link;
+        }
+
+        insert_cell(btree, page, index, key + prefix, length - prefix);
+        write_page(btree,page);
+
+        if (parent_of(btree, page) == ITZAM_NULL_REF)
+            set_root(btree,page);
+    }
+    else if (start_sequence(btree, &keys))
+    {
+        append_keys(btree, &keys, page, 0, index);
+        append_key(&keys, NULL, 0, key, length);
+        append_keys(btree, &keys, page, index, count);
+
+        /* the links, with the new one after the new key
+         */
+        for (n = 0, m = 0; n <= keys.m_count; ++n)
+            keys.m_links[n] = ((link != ITZAM_NULL_REF) && (n == index + 1)) ? link : page->m_links[m++];
+
+        store_keys(btree, page, &keys, itzam_true);
+        end_sequence(btree, &keys);
+    }
+}
+
+/* store a key, and any value after it, in the leaf search found for it
+ */
+static void insert_var(itzam_btree * btree, search_result * insert_info, const itzam_byte * key, itzam_int length)
+{
+    itzam_btree_page * page = insert_info->m_page;
+    itzam_int prefix = prefix_length(btree, page);
+    key_sequence keys;
+
+    if (shares_prefix(btree, page, key) && cell_fits(btree, page, length - prefix))
+    {
+        insert_cell(btree, page, insert_info->m_index, key + prefix, length - prefix);
+        write_page(btree,page);
+    }
+    else if (start_sequence(btree, &keys))
+    {
+        append_keys(btree, &keys, page, 0, insert_info->m_index);
+        append_key(&keys, NULL, 0, key, length);
+        append_keys(btree, &keys, page, insert_info->m_index, page->m_header->m_key_count);
+
+        store_keys(btree, page, &keys, itzam_false);
+        end_sequence(btree, &keys);
+    }
+}
+
+static void write_key(itzam_btree * btree,
+                      search_result * insert_info,
+                      const itzam_byte * key)
+{
+    itzam_btree_page * page_sibling;
+    itzam_btree_page * page_parent;
+
+    /* check to see if page is full
+     */
+    if (btree->m_varkeys)
+        insert_var(btree,insert_info,key,btree->m_key_size(key));
+    else if ((insert_info->m_page->m_header->m_key_count == btree->m_header->m_order) && btree->m_linked_leaves)
+        split_leaf(btree,insert_info,key);
+    else if (insert_info->m_page->m_header->m_key_count == btree->m_header->m_order)
+    {
+        int nt, ni;
+
+        /* temporary array to store new items
+         */
+        itzam_byte * temp_keys = (itzam_byte *)take_block(btree);
+
+        if (temp_keys == NULL)
+        {
+            btree->m_datafile->m_error_handler("write_key", ITZAM_ERROR_MALLOC);
+            return;
+        }
+
+        memcpy(temp_keys + insert_info->m_index * btree->m_header->m_sizeof_key, key, btree->m_header->m_sizeof_key);
+
+        /* copy entries from insertion page to temps
+         */
+        nt = 0;
+        ni = 0;
+
+        while (ni < btree->m_header->m_order)
+        {
+            /* skip over inserted data
+             */
+            if (ni == insert_info->m_index)
+                ++nt;
+
+            /* copy data
+             */
+            memcpy(temp_keys + nt * btree->m_header->m_sizeof_key, insert_info->m_page->m_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+            /* next one
+             */
+            ++ni;
+            ++nt;
+        }
+
+        /* create a new leaf
+         */
+        page_sibling = alloc_page(btree);
+        link_parent(btree, page_sibling, parent_of(btree, insert_info->m_page));
+
+        /* clear key counts
+         */
+        insert_info->m_page->m_header->m_key_count = 0;
+        page_sibling->m_header->m_key_count        = 0;
+
+        /* copy keys from temp to pages
+         */
+        for (ni = 0; ni < btree->m_min_keys; ++ni)
+        {
+            memcpy(insert_info->m_page->m_keys + ni * btree->m_header->m_sizeof_key, temp_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+            ++insert_info->m_page->m_header->m_key_count;
+        }
+
+        for (ni = btree->m_min_keys + 1; ni <= btree->m_header->m_order; ++ni)
+        {
+            memcpy(page_sibling->m_keys + (ni - 1 - btree->m_min_keys) * btree->m_header->m_sizeof_key, temp_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+            ++page_sibling->m_header->m_key_count;
+        }
+
+        /* replace remaining entries with null
+         */
+        for (ni = btree->m_min_keys; ni < btree->m_header->m_order; ++ni)
+            memset(insert_info->m_page->m_keys + ni * btree->m_header->m_sizeof_key,0,btree->m_header->m_sizeof_key);
+
+        /* write pages
+         */
+        write_page(btree,insert_info->m_page);
+        write_page(btree,page_sibling);
+
+        /* promote key and its pointer
+         */
+        if (parent_of(btree, insert_info->m_page) == ITZAM_NULL_REF)
+        {
+            /* creating a new root page
+             */
+            promote_root(btree,
+                         temp_keys + btree->m_min_keys * btree->m_header->m_sizeof_key,
+                         page_sibling);
+        }
+        else
+        {
+            /* read parent
+             */
+            page_parent = read_page(btree,parent_of(btree, insert_info->m_page));
+
+            /* promote key into parent page
+             */
+            promote_internal(btree,
+                             page_parent,
+                             temp_keys + btree->m_min_keys * btree->m_header->m_sizeof_key,
+                             page_sibling->m_header->m_where);
+
+            free_page(btree,page_parent);
+        }
+
+        /* release sibling page
+         */
+        free_page(btree,page_sibling);
+
+        give_block(btree, temp_keys);
+    }
+    else
+    {
+        int n;
+
+        /* move keys to make room for new one
+         */
+        for (n = insert_info->m_page->m_header->m_key_count; n > insert_info->m_index; --n)
+            memcpy(insert_info->m_page->m_keys + n * btree->m_header->m_sizeof_key, insert_info->m_page->m_keys + (n - 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+        memcpy(insert_info->m_page->m_keys + insert_info->m_index * btree->m_header->m_sizeof_key, key, btree->m_header->m_sizeof_key);
+
+        ++insert_info->m_page->m_header->m_key_count;
+
+        /* write updated page
+         */
+        write_page(btree,insert_info->m_page);
+    }
+}
+
+itzam_state itzam_btree_insert(itzam_btree * btree,
+                               const void * key)
+{
+    itzam_state result = ITZAM_FAILED;
+    search_result insert_info;
+
+    if ((btree != NULL) && (key != NULL))
+    {
+        itzam_datafile_write_lock(btree->m_datafile);
+
+        if (!btree->m_datafile->m_read_only)
+        {
+            itzam_cache_sync(&btree->m_cache);
+            begin_versions(btree);
+
+            search(btree,key,&insert_info,itzam_true);
+
+            if (input_key_size(btree, key) > btree->m_header->m_sizeof_key)
+            {
+                btree->m_datafile->m_error_handler("itzam_btree_insert",ITZAM_ERROR_TOO_LONG);
+                result = ITZAM_FAILED;
+            }
+            else if (btree->m_values)
+            {
+                btree->m_datafile->m_error_handler("itzam_btree_insert",ITZAM_ERROR_VALUES);
+                result = ITZAM_FAILED;
+            }
+            else if (!insert_info.m_found)
+            {
+                write_key(btree,&insert_info,(const itzam_byte *)key);
+                ++btree->m_header->m_count;
+                ++btree->m_header->m_ticker;
+
+                result = update_header(btree);
+            }
+            else
+            {
+                result = ITZAM_DUPLICATE;
+            }
+
+            free_page(btree,insert_info.m_page);
+
+            if (ITZAM_OKAY != itzam_cache_flush(&btree->m_cache))
+                result = ITZAM_FAILED;
+
+            end_versions(btree);
+        }
+        else
+            result = ITZAM_READ_ONLY;
+
+        itzam_datafile_write_unlock(btree->m_datafile);
+    }
+
+    //return result;
+    return result;
+}
+
+static void redistribute(itzam_btree * btree,
+                         int index,
+                         itzam_btree_page * page_before,
+                         itzam_btree_page * page_parent,
+                         itzam_btree_page * page_after)
+{
+    if ((btree != NULL) && (page_before != NULL) && (page_parent != NULL) && (page_after != NULL))
+    {
+       /* check for leaf page
+       */
+        if ((page_before->m_links[0] == ITZAM_NULL_REF) && btree->m_linked_leaves)
+        {
+            const uint32_t sizeof_key = btree->m_header->m_sizeof_key;
+
+            /* linked leaves hold every key, so a key moves directly between them, and the
+             * separator becomes a copy of the first key on the right
+             */
+            if (page_before->m_header->m_key_count > page_after->m_header->m_key_count)
+            {
+                memmove(page_after->m_keys + sizeof_key, page_after->m_keys, page_after->m_header->m_key_count * sizeof_key);
+                --page_before->m_header->m_key_count;
+                memcpy(page_after->m_keys, page_before->m_keys + page_before->m_header->m_key_count * sizeof_key, sizeof_key);
+                memset(page_before->m_keys + page_before->m_header->m_key_count * sizeof_key, 0, sizeof_key);
+                ++page_after->m_header->m_key_count;
+            }
+            else
+            {
+                memcpy(page_before->m_keys + page_before->m_header->m_key_count * sizeof_key, page_after->m_keys, sizeof_key);
+                ++page_before->m_header->m_key_count;
+                --page_after->m_header->m_key_count;
+                memmove(page_after->m_keys, page_after->m_keys + sizeof_key, page_after->m_header->m_key_count * sizeof_key);
+                memset(page_after->m_keys + page_after->m_header->m_key_count * sizeof_key, 0, sizeof_key);
+            }
+
+            memcpy(page_parent->m_keys + index * sizeof_key, page_after->m_keys, sizeof_key);
+        }
+        else if (page_before->m_links[0] == ITZAM_NULL_REF)
+        {
+            if (page_before->m_header->m_key_count > page_after->m_header->m_key_count)
+            {
+                int n;
+
+                /* move a key from page_before to page_after
+                 */
+                for (n = page_after->m_header->m_key_count; n > 0; --n)
+                    memcpy(page_after->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + (n - 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+                /* store parent separator in page_after
+                 */
+                memcpy(page_after->m_keys, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+                /* increment page_after key count
+                 */
+                ++page_after->m_header->m_key_count;
+
+                /* decrement page_before key count
+                 */
+                --page_before->m_header->m_key_count;
+
+                /* move last key in page_before to page_parent as separator
+                 */
+                memcpy(page_parent->m_keys + index * btree->m_header->m_sizeof_key, page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+                /* clear last key in page_before
+                 */
+                memset(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+            }
+            else
+            {
+                int n;
+
+                /* add parent key to lesser page
+                 */
+                memcpy(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+                /* increment page_before key count
+                 */
+                ++page_before->m_header->m_key_count;
+
+                /* move first key in page_after to page_parent as separator
+                 */
+                memcpy(page_parent->m_keys + index * btree->m_header->m_sizeof_key, page_after->m_keys, btree->m_header->m_sizeof_key);
+
+                /* decrement page_after key count
+                 */
+                --page_after->m_header->m_key_count;
+
+                /* move a key from page_after to page_before
+                 */
+                for (n = 0; n < page_after->m_header->m_key_count; ++n)
+                    memcpy(page_after->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+                /* clear last key in page_after
+                 */
+                memset(page_after->m_keys + n * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+            }
+        }
+        else
+        {
+            if (page_before->m_header->m_key_count > page_after->m_header->m_key_count)
+            {
+                int n;
+
+                /* move a key from page_before to page_after
+                 */
+                for (n = page_after->m_header->m_key_count; n > 0; --n)
+                {
+                    memcpy(page_after->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + (n - 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+                    page_after->m_links[n + 1] = page_after->m_links[n];
+                }
+
+                page_after->m_links[1] = page_after->m_links[0];
+
+                /* store page_parent separator key in page_after
+                 */
+                memcpy(page_after->m_keys, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+                page_after->m_links[0] = page_before->m_links[page_before->m_header->m_key_count];
+
+                /* update child link
+                 */
+                relink_child(btree, page_after->m_links[0], page_after->m_header->m_where, "redistribute");
+
+                /* increment page_after key count
+                 */
+                ++page_after->m_header->m_key_count;
+
+                /* decrement page_before key count
+                 */
+                --page_before->m_header->m_key_count;
+
+                /* move last key in page_before to page_parent as separator
+                 */
+                memcpy(page_parent->m_keys + index * btree->m_header->m_sizeof_key, page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+                /* clear last key in page_before
+                 */
+                memset(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+                page_before->m_links[page_before->m_header->m_key_count + 1] = ITZAM_NULL_REF;
+            }
+            else
+            {
+                int n;
+
+                /* store page_parent separator key in page_before
+                 */
+                memcpy(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+                page_before->m_links[page_before->m_header->m_key_count + 1] = page_after->m_links[0];
+
+                /* update child link
+                 */
+                relink_child(btree, page_after->m_links[0], page_before->m_header->m_where, "redistribute");
+
+                /* increment page_before key count
+                 */
+                ++page_before->m_header->m_key_count;
+
+                /* move last key in page_after to page_parent as separator
+                 */
+                memcpy(page_parent->m_keys + index * btree->m_header->m_sizeof_key, page_after->m_keys, btree->m_header->m_sizeof_key);
+
+                /* decrement page_after key count
+                 */
+                --page_after->m_header->m_key_count;
+
+                /* move a key from page_after to page_before
+                 */
+                for (n = 0; n < page_after->m_header->m_key_count; ++n)
+                {
+                    memcpy(page_after->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+                    page_after->m_links[n] = page_after->m_links[n + 1];
+                }
+
+                page_after->m_links[n] = page_after->m_links[n + 1];
+
+                /* clear last key in page_after
+                 */
+                memset(page_after->m_keys + n * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+                page_after->m_links[n + 1] = ITZAM_NULL_REF;
+            }
+        }
+
+        /* write updated pages
+         */
+        write_page(btree,page_before);
+        write_page(btree,page_after);
+        write_page(btree,page_parent);
+
+        if (parent_of(btree, page_parent) == ITZAM_NULL_REF)
+            set_root(btree, page_parent);
+    }
+}
+
+static void adjust_tree(itzam_btree * btree, itzam_btree_page * page);
+
+static void concatenate(itzam_btree * btree, int index, itzam_btree_page * page_before, itzam_btree_page * page_parent, itzam_btree_page * page_after)
+{
+    int n, n2;
+
+    /* a separator above linked leaves is only a copy, and is dropped
+     */
+    if ((page_before->m_links[0] != ITZAM_NULL_REF) || !btree->m_linked_leaves)
+    {
+        /* move separator key from page_parent into page_before
+         */
+        memcpy(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+        page_before->m_links[page_before->m_header->m_key_count + 1] = page_after->m_links[0];
+
+        /* increment page_before key count
+         */
+        ++page_before->m_header->m_key_count;
+    }
+
+    /* delete separator from page_parent
+     */
+    --page_parent->m_header->m_key_count;
+
+    for (n = index; n < page_parent->m_header->m_key_count; ++n)
+    {
+        memcpy(page_parent->m_keys + n * btree->m_header->m_sizeof_key, page_parent->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+        page_parent->m_links[n + 1] = page_parent->m_links[n + 2];
+    }
+
+    /* clear unused key from parent
+     */
+    memset(page_parent->m_keys + n * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+    page_parent->m_links[n + 1] = ITZAM_NULL_REF;
+
+    /* copy keys from page_after to page_before
+     */
+    n2 = 0;
+    n = page_before->m_header->m_key_count;
+
+    /* combine pages
+     */
+    while (n2 < page_after->m_header->m_key_count)
+    {
+        ++page_before->m_header->m_key_count;
+        memcpy(page_before->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + n2 * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+        page_before->m_links[n + 1] = page_after->m_links[n2 + 1];
+        ++n2;
+        ++n;
+    }
+
+    /* unchain page_after from the leaves
+     */
+    if ((page_before->m_links[0] == ITZAM_NULL_REF) && btree->m_linked_leaves)
+    {
+        page_before->m_siblings[NEXT_LEAF] = page_after->m_siblings[NEXT_LEAF];
+
+        if (page_after->m_siblings[NEXT_LEAF] != ITZAM_NULL_REF)
+        {
+            itzam_btree_page * page_next = read_page(btree,page_after->m_siblings[NEXT_LEAF]);
+
+            if (page_next != NULL)
+            {
+                page_next->m_siblings[PREV_LEAF] = page_before->m_header->m_where;
+                write_page(btree,page_next);
+                free_page(btree,page_next);
+            }
+            else
+                btree->m_datafile->m_error_handler("concatenate",ITZAM_ERROR_PAGE_NOT_FOUND);
+        }
+    }
+
+    /* delete page_after
+     */
+    remove_page(btree,page_after);
+
+    /* is this an inner page?
+     */
+    if (page_before->m_links[0] != ITZAM_NULL_REF)
+    {
+        /* adjust child pointers
+         */
+        for (n = 0; n <= page_before->m_header->m_key_count; ++n)
+            relink_child(btree, page_before->m_links[n], page_before->m_header->m_where, "concatenate");
+    }
+
+    /* write page_before and parent
+     */
+    if (page_parent->m_header->m_key_count == 0)
+    {
+        /* update before page with old parent's parent
+         */
+        link_parent(btree, page_before, parent_of(btree, page_parent));
+        write_page(btree,page_before);
+
+        if (parent_of(btree, page_parent) == ITZAM_NULL_REF)
+        {
+            /* update the header if this is the new root
+             */
+            set_root(btree,page_before);
+        }
+        else
+        {
+            /* read parents's parent
+             */
+            itzam_btree_page * parents_parent = read_page(btree,parent_of(btree, page_parent));
+
+            /* find parent reference and replace with before page
+             */
+            if (parents_parent != NULL)
+            {
+                for (n = 0; n < btree->m_links_size; ++n)
+                {
+                    if (parents_parent->m_links[n] == page_parent->m_header->m_where)
+                    {
+                        parents_parent->m_links[n] = page_before->m_header->m_where;
+                        write_page(btree,parents_parent);
+                    }
+                }
+
+                free_page(btree,parents_parent);
+            }
+        }
+
+        /* remove empty parent page
+         */
+        remove_page(btree,page_parent);
+    }
+    else
+    {
+        /* write pages
+         */
+        write_page(btree,page_parent);
+        write_page(btree,page_before);
+
+        /* reset root page if needed
+         */
+        if (parent_of(btree, page_parent) == ITZAM_NULL_REF)
+            set_root(btree,page_parent);
+
+        /* if parent is too small, adjust
+         */
+        if (page_parent->m_header->m_key_count < btree->m_min_keys)
+            adjust_tree(btree,page_parent);
+    }
+}
+
+static void adjust_tree(itzam_btree * btree, itzam_btree_page * page)
+{
+    if ((btree != NULL) && (page != NULL) && (parent_of(btree, page) != ITZAM_NULL_REF))
+    {
+        /* get parent page
+         */
+        itzam_btree_page * page_parent = read_page(btree,parent_of(btree, page));
+
+        if (page_parent != NULL)
+        {
+            itzam_btree_page * page_sibling_after  = NULL;
+            itzam_btree_page * page_sibling_before = NULL;
+
+            /* find pointer to page
+             */
+            int n = 0;
+
+            while (page_parent->m_links[n] != page->m_header->m_where)
+                ++n;
+
+            /* read sibling pages
+             */
+            if (n < page_parent->m_header->m_key_count)
+                page_sibling_after = read_page(btree,page_parent->m_links[n+1]);
+
+            if (n > 0)
+                page_sibling_before = read_page(btree,page_parent->m_links[n-1]);
+
+            /* figure out what to do
+             */
+            if (page_sibling_before != NULL)
+            {
+                --n;
+
+                if (page_sibling_before->m_header->m_key_count > btree->m_min_keys)
+                    redistribute(btree,n,page_sibling_before,page_parent,page);
+                else
+                    concatenate(btree,n,page_sibling_before,page_parent,page);
+            }
+            else
+            {
+                if (page_sibling_after != NULL)
+                {
+                    if (page_sibling_after->m_header->m_key_count > btree->m_min_keys)
+                        redistribute(btree,n,page,page_parent,page_sibling_after);
+                    else
+                        concatenate(btree,n,page,page_parent,page_sibling_after);
+                }
+            }
+
+            if (page_sibling_before != NULL)
+                free_page(btree,page_sibling_before);
+
+            if (page_sibling_after != NULL)
+                free_page(btree,page_sibling_after);
+
+            free_page(btree,page_parent);
+        }
+    }
+}
+
+/* removal from slotted pages; a page that falls below a quarter full is merged with its
+ * neighbour when the two fit in one page, and otherwise the keys of both are divided
+ * between them again. Keys pass through the parent between inner pages
+ */
+static void adjust_var(itzam_btree * btree, itzam_btree_page * page);
+
+static void merge_var(itzam_btree * btree, int index, const key_sequence * keys, itzam_btree_page * page_before, itzam_btree_page * page_parent, itzam_btree_page * page_after)
+{
+    itzam_btree_page * image = dupe_page(btree, page_before);
+    itzam_btree_page * page_next;
+
+    if (image == NULL)
+    {
+        btree->m_datafile->m_error_handler("merge_var", ITZAM_ERROR_MALLOC);
+        return;
+    }
+
+    fill_page(btree, image, keys, 0, keys->m_count, page_before->m_links[0] != ITZAM_NULL_REF);
+    memcpy(page_before->m_data, image->m_data, btree->m_header->m_sizeof_page);
+    free_page(btree,image);
+
+    /* unchain page_after from the leaves
+     */
+    if (page_before->m_links[0] == ITZAM_NULL_REF)
+    {
+        page_before->m_siblings[NEXT_LEAF] = page_after->m_siblings[NEXT_LEAF];
+
+        if (page_after->m_siblings[NEXT_LEAF] != ITZAM_NULL_REF)
+        {
+            page_next = read_page(btree,page_after->m_siblings[NEXT_LEAF]);
+
+            if (page_next != NULL)
+            {
+                page_next->m_siblings[PREV_LEAF] = page_before->m_header->m_where;
+                write_page(btree,page_next);
+                free_page(btree,page_next);
+            }
+            else
+                btree->m_datafile->m_error_handler("merge_var",ITZAM_ERROR_PAGE_NOT_FOUND);
+        }
+    }
+
+    remove_page(btree,page_after);
+
+    /* delete separator from page_parent
+     */
+    delete_cell(btree, page_parent, index);
+
+    memmove(page_parent->m_links + index + 1, page_parent->m_links + index + 2, sizeof(itzam_ref) * (page_parent->m_header->m_key_count - index));
+    page_parent->m_links[page_parent->m_header->m_key_count + 1] = ITZAM_NULL_REF;
+
+    if ((page_parent->m_header->m_key_count == 0) && (parent_of(btree, page_parent) == ITZAM_NULL_REF))
+    {
+        /* the root has gone, and page_before takes its place
+         */
+        write_page(btree,page_before);
+        set_root(btree,page_before);
+        remove_page(btree,page_parent);
+    }
+    else
+    {
+        write_page(btree,page_parent);
+        write_page(btree,page_before);
+
+        if (parent_of(btree, page_parent) == ITZAM_NULL_REF)
+            set_root(btree,page_parent);
+
+        /* an inner page may be left with no keys, for as long as it takes to fix it
+         */
+        if (underfull(btree, page_parent))
+            adjust_var(btree,page_parent);
+    }
+}
+
+/* divide the keys of two neighbours at split, and give the parent the separator between them
+ */
+static void rotate_var(itzam_btree * btree, int index, const key_sequence * keys, int split, itzam_btree_page * page_before, itzam_btree_page * page_parent, itzam_btree_page * page_after)
+{
+    itzam_bool inner = (page_before->m_links[0] != ITZAM_NULL_REF);
+    itzam_btree_page * image_before = dupe_page(btree, page_before);
+    itzam_btree_page * image_after = dupe_page(btree, page_after);
+    itzam_byte * separator = NULL;
+
+    if ((image_before != NULL) && (image_after != NULL))
+        separator = inner ? make_cell(btree, &keys->m_keys[split], ref_length(&keys->m_keys[split])) : separator_cell(btree, keys, split);
+
+    if (separator == NULL)
+    {
+        btree->m_datafile->m_error_handler("rotate_var", ITZAM_ERROR_MALLOC);
+        free_page(btree, image_before);
+        free_page(btree, image_after);
+        return;
+    }
+
+    /* both pages are built before either changes, since the keys come from both
+     */
+    fill_page(btree, image_before, keys, 0, split, inner);
+    fill_page(btree, image_after, keys, inner ? split + 1 : split, keys->m_count, inner);
+
+    memcpy(page_before->m_data, image_before->m_data, btree->m_header->m_sizeof_page);
+    memcpy(page_after->m_data, image_after->m_data, btree->m_header->m_sizeof_page);
+
+    write_page(btree,page_before);
+    write_page(btree,page_after);
+
+    /* a longer separator can split the parent
+     */
+    delete_cell(btree, page_parent, index);
+    add_separator(btree, page_parent, index, separator + sizeof(uint16_t), ITZAM_NULL_REF);
+
+    give_block(btree, separator);
+    free_page(btree,image_before);
+    free_page(btree,image_after);
+}
+
+static void adjust_var(itzam_btree * btree, itzam_btree_page * page)
+{
+    itzam_btree_page * page_parent;
+    itzam_btree_page * page_sibling;
+    itzam_btree_page * page_before;
+    itzam_btree_page * page_after;
+    key_sequence keys;
+    itzam_bool inner;
+    int count;
+    int split;
+    int n = 0;
+
+    if (parent_of(btree, page) == ITZAM_NULL_REF)
+        return;
+
+    page_parent = read_page(btree,parent_of(btree, page));
+
+    if (page_parent == NULL)
+    {
+        btree->m_datafile->m_error_handler("adjust_var",ITZAM_ERROR_PAGE_NOT_FOUND);
+        return;
+    }
+
+    while (page_parent->m_links[n] != page->m_header->m_where)
+        ++n;
+
+    /* prefer the neighbour before
+     */
+    if (n > 0)
+        page_sibling = read_page(btree,page_parent->m_links[--n]);
+    else if (page_parent->m_header->m_key_count > 0)
+        page_sibling = read_page(btree,page_parent->m_links[1]);
+    else
+        page_sibling = NULL;
+
+    if ((page_sibling != NULL) && start_sequence(btree, &keys))
+    {
+        page_before = (page_parent->m_links[n] == page->m_header->m_where) ? page : page_sibling;
+        page_after  = (page_before == page) ? page_sibling : page;
+
+        inner = (page_before->m_links[0] != ITZAM_NULL_REF);
+        count = page_before->m_header->m_key_count;
+
+        /* the separator of inner pages comes down between their keys
+         */
+        append_keys(btree, &keys, page_before, 0, count);
+
+        if (inner)
+        {
+            append_keys(btree, &keys, page_parent, n, n + 1);
+            memcpy(keys.m_links, page_before->m_links, sizeof(itzam_ref) * (count + 1));
+            memcpy(keys.m_links + count + 1, page_after->m_links, sizeof(itzam_ref) * (page_after->m_header->m_key_count + 1));
+        }
+
+        append_keys(btree, &keys, page_after, 0, page_after->m_header->m_key_count);
+
+        if (group_fits(btree, &keys, 0, keys.m_count, sequence_length(&keys)))
+            merge_var(btree, n, &keys, page_before, page_parent, page_after);
+        else
+        {
+            split = best_split(btree, &keys, inner);
+
+            if (split != count)
+                rotate_var(btree, n, &keys, split, page_before, page_parent, page_after);
+        }
+
+        end_sequence(btree, &keys);
+    }
+
+    free_page(btree,page_sibling);
+    free_page(btree,page_parent);
+}
+
+/* removes a key that search has found
+ */
+static itzam_state remove_found(itzam_btree * btree, search_result * remove_info)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    /* slotted pages are always leaves here, since their separators are only copies
+    */
+    if (btree->m_varkeys)
+    {
+        delete_cell(btree, remove_info->m_page, remove_info->m_index);
+        write_page(btree,remove_info->m_page);
+
+        if (underfull(btree, remove_info->m_page))
+            adjust_var(btree,remove_info->m_page);
+
+        result = ITZAM_OKAY;
+    }
+    else if (remove_info->m_page->m_links[0] == ITZAM_NULL_REF) /* is this a leaf node? */
+    {
+        int n;
+
+        /* removing key from leaf
+        */
+        --remove_info->m_page->m_header->m_key_count;
+
+        /* slide keys left over removed one
+        */
+        for (n = remove_info->m_index; n < remove_info->m_page->m_header->m_key_count; ++n)
+            memcpy(remove_info->m_page->m_keys + n * btree->m_header->m_sizeof_key, remove_info->m_page->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+        memset( remove_info->m_page->m_keys + remove_info->m_page->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+
+        /* save page
+        */
+        write_page(btree,remove_info->m_page);
+
+        /* adjust the tree, if needed
+        */
+        if (remove_info->m_page->m_header->m_key_count < btree->m_min_keys)
+            adjust_tree(btree,remove_info->m_page);
+
+        result = ITZAM_OKAY;
+    }
+    else /* removing from an internal page */
+    {
+        /* get the successor page
+        */
+        itzam_btree_page * page_successor = read_page(btree,remove_info->m_page->m_links[remove_info->m_index + 1]);
+
+        if (page_successor != NULL)
+        {
+            int n;
+
+            /* the path continues from the page holding the key
+             */
+            note_path(btree, btree->m_path_length, page_successor);
+
+            while (page_successor->m_links[0] != ITZAM_NULL_REF)
+            {
+                itzam_btree_page * next_successor = read_page(btree,page_successor->m_links[0]);
+
+                /* check for null page in case of corrupted index
+                */
+                if (next_successor != NULL)
+                {
+                    free_page(btree,page_successor);
+                    page_successor = next_successor;
+                    note_path(btree, btree->m_path_length, page_successor);
+                }
+                else
+                    btree->m_datafile->m_error_handler("itzam_btree_remove",ITZAM_ERROR_PAGE_NOT_FOUND);
+            }
+
+            /* first key is the "swappee"
+            */
+            memcpy(remove_info->m_page->m_keys + remove_info->m_index * btree->m_header->m_sizeof_key, page_successor->m_keys, btree->m_header->m_sizeof_key);
+
+            /* remove swapped key from successor page
+            */
+            --page_successor->m_header->m_key_count;
+
+            for (n = 0; n < page_successor->m_header->m_key_count; ++n)
+                memcpy(page_successor->m_keys + n * btree->m_header->m_sizeof_key, page_successor->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+            memset(page_successor->m_keys + page_successor->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+
+            /* write modified pages
+            */
+            write_page(btree,remove_info->m_page);
+            write_page(btree,page_successor);
+
+            /* adjust tree for leaf node
+            */
+            if (page_successor->m_header->m_key_count < btree->m_min_keys)
+                adjust_tree(btree,page_successor);
+
+            result = ITZAM_OKAY;
+
+            free_page(btree,page_successor);
+        }
+    }
+
+    return result;
+}
+
+/* the reference of the record holding a value kept out of the page
+ */
+static itzam_ref value_record(const itzam_byte * key, itzam_int stored)
+{
+    itzam_ref result;
+
+    memcpy(&result, key + stored - VALUE_TRAILER_SIZE - sizeof(itzam_ref), sizeof(itzam_ref));
+
+    return result;
+}
+
+/* release the record holding a key's value, if it has one
+ */
+static void drop_value(itzam_btree * btree, const itzam_byte * key)
+{
+    itzam_int stored = stored_key_size(btree, key);
+
+    if (value_trailer(key, stored) & VALUE_OUTLINE)
+    {
+        itzam_datafile_seek(btree->m_datafile, value_record(key, stored));
+        itzam_datafile_remove(btree->m_datafile);
+    }
+}
+
+itzam_state itzam_btree_remove(itzam_btree * btree, const void * key)
+{
+    itzam_state result = ITZAM_FAILED;
+    search_result remove_info;
+
+    if ((btree != NULL) && (key != NULL))
+    {
+        itzam_datafile_write_lock(btree->m_datafile);
+
+        if (btree->m_datafile->m_read_only)
+            result = ITZAM_READ_ONLY;
+        else
+        {
+            itzam_cache_sync(&btree->m_cache);
+            begin_versions(btree);
+
+            search(btree,key,&remove_info,itzam_true);
+
+            if (remove_info.m_found)
+            {
+                if (btree->m_values)
+                    drop_value(btree, key_at(btree, remove_info.m_page, remove_info.m_index));
+
+                result = remove_found(btree,&remove_info);
+
+                /* decrement number of records in file
+                */
+                if (result == ITZAM_OKAY)
+                {
+                    --btree->m_header->m_count;
+                    update_header(btree);
+                }
+            }
+            else
+            {
+                result = ITZAM_NOT_FOUND;
+            }
+
+            free_page(btree,remove_info.m_page);
+
+            if (ITZAM_OKAY != itzam_cache_flush(&btree->m_cache))
+                result = ITZAM_FAILED;
+
+            end_versions(btree);
+        }
+
+        itzam_datafile_write_unlock(btree->m_datafile);
+    }
+
+    return result;
+}
+
+/*-----------------------------------------------------------------------------
+ * values; each key in a B-tree created with m_inline_values carries a value. Short values
+ * stay in the leaf with their keys, and longer ones go to datafile records of their own,
+ * so that pages stay dense with keys and a longer value does not split a leaf
+ */
+
+itzam_state itzam_btree_put(itzam_btree * btree, const void * key, const void * value, itzam_int length)
+{
+    itzam_state result = ITZAM_FAILED;
+    search_result put_info;
+    const itzam_byte * old_key = NULL;
+    itzam_byte * entry;
+    itzam_ref where = ITZAM_NULL_REF;
+    itzam_int key_length;
+    itzam_int stored;
+    itzam_bool outline;
+    uint32_t trailer;
+
+    if ((btree == NULL) || (key == NULL) || (length < 0) || ((value == NULL) && (length > 0)))
+    {
+        default_error_handler("itzam_btree_put",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+        return result;
+    }
+
+    itzam_datafile_write_lock(btree->m_datafile);
+
+    if (btree->m_datafile->m_read_only)
+        result = ITZAM_READ_ONLY;
+    else if (!btree->m_values)
+        btree->m_datafile->m_error_handler("itzam_btree_put",ITZAM_ERROR_VALUES);
+    else
+    {
+        /* a value stays in the page if the key and value together are no longer than the
+         * longest key and value the tree was created for
+         */
+        key_length = btree->m_key_size(key);
+        outline = (key_length + length + VALUE_TRAILER_SIZE > (itzam_int)btree->m_header->m_sizeof_key);
+
+        if (outline && (key_length + (itzam_int)sizeof(itzam_ref) + VALUE_TRAILER_SIZE > (itzam_int)btree->m_header->m_sizeof_key))
+            btree->m_datafile->m_error_handler("itzam_btree_put",ITZAM_ERROR_TOO_LONG);
+        else
+        {
+            itzam_cache_sync(&btree->m_cache);
+            begin_versions(btree);
+
+            search(btree,key,&put_info,itzam_true);
+
+            if (put_info.m_found)
+                old_key = key_at(btree, put_info.m_page, put_info.m_index);
+
+            /* a value as long as the one in its record replaces it there, leaving the index alone
+             */
+            if ((old_key != NULL) && outline && (value_trailer(old_key, stored_key_size(btree, old_key)) == (VALUE_OUTLINE | (uint32_t)length)))
+                result = itzam_datafile_overwrite(btree->m_datafile, value, length, value_record(old_key, stored_key_size(btree, old_key)), 0);
+            else
+            {
+                entry = (itzam_byte *)take_block(btree);
+
+                if ((entry != NULL) && outline)
+                    where = itzam_datafile_write(btree->m_datafile, value, length, ITZAM_NULL_REF);
+
+                if (entry == NULL)
+                    btree->m_datafile->m_error_handler("itzam_btree_put",ITZAM_ERROR_MALLOC);
+                else if (outline && (where == ITZAM_NULL_REF))
+                    btree->m_datafile->m_error_handler("itzam_btree_put",ITZAM_ERROR_WRITE_FAILED);
+                else
+                {
+                    memcpy(entry, key, key_length);
+
+                    if (outline)
+                    {
+                        memcpy(entry + key_length, &where, sizeof(itzam_ref));
+                        stored  = key_length + sizeof(itzam_ref);
+                        trailer = VALUE_OUTLINE | (uint32_t)length;
+                    }
+                    else
+                    {
+                        if (length > 0)
+                            memcpy(entry + key_length, value, length);
+
+                        stored  = key_length + length;
+                        trailer = (uint32_t)length;
+                    }
+
+                    memcpy(entry + stored, &trailer, sizeof(uint32_t));
+                    stored += VALUE_TRAILER_SIZE;
+
+                    /* the key's old entry makes way for the new one
+                     */
+                    if (old_key != NULL)
+                    {
+                        drop_value(btree, old_key);
+                        delete_cell(btree, put_info.m_page, put_info.m_index);
+                    }
+                    else
+                    {
+                        ++btree->m_header->m_count;
+                        ++btree->m_header->m_ticker;
+                    }
+
+                    insert_var(btree, &put_info, entry, stored);
+
+                    result = update_header(btree);
+                }
+
+                give_block(btree, entry);
+            }
+
+            free_page(btree,put_info.m_page);
+
+            if (ITZAM_OKAY != itzam_cache_flush(&btree->m_cache))
+                result = ITZAM_FAILED;
+
+            end_versions(btree);
+        }
+    }
+
+    itzam_datafile_write_unlock(btree->m_datafile);
+
+    return result;
+}
+
+itzam_state itzam_btree_get(itzam_btree * btree, const void * key, void * value, itzam_int max_length, itzam_int * length)
+{
+    itzam_state result = ITZAM_FAILED;
+    const itzam_byte * entry;
+    search_result s;
+    itzam_int stored;
+    itzam_int value_length;
+    uint32_t trailer;
+
+    if ((btree == NULL) || (key == NULL))
+    {
+        default_error_handler("itzam_btree_get",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+        return result;
+    }
+
+    if (!btree->m_values)
+    {
+        btree->m_datafile->m_error_handler("itzam_btree_get",ITZAM_ERROR_VALUES);
+        return result;
+    }
+
+    itzam_datafile_read_lock(btree->m_datafile);
+    itzam_cache_sync(&btree->m_cache);
+
+    search(btree,key,&s,itzam_false);
+
+    if (s.m_found)
+    {
+        entry   = key_at(btree, s.m_page, s.m_index);
+        stored  = stored_key_size(btree, entry);
+        trailer = value_trailer(entry, stored);
+        value_length = (itzam_int)(trailer & ~VALUE_OUTLINE);
+
+        if (max_length > value_length)
+            max_length = value_length;
+
+        result = ITZAM_OKAY;
+
+        /* a value kept out of the page is read from its record
+         */
+        if ((value != NULL) && (max_length > 0))
+        {
+            if (trailer & VALUE_OUTLINE)
+                result = itzam_datafile_read_at(btree->m_datafile, value_record(entry, stored), value, max_length);
+            else
+                memcpy(value, entry + stored - VALUE_TRAILER_SIZE - value_length, max_length);
+        }
+
+        if (length != NULL)
+            *length = value_length;
+    }
+    else
+        result = ITZAM_NOT_FOUND;
+
+    free_page(btree,s.m_page);
+
+    itzam_datafile_read_unlock(btree->m_datafile);
+
+    return result;
+}
+
+/* batches; keys are sorted so that neighbours share one descent, and a key between the
+ * separators that bound the last leaf reached can only be in that leaf
+ */
+typedef struct t_batch_leaf
+{
+    itzam_btree_page * m_page;
+    itzam_byte *       m_low;
+    itzam_byte *       m_high;
+    itzam_bool         m_has_low;
+    itzam_bool         m_has_high;
+}
+batch_leaf;
+
+/* qsort can't pass the tree's comparator, so batches are ordered by a merge sort of
+ * key indices; already sorted runs are merged with a single comparison, and the spare
+ * entry keeps an empty batch from looking like a failed allocation
+ */
+static size_t * sort_batch(itzam_btree * btree, const itzam_byte * keys, size_t count)
+{
+    const uint32_t sizeof_key = btree->m_header->m_sizeof_key;
+    size_t * order = (size_t *)malloc(sizeof(size_t) * (count + 1));
+    size_t * temp  = (size_t *)malloc(sizeof(size_t) * (count + 1));
+    size_t * swap;
+    size_t width, lo, mid, hi, i, j, n;
+
+    if ((order == NULL) || (temp == NULL))
+    {
+        btree->m_datafile->m_error_handler("sort_batch",ITZAM_ERROR_MALLOC);
+        free(order);
+        free(temp);
+        return NULL;
+    }
+
+    for (n = 0; n < count; ++n)
+        order[n] = n;
+
+    for (width = 1; width < count; width *= 2)
+    {
+        for (lo = 0; lo < count; lo += 2 * width)
+        {
+            mid = (lo + width < count) ? lo + width : count;
+            hi  = (lo + 2 * width < count) ? lo + 2 * width : count;
+
+            if ((mid == hi) || (btree->m_key_comparator(keys + order[mid - 1] * sizeof_key, keys + order[mid] * sizeof_key) <= 0))
+            {
+                memcpy(temp + lo, order + lo, sizeof(size_t) * (hi - lo));
+                continue;
+            }
+
+            i = lo;
+            j = mid;
+
+            for (n = lo; n < hi; ++n)
+            {
+                if ((j >= hi) || ((i < mid) && (btree->m_key_comparator(keys + order[i] * sizeof_key, keys + order[j] * sizeof_key) <= 0)))
+                    temp[n] = order[i++];
+                else
+                    temp[n] = order[j++];
+            }
+        }
+
+        swap  = order;
+        order = temp;
+        temp  = swap;
+    }
+
+    free(temp);
+
+    return order;
+}
+
+static itzam_bool batch_init(itzam_btree * btree, batch_leaf * leaf)
+{
+    leaf->m_page     = NULL;
+    leaf->m_has_low  = itzam_false;
+    leaf->m_has_high = itzam_false;
+    leaf->m_low      = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+    leaf->m_high     = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+
+    if ((leaf->m_low == NULL) || (leaf->m_high == NULL))
+    {
+        btree->m_datafile->m_error_handler("batch_init",ITZAM_ERROR_MALLOC);
+        free(leaf->m_low);
+        free(leaf->m_high);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/* forget the last leaf; done whenever the shape of the tree changes
+ */
+static void batch_drop(itzam_btree * btree, batch_leaf * leaf)
+{
+    free_page(btree,leaf->m_page);
+    leaf->m_page = NULL;
+}
+
+static void batch_free(itzam_btree * btree, batch_leaf * leaf)
+{
+    batch_drop(btree,leaf);
+    free(leaf->m_low);
+    free(leaf->m_high);
+}
+
+/* releases a search result unless it is the leaf being kept
+ */
+static void batch_release(itzam_btree * btree, batch_leaf * leaf, search_result * result)
+{
+    if (result->m_page != leaf->m_page)
+        free_page(btree,result->m_page);
+
+    result->m_page = NULL;
+}
+
+/* like search, but starts from the last leaf when the key lies within its bounds, and
+ * records the bounds of any new leaf it reaches; a writer's path to the last leaf stays
+ * valid for as long as the leaf is kept
+ */
+static void batch_search(itzam_btree * btree, batch_leaf * leaf, const void * key, search_result * result, itzam_bool writing)
+{
+    const uint32_t sizeof_key = btree->m_header->m_sizeof_key;
+    itzam_btree_page * page;
+    int index;
+    int depth = 0;
+
+    /* with linked leaves, a key equal to a separator belongs to the right of it
+     */
+    if ((leaf->m_page != NULL)
+     && (!leaf->m_has_low  || (btree->m_key_comparator(key, leaf->m_low) > (btree->m_linked_leaves ? -1 : 0)))
+     && (!leaf->m_has_high || (btree->m_key_comparator(key, leaf->m_high) < 0)))
+    {
+        result->m_page  = leaf->m_page;
+        result->m_index = search_page(btree, leaf->m_page, key, &result->m_found);
+        return;
+    }
+
+    batch_drop(btree,leaf);
+    leaf->m_has_low  = itzam_false;
+    leaf->m_has_high = itzam_false;
+
+    page = &btree->m_root;
+
+    if (writing)
+        btree->m_path_length = 0;
+
+    while (page != NULL)
+    {
+        if (writing)
+            note_path(btree, depth++, page);
+
+        index = search_page(btree, page, key, &result->m_found);
+
+        if (result->m_found && btree->m_linked_leaves && (page->m_links[0] != ITZAM_NULL_REF))
+        {
+            ++index;
+            result->m_found = itzam_false;
+        }
+
+        if ((result->m_found) || (page->m_links[index] == ITZAM_NULL_REF))
+        {
+            result->m_page  = page;
+            result->m_index = index;
+
+            if (page->m_links[0] == ITZAM_NULL_REF)
+                leaf->m_page = page;
+
+            return;
+        }
+
+        /* the separators around the link followed bound everything below it
+         */
+        if (index > 0)
+        {
+            memcpy(leaf->m_low, page->m_keys + (index - 1) * sizeof_key, sizeof_key);
+            leaf->m_has_low = itzam_true;
+        }
+
+        if (index < page->m_header->m_key_count)
+        {
+            memcpy(leaf->m_high, page->m_keys + index * sizeof_key, sizeof_key);
+            leaf->m_has_high = itzam_true;
+        }
+
+        {
+            itzam_btree_page * next_page = read_page(btree,page->m_links[index]);
+            free_page(btree,page);
+            page = next_page;
+        }
+    }
+
+    btree->m_datafile->m_error_handler("batch_search",ITZAM_ERROR_PAGE_NOT_FOUND);
+
+    result->m_page  = NULL;
+    result->m_index = 0;
+    result->m_found = itzam_false;
+}
+
+itzam_state itzam_btree_insert_batch(itzam_btree * btree,
+                                     const void * keys,
+                                     size_t count,
+                                     itzam_state * results)
+{
+    itzam_state result = ITZAM_FAILED;
+    search_result insert_info;
+    batch_leaf leaf;
+    size_t * order;
+    size_t n;
+
+    /* a batch is an array of keys of one size
+     */
+    if ((btree != NULL) && btree->m_varkeys)
+    {
+        btree->m_datafile->m_error_handler("itzam_btree_insert_batch",ITZAM_ERROR_VARKEY);
+        return result;
+    }
+
+    if ((btree != NULL) && (keys != NULL))
+    {
+        itzam_datafile_write_lock(btree->m_datafile);
+
+        if (btree->m_datafile->m_read_only)
+            result = ITZAM_READ_ONLY;
+        else if ((order = sort_batch(btree, (const itzam_byte *)keys, count)) != NULL)
+        {
+            if (batch_init(btree, &leaf))
+            {
+                const itzam_byte * key;
+
+                itzam_cache_sync(&btree->m_cache);
+                begin_versions(btree);
+
+                result = ITZAM_OKAY;
+
+                for (n = 0; n < count; ++n)
+                {
+                    key = (const itzam_byte *)keys + order[n] * btree->m_header->m_sizeof_key;
+
+                    batch_search(btree, &leaf, key, &insert_info, itzam_true);
+
+                    if (insert_info.m_page == NULL)
+                    {
+                        result = ITZAM_FAILED;
+                        break;
+                    }
+
+                    if (!insert_info.m_found)
+                    {
+                        /* a full leaf splits, and the tree changes shape
+                         */
+                        if (insert_info.m_page->m_header->m_key_count == btree->m_header->m_order)
+                            leaf.m_page = NULL;
+
+                        write_key(btree,&insert_info,key);
+
+                        ++btree->m_header->m_count;
+                        ++btree->m_header->m_ticker;
+
+                        if (results != NULL)
+                            results[order[n]] = ITZAM_OKAY;
+                    }
+                    else
+                    {
+                        if (results != NULL)
+                            results[order[n]] = ITZAM_DUPLICATE;
+
+                        result = ITZAM_DUPLICATE;
+                    }
+
+                    batch_release(btree, &leaf, &insert_info);
+                }
+
+                batch_free(btree, &leaf);
+
+                /* one header write for the whole batch
+                 */
+                if (ITZAM_OKAY != update_header(btree))
+                    result = ITZAM_FAILED;
+
+                if (ITZAM_OKAY != itzam_cache_flush(&btree->m_cache))
+                    result = ITZAM_FAILED;
+
+                end_versions(btree);
+            }
+
+            free(order);
+        }
+
+        itzam_datafile_write_unlock(btree->m_datafile);
+    }
+
+    return result;
+}
+
+size_t itzam_btree_find_batch(itzam_btree * btree,
+                              const void * keys,
+                              size_t count,
+                              void * returned_keys,
+                              itzam_bool * found)
+{
+    size_t result = 0;
+    search_result s;
+    batch_leaf leaf;
+    size_t * order;
+    size_t n;
+
+    /* a batch is an array of keys of one size
+     */
+    if ((btree != NULL) && btree->m_varkeys)
+    {
+        btree->m_datafile->m_error_handler("itzam_btree_find_batch",ITZAM_ERROR_VARKEY);
+        return result;
+    }
+
+    if ((btree != NULL) && (keys != NULL))
+    {
+        itzam_datafile_read_lock(btree->m_datafile);
+
+        if ((order = sort_batch(btree, (const itzam_byte *)keys, count)) != NULL)
+        {
+            if (batch_init(btree, &leaf))
+            {
+                itzam_cache_sync(&btree->m_cache);
+
+                for (n = 0; n < count; ++n)
+                {
+                    batch_search(btree, &leaf, (const itzam_byte *)keys + order[n] * btree->m_header->m_sizeof_key, &s, itzam_false);
+
+                    if (s.m_found)
+                    {
+                        ++result;
+
+                        if (returned_keys != NULL)
+                            memcpy((itzam_byte *)returned_keys + order[n] * btree->m_header->m_sizeof_key, s.m_page->m_keys + s.m_index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+                    }
+
+                    if (found != NULL)
+                        found[order[n]] = s.m_found;
+
+                    if (s.m_page == NULL)
+                        break;
+
+                    batch_release(btree, &leaf, &s);
+                }
+
+                batch_free(btree, &leaf);
+            }
+
+            free(order);
+        }
+
+        itzam_datafile_read_unlock(btree->m_datafile);
+    }
+    else
+    {
+        default_error_handler("itzam_btree_find_batch",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+    }
+
+    return result;
+}
+
+itzam_state itzam_btree_remove_batch(itzam_btree * btree,
+                                     const void * keys,
+                                     size_t count,
+                                     itzam_state * results)
+{
+    itzam_state result = ITZAM_FAILED;
+    search_result remove_info;
+    batch_leaf leaf;
+    size_t * order;
+    size_t n;
+
+    /* a batch is an array of keys of one size
+     */
+    if ((btree != NULL) && btree->m_varkeys)
+    {
+        btree->m_datafile->m_error_handler("itzam_btree_remove_batch",ITZAM_ERROR_VARKEY);
+        return result;
+    }
+
+    if ((btree != NULL) && (keys != NULL))
+    {
+        itzam_datafile_write_lock(btree->m_datafile);
+
+        if (btree->m_datafile->m_read_only)
+            result = ITZAM_READ_ONLY;
+        else if ((order = sort_batch(btree, (const itzam_byte *)keys, count)) != NULL)
+        {
+            if (batch_init(btree, &leaf))
+            {
+                itzam_cache_sync(&btree->m_cache);
+                begin_versions(btree);
+
+                result = ITZAM_OKAY;
+
+                for (n = 0; n < count; ++n)
+                {
+                    batch_search(btree, &leaf, (const itzam_byte *)keys + order[n] * btree->m_header->m_sizeof_key, &remove_info, itzam_true);
+
+                    if (remove_info.m_page == NULL)
+                    {
+                        result = ITZAM_FAILED;
+                        break;
+                    }
+
+                    if (remove_info.m_found)
+                    {
+                        itzam_btree_page * page = remove_info.m_page;
+                        itzam_state state;
+
+                        /* a leaf with keys to spare, or a leaf root, keeps its shape
+                         */
+                        if ((page == leaf.m_page)
+                         && ((parent_of(btree, page) == ITZAM_NULL_REF) || (page->m_header->m_key_count > btree->m_min_keys)))
+                        {
+                            int i;
+
+                            --page->m_header->m_key_count;
+
+                            for (i = remove_info.m_index; i < page->m_header->m_key_count; ++i)
+                                memcpy(page->m_keys + i * btree->m_header->m_sizeof_key, page->m_keys + (i + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+
+                            memset(page->m_keys + page->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+
+                            write_page(btree,page);
+
+                            state = ITZAM_OKAY;
+                        }
+                        else
+                        {
+                            leaf.m_page = NULL;
+                            state = remove_found(btree,&remove_info);
+                        }
+
+                        if (state == ITZAM_OKAY)
+                            --btree->m_header->m_count;
+                        else
+                            result = ITZAM_FAILED;
+
+                        if (results != NULL)
+                            results[order[n]] = state;
+                    }
+                    else
+                    {
+                        if (results != NULL)
+                            results[order[n]] = ITZAM_NOT_FOUND;
+
+                        if (result == ITZAM_OKAY)
+                            result = ITZAM_NOT_FOUND;
+                    }
+
+                    batch_release(btree, &leaf, &remove_info);
+                }
+
+                batch_free(btree, &leaf);
+
+                if (ITZAM_OKAY != update_header(btree))
+                    result = ITZAM_FAILED;
+
+                if (ITZAM_OKAY != itzam_cache_flush(&btree->m_cache))
+                    result = ITZAM_FAILED;
+
+                end_versions(btree);
+            }
+
+            free(order);
+        }
+
+        itzam_datafile_write_unlock(btree->m_datafile);
+    }
+
+    return result;
+}
+
+/* bulk loading; pages are built bottom-up, one open page per level, and written once at
+ * consecutive locations at the end of the file
+ */
+#define ITZAM_BULK_MAX_LEVELS 64
+
+typedef struct t_bulk_level
 {
-    if (page_insert->m_header->m_key_count == btree->m_header->m_order)
+    itzam_btree_page * m_page;
+    itzam_ref          m_where;
+}
+bulk_level;
+
+typedef struct t_bulk_loader
+{
+    itzam_btree * m_btree;
+    bulk_level    m_levels[ITZAM_BULK_MAX_LEVELS];
+    int           m_level_count;
+    int           m_target;
+    itzam_ref     m_next;
+    itzam_bool    m_failed;
+    itzam_btree_page * m_spare;
+}
+bulk_loader;
+
+static void bulk_start_page(bulk_loader * loader, int level)
+{
+    init_page(loader->m_btree, loader->m_levels[level].m_page);
+
+    /* reserve the next slot; every page record has the same size
+     */
+    loader->m_levels[level].m_where = loader->m_next;
+    loader->m_levels[level].m_page->m_header->m_where = loader->m_next;
+    loader->m_next += loader->m_btree->m_datafile->m_sizeof_header + loader->m_btree->m_header->m_sizeof_page;
+}
+
+static itzam_bool bulk_add_level(bulk_loader * loader)
+{
+    itzam_bool result = itzam_false;
+
+    if (loader->m_level_count < ITZAM_BULK_MAX_LEVELS)
     {
-        int nt  = 0;
-        int ni  = 0;
-        int insert_index = 0;
+        loader->m_levels[loader->m_level_count].m_page = alloc_page(loader->m_btree);
 
-        itzam_btree_page * page_sibling;
-        itzam_btree_page * child;
+        /* linked leaves are written one behind, from a second buffer
+         */
+        if ((loader->m_level_count == 0) && loader->m_btree->m_linked_leaves)
+            loader->m_spare = alloc_page(loader->m_btree);
+
+        if ((loader->m_levels[loader->m_level_count].m_page != NULL) && ((loader->m_level_count > 0) || !loader->m_btree->m_linked_leaves || (loader->m_spare != NULL)))
+        {
+            bulk_start_page(loader, loader->m_level_count);
+            ++loader->m_level_count;
+            result = itzam_true;
+        }
+        else
+        {
+            if (loader->m_levels[loader->m_level_count].m_page != NULL)
+                free_page(loader->m_btree, loader->m_levels[loader->m_level_count].m_page);
+
+            loader->m_btree->m_datafile->m_error_handler("itzam_btree_bulk_load",ITZAM_ERROR_MALLOC);
+        }
+    }
+
+    return result;
+}
+
+static void bulk_write_page(bulk_loader * loader, itzam_btree_page * page, itzam_ref parent)
+{
+    link_parent(loader->m_btree, page, parent);
+
+    if (page->m_header->m_where != itzam_datafile_write_flags(loader->m_btree->m_datafile,
+                                                                page->m_data,
+                                                                loader->m_btree->m_header->m_sizeof_page,
+                                                                page->m_header->m_where,
+                                                                ITZAM_RECORD_BTREE_PAGE))
+        loader->m_failed = itzam_true;
+}
+
+/* the open page at a level is full; write it, link it into the level above, and
+ * send the key that follows it up as a separator
+ */
+static void bulk_push(bulk_loader * loader, int level, const itzam_byte * separator)
+{
+    itzam_btree_page * parent;
+    const itzam_bool linked_leaf = (level == 0) && loader->m_btree->m_linked_leaves;
+
+    if ((level + 1 == loader->m_level_count) && !bulk_add_level(loader))
+    {
+        loader->m_failed = itzam_true;
+        return;
+    }
+
+    parent = loader->m_levels[level + 1].m_page;
+    parent->m_links[parent->m_header->m_key_count] = loader->m_levels[level].m_where;
 
-        /* temporary array
+    if (linked_leaf)
+    {
+        /* hold the leaf back until the next one has a place to link to
          */
-        itzam_byte * temp_keys  = (itzam_byte *)malloc(btree->m_header->m_sizeof_key * (btree->m_header->m_order + 1));
-        itzam_ref * temp_links = (itzam_ref *)malloc(sizeof(itzam_ref) * (btree->m_header->m_order + 2));
+        itzam_btree_page * closed = loader->m_levels[0].m_page;
 
-        if ((temp_keys == NULL) || (temp_links == NULL))
-            btree->m_datafile->m_error_handler("promote_internal", ITZAM_ERROR_MALLOC);
+        closed->m_header->m_parent = loader->m_levels[1].m_where;
+        loader->m_levels[0].m_page = loader->m_spare;
+        loader->m_spare = closed;
+    }
+    else
+        bulk_write_page(loader, loader->m_levels[level].m_page, loader->m_levels[level + 1].m_where);
 
-        temp_links[0] = page_insert->m_links[0];
+    if (parent->m_header->m_key_count < loader->m_target)
+    {
+        memcpy(parent->m_keys + parent->m_header->m_key_count * loader->m_btree->m_header->m_sizeof_key, separator, loader->m_btree->m_header->m_sizeof_key);
+        ++parent->m_header->m_key_count;
+    }
+    else
+        bulk_push(loader, level + 1, separator);
 
-        /* find insertion point
+    bulk_start_page(loader, level);
+
+    if (linked_leaf)
+    {
+        loader->m_spare->m_siblings[NEXT_LEAF] = loader->m_levels[0].m_where;
+        loader->m_levels[0].m_page->m_siblings[PREV_LEAF] = loader->m_spare->m_header->m_where;
+        bulk_write_page(loader, loader->m_spare, loader->m_spare->m_header->m_parent);
+    }
+}
+
+static void bulk_add(bulk_loader * loader, const itzam_byte * key)
+{
+    itzam_btree_page * leaf = loader->m_levels[0].m_page;
+
+    if (leaf->m_header->m_key_count == loader->m_target)
+    {
+        /* with linked leaves, the separator is a copy and the key itself starts the
+         * next leaf
          */
-        while ((insert_index < page_insert->m_header->m_key_count) && (btree->m_key_comparator(key,(const void *)(page_insert->m_keys + insert_index * btree->m_header->m_sizeof_key)) >= 0))
-            ++insert_index;
+        bulk_push(loader, 0, key);
 
-        /* store new info
+        if (!loader->m_btree->m_linked_leaves || loader->m_failed)
+            return;
+
+        leaf = loader->m_levels[0].m_page;
+    }
+
+    memcpy(leaf->m_keys + leaf->m_header->m_key_count * loader->m_btree->m_header->m_sizeof_key, key, loader->m_btree->m_header->m_sizeof_key);
+    ++leaf->m_header->m_key_count;
+}
+
+/* write the open pages along the right edge; the topmost becomes the root
+ */
+static void bulk_finish(bulk_loader * loader)
+{
+    int level;
+
+    for (level = 0; level < loader->m_level_count - 1; ++level)
+    {
+        itzam_btree_page * parent = loader->m_levels[level + 1].m_page;
+
+        parent->m_links[parent->m_header->m_key_count] = loader->m_levels[level].m_where;
+        bulk_write_page(loader, loader->m_levels[level].m_page, loader->m_levels[level + 1].m_where);
+    }
+
+    bulk_write_page(loader, loader->m_levels[level].m_page, ITZAM_NULL_REF);
+}
+
+/* pages on the right edge may hold fewer than the minimum number of keys; fix the
+ * topmost one from its left sibling until none remain
+ */
+static void bulk_fix_right_edge(itzam_btree * btree)
+{
+    itzam_bool fixed = itzam_false;
+
+    while (!fixed)
+    {
+        itzam_btree_page * page = &btree->m_root;
+        int depth = 0;
+
+        fixed = itzam_true;
+
+        /* the walk down the right edge is the path adjust_tree works from
          */
-        memcpy(temp_keys + insert_index * btree->m_header->m_sizeof_key, key, btree->m_header->m_sizeof_key);
-        temp_links[insert_index + 1] = link;
+        note_path(btree, depth++, page);
 
-        /* copy existing keys
+        while ((page != NULL) && (page->m_links[0] != ITZAM_NULL_REF))
+        {
+            itzam_btree_page * child = read_page(btree, page->m_links[page->m_header->m_key_count]);
+
+            free_page(btree, page);
+            page = child;
+
+            if (page != NULL)
+                note_path(btree, depth++, page);
+
+            if ((page != NULL) && (page->m_header->m_key_count < btree->m_min_keys))
+            {
+                adjust_tree(btree, page);
+                fixed = itzam_false;
+                break;
+            }
+        }
+
+        if (page == NULL)
+        {
+            btree->m_datafile->m_error_handler("itzam_btree_bulk_load",ITZAM_ERROR_PAGE_NOT_FOUND);
+            break;
+        }
+
+        free_page(btree, page);
+    }
+}
+
+static itzam_state bulk_insert(itzam_btree * btree, itzam_key_source * source, void * context)
+{
+    itzam_state result = ITZAM_OKAY;
+    search_result insert_info;
+    itzam_byte * key;
+    itzam_byte * prev_key;
+    uint64_t count = 0;
+    int comparison;
+
+    key      = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+    prev_key = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+
+    if ((key == NULL) || (prev_key == NULL))
+    {
+        btree->m_datafile->m_error_handler("itzam_btree_bulk_load",ITZAM_ERROR_MALLOC);
+        free(key);
+        free(prev_key);
+        return ITZAM_FAILED;
+    }
+
+    itzam_datafile_write_lock(btree->m_datafile);
+
+    if (btree->m_datafile->m_read_only)
+        result = ITZAM_READ_ONLY;
+    else if ((btree->m_header->m_count != 0) || (btree->m_root.m_header->m_key_count != 0))
+        result = ITZAM_FAILED;
+    else
+    {
+        itzam_cache_sync(&btree->m_cache);
+        begin_versions(btree);
+
+        while (source(context, key))
+        {
+            if (input_key_size(btree, key) > btree->m_header->m_sizeof_key)
+            {
+                btree->m_datafile->m_error_handler("itzam_btree_bulk_load",ITZAM_ERROR_TOO_LONG);
+                result = ITZAM_FAILED;
+                break;
+            }
+
+            /* stop at the first key out of order; the keys before it are kept
+             */
+            if (count > 0)
+            {
+                comparison = btree->m_key_comparator(prev_key, key);
+
+                if (comparison >= 0)
+                {
+                    result = (comparison == 0) ? ITZAM_DUPLICATE : ITZAM_NOT_SORTED;
+                    break;
+                }
+            }
+
+            search(btree,key,&insert_info,itzam_true);
+            write_key(btree,&insert_info,key);
+            free_page(btree,insert_info.m_page);
+
+            ++count;
+            memcpy(prev_key, key, input_key_size(btree, key));
+        }
+
+        btree->m_header->m_count   = count;
+        btree->m_header->m_ticker += count;
+
+        if (ITZAM_OKAY != update_header(btree))
+            result = ITZAM_FAILED;
+
+        if (ITZAM_OKAY != itzam_cache_flush(&btree->m_cache))
+            result = ITZAM_FAILED;
+
+        end_versions(btree);
+    }
+
+    itzam_datafile_write_unlock(btree->m_datafile);
+
+    free(key);
+    free(prev_key);
+
+    return result;
+}
+
+itzam_state itzam_btree_bulk_load(itzam_btree * btree,
+                                  itzam_key_source * source,
+                                  void * context,
+                                  double fill_factor)
+{
+    itzam_state result = ITZAM_FAILED;
+    bulk_loader loader;
+    itzam_byte * key;
+    itzam_byte * prev_key;
+    uint64_t count = 0;
+    int n;
+
+    if ((btree == NULL) || (source == NULL) || (fill_factor <= 0.0) || (fill_factor > 1.0))
+        return ITZAM_FAILED;
+
+    /* slotted pages fill by bytes, not keys; trees of them are loaded a key at a time
+     */
+    if (btree->m_varkeys)
+        return bulk_insert(btree, source, context);
+
+    key      = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+    prev_key = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+
+    if ((key == NULL) || (prev_key == NULL))
+    {
+        btree->m_datafile->m_error_handler("itzam_btree_bulk_load",ITZAM_ERROR_MALLOC);
+        free(key);
+        free(prev_key);
+        return ITZAM_FAILED;
+    }
+
+    itzam_datafile_write_lock(btree->m_datafile);
+
+    if (btree->m_datafile->m_read_only)
+        result = ITZAM_READ_ONLY;
+    else
+    {
+        itzam_cache_sync(&btree->m_cache);
+        begin_versions(btree);
+
+        /* only an empty tree can be built from the bottom up
+         */
+        if ((btree->m_header->m_count == 0) && (btree->m_root.m_header->m_key_count == 0))
+        {
+            result = ITZAM_OKAY;
+
+            loader.m_btree       = btree;
+            loader.m_level_count = 0;
+            loader.m_failed      = itzam_false;
+            loader.m_spare       = NULL;
+
+            /* fill pages to the requested fraction, but never below the minimum
+             */
+            loader.m_target = (int)(fill_factor * btree->m_header->m_order + 0.5);
+
+            if (loader.m_target < btree->m_min_keys)
+                loader.m_target = btree->m_min_keys;
+
+            if (loader.m_target > btree->m_header->m_order)
+                loader.m_target = btree->m_header->m_order;
+
+            itzam_datafile_mutex_lock(btree->m_datafile);
+            loader.m_next = itzam_file_seek(btree->m_datafile->m_file,0,ITZAM_SEEK_END);
+            itzam_datafile_mutex_unlock(btree->m_datafile);
+
+            if ((loader.m_next > 0) && source(context, key))
+            {
+                if (bulk_add_level(&loader))
+                {
+                    do
+                    {
+                        if (count > 0)
+                        {
+                            int comparison = btree->m_key_comparator(prev_key, key);
+
+                            /* stop at the first key out of order; the keys before it are kept
+                             */
+                            if (comparison >= 0)
+                            {
+                                result = (comparison == 0) ? ITZAM_DUPLICATE : ITZAM_NOT_SORTED;
+                                break;
+                            }
+                        }
+
+                        bulk_add(&loader, key);
+
+                        if (loader.m_failed)
+                            break;
+
+                        ++count;
+                        memcpy(prev_key, key, btree->m_header->m_sizeof_key);
+                    }
+                    while (source(context, key));
+
+                    bulk_finish(&loader);
+
+                    if (!loader.m_failed)
+                    {
+                        /* replace the empty root with the top of the new tree
+                         */
+                        remove_page(btree, &btree->m_root);
+                        set_root(btree, loader.m_levels[loader.m_level_count - 1].m_page);
+
+                        bulk_fix_right_edge(btree);
+
+                        btree->m_header->m_count   = count;
+                        btree->m_header->m_ticker += count;
+
+                        if (ITZAM_OKAY != update_header(btree))
+                            result = ITZAM_FAILED;
+                    }
+                    else
+                        result = ITZAM_FAILED;
+                }
+                else
+                    result = ITZAM_FAILED;
+
+                for (n = 0; n < loader.m_level_count; ++n)
+                    free_page(btree, loader.m_levels[n].m_page);
+
+                if (loader.m_spare != NULL)
+                    free_page(btree, loader.m_spare);
+            }
+
+            if (ITZAM_OKAY != itzam_cache_flush(&btree->m_cache))
+                result = ITZAM_FAILED;
+        }
+
+        end_versions(btree);
+    }
+
+    itzam_datafile_write_unlock(btree->m_datafile);
+
+    free(key);
+    free(prev_key);
+
+    return result;
+}
+
+uint16_t itzam_btree_cursor_count(itzam_btree * btree)
+{
+    uint16_t result = 0;
+
+    if (btree != NULL)
+    {
+        itzam_datafile_read_lock(btree->m_datafile);
+        result = btree->m_cursor_count;
+        itzam_datafile_read_unlock(btree->m_datafile);
+    }
+
+    return result;
+}
+
+itzam_state itzam_btree_transaction_start(itzam_btree * btree)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    if (btree != NULL)
+    {
+        itzam_datafile_write_lock(btree->m_datafile);
+        result = itzam_datafile_transaction_start(btree->m_datafile);
+
+        if (result != ITZAM_OKAY)
+            itzam_datafile_write_unlock(btree->m_datafile);
+    }
+
+    return result;
+}
+
+itzam_state itzam_btree_transaction_commit(itzam_btree * btree)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    if (btree != NULL)
+    {
+        /* readers may proceed while the commit waits for the log; the datafile
+         * mutex still keeps other writers out until the commit is logged
          */
-        while (ni < btree->m_header->m_order)
-        {
-            if (ni == insert_index)
-                ++nt;
+        itzam_datafile_write_unlock(btree->m_datafile);
+        result = itzam_datafile_transaction_commit(btree->m_datafile);
+    }
 
-            memcpy(temp_keys + nt * btree->m_header->m_sizeof_key, page_insert->m_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-            temp_links[nt + 1] = page_insert->m_links[ni + 1];
+    return result;
+}
 
-            ++ni;
-            ++nt;
-        }
+itzam_state itzam_btree_transaction_rollback(itzam_btree * btree)
+{
+    itzam_state result = ITZAM_FAILED;
+    itzam_btree_page * old_root;
 
-        /* generate a new leaf node
-         */
-        page_sibling = alloc_page(btree);
-        page_sibling->m_header->m_parent = page_insert->m_header->m_parent;
+    if (btree != NULL)
+    {
+        result = itzam_datafile_transaction_rollback(btree->m_datafile);
 
-        /* clear key counts
+        /* the header has been restored in the file
          */
-        page_insert->m_header->m_key_count = 0;
-        page_sibling->m_header->m_key_count = 0;
-        page_insert->m_links[0] = temp_links[0];
+        itzam_datafile_read_at(btree->m_datafile, btree->m_header->m_where, btree->m_header, sizeof(itzam_btree_header));
 
-        /* copy keys from temp to pages
+        /* cached pages may have been restored to their earlier contents
          */
-        for (ni = 0; ni < btree->m_min_keys; ++ni)
-        {
-            memcpy(page_insert->m_keys + ni * btree->m_header->m_sizeof_key, temp_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-            page_insert->m_links[ni + 1] = temp_links[ni + 1];
-            ++page_insert->m_header->m_key_count;
-        }
-
-        page_sibling->m_links[0] = temp_links[btree->m_min_keys + 1];
-
-        for (ni = btree->m_min_keys + 1; ni <= btree->m_header->m_order; ++ni)
-        {
-            memcpy(page_sibling->m_keys + (ni - 1 - btree->m_min_keys) * btree->m_header->m_sizeof_key, temp_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-            page_sibling->m_links[ni - btree->m_min_keys]    = temp_links[ni + 1];
-            ++page_sibling->m_header->m_key_count;
-        }
+        itzam_cache_invalidate(&btree->m_cache);
+        itzam_cache_sync(&btree->m_cache);
 
-        /* replace unused entries with null
+        /* restore the root
          */
-        for (ni = btree->m_min_keys; ni < btree->m_header->m_order; ++ni)
+        old_root = read_page(btree,btree->m_header->m_root_where);
+
+        if (old_root != NULL)
         {
-            memset(page_insert->m_keys + ni * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
-            page_insert->m_links[ni + 1] = ITZAM_NULL_REF;
+            memcpy(btree->m_root_data, old_root->m_data, btree->m_header->m_sizeof_page);
+            free_page(btree,old_root);
         }
 
-        /* write pages
+        /* done here
          */
-        write_page(btree,page_insert);
-        write_page(btree,page_sibling);
+        itzam_datafile_write_unlock(btree->m_datafile);
+    }
 
-        if (page_insert->m_header->m_parent == ITZAM_NULL_REF)
-            set_root(btree,page_insert);
+    return result;
+}
 
-        /* update parent links in child nodes
-         */
-        for (ni = 0; ni <= page_sibling->m_header->m_key_count; ++ni)
-        {
-            child = read_page(btree,page_sibling->m_links[ni]);
+/**
+ *------------------------------------------------------------
+ * B-tree cursor functions
+ */
 
-            if (child != NULL)
-            {
-                child->m_header->m_parent = page_sibling->m_header->m_where;
-                write_page(btree,child);
-            }
-            else
-                btree->m_datafile->m_error_handler("promote_internal",ITZAM_ERROR_PAGE_NOT_FOUND);
+/* parent positions are kept by each cursor once released, since cursors belong to a
+ * single thread; a cursor allocates no more of them than the depth of the tree
+ */
+static itzam_btree_cursor_memory * take_memory(itzam_btree_cursor * cursor)
+{
+    itzam_btree_cursor_memory * memory = cursor->m_spare_memory;
 
-            free_page(child);
-        }
+    if (memory != NULL)
+        cursor->m_spare_memory = memory->m_prev;
+    else
+        memory = (itzam_btree_cursor_memory *)malloc(sizeof(itzam_btree_cursor_memory));
 
-        /* promote key and pointer
-         */
-        if (page_insert->m_header->m_parent == ITZAM_NULL_REF)
-        {
-            /* create a new root
-             */
-            promote_root(btree,
-                         temp_keys + btree->m_min_keys * btree->m_header->m_sizeof_key,
-                         page_sibling);
-        }
-        else
-        {
-            /* read parent and promote key
-             */
-            itzam_btree_page * parent_page = read_page(btree,page_insert->m_header->m_parent);
+    return memory;
+}
 
-            promote_internal(btree,
-                             parent_page,
-                             temp_keys + btree->m_min_keys * btree->m_header->m_sizeof_key,
-                             page_sibling->m_header->m_where);
+static void give_memory(itzam_btree_cursor * cursor, itzam_btree_cursor_memory * memory)
+{
+    memory->m_prev = cursor->m_spare_memory;
+    cursor->m_spare_memory = memory;
+}
 
-            free_page(parent_page);
-        }
+static void free_spare_memory(itzam_btree_cursor * cursor)
+{
+    itzam_btree_cursor_memory * temp_memory;
 
-        /* release resources
-         */
-        free_page(page_sibling);
-        free(temp_keys);
-        free(temp_links);
-    }
-    else
+    while (cursor->m_spare_memory != NULL)
     {
-        int n, insert_index = 0;
+        temp_memory = cursor->m_spare_memory;
+        cursor->m_spare_memory = temp_memory->m_prev;
+        free(temp_memory);
+    }
+}
 
-        /* find insertion point
-         */
-        while ((insert_index < page_insert->m_header->m_key_count)
-            && (btree->m_key_comparator(key,(void *)(page_insert->m_keys + insert_index * btree->m_header->m_sizeof_key)) >= 0))
-        {
-            ++insert_index;
-        }
+/* release the page and parent positions held by a cursor
+ */
+static void release_cursor(itzam_btree_cursor * cursor)
+{
+    itzam_btree_cursor_memory * temp_memory;
 
-        /* shift keys right
-         */
-        for (n = page_insert->m_header->m_key_count; n > insert_index; --n)
-        {
-            memcpy(page_insert->m_keys + n * btree->m_header->m_sizeof_key, page_insert->m_keys + (n - 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-            page_insert->m_links[n + 1] = page_insert->m_links[n];
-        }
+    free_page(cursor->m_btree,cursor->m_page);
+    cursor->m_page = NULL;
 
-        memcpy(page_insert->m_keys + insert_index * btree->m_header->m_sizeof_key, key, btree->m_header->m_sizeof_key);
-        page_insert->m_links[insert_index + 1] = link;
+    while (cursor->m_parent_memory != NULL)
+    {
+        temp_memory = cursor->m_parent_memory;
+        cursor->m_parent_memory = temp_memory->m_prev;
+        give_memory(cursor, temp_memory);
+    }
+}
 
-        ++page_insert->m_header->m_key_count;
+/* record where a cursor is; if the tree is changed before the cursor is used again, it
+ * finds its place by seeking to the key it was on
+ */
+static void note_cursor(itzam_btree_cursor * cursor)
+{
+    cursor->m_generation = cursor->m_btree->m_datafile->m_shared->m_generation;
+    cursor->m_on_key = (cursor->m_page != NULL) && (cursor->m_index < cursor->m_page->m_header->m_key_count);
 
-        /* write updated page
-         */
-        write_page(btree,page_insert);
+    if (cursor->m_on_key)
+        copy_key(cursor->m_btree, cursor->m_key, cursor->m_page, cursor->m_index);
+}
 
-        if (page_insert->m_header->m_parent == ITZAM_NULL_REF)
-            set_root(btree, page_insert);
-    }
+static itzam_bool cursor_changed(const itzam_btree_cursor * cursor)
+{
+    return (cursor->m_generation != cursor->m_btree->m_datafile->m_shared->m_generation);
 }
 
-static void write_key(itzam_btree * btree,
-                      search_result * insert_info,
-                      const itzam_byte * key)
+static itzam_bool reset_cursor(itzam_btree_cursor * cursor)
 {
-    itzam_btree_page * page_sibling;
-    itzam_btree_page * page_parent;
+    itzam_bool result = itzam_false;
+    itzam_bool looking = itzam_true;
 
-    /* check to see if page is full
-     */
-    if (insert_info->m_page->m_header->m_key_count == btree->m_header->m_order)
+    /* read root */
+    itzam_btree_page * next_page = NULL;
+    itzam_btree_cursor_memory * next_memory = NULL;
+    itzam_btree_page * page = &cursor->m_btree->m_root;
+
+    /* follow the tree to the first key in the sequence */
+    release_cursor(cursor);
+    itzam_cache_sync(&cursor->m_btree->m_cache);
+    cursor->m_index = 0;
+
+    while (looking && (page != NULL))
     {
-        int nt, ni;
+        if (page->m_header->m_key_count > 0)
+        {
+            if (page->m_links[0] == ITZAM_NULL_REF)
+            {
+                /* found the first key */
+                cursor->m_page = page;
+                cursor->m_index = 0;
+                result = itzam_true;
+                looking = itzam_false;
+            }
+            else
+            {
+                /* remember position in parent page; linked leaves need no path back */
+                if (!cursor->m_btree->m_linked_leaves)
+                {
+                    next_memory = take_memory(cursor);
 
-        /* temporary array to store new items
-         */
-        itzam_byte * temp_keys = (itzam_byte *)malloc(btree->m_header->m_sizeof_key * (btree->m_header->m_order + 1));
-        memcpy(temp_keys + insert_info->m_index * btree->m_header->m_sizeof_key, key, btree->m_header->m_sizeof_key);
+                    if (next_memory == NULL)
+                        cursor->m_btree->m_datafile->m_error_handler("reset_sursor", ITZAM_ERROR_MALLOC);
 
-        /* copy entries from insertion page to temps
-         */
-        nt = 0;
-        ni = 0;
+                    next_memory->m_prev = cursor->m_parent_memory;
+                    next_memory->m_index = 0;
+                    next_memory->m_where = page->m_header->m_where;
+                    cursor->m_parent_memory = next_memory;
+                }
 
-        while (ni < btree->m_header->m_order)
-        {
-            /* skip over inserted data
-             */
-            if (ni == insert_info->m_index)
-                ++nt;
+                /* move to next page */
+                next_page = read_page(cursor->m_btree,page->m_links[0]);
 
-            /* copy data
-             */
-            memcpy(temp_keys + nt * btree->m_header->m_sizeof_key, insert_info->m_page->m_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+                free_page(cursor->m_btree,page);
 
-            /* next one
-             */
-            ++ni;
-            ++nt;
+                page = next_page;
+            }
+        }
+        else
+        {
+            free_page(cursor->m_btree,page);
+            release_cursor(cursor);
+            cursor->m_index = 0;
+            looking = itzam_false;
         }
+    }
 
-        /* create a new leaf
-         */
-        page_sibling = alloc_page(btree);
-        page_sibling->m_header->m_parent = insert_info->m_page->m_header->m_parent;
+    return result;
+}
 
-        /* clear key counts
-         */
-        insert_info->m_page->m_header->m_key_count = 0;
-        page_sibling->m_header->m_key_count        = 0;
+itzam_state itzam_btree_cursor_create(itzam_btree_cursor * cursor, itzam_btree * btree)
+{
+    itzam_state result = ITZAM_FAILED;
 
-        /* copy keys from temp to pages
-         */
-        for (ni = 0; ni < btree->m_min_keys; ++ni)
+    if ((cursor != NULL) && (btree != NULL))
+    {
+        /* keep reference to target tree */
+        cursor->m_btree = btree;
+        cursor->m_page = NULL;
+        cursor->m_parent_memory = NULL;
+        cursor->m_spare_memory = NULL;
+        cursor->m_key = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+
+        if (cursor->m_key == NULL)
         {
-            memcpy(insert_info->m_page->m_keys + ni * btree->m_header->m_sizeof_key, temp_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-            ++insert_info->m_page->m_header->m_key_count;
+            btree->m_datafile->m_error_handler("itzam_btree_cursor_create",ITZAM_ERROR_MALLOC);
+            return ITZAM_FAILED;
         }
 
-        for (ni = btree->m_min_keys + 1; ni <= btree->m_header->m_order; ++ni)
+        itzam_datafile_write_lock(btree->m_datafile);
+
+        /* set cursor to first index key */
+        if (reset_cursor(cursor))
         {
-            memcpy(page_sibling->m_keys + (ni - 1 - btree->m_min_keys) * btree->m_header->m_sizeof_key, temp_keys + ni * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-            ++page_sibling->m_header->m_key_count;
+            note_cursor(cursor);
+
+            /* increment count of cursors in btree */
+            ++cursor->m_btree->m_cursor_count;
+            result = ITZAM_OKAY;
+        }
+        else
+        {
+            free_spare_memory(cursor);
+            free(cursor->m_key);
+            cursor->m_key = NULL;
         }
 
-        /* replace remaining entries with null
-         */
-        for (ni = btree->m_min_keys; ni < btree->m_header->m_order; ++ni)
-            memset(insert_info->m_page->m_keys + ni * btree->m_header->m_sizeof_key,0,btree->m_header->m_sizeof_key);
+        itzam_datafile_write_unlock(btree->m_datafile);
+    }
 
-        /* write pages
-         */
-        write_page(btree,insert_info->m_page);
-        write_page(btree,page_sibling);
+    return result;
+}
 
-        /* promote key and its pointer
-         */
-        if (insert_info->m_page->m_header->m_parent == ITZAM_NULL_REF)
+itzam_bool itzam_btree_cursor_valid(itzam_btree_cursor * cursor)
+{
+    return (cursor->m_page != NULL);
+}
+
+itzam_state itzam_btree_cursor_free(itzam_btree_cursor * cursor)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    if ((cursor != NULL) && (cursor->m_page != NULL))
+    {
+        itzam_datafile_write_lock(cursor->m_btree->m_datafile);
+
+        /* decrement btree cursor count */
+        if (cursor->m_btree->m_cursor_count > 0)
         {
-            /* creating a new root page
-             */
-            promote_root(btree,
-                         temp_keys + btree->m_min_keys * btree->m_header->m_sizeof_key,
-                         page_sibling);
+            --cursor->m_btree->m_cursor_count;
+            result = ITZAM_OKAY;
         }
         else
-        {
-            /* read parent
-             */
-            page_parent = read_page(btree,insert_info->m_page->m_header->m_parent);
+            cursor->m_btree->m_datafile->m_error_handler("itzam_btree_cursor_free",ITZAM_ERROR_CURSOR_COUNT);
 
-            /* promote key into parent page
-             */
-            promote_internal(btree,
-                             page_parent,
-                             temp_keys + btree->m_min_keys * btree->m_header->m_sizeof_key,
-                             page_sibling->m_header->m_where);
+        /* unpin pages */
+        release_cursor(cursor);
+        free_spare_memory(cursor);
 
-            free_page(page_parent);
-        }
+        free(cursor->m_key);
+        cursor->m_key = NULL;
 
-        /* release sibling page
-         */
-        if (page_sibling->m_header->m_parent != ITZAM_NULL_REF)
-            free_page(page_sibling);
+        itzam_datafile_write_unlock(cursor->m_btree->m_datafile);
+    }
 
-        free(temp_keys);
+    return result;
+}
+
+/* remember the link followed from the current page, before moving down it
+ */
+static itzam_bool push_cursor(itzam_btree_cursor * cursor, size_t index)
+{
+    itzam_btree_cursor_memory * memory = take_memory(cursor);
+
+    if (memory == NULL)
+    {
+        cursor->m_btree->m_datafile->m_error_handler("push_cursor", ITZAM_ERROR_MALLOC);
+        return itzam_false;
     }
-    else
+
+    memory->m_prev = cursor->m_parent_memory;
+    memory->m_index = index;
+    memory->m_where = cursor->m_page->m_header->m_where;
+    cursor->m_parent_memory = memory;
+
+    return itzam_true;
+}
+
+/* return to the parent page, at the link the cursor came down; returns false at the root
+ */
+static itzam_bool pop_cursor(itzam_btree_cursor * cursor)
+{
+    itzam_btree_page * next_page;
+    itzam_btree_cursor_memory * temp_memory;
+
+    if (cursor->m_parent_memory == NULL)
+        return itzam_false;
+
+    next_page = read_page(cursor->m_btree,cursor->m_parent_memory->m_where);
+
+    if (next_page == NULL)
     {
-        int n;
+        cursor->m_btree->m_datafile->m_error_handler("pop_cursor",ITZAM_ERROR_PAGE_NOT_FOUND);
+        return itzam_false;
+    }
 
-        /* move keys to make room for new one
-         */
-        for (n = insert_info->m_page->m_header->m_key_count; n > insert_info->m_index; --n)
-            memcpy(insert_info->m_page->m_keys + n * btree->m_header->m_sizeof_key, insert_info->m_page->m_keys + (n - 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+    /* make new page our current page */
+    free_page(cursor->m_btree,cursor->m_page);
 
-        memcpy(insert_info->m_page->m_keys + insert_info->m_index * btree->m_header->m_sizeof_key, key, btree->m_header->m_sizeof_key);
+    cursor->m_page = next_page;
 
-        ++insert_info->m_page->m_header->m_key_count;
+    /* restore parent page position, remove old parent memory */
+    temp_memory = cursor->m_parent_memory;
+    cursor->m_index = cursor->m_parent_memory->m_index;
+    cursor->m_parent_memory = cursor->m_parent_memory->m_prev;
+    give_memory(cursor, temp_memory);
 
-        /* write updated page
-         */
-        write_page(btree,insert_info->m_page);
+    return itzam_true;
+}
+
+/* move down the link at index; the cursor is left at the start of the child page
+ */
+static itzam_bool descend_cursor(itzam_btree_cursor * cursor, size_t index)
+{
+    itzam_btree_page * next_page = read_page(cursor->m_btree,cursor->m_page->m_links[index]);
+
+    if ((next_page == NULL) || (!cursor->m_btree->m_linked_leaves && !push_cursor(cursor, index)))
+    {
+        if (next_page == NULL)
+            cursor->m_btree->m_datafile->m_error_handler("descend_cursor",ITZAM_ERROR_PAGE_NOT_FOUND);
+        else
+            free_page(cursor->m_btree,next_page);
+
+        return itzam_false;
     }
+
+    free_page(cursor->m_btree,cursor->m_page);
+
+    cursor->m_page = next_page;
+    cursor->m_index = 0;
+
+    return itzam_true;
 }
 
-itzam_state itzam_btree_insert(itzam_btree * btree,
-                               const void * key)
+/* step to the previous or next leaf in a tree with linked leaves; returns false at
+ * either end of the chain, leaving the cursor where it was
+ */
+static itzam_bool follow_leaf(itzam_btree_cursor * cursor, int direction)
 {
-    itzam_state result = ITZAM_FAILED;
-    search_result insert_info;
+    itzam_btree_page * next_page;
+
+    if (cursor->m_page->m_siblings[direction] == ITZAM_NULL_REF)
+        return itzam_false;
 
-    if ((btree != NULL) && (key != NULL) && (btree->m_cursor_count == 0))
+    next_page = read_page(cursor->m_btree,cursor->m_page->m_siblings[direction]);
+
+    if (next_page == NULL)
     {
-        itzam_datafile_mutex_lock(btree->m_datafile);
+        cursor->m_btree->m_datafile->m_error_handler("follow_leaf",ITZAM_ERROR_PAGE_NOT_FOUND);
+        return itzam_false;
+    }
 
-        if (!btree->m_datafile->m_read_only)
-        {
-            search(btree,key,&insert_info);
+    free_page(cursor->m_btree,cursor->m_page);
+    cursor->m_page = next_page;
 
-            if (!insert_info.m_found)
-            {
-                write_key(btree,&insert_info,(const itzam_byte *)key);
-                ++btree->m_header->m_count;
-                ++btree->m_header->m_ticker;
+    return itzam_true;
+}
 
-                result = update_header(btree);
-            }
-            else
-            {
-                result = ITZAM_DUPLICATE;
-            }
+/* from a position at or past the end of a leaf, climb to the next key; at the end of the
+ * keys, the cursor is left on the root, past its last key (or past the end of the last
+ * leaf, when leaves are linked)
+ */
+static itzam_bool climb_next(itzam_btree_cursor * cursor)
+{
+    while (cursor->m_index == cursor->m_page->m_header->m_key_count)
+    {
+        if (cursor->m_btree->m_linked_leaves)
+        {
+            if (!follow_leaf(cursor, NEXT_LEAF))
+                return itzam_false;
 
-            if (insert_info.m_page->m_header->m_parent != ITZAM_NULL_REF)
-                free_page(insert_info.m_page);
+            cursor->m_index = 0;
         }
-        else
-            result = ITZAM_READ_ONLY;
+        else if (!pop_cursor(cursor))
+            return itzam_false;
+    }
 
-        itzam_datafile_mutex_unlock(btree->m_datafile);
+    return itzam_true;
+}
+
+static itzam_bool move_next(itzam_btree_cursor * cursor)
+{
+    ++cursor->m_index;
+
+    /* is this a leaf page? */
+    if (cursor->m_page->m_links[cursor->m_index] == ITZAM_NULL_REF)
+        return climb_next(cursor);
+
+    /* inner page; the next key is the first one in the subtree to the right */
+    do
+    {
+        if (!descend_cursor(cursor, cursor->m_index))
+            return itzam_false;
     }
+    while (cursor->m_page->m_links[0] != ITZAM_NULL_REF);
 
-    //return result;
-    return result;
+    return itzam_true;
 }
 
-static void redistribute(itzam_btree * btree,
-                         int index,
-                         itzam_btree_page * page_before,
-                         itzam_btree_page * page_parent,
-                         itzam_btree_page * page_after)
+/* the key before a position is the last one in the subtree to its left, or, at the start
+ * of a leaf, the parent key before the link that leads to it
+ */
+static itzam_bool move_prev(itzam_btree_cursor * cursor)
 {
-    if ((btree != NULL) && (page_before != NULL) && (page_parent != NULL) && (page_after != NULL))
+    if (cursor->m_page->m_links[cursor->m_index] == ITZAM_NULL_REF)
     {
-       /* check for leaf page
-       */
-        if (page_before->m_links[0] == ITZAM_NULL_REF)
+        while (cursor->m_index == 0)
         {
-            if (page_before->m_header->m_key_count > page_after->m_header->m_key_count)
+            if (cursor->m_btree->m_linked_leaves)
             {
-                int n;
+                if (follow_leaf(cursor, PREV_LEAF))
+                    cursor->m_index = cursor->m_page->m_header->m_key_count;
+                else
+                {
+                    /* at the beginning of the keys */
+                    cursor->m_index = cursor->m_page->m_header->m_key_count;
+                    return itzam_false;
+                }
+            }
+            else if (!pop_cursor(cursor))
+            {
+                /* at the beginning of the keys */
+                cursor->m_index = cursor->m_page->m_header->m_key_count;
+                return itzam_false;
+            }
+        }
 
-                /* move a key from page_before to page_after
-                 */
-                for (n = page_after->m_header->m_key_count; n > 0; --n)
-                    memcpy(page_after->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + (n - 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+        --cursor->m_index;
+        return itzam_true;
+    }
 
-                /* store parent separator in page_after
-                 */
-                memcpy(page_after->m_keys, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+    do
+    {
+        if (!descend_cursor(cursor, cursor->m_index))
+            return itzam_false;
 
-                /* increment page_after key count
-                 */
-                ++page_after->m_header->m_key_count;
+        cursor->m_index = cursor->m_page->m_header->m_key_count;
+    }
+    while (cursor->m_page->m_links[0] != ITZAM_NULL_REF);
 
-                /* decrement page_before key count
-                 */
-                --page_before->m_header->m_key_count;
+    --cursor->m_index;
 
-                /* move last key in page_before to page_parent as separator
-                 */
-                memcpy(page_parent->m_keys + index * btree->m_header->m_sizeof_key, page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+    return itzam_true;
+}
 
-                /* clear last key in page_before
-                 */
-                memset(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
-            }
-            else
-            {
-                int n;
+/* follow the rightmost links down to the last key; in an empty tree, the cursor is left
+ * on the root
+ */
+static itzam_bool last_cursor(itzam_btree_cursor * cursor)
+{
+    release_cursor(cursor);
+    itzam_cache_sync(&cursor->m_btree->m_cache);
 
-                /* add parent key to lesser page
-                 */
-                memcpy(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+    cursor->m_page = &cursor->m_btree->m_root;
+    cursor->m_index = cursor->m_page->m_header->m_key_count;
 
-                /* increment page_before key count
-                 */
-                ++page_before->m_header->m_key_count;
+    if (cursor->m_index == 0)
+        return itzam_false;
 
-                /* move first key in page_after to page_parent as separator
-                 */
-                memcpy(page_parent->m_keys + index * btree->m_header->m_sizeof_key, page_after->m_keys, btree->m_header->m_sizeof_key);
+    while (cursor->m_page->m_links[0] != ITZAM_NULL_REF)
+    {
+        if (!descend_cursor(cursor, cursor->m_index))
+            return itzam_false;
 
-                /* decrement page_after key count
-                 */
-                --page_after->m_header->m_key_count;
+        cursor->m_index = cursor->m_page->m_header->m_key_count;
+    }
 
-                /* move a key from page_after to page_before
-                 */
-                for (n = 0; n < page_after->m_header->m_key_count; ++n)
-                    memcpy(page_after->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+    --cursor->m_index;
 
-                /* clear last key in page_after
-                 */
-                memset(page_after->m_keys + n * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
-            }
-        }
-        else
-        {
-            itzam_btree_page * page_child;
+    return itzam_true;
+}
 
-            if (page_before->m_header->m_key_count > page_after->m_header->m_key_count)
-            {
-                int n;
+static itzam_bool seek_cursor(itzam_btree_cursor * cursor, const void * key, itzam_seek_mode mode);
 
-                /* move a key from page_before to page_after
-                 */
-                for (n = page_after->m_header->m_key_count; n > 0; --n)
-                {
-                    memcpy(page_after->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + (n - 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-                    page_after->m_links[n + 1] = page_after->m_links[n];
-                }
+/* a cursor that has moved past either end of the keys stays there until it is reset,
+ * moved to the last key, or seeks; if the tree has changed since the cursor last moved,
+ * the pages it holds may be stale, and it moves by seeking from the key it was on
+ */
+itzam_bool itzam_btree_cursor_next(itzam_btree_cursor * cursor)
+{
+    itzam_bool result = itzam_false;
 
-                page_after->m_links[1] = page_after->m_links[0];
+    if ((cursor != NULL) && (cursor->m_page != NULL))
+    {
+        itzam_datafile_read_lock(cursor->m_btree->m_datafile);
+        itzam_cache_sync(&cursor->m_btree->m_cache);
 
-                /* store page_parent separator key in page_after
-                 */
-                memcpy(page_after->m_keys, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-                page_after->m_links[0] = page_before->m_links[page_before->m_header->m_key_count];
+        if (cursor->m_on_key)
+        {
+            if (cursor_changed(cursor))
+                result = seek_cursor(cursor, cursor->m_key, ITZAM_KEY_GT);
+            else
+                result = move_next(cursor);
 
-                /* update child link
-                 */
-                page_child = read_page(btree,page_after->m_links[0]);
+            note_cursor(cursor);
+        }
 
-                if (page_child != NULL)
-                {
-                    page_child->m_header->m_parent = page_after->m_header->m_where;
-                    write_page(btree,page_child);
-                    free_page(page_child);
-                }
-                else
-                    btree->m_datafile->m_error_handler("redistribute",ITZAM_ERROR_PAGE_NOT_FOUND);
+        itzam_datafile_read_unlock(cursor->m_btree->m_datafile);
+    }
 
-                /* increment page_after key count
-                 */
-                ++page_after->m_header->m_key_count;
+    return result;
+}
 
-                /* decrement page_before key count
-                 */
-                --page_before->m_header->m_key_count;
+itzam_bool itzam_btree_cursor_prev(itzam_btree_cursor * cursor)
+{
+    itzam_bool result = itzam_false;
 
-                /* move last key in page_before to page_parent as separator
-                 */
-                memcpy(page_parent->m_keys + index * btree->m_header->m_sizeof_key, page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+    if ((cursor != NULL) && (cursor->m_page != NULL))
+    {
+        itzam_datafile_read_lock(cursor->m_btree->m_datafile);
+        itzam_cache_sync(&cursor->m_btree->m_cache);
 
-                /* clear last key in page_before
-                 */
-                memset(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
-                page_before->m_links[page_before->m_header->m_key_count + 1] = ITZAM_NULL_REF;
-            }
+        if (cursor->m_on_key)
+        {
+            if (cursor_changed(cursor))
+                result = seek_cursor(cursor, cursor->m_key, ITZAM_KEY_LT);
             else
-            {
-                int n;
+                result = move_prev(cursor);
 
-                /* store page_parent separator key in page_before
-                 */
-                memcpy(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-                page_before->m_links[page_before->m_header->m_key_count + 1] = page_after->m_links[0];
+            note_cursor(cursor);
+        }
 
-                /* update child link
-                 */
-                page_child = read_page(btree,page_after->m_links[0]);
+        itzam_datafile_read_unlock(cursor->m_btree->m_datafile);
+    }
 
-                if (page_child != NULL)
-                {
-                    page_child->m_header->m_parent = page_before->m_header->m_where;
-                    write_page(btree,page_child);
-                    free_page(page_child);
-                }
-                else
-                    btree->m_datafile->m_error_handler("redistribute",ITZAM_ERROR_PAGE_NOT_FOUND);
+    return result;
+}
 
-                /* increment page_before key count
-                 */
-                ++page_before->m_header->m_key_count;
+itzam_bool itzam_btree_cursor_last(itzam_btree_cursor * cursor)
+{
+    itzam_bool result = itzam_false;
+
+    if ((cursor != NULL) && (cursor->m_page != NULL))
+    {
+        itzam_datafile_read_lock(cursor->m_btree->m_datafile);
+        result = last_cursor(cursor);
+        note_cursor(cursor);
+        itzam_datafile_read_unlock(cursor->m_btree->m_datafile);
+    }
+
+    return result;
+}
+
+/* position the cursor relative to a key in one descent; the path down is remembered so
+ * that the cursor can move on from there
+ */
+static itzam_bool seek_cursor(itzam_btree_cursor * cursor, const void * key, itzam_seek_mode mode)
+{
+    itzam_bool found;
+    size_t index;
 
-                /* move last key in page_after to page_parent as separator
-                 */
-                memcpy(page_parent->m_keys + index * btree->m_header->m_sizeof_key, page_after->m_keys, btree->m_header->m_sizeof_key);
+    release_cursor(cursor);
+    itzam_cache_sync(&cursor->m_btree->m_cache);
 
-                /* decrement page_after key count
-                 */
-                --page_after->m_header->m_key_count;
+    cursor->m_page = &cursor->m_btree->m_root;
 
-                /* move a key from page_after to page_before
-                 */
-                for (n = 0; n < page_after->m_header->m_key_count; ++n)
-                {
-                    memcpy(page_after->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-                    page_after->m_links[n] = page_after->m_links[n + 1];
-                }
+    while (itzam_true)
+    {
+        index = search_page(cursor->m_btree, cursor->m_page, key, &found);
 
-                page_after->m_links[n] = page_after->m_links[n + 1];
+        if (found && cursor->m_btree->m_linked_leaves && (cursor->m_page->m_links[0] != ITZAM_NULL_REF))
+        {
+            ++index;
+            found = itzam_false;
+        }
 
-                /* clear last key in page_after
-                 */
-                memset(page_after->m_keys + n * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
-                page_after->m_links[n + 1] = ITZAM_NULL_REF;
+        cursor->m_index = index;
+
+        if (found)
+        {
+            switch (mode)
+            {
+                case ITZAM_KEY_GT:
+                    return move_next(cursor);
+                case ITZAM_KEY_LT:
+                    return move_prev(cursor);
+                default:
+                    return itzam_true;
             }
         }
 
-        /* write updated pages
-         */
-        write_page(btree,page_before);
-        write_page(btree,page_after);
-        write_page(btree,page_parent);
+        if (cursor->m_page->m_links[index] == ITZAM_NULL_REF)
+            break;
 
-        if(page_parent->m_header->m_parent == ITZAM_NULL_REF)
-            set_root(btree, page_parent);
+        if (!descend_cursor(cursor, index))
+            return itzam_false;
     }
+
+    /* in a leaf, before the first key greater than the search key */
+    if ((mode == ITZAM_KEY_GE) || (mode == ITZAM_KEY_GT))
+        return climb_next(cursor);
+    else
+        return move_prev(cursor);
 }
 
-static void adjust_tree(itzam_btree * btree, itzam_btree_page * page);
+itzam_bool itzam_btree_cursor_seek(itzam_btree_cursor * cursor, const void * key, itzam_seek_mode mode)
+{
+    itzam_bool result = itzam_false;
 
-static void concatenate(itzam_btree * btree, int index, itzam_btree_page * page_before, itzam_btree_page * page_parent, itzam_btree_page * page_after)
+    if ((cursor != NULL) && (cursor->m_page != NULL) && (key != NULL))
+    {
+        itzam_datafile_read_lock(cursor->m_btree->m_datafile);
+        result = seek_cursor(cursor, key, mode);
+        note_cursor(cursor);
+        itzam_datafile_read_unlock(cursor->m_btree->m_datafile);
+    }
+
+    return result;
+}
+
+/* range scans release the read lock after this many keys, so that a long scan does not
+ * hold off writers
+ */
+#define ITZAM_SCAN_YIELD_KEYS 256
+
+uint64_t itzam_btree_scan_range(itzam_btree * btree,
+                                const void * low_key,
+                                const void * high_key,
+                                itzam_key_visitor * visitor,
+                                void * context)
 {
-    int n, n2;
+    uint64_t result = 0;
+    itzam_btree_cursor cursor;
+    itzam_bool more;
 
-    /* move separator key from page_parent into page_before
-     */
-    memcpy(page_before->m_keys + page_before->m_header->m_key_count * btree->m_header->m_sizeof_key, page_parent->m_keys + index * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-    page_before->m_links[page_before->m_header->m_key_count + 1] = page_after->m_links[0];
+    if ((btree == NULL) || (visitor == NULL) || (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree)))
+        return 0;
 
-    /* increment page_before key count
-     */
-    ++page_before->m_header->m_key_count;
+    itzam_datafile_read_lock(btree->m_datafile);
 
-    /* delete separator from page_parent
-     */
-    --page_parent->m_header->m_key_count;
+    if (low_key != NULL)
+        more = seek_cursor(&cursor, low_key, ITZAM_KEY_GE);
+    else
+        more = (cursor.m_index < cursor.m_page->m_header->m_key_count);
 
-    for (n = index; n < page_parent->m_header->m_key_count; ++n)
+    while (more)
     {
-        memcpy(page_parent->m_keys + n * btree->m_header->m_sizeof_key, page_parent->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-        page_parent->m_links[n + 1] = page_parent->m_links[n + 2];
+        const itzam_byte * key = full_key(btree, cursor.m_page, cursor.m_index, cursor.m_key);
+
+        /* the range is half-open; stop at the first key not below the end */
+        if ((high_key != NULL) && (btree->m_key_comparator(key, high_key) >= 0))
+            break;
+
+        ++result;
+
+        if (!visitor(context, key))
+            break;
+
+        /* let writers in now and then; if they change the tree, carry on after the last
+         * key visited
+         */
+        if ((result % ITZAM_SCAN_YIELD_KEYS) == 0)
+        {
+            note_cursor(&cursor);
+            itzam_datafile_read_unlock(btree->m_datafile);
+            itzam_datafile_read_lock(btree->m_datafile);
+            itzam_cache_sync(&btree->m_cache);
+
+            if (cursor_changed(&cursor))
+            {
+                more = seek_cursor(&cursor, cursor.m_key, ITZAM_KEY_GT);
+                continue;
+            }
+        }
+
+        more = move_next(&cursor);
     }
 
-    /* clear unused key from parent
-     */
-    memset(page_parent->m_keys + n * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
-    page_parent->m_links[n + 1] = ITZAM_NULL_REF;
+    itzam_datafile_read_unlock(btree->m_datafile);
 
-    /* copy keys from page_after to page_before
-     */
-    n2 = 0;
-    n = page_before->m_header->m_key_count;
+    itzam_btree_cursor_free(&cursor);
 
-    /* combine pages
+    return result;
+}
+
+uint64_t itzam_btree_scan_range_reverse(itzam_btree * btree,
+                                        const void * low_key,
+                                        const void * high_key,
+                                        itzam_key_visitor * visitor,
+                                        void * context)
+{
+    uint64_t result = 0;
+    itzam_btree_cursor cursor;
+    itzam_bool more;
+
+    if ((btree == NULL) || (visitor == NULL))
+        return 0;
+
+    /* a private cursor, positioned from the right; the read lock keeps writers out for
+     * the length of the scan
      */
-    while (n2 < page_after->m_header->m_key_count)
+    cursor.m_btree = btree;
+    cursor.m_page = NULL;
+    cursor.m_index = 0;
+    cursor.m_parent_memory = NULL;
+    cursor.m_spare_memory = NULL;
+    cursor.m_key = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+
+    if (cursor.m_key == NULL)
     {
-        ++page_before->m_header->m_key_count;
-        memcpy(page_before->m_keys + n * btree->m_header->m_sizeof_key, page_after->m_keys + n2 * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
-        page_before->m_links[n + 1] = page_after->m_links[n2 + 1];
-        ++n2;
-        ++n;
+        btree->m_datafile->m_error_handler("itzam_btree_scan_range_reverse",ITZAM_ERROR_MALLOC);
+        return 0;
     }
 
-    /* delete page_after
-     */
-    itzam_datafile_seek(btree->m_datafile,page_after->m_header->m_where);
-    itzam_datafile_remove(btree->m_datafile);
+    itzam_datafile_read_lock(btree->m_datafile);
 
-    /* is this an inner page?
-     */
-    if (page_before->m_links[0] != ITZAM_NULL_REF)
+    if (high_key != NULL)
+        more = seek_cursor(&cursor, high_key, ITZAM_KEY_LT);
+    else
+        more = last_cursor(&cursor);
+
+    while (more)
     {
-        /* adjust child pointers
-         */
-        itzam_btree_page * page_child;
+        const itzam_byte * key = full_key(btree, cursor.m_page, cursor.m_index, cursor.m_key);
 
-        for (n = 0; n <= page_before->m_header->m_key_count; ++n)
+        /* the low end is included in the range */
+        if ((low_key != NULL) && (btree->m_key_comparator(key, low_key) < 0))
+            break;
+
+        ++result;
+
+        if (!visitor(context, key))
+            break;
+
+        if ((result % ITZAM_SCAN_YIELD_KEYS) == 0)
         {
-            /* read child
-             */
-            page_child = read_page(btree,page_before->m_links[n]);
+            note_cursor(&cursor);
+            itzam_datafile_read_unlock(btree->m_datafile);
+            itzam_datafile_read_lock(btree->m_datafile);
+            itzam_cache_sync(&btree->m_cache);
 
-            /* make sure the child was actually read
-             */
-            if (page_child != NULL)
+            if (cursor_changed(&cursor))
             {
-                page_child->m_header->m_parent = page_before->m_header->m_where;
-                write_page(btree,page_child);
-                free_page(page_child);
+                more = seek_cursor(&cursor, cursor.m_key, ITZAM_KEY_LT);
+                continue;
             }
-            else
-                btree->m_datafile->m_error_handler("concatenate",ITZAM_ERROR_PAGE_NOT_FOUND);
         }
+
+        more = move_prev(&cursor);
     }
 
-    /* write page_before and parent
-     */
-    if (page_parent->m_header->m_key_count == 0)
-    {
-        /* update before page with old parent's parent
-         */
-        page_before->m_header->m_parent = page_parent->m_header->m_parent;
-        write_page(btree,page_before);
+    release_cursor(&cursor);
+    free_spare_memory(&cursor);
+    free(cursor.m_key);
 
-        if (page_before->m_header->m_parent == ITZAM_NULL_REF)
-        {
-            /* update the header if this is the new root
-             */
-            set_root(btree,page_before);
-        }
-        else
-        {
-            /* read parents's parent
-             */
-            itzam_btree_page * parents_parent = read_page(btree,page_parent->m_header->m_parent);
+    itzam_datafile_read_unlock(btree->m_datafile);
 
-            /* find parent reference and replace with before page
-             */
-            if (parents_parent != NULL)
-            {
-                for (n = 0; n < btree->m_links_size; ++n)
-                {
-                    if (parents_parent->m_links[n] == page_parent->m_header->m_where)
-                    {
-                        parents_parent->m_links[n] = page_before->m_header->m_where;
-                        write_page(btree,parents_parent);
-                    }
-                }
+    return result;
+}
 
-                free_page(parents_parent);
-            }
-        }
+itzam_bool itzam_btree_cursor_reset(itzam_btree_cursor * cursor)
+{
+    itzam_bool result = itzam_false;
 
-        /* remove empty parent page
-         */
-        itzam_datafile_seek(btree->m_datafile,page_parent->m_header->m_where);
-        itzam_datafile_remove(btree->m_datafile);
+    if (cursor != NULL)
+    {
+        itzam_datafile_read_lock(cursor->m_btree->m_datafile);
+        result = reset_cursor(cursor);
+        note_cursor(cursor);
+        itzam_datafile_read_unlock(cursor->m_btree->m_datafile);
     }
-    else
+
+    return result;
+}
+
+itzam_state itzam_btree_cursor_read(itzam_btree_cursor * cursor, void * returned_key)
+{
+    itzam_state result = ITZAM_NOT_FOUND;
+
+    if ((cursor != NULL) && (returned_key != NULL) && (cursor->m_page != NULL))
     {
-        /* write pages
-         */
-        write_page(btree,page_parent);
-        write_page(btree,page_before);
+        itzam_datafile_read_lock(cursor->m_btree->m_datafile);
 
-        /* reset root page if needed
+        /* if the key the cursor was on has been removed, it moves on to the next one
          */
-        if (page_parent->m_header->m_parent == ITZAM_NULL_REF)
-            set_root(btree,page_parent);
+        if (cursor->m_on_key && cursor_changed(cursor))
+        {
+            itzam_cache_sync(&cursor->m_btree->m_cache);
+            seek_cursor(cursor, cursor->m_key, ITZAM_KEY_GE);
+            note_cursor(cursor);
+        }
 
-        /* if parent is too small, adjust
-         */
-        if (page_parent->m_header->m_key_count < btree->m_min_keys)
-            adjust_tree(btree,page_parent);
+        if (cursor->m_on_key)
+        {
+            memcpy(returned_key, cursor->m_key, input_key_size(cursor->m_btree, cursor->m_key));
+            result = ITZAM_OKAY;
+        }
+
+        itzam_datafile_read_unlock(cursor->m_btree->m_datafile);
     }
+
+    return result;
 }
 
-static void adjust_tree(itzam_btree * btree, itzam_btree_page * page)
+/*-----------------------------------------------------------------------------
+ * snapshots
+ *
+ * A snapshot reads the tree without the read lock. Writers that run while snapshots are
+ * active keep the contents each page had before they changed it, so a snapshot can read
+ * any page either from the cache or file (if it has not changed since the snapshot began)
+ * or from the oldest version replaced after the snapshot began.
+ */
+
+itzam_state itzam_btree_snapshot_begin(itzam_btree * btree, itzam_btree_snapshot * snapshot)
 {
-    if ((btree != NULL) && (page != NULL) && (page->m_header->m_parent != ITZAM_NULL_REF))
+    itzam_state result = ITZAM_FAILED;
+
+    if ((btree != NULL) && (snapshot != NULL))
     {
-        /* get parent page
+        /* the read lock waits out any write in progress, so the snapshot begins between writes
          */
-        itzam_btree_page * page_parent = read_page(btree,page->m_header->m_parent);
+        itzam_datafile_read_lock(btree->m_datafile);
+        itzam_cache_sync(&btree->m_cache);
 
-        if (page_parent != NULL)
+        version_write_lock(btree);
+
+        if (btree->m_versions == NULL)
+            btree->m_versions = (itzam_page_version **)calloc(ITZAM_VERSION_BUCKETS, sizeof(itzam_page_version *));
+
+        if (btree->m_versions != NULL)
         {
-            itzam_btree_page * page_sibling_after  = NULL;
-            itzam_btree_page * page_sibling_before = NULL;
+            snapshot->m_btree      = btree;
+            snapshot->m_epoch      = btree->m_epoch;
+            snapshot->m_root_where = btree->m_header->m_root_where;
+            snapshot->m_count      = btree->m_header->m_count;
+            snapshot->m_next       = btree->m_snapshots;
 
-            /* find pointer to page
-             */
-            int n = 0;
+            btree->m_snapshots = snapshot;
 
-            while (page_parent->m_links[n] != page->m_header->m_where)
-                ++n;
+            result = ITZAM_OKAY;
+        }
+        else
+            btree->m_datafile->m_error_handler("itzam_btree_snapshot_begin",ITZAM_ERROR_MALLOC);
 
-            /* read sibling pages
-             */
-            if (n < page_parent->m_header->m_key_count)
-                page_sibling_after = read_page(btree,page_parent->m_links[n+1]);
+        version_write_unlock(btree);
 
-            if (n > 0)
-                page_sibling_before = read_page(btree,page_parent->m_links[n-1]);
+        itzam_datafile_read_unlock(btree->m_datafile);
+    }
 
-            /* figure out what to do
-             */
-            if (page_sibling_before != NULL)
-            {
-                --n;
+    return result;
+}
 
-                if (page_sibling_before->m_header->m_key_count > btree->m_min_keys)
-                    redistribute(btree,n,page_sibling_before,page_parent,page);
-                else
-                    concatenate(btree,n,page_sibling_before,page_parent,page);
-            }
-            else
+itzam_state itzam_btree_snapshot_end(itzam_btree_snapshot * snapshot)
+{
+    itzam_state result = ITZAM_NOT_FOUND;
+    itzam_btree_snapshot ** link;
+
+    if ((snapshot != NULL) && (snapshot->m_btree != NULL))
+    {
+        itzam_btree * btree = snapshot->m_btree;
+
+        version_write_lock(btree);
+
+        for (link = &btree->m_snapshots; *link != NULL; link = &(*link)->m_next)
+        {
+            if (*link == snapshot)
             {
-                if (page_sibling_after != NULL)
-                {
-                    if (page_sibling_after->m_header->m_key_count > btree->m_min_keys)
-                        redistribute(btree,n,page,page_parent,page_sibling_after);
-                    else
-                        concatenate(btree,n,page,page_parent,page_sibling_after);
-                }
+                *link = snapshot->m_next;
+                result = ITZAM_OKAY;
+                break;
             }
+        }
 
-            if (page_sibling_before != NULL)
-                free_page(page_sibling_before);
+        /* versions only the oldest snapshots could see are no longer needed
+         */
+        reclaim_versions(btree);
 
-            if (page_sibling_after != NULL)
-                free_page(page_sibling_after);
+        version_write_unlock(btree);
 
-            if (page_parent->m_header->m_parent != ITZAM_NULL_REF)
-                free_page(page_parent);
-        }
+        snapshot->m_btree = NULL;
     }
+
+    return result;
 }
 
-itzam_state itzam_btree_remove(itzam_btree * btree, const void * key)
+uint64_t itzam_btree_snapshot_count(itzam_btree_snapshot * snapshot)
 {
-    itzam_state result = ITZAM_FAILED;
-    search_result remove_info;
-
-    if ((btree != NULL) && (key != NULL) && (btree->m_cursor_count == 0))
-    {
-        itzam_datafile_mutex_lock(btree->m_datafile);
+    uint64_t result = 0;
 
-        if (btree->m_datafile->m_read_only)
-            result = ITZAM_READ_ONLY;
-        else
-        {
-            search(btree,key,&remove_info);
+    if ((snapshot != NULL) && (snapshot->m_btree != NULL))
+        result = snapshot->m_count;
 
-            if (remove_info.m_found)
-            {
-                /* is this a leaf node?
-                */
-                if (remove_info.m_page->m_links[0] == ITZAM_NULL_REF)
-                {
-                    int n;
+    return result;
+}
 
-                    /* removing key from leaf
-                    */
-                    --remove_info.m_page->m_header->m_key_count;
+/* copy a page as the snapshot sees it; holding the version lock keeps writers from
+ * changing a page between the search for its versions and the copy
+ */
+static itzam_bool snapshot_page(itzam_btree_snapshot * snapshot, itzam_ref where, itzam_btree_page * page)
+{
+    itzam_btree * btree = snapshot->m_btree;
+    itzam_page_version * version;
+    itzam_bool result = itzam_true;
 
-                    /* slide keys left over removed one
-                    */
-                    for (n = remove_info.m_index; n < remove_info.m_page->m_header->m_key_count; ++n)
-                        memcpy(remove_info.m_page->m_keys + n * btree->m_header->m_sizeof_key, remove_info.m_page->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+    version_read_lock(btree);
 
-                    memset( remove_info.m_page->m_keys + remove_info.m_page->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+    version = find_version(btree, where, snapshot->m_epoch);
 
-                    /* save page
-                    */
-                    write_page(btree,remove_info.m_page);
+    if (version != NULL)
+        memcpy(page->m_data, version->m_data, btree->m_header->m_sizeof_page);
+    else if (ITZAM_OKAY != itzam_cache_peek(&btree->m_cache, where, page->m_data))
+        result = itzam_false;
 
-                    /* adjust the tree, if needed
-                    */
-                    if (remove_info.m_page->m_header->m_key_count < btree->m_min_keys)
-                        adjust_tree(btree,remove_info.m_page);
+    version_read_unlock(btree);
 
-                    result = ITZAM_OKAY;
-                }
-                else /* removing from an internal page */
-                {
-                    /* get the successor page
-                    */
-                    itzam_btree_page * page_successor = read_page(btree,remove_info.m_page->m_links[remove_info.m_index + 1]);
+    return result;
+}
 
-                    if (page_successor != NULL)
-                    {
-                        int n;
+/* a page buffer for snapshot readers, which never touch the cache's frames
+ */
+static itzam_bool snapshot_alloc(itzam_btree * btree, itzam_btree_page * page)
+{
+    itzam_byte * memory = (itzam_byte *)malloc(btree->m_header->m_sizeof_page);
 
-                        while (page_successor->m_links[0] != ITZAM_NULL_REF)
-                        {
-                            itzam_btree_page * next_successor = read_page(btree,page_successor->m_links[0]);
+    if (memory == NULL)
+    {
+        btree->m_datafile->m_error_handler("snapshot_alloc",ITZAM_ERROR_MALLOC);
+        return itzam_false;
+    }
 
-                            /* check for null page in case of corrupted index
-                            */
-                            if (next_successor != NULL)
-                            {
-                                free_page(page_successor);
-                                page_successor = next_successor;
-                            }
-                            else
-                                btree->m_datafile->m_error_handler("itzam_btree_remove",ITZAM_ERROR_PAGE_NOT_FOUND);
-                        }
+    set_page(btree, page, memory);
+    page->m_frame = NULL;
 
-                        /* first key is the "swappee"
-                        */
-                        memcpy(remove_info.m_page->m_keys + remove_info.m_index * btree->m_header->m_sizeof_key, page_successor->m_keys, btree->m_header->m_sizeof_key);
+    return itzam_true;
+}
 
-                        /* remove swapped key from successor page
-                        */
-                        --page_successor->m_header->m_key_count;
+itzam_bool itzam_btree_snapshot_find(itzam_btree_snapshot * snapshot, const void * key, void * returned_key)
+{
+    itzam_bool result = itzam_false;
+    itzam_btree_page page;
+    itzam_btree * btree;
+    itzam_ref where;
+    itzam_bool found;
+    int index;
 
-                        for (n = 0; n < page_successor->m_header->m_key_count; ++n)
-                            memcpy(page_successor->m_keys + n * btree->m_header->m_sizeof_key, page_successor->m_keys + (n + 1) * btree->m_header->m_sizeof_key, btree->m_header->m_sizeof_key);
+    if ((snapshot == NULL) || (snapshot->m_btree == NULL) || (key == NULL))
+        return itzam_false;
 
-                        memset(page_successor->m_keys + page_successor->m_header->m_key_count * btree->m_header->m_sizeof_key, 0, btree->m_header->m_sizeof_key);
+    btree = snapshot->m_btree;
 
-                        /* write modified pages
-                        */
-                        write_page(btree,remove_info.m_page);
-                        write_page(btree,page_successor);
+    if (!snapshot_alloc(btree, &page))
+        return itzam_false;
 
-                        /* adjust tree for leaf node
-                        */
-                        if (page_successor->m_header->m_key_count < btree->m_min_keys)
-                            adjust_tree(btree,page_successor);
+    where = snapshot->m_root_where;
 
-                        result = ITZAM_OKAY;
+    while ((where != ITZAM_NULL_REF) && snapshot_page(snapshot, where, &page))
+    {
+        index = search_page(btree, &page, key, &found);
 
-                        free_page(page_successor);
-                    }
-                }
+        /* separators in a linked-leaf tree are copies; the key itself is to the right
+         */
+        if (found && btree->m_linked_leaves && (page.m_links[0] != ITZAM_NULL_REF))
+        {
+            ++index;
+            found = itzam_false;
+        }
 
-                /* decrement number of records in file
-                */
-                --btree->m_header->m_count;
-                update_header(btree);
-            }
-            else
-            {
-                result = ITZAM_NOT_FOUND;
-            }
+        if (found)
+        {
+            if (returned_key != NULL)
+                copy_key(btree, returned_key, &page, index);
 
-            if (remove_info.m_page->m_header->m_parent != ITZAM_NULL_REF)
-                free_page(remove_info.m_page);
+            result = itzam_true;
+            break;
         }
 
-        itzam_datafile_mutex_unlock(btree->m_datafile);
+        where = page.m_links[index];
     }
 
+    free(page.m_data);
+
     return result;
 }
 
-uint16_t itzam_btree_cursor_count(itzam_btree * btree)
+/* working storage for a snapshot scan; one page buffer per level of the tree
+ */
+typedef struct t_snapshot_scan
 {
-    uint16_t result = 0;
+    itzam_btree_snapshot * m_snapshot;
+    const void *           m_high_key;
+    itzam_key_visitor *    m_visitor;
+    void *                 m_context;
+    uint64_t               m_count;
+    itzam_byte *           m_key;          /* keys stored after a prefix are put back together here */
+    int                    m_level_count;
+    itzam_btree_page       m_levels[ITZAM_SNAPSHOT_MAX_LEVELS];
+}
+snapshot_scan;
 
-    if (btree != NULL)
+/* visit the keys of a subtree in order, starting at the first key not below low_key;
+ * returns false when the scan should stop
+ */
+static itzam_bool scan_subtree(snapshot_scan * scan, itzam_ref where, int level, const void * low_key)
+{
+    itzam_btree * btree = scan->m_snapshot->m_btree;
+    itzam_btree_page * page;
+    itzam_bool found = itzam_false;
+    itzam_bool leaf;
+    int index = 0;
+
+    if (level == ITZAM_SNAPSHOT_MAX_LEVELS)
+        return itzam_false;
+
+    if (level == scan->m_level_count)
     {
-        itzam_datafile_mutex_lock(btree->m_datafile);
-        result = btree->m_cursor_count;
-        itzam_datafile_mutex_unlock(btree->m_datafile);
+        if (!snapshot_alloc(btree, &scan->m_levels[level]))
+            return itzam_false;
+
+        ++scan->m_level_count;
     }
 
-    return result;
-}
+    page = &scan->m_levels[level];
 
-itzam_state itzam_btree_transaction_start(itzam_btree * btree)
-{
-    itzam_state result = ITZAM_FAILED;
+    if (!snapshot_page(scan->m_snapshot, where, page))
+        return itzam_false;
 
-    if (btree != NULL)
+    leaf = (page->m_links[0] == ITZAM_NULL_REF) ? itzam_true : itzam_false;
+
+    if (low_key != NULL)
     {
-        itzam_datafile_mutex_lock(btree->m_datafile);
-        result = itzam_datafile_transaction_start(btree->m_datafile);
+        index = search_page(btree, page, low_key, &found);
 
-        if (result == ITZAM_OKAY)
-            btree->m_saved_header = itzam_datafile_write(btree->m_datafile->m_tran_file, btree->m_header, sizeof(itzam_btree_header), ITZAM_NULL_REF);
+        if (found && btree->m_linked_leaves && !leaf)
+        {
+            ++index;
+            found = itzam_false;
+        }
     }
 
-    return result;
-}
+    for (; index <= page->m_header->m_key_count; ++index)
+    {
+        /* keys in the link left of a key equal to low_key are all below it
+         */
+        if (!leaf && !found)
+        {
+            if (!scan_subtree(scan, page->m_links[index], level + 1, low_key))
+                return itzam_false;
+        }
 
-itzam_state itzam_btree_transaction_commit(itzam_btree * btree)
-{
-    itzam_state result = ITZAM_FAILED;
+        found    = itzam_false;
+        low_key  = NULL;
 
-    if (btree != NULL)
-    {
-        result = itzam_datafile_transaction_commit(btree->m_datafile);
-        itzam_datafile_mutex_unlock(btree->m_datafile);
+        /* the separators of a linked-leaf tree are not keys
+         */
+        if ((index < page->m_header->m_key_count) && (leaf || !btree->m_linked_leaves))
+        {
+            const itzam_byte * key = full_key(btree, page, index, scan->m_key);
+
+            if ((scan->m_high_key != NULL) && (btree->m_key_comparator(key, scan->m_high_key) >= 0))
+                return itzam_false;
+
+            ++scan->m_count;
+
+            if (!scan->m_visitor(scan->m_context, key))
+                return itzam_false;
+        }
     }
 
-    return result;
+    return itzam_true;
 }
 
-itzam_state itzam_btree_transaction_rollback(itzam_btree * btree)
+uint64_t itzam_btree_snapshot_scan(itzam_btree_snapshot * snapshot,
+                                   const void * low_key,
+                                   const void * high_key,
+                                   itzam_key_visitor * visitor,
+                                   void * context)
 {
-    itzam_state result = ITZAM_FAILED;
-    itzam_btree_page * old_root;
+    snapshot_scan scan;
+    int n;
 
-    if (btree != NULL)
+    if ((snapshot == NULL) || (snapshot->m_btree == NULL) || (visitor == NULL))
+        return 0;
+
+    scan.m_snapshot    = snapshot;
+    scan.m_high_key    = high_key;
+    scan.m_visitor     = visitor;
+    scan.m_context     = context;
+    scan.m_count       = 0;
+    scan.m_level_count = 0;
+    scan.m_key         = (itzam_byte *)malloc(snapshot->m_btree->m_header->m_sizeof_key);
+
+    if (scan.m_key == NULL)
     {
-        /* turn off transaction processing so we can restore
-         */
-        btree->m_datafile->m_in_transaction = itzam_false;
-        itzam_datafile_seek(btree->m_datafile->m_tran_file, btree->m_saved_header);
-        itzam_datafile_read(btree->m_datafile->m_tran_file, btree->m_header, sizeof(itzam_btree_header));
-        update_header(btree);
+        snapshot->m_btree->m_datafile->m_error_handler("itzam_btree_snapshot_scan",ITZAM_ERROR_MALLOC);
+        return 0;
+    }
 
-        /* turn transaction processing on again
-         */
-        btree->m_datafile->m_in_transaction = itzam_true;
-        result = itzam_datafile_transaction_rollback(btree->m_datafile);
+    scan_subtree(&scan, snapshot->m_root_where, 0, low_key);
 
-        /* restore the root
-         */
-        old_root = read_page(btree,btree->m_header->m_root_where);
-        //free(btree->m_root.m_data);
-        memcpy(btree->m_root_data, old_root->m_data, btree->m_header->m_sizeof_page);
+    for (n = 0; n < scan.m_level_count; ++n)
+        free(scan.m_levels[n].m_data);
 
-        /* done here
-         */
-        itzam_datafile_mutex_unlock(btree->m_datafile);
-    }
+    free(scan.m_key);
 
-    return result;
+    return scan.m_count;
 }
 
-/**
- *------------------------------------------------------------
- * B-tree cursor functions
+/*-----------------------------------------------------------------------------
+ * asynchronous lookups; pages missing from the cache are read through a file ring, so many
+ * lookups can wait on the disk at once. No lock is held while reads are in flight; each
+ * read notes the file generation, and a lookup starts again from the root if a writer has
+ * changed the file by the time its page arrives
  */
 
-static itzam_bool reset_cursor(itzam_btree_cursor * cursor)
-{
-    itzam_bool result = itzam_false;
-    itzam_bool looking = itzam_true;
+/* most completions handled by one poll
+ */
+#define ITZAM_ASYNC_REAP 64
 
-    /* read root */
-    itzam_btree_page * next_page = NULL;
-    itzam_btree_cursor_memory * next_memory = NULL;
-    itzam_btree_page * page = &cursor->m_btree->m_root;
+/* continue a lookup from page, following pages through the cache for as long as they are
+ * there; the read lock must be held. Returns itzam_true when the lookup has finished, and
+ * itzam_false when it waits on a queued read
+ */
+static itzam_bool async_descend(itzam_btree_async * async, itzam_btree_lookup * lookup, itzam_btree_page * page)
+{
+    itzam_btree * btree = async->m_btree;
+    itzam_cache_frame * frame = NULL;
+    itzam_cache_frame * next_frame;
+    itzam_bool result = itzam_true;
+    itzam_ref where;
+    int index;
 
-    /* follow the tree to the first key in the sequence */
-    cursor->m_parent_memory = NULL;
-    cursor->m_page = NULL;
-    cursor->m_index = 0;
+    lookup->m_found = itzam_false;
 
-    while (looking && (page != NULL))
+    while (page->m_header->m_key_count > 0)
     {
-        if (page->m_header->m_key_count > 0)
+        index = search_page(btree, page, lookup->m_key, &lookup->m_found);
+
+        if (lookup->m_found && btree->m_linked_leaves && (page->m_links[0] != ITZAM_NULL_REF))
         {
-            if (page->m_links[0] == ITZAM_NULL_REF)
-            {
-                /* found the first key */
-                cursor->m_page = page;
-                cursor->m_index = 0;
-                result = itzam_true;
-                looking = itzam_false;
-            }
-            else
-            {
-                /* remember position in parent page */
-                next_memory = (itzam_btree_cursor_memory *)malloc(sizeof(itzam_btree_cursor_memory));
+            ++index;
+            lookup->m_found = itzam_false;
+        }
 
-                if (next_memory == NULL)
-                    cursor->m_btree->m_datafile->m_error_handler("reset_sursor", ITZAM_ERROR_MALLOC);
+        if (lookup->m_found)
+        {
+            copy_key(btree, lookup->m_found_key, page, index);
+            break;
+        }
 
-                next_memory->m_prev = cursor->m_parent_memory;
-                next_memory->m_index = 0;
-                cursor->m_parent_memory = next_memory;
+        where = page->m_links[index];
 
-                /* move to next page */
-                next_page = read_page(cursor->m_btree,page->m_links[0]);
+        if (where == ITZAM_NULL_REF)
+            break;
 
-                if (page->m_header->m_parent != ITZAM_NULL_REF)
-                    free_page(page);
+        next_frame = itzam_cache_probe(&btree->m_cache, where);
 
-                page = next_page;
-            }
-        }
-        else
+        if (next_frame == NULL)
         {
-            free_page(page);
-            cursor->m_page = NULL;
-            cursor->m_index = 0;
-            cursor->m_parent_memory = NULL;
-            looking = itzam_false;
+            /* page may be the lookup's buffer, so it is not used after the read is queued
+             */
+            lookup->m_where      = where;
+            lookup->m_generation = btree->m_datafile->m_shared->m_generation;
+
+            if (itzam_file_ring_read(async->m_ring, btree->m_datafile->m_file, lookup->m_buffer,
+                                     btree->m_datafile->m_sizeof_header + btree->m_header->m_sizeof_page,
+                                     where, (uint64_t)(lookup - async->m_lookups)))
+                result = itzam_false;
+            else
+                btree->m_datafile->m_error_handler("itzam_btree_find_async",ITZAM_ERROR_READ_FAILED);
+
+            break;
         }
+
+        itzam_cache_release(&btree->m_cache, frame);
+        frame = next_frame;
+        set_page(btree, page, frame->m_data);
     }
 
+    itzam_cache_release(&btree->m_cache, frame);
+
     return result;
 }
 
-itzam_state itzam_btree_cursor_create(itzam_btree_cursor * cursor, itzam_btree * btree)
+/* a page has been read for a lookup; the read lock must be held
+ */
+static itzam_bool async_arrived(itzam_btree_async * async, itzam_btree_lookup * lookup, itzam_bool read)
 {
-    itzam_state result = ITZAM_FAILED;
+    itzam_btree * btree = async->m_btree;
+    itzam_btree_page page = btree->m_root;
+    itzam_btree_page * cached;
+    const void * data = NULL;
+    itzam_bool result = itzam_true;
 
-    if ((cursor != NULL) && (btree != NULL))
+    /* a writer changed the file while the page was in flight
+     */
+    if (lookup->m_generation != btree->m_datafile->m_shared->m_generation)
+        return async_descend(async, lookup, &page);
+
+    if (read)
+        data = itzam_datafile_record_data(btree->m_datafile, lookup->m_buffer, btree->m_header->m_sizeof_page);
+
+    if (data != NULL)
     {
-        /* keep reference to target tree */
-        cursor->m_btree = btree;
+        itzam_cache_fill(&btree->m_cache, lookup->m_where, data);
+        set_page(btree, &page, (itzam_byte *)data);
+        result = async_descend(async, lookup, &page);
+    }
+    else
+    {
+        /* let the cache read the page, and report it if it can't
+         */
+        cached = read_page(btree, lookup->m_where);
 
-        /* set cursor to first index key */
-        if (reset_cursor(cursor))
+        if (cached != NULL)
         {
-            /* increment count of cursors in btree */
-            ++cursor->m_btree->m_cursor_count;
-            result = ITZAM_OKAY;
+            set_page(btree, &page, cached->m_data);
+            result = async_descend(async, lookup, &page);
+            free_page(btree, cached);
         }
+        else
+            lookup->m_found = itzam_false;
     }
 
     return result;
 }
 
-itzam_bool itzam_btree_cursor_valid(itzam_btree_cursor * cursor)
+/* hand a finished lookup to its callback, then make it available again
+ */
+static void async_finish(itzam_btree_async * async, itzam_btree_lookup * lookup)
 {
-    return (cursor->m_page != NULL);
+    lookup->m_callback(lookup->m_context, lookup->m_key, lookup->m_found ? lookup->m_found_key : NULL);
+
+    async->m_free[async->m_free_count++] = (uint32_t)(lookup - async->m_lookups);
 }
 
-itzam_state itzam_btree_cursor_free(itzam_btree_cursor * cursor)
+itzam_state itzam_btree_async_create(itzam_btree_async * async, itzam_btree * btree, uint32_t depth)
 {
     itzam_state result = ITZAM_FAILED;
+    itzam_btree_lookup * lookup;
+    size_t stride;
+    uint32_t n;
 
-    if ((cursor != NULL) && (cursor->m_page != NULL))
+    if ((async != NULL) && (btree != NULL) && (depth > 0))
     {
-        /* decrement btree cursor count */
-        if (cursor->m_btree->m_cursor_count > 0)
+        /* each lookup has a page buffer and two keys, kept aligned for the page's links
+         */
+        stride = btree->m_datafile->m_sizeof_header + btree->m_header->m_sizeof_page + 2 * btree->m_header->m_sizeof_key;
+        stride = (stride + sizeof(itzam_ref) - 1) & ~(sizeof(itzam_ref) - 1);
+
+        async->m_btree      = btree;
+        async->m_depth      = depth;
+        async->m_active     = 0;
+        async->m_free_count = depth;
+        async->m_ring       = itzam_file_ring_create(depth);
+        async->m_lookups    = (itzam_btree_lookup *)malloc(depth * sizeof(itzam_btree_lookup));
+        async->m_free       = (uint32_t *)malloc(depth * sizeof(uint32_t));
+        async->m_memory     = (itzam_byte *)malloc(depth * stride);
+
+        if ((async->m_ring != NULL) && (async->m_lookups != NULL) && (async->m_free != NULL) && (async->m_memory != NULL))
         {
-            --cursor->m_btree->m_cursor_count;
+            for (n = 0; n < depth; ++n)
+            {
+                lookup = &async->m_lookups[n];
+
+                lookup->m_buffer    = async->m_memory + n * stride;
+                lookup->m_key       = lookup->m_buffer + btree->m_datafile->m_sizeof_header + btree->m_header->m_sizeof_page;
+                lookup->m_found_key = lookup->m_key + btree->m_header->m_sizeof_key;
+
+                async->m_free[n] = depth - 1 - n;
+            }
+
             result = ITZAM_OKAY;
         }
         else
-            cursor->m_btree->m_datafile->m_error_handler("itzam_btree_cursor_free",ITZAM_ERROR_CURSOR_COUNT);
+        {
+            itzam_file_ring_destroy(async->m_ring);
+            free(async->m_lookups);
+            free(async->m_free);
+            free(async->m_memory);
+
+            async->m_ring = NULL;
+
+            btree->m_datafile->m_error_handler("itzam_btree_async_create",ITZAM_ERROR_MALLOC);
+        }
     }
+    else
+        default_error_handler("itzam_btree_async_create",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
     return result;
 }
 
-itzam_bool itzam_btree_cursor_next(itzam_btree_cursor * cursor)
+/* finishes any lookups still in flight, calling their callbacks
+ */
+itzam_state itzam_btree_async_free(itzam_btree_async * async)
 {
-    itzam_bool result = itzam_false;
-    itzam_bool looking = itzam_true;
-    itzam_btree_page * next_page = NULL;
-    itzam_btree_cursor_memory * temp_memory = NULL;
+    itzam_state result = ITZAM_FAILED;
 
-    if ((cursor != NULL) && (cursor->m_page != NULL))
+    if ((async != NULL) && (async->m_ring != NULL))
     {
-        ++cursor->m_index;
+        while (async->m_active > 0)
+            itzam_btree_async_poll(async, itzam_true);
 
-        /* is this a leaf page? */
-        if (cursor->m_page->m_links[cursor->m_index] == ITZAM_NULL_REF)
-        {
-            while (looking)
-            {
-                /* are we at the end of the leaf page? */
-                if (cursor->m_index == cursor->m_page->m_header->m_key_count)
-                {
-                    /* do we have a oarent to go back to? */
-                    if (cursor->m_page->m_header->m_parent == ITZAM_NULL_REF)
-                    {
-                        /* at end of keys */
-                        result = itzam_false;
-                        looking = itzam_false;
-                    }
-                    else
-                    {
-                        /* return to parent */
-                        next_page = read_page(cursor->m_btree,cursor->m_page->m_header->m_parent);
+        itzam_file_ring_destroy(async->m_ring);
+        free(async->m_lookups);
+        free(async->m_free);
+        free(async->m_memory);
 
-                        /* make new page our current page */
-                        if (cursor->m_page->m_header->m_parent != ITZAM_NULL_REF)
-                            free_page(cursor->m_page);
+        async->m_ring    = NULL;
+        async->m_lookups = NULL;
+        async->m_free    = NULL;
+        async->m_memory  = NULL;
 
-                        cursor->m_page = next_page;
+        result = ITZAM_OKAY;
+    }
 
-                        /* restore parent page position, remove old parent memory */
-                        temp_memory = cursor->m_parent_memory;
-                        cursor->m_index = cursor->m_parent_memory->m_index;
-                        cursor->m_parent_memory = cursor->m_parent_memory->m_prev;
-                        free(temp_memory);
+    return result;
+}
 
-                        result = itzam_true;
-                        looking = itzam_true;
-                    }
-                }
-                else
-                {
-                    /* we're on the next key */
-                    result = itzam_true;
-                    looking = itzam_false;
-                }
-            }
-        }
-        else /* inner page */
+/* look for a key; the callback is called before this returns if every page on the way is
+ * cached, and otherwise by a later itzam_btree_async_poll
+ */
+itzam_state itzam_btree_find_async(itzam_btree_async * async,
+                                   const void * key,
+                                   itzam_find_callback * callback,
+                                   void * context)
+{
+    itzam_state result = ITZAM_FAILED;
+    itzam_btree_lookup * lookup;
+    itzam_btree_page page;
+    itzam_byte * found_key;
+    itzam_bool done;
+
+    if ((async != NULL) && (async->m_ring != NULL) && (key != NULL) && (callback != NULL))
+    {
+        itzam_btree * btree = async->m_btree;
+
+        while ((async->m_free_count == 0) && (async->m_active > 0))
+            itzam_btree_async_poll(async, itzam_true);
+
+        if (async->m_free_count == 0)
         {
-            while (itzam_true)
+            /* every lookup is in a callback, and this call comes from one of them
+             */
+            found_key = (itzam_byte *)malloc(btree->m_header->m_sizeof_key);
+
+            if (found_key != NULL)
             {
-                /* read next page */
-                next_page = read_page(cursor->m_btree,cursor->m_page->m_links[cursor->m_index]);
+                callback(context, key, itzam_btree_find(btree, key, found_key) ? found_key : NULL);
+                free(found_key);
+                result = ITZAM_OKAY;
+            }
+            else
+                btree->m_datafile->m_error_handler("itzam_btree_find_async",ITZAM_ERROR_MALLOC);
 
-                /* remember position in parent page */
-                temp_memory = (itzam_btree_cursor_memory *)malloc(sizeof(itzam_btree_cursor_memory));
-                temp_memory->m_prev = cursor->m_parent_memory;
-                temp_memory->m_index = cursor->m_index;
-                cursor->m_parent_memory = temp_memory;
+            return result;
+        }
 
-                /* start at beginning of new page */
-                cursor->m_index = 0;
+        lookup = &async->m_lookups[async->m_free[--async->m_free_count]];
 
-                /* make new page our current page */
-                if (cursor->m_page->m_header->m_parent != ITZAM_NULL_REF)
-                    free_page(cursor->m_page);
+        lookup->m_callback = callback;
+        lookup->m_context  = context;
+        memcpy(lookup->m_key, key, input_key_size(btree, key));
 
-                cursor->m_page = next_page;
+        itzam_datafile_read_lock(btree->m_datafile);
+        itzam_cache_sync(&btree->m_cache);
 
-                /* do we need to push and move up again? */
-                if ((cursor->m_index == 0) && (cursor->m_page->m_header->m_parent != ITZAM_NULL_REF) && (cursor->m_page->m_links[0] != ITZAM_NULL_REF))
-                    continue;
-                else
-                    break;
-            }
+        page = btree->m_root;
+        done = async_descend(async, lookup, &page);
 
-            result = itzam_true;
-        }
+        itzam_datafile_read_unlock(btree->m_datafile);
+
+        if (done)
+            async_finish(async, lookup);
+        else
+            ++async->m_active;
+
+        result = ITZAM_OKAY;
     }
+    else
+        default_error_handler("itzam_btree_find_async",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
     return result;
 }
 
-itzam_bool itzam_btree_cursor_reset(itzam_btree_cursor * cursor)
+/* continue lookups whose pages have arrived, waiting for one if wait is true; returns the
+ * number of lookups finished, whose callbacks have been called
+ */
+uint32_t itzam_btree_async_poll(itzam_btree_async * async, itzam_bool wait)
 {
-    return reset_cursor(cursor);
-}
+    uint64_t tags[ITZAM_ASYNC_REAP];
+    itzam_bool reads[ITZAM_ASYNC_REAP];
+    uint32_t finished[ITZAM_ASYNC_REAP];
+    uint32_t done = 0;
+    uint32_t count;
+    uint32_t n;
 
-itzam_state itzam_btree_cursor_read(itzam_btree_cursor * cursor, void * returned_key)
-{
-    itzam_state result = ITZAM_NOT_FOUND;
+    if ((async == NULL) || (async->m_ring == NULL) || (async->m_active == 0))
+        return 0;
 
-    if ((cursor != NULL) && (returned_key != NULL) && (cursor->m_page != NULL))
+    count = itzam_file_ring_reap(async->m_ring, tags, reads, ITZAM_ASYNC_REAP, wait);
+
+    if (count > 0)
     {
-        memcpy(returned_key, cursor->m_page->m_keys + cursor->m_index * cursor->m_btree->m_header->m_sizeof_key, cursor->m_btree->m_header->m_sizeof_key);
-        result = ITZAM_OKAY;
+        itzam_datafile_read_lock(async->m_btree->m_datafile);
+        itzam_cache_sync(&async->m_btree->m_cache);
+
+        for (n = 0; n < count; ++n)
+        {
+            if (async_arrived(async, &async->m_lookups[tags[n]], reads[n]))
+                finished[done++] = (uint32_t)tags[n];
+        }
+
+        itzam_datafile_read_unlock(async->m_btree->m_datafile);
+
+        /* callbacks run without the lock, so they may use the tree
+         */
+        async->m_active -= done;
+
+        for (n = 0; n < done; ++n)
+            async_finish(async, &async->m_lookups[finished[n]]);
     }
 
-    return result;
+    return done;
+}
+
+uint32_t itzam_btree_async_pending(const itzam_btree_async * async)
+{
+    return (async != NULL) ? async->m_active : 0;
 }
@@ -0,0 +1,804 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "itzam.h"
+
+#include <stdlib.h>
+#if defined(ITZAM_UNIX)
+#include <sched.h>
+#endif
+
+/*-----------------------------------------------------------------------------
+ * internal utilities
+ */
+
+/* the latch is held only for short stretches of bookkeeping, never across I/O
+ */
+static void latch_init(itzam_cache * cache)
+{
+#if defined(ITZAM_UNIX)
+    pthread_mutex_init(&cache->m_latch, NULL);
+#else
+    InitializeCriticalSection(&cache->m_latch);
+#endif
+}
+
+static void latch_destroy(itzam_cache * cache)
+{
+#if defined(ITZAM_UNIX)
+    pthread_mutex_destroy(&cache->m_latch);
+#else
+    DeleteCriticalSection(&cache->m_latch);
+#endif
+}
+
+static void latch(itzam_cache * cache)
+{
+#if defined(ITZAM_UNIX)
+    pthread_mutex_lock(&cache->m_latch);
+#else
+    EnterCriticalSection(&cache->m_latch);
+#endif
+}
+
+static void unlatch(itzam_cache * cache)
+{
+#if defined(ITZAM_UNIX)
+    pthread_mutex_unlock(&cache->m_latch);
+#else
+    LeaveCriticalSection(&cache->m_latch);
+#endif
+}
+
+/* lets another thread take the latch, and finish what it is doing
+ */
+static void yield_latch(itzam_cache * cache)
+{
+    unlatch(cache);
+#if defined(ITZAM_UNIX)
+    sched_yield();
+#else
+    SwitchToThread();
+#endif
+    latch(cache);
+}
+
+static uint32_t hash_ref(itzam_ref where)
+{
+    uint64_t h = (uint64_t)where;
+
+    /* records are multiples of a page apart, so mix the bits before masking
+     */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return (uint32_t)h;
+}
+
+static itzam_cache_frame * lookup(itzam_cache * cache, itzam_ref where)
+{
+    itzam_cache_frame * frame = cache->m_buckets[hash_ref(where) & cache->m_bucket_mask];
+
+    while ((frame != NULL) && (frame->m_where != where))
+        frame = frame->m_hash_next;
+
+    return frame;
+}
+
+static void hash_insert(itzam_cache * cache, itzam_cache_frame * frame)
+{
+    itzam_cache_frame ** bucket = &cache->m_buckets[hash_ref(frame->m_where) & cache->m_bucket_mask];
+
+    frame->m_hash_next = *bucket;
+    *bucket = frame;
+}
+
+static void hash_remove(itzam_cache * cache, itzam_cache_frame * frame)
+{
+    itzam_cache_frame ** link = &cache->m_buckets[hash_ref(frame->m_where) & cache->m_bucket_mask];
+
+    while (*link != NULL)
+    {
+        if (*link == frame)
+        {
+            *link = frame->m_hash_next;
+            break;
+        }
+
+        link = &(*link)->m_hash_next;
+    }
+
+    frame->m_hash_next = NULL;
+}
+
+/* size the hash table for the given number of frames
+ */
+static itzam_state resize_buckets(itzam_cache * cache, uint32_t capacity)
+{
+    itzam_cache_frame ** old_buckets = cache->m_buckets;
+    uint32_t old_count = (old_buckets == NULL) ? 0 : cache->m_bucket_mask + 1;
+    uint32_t buckets = 64;
+    itzam_cache_frame * frame;
+    uint32_t n;
+
+    while (buckets < capacity * 2)
+        buckets *= 2;
+
+    if (buckets == old_count)
+        return ITZAM_OKAY;
+
+    cache->m_buckets = (itzam_cache_frame **)calloc(buckets, sizeof(itzam_cache_frame *));
+
+    if (cache->m_buckets == NULL)
+    {
+        cache->m_buckets = old_buckets;
+        return ITZAM_FAILED;
+    }
+
+    cache->m_bucket_mask = buckets - 1;
+
+    /* move existing frames to their new buckets
+     */
+    for (n = 0; n < old_count; ++n)
+    {
+        while (old_buckets[n] != NULL)
+        {
+            frame = old_buckets[n];
+            old_buckets[n] = frame->m_hash_next;
+            hash_insert(cache, frame);
+        }
+    }
+
+    free(old_buckets);
+
+    return ITZAM_OKAY;
+}
+
+static itzam_state write_frame(itzam_cache * cache, itzam_cache_frame * frame)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    if (frame->m_where == itzam_datafile_write_flags(cache->m_datafile, frame->m_data, cache->m_frame_size, frame->m_where, cache->m_flags))
+    {
+        frame->m_dirty = itzam_false;
+        cache->m_modified = itzam_true;
+        result = ITZAM_OKAY;
+    }
+
+    return result;
+}
+
+/* detach a frame from whatever record it holds, writing it first if needed
+ */
+static itzam_state empty_frame(itzam_cache * cache, itzam_cache_frame * frame)
+{
+    itzam_state result = ITZAM_OKAY;
+
+    if (frame->m_where != ITZAM_NULL_REF)
+    {
+        if (frame->m_orphan)
+            frame->m_orphan = itzam_false;
+        else
+        {
+            if (frame->m_dirty)
+                result = write_frame(cache, frame);
+
+            hash_remove(cache, frame);
+        }
+
+        frame->m_where      = ITZAM_NULL_REF;
+        frame->m_dirty      = itzam_false;
+        frame->m_referenced = itzam_false;
+    }
+
+    return result;
+}
+
+static itzam_cache_frame * new_frame(itzam_cache * cache)
+{
+    itzam_cache_frame * frame = NULL;
+
+    /* grow the frame list if needed
+     */
+    if (cache->m_count == cache->m_frames_size)
+    {
+        uint32_t new_size = (cache->m_frames_size == 0) ? 16 : cache->m_frames_size * 2;
+        itzam_cache_frame ** new_frames = (itzam_cache_frame **)realloc(cache->m_frames, sizeof(itzam_cache_frame *) * new_size);
+
+        if (new_frames == NULL)
+            return NULL;
+
+        cache->m_frames = new_frames;
+        cache->m_frames_size = new_size;
+    }
+
+    /* frame, owner data and record data are allocated as one block
+     */
+    frame = (itzam_cache_frame *)calloc(1, sizeof(itzam_cache_frame) + cache->m_user_size + cache->m_frame_size);
+
+    if (frame != NULL)
+    {
+        frame->m_user  = (void *)(frame + 1);
+        frame->m_data  = (itzam_byte *)(frame + 1) + cache->m_user_size;
+        frame->m_where = ITZAM_NULL_REF;
+
+        cache->m_frames[cache->m_count] = frame;
+        ++cache->m_count;
+    }
+
+    return frame;
+}
+
+static void delete_frame(itzam_cache * cache, uint32_t index)
+{
+    itzam_cache_frame * frame = cache->m_frames[index];
+
+    empty_frame(cache, frame);
+    free(frame);
+
+    --cache->m_count;
+    cache->m_frames[index] = cache->m_frames[cache->m_count];
+
+    if (cache->m_hand >= cache->m_count)
+        cache->m_hand = 0;
+}
+
+/* find a frame that can hold a new record, using the CLOCK algorithm
+ */
+static itzam_cache_frame * victim(itzam_cache * cache)
+{
+    itzam_cache_frame * frame;
+    uint32_t n;
+
+    if (cache->m_count < cache->m_capacity)
+        return new_frame(cache);
+
+    /* two sweeps guarantee that every reference bit has been cleared once
+     */
+    for (n = 0; n < cache->m_count * 2; ++n)
+    {
+        frame = cache->m_frames[cache->m_hand];
+
+        cache->m_hand = (cache->m_hand + 1) % cache->m_count;
+
+        if (frame->m_pins == 0)
+        {
+            if (frame->m_referenced)
+                frame->m_referenced = itzam_false;
+            else
+            {
+                if (ITZAM_OKAY == empty_frame(cache, frame))
+                    return frame;
+            }
+        }
+    }
+
+    /* everything is pinned; exceed capacity for now
+     */
+    return new_frame(cache);
+}
+
+/* obtain a pinned frame for a record, without reading it
+ */
+static itzam_cache_frame * claim(itzam_cache * cache, itzam_ref where)
+{
+    itzam_cache_frame * frame = lookup(cache, where);
+
+    if (frame == NULL)
+    {
+        frame = victim(cache);
+
+        if (frame != NULL)
+        {
+            frame->m_where = where;
+            hash_insert(cache, frame);
+        }
+        else
+            cache->m_datafile->m_error_handler("itzam_cache", ITZAM_ERROR_MALLOC);
+    }
+
+    if (frame != NULL)
+    {
+        ++frame->m_pins;
+        frame->m_referenced = itzam_true;
+    }
+
+    return frame;
+}
+
+/* drop every record; pinned frames are orphaned and emptied when released
+ */
+static void invalidate_frames(itzam_cache * cache)
+{
+    itzam_cache_frame * frame;
+    uint32_t n;
+
+    for (n = 0; n < cache->m_count; ++n)
+    {
+        frame = cache->m_frames[n];
+
+        if ((frame->m_where != ITZAM_NULL_REF) && !frame->m_orphan)
+        {
+            frame->m_dirty = itzam_false;
+
+            if (frame->m_pins > 0)
+            {
+                hash_remove(cache, frame);
+                frame->m_orphan = itzam_true;
+            }
+            else
+                empty_frame(cache, frame);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * cache functions
+ */
+itzam_state itzam_cache_create(itzam_cache * cache,
+                               itzam_datafile * datafile,
+                               uint32_t frame_size,
+                               uint32_t user_size,
+                               uint32_t capacity,
+                               int32_t flags)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    if ((cache != NULL) && (datafile != NULL) && (frame_size > 0))
+    {
+        /* align owner data so that the record data following it is aligned too
+         */
+        user_size = (user_size + 15) & ~15U;
+
+        cache->m_datafile    = datafile;
+        cache->m_flags       = flags;
+        cache->m_frame_size  = frame_size;
+        cache->m_user_size   = user_size;
+        cache->m_capacity    = capacity;
+        cache->m_count       = 0;
+        cache->m_hand        = 0;
+        cache->m_frames_size = 0;
+        cache->m_frames      = NULL;
+        cache->m_buckets     = NULL;
+        cache->m_modified    = itzam_false;
+        cache->m_generation  = datafile->m_shared->m_generation;
+        cache->m_hits        = 0;
+        cache->m_misses      = 0;
+
+        latch_init(cache);
+
+        result = resize_buckets(cache, capacity);
+
+        if (result != ITZAM_OKAY)
+            datafile->m_error_handler("itzam_cache_create", ITZAM_ERROR_MALLOC);
+    }
+    else
+        default_error_handler("itzam_cache_create", ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+/* dirty frames are not written; call itzam_cache_flush first
+ */
+void itzam_cache_destroy(itzam_cache * cache)
+{
+    uint32_t n;
+
+    if (cache != NULL)
+    {
+        for (n = 0; n < cache->m_count; ++n)
+            free(cache->m_frames[n]);
+
+        free(cache->m_frames);
+        free(cache->m_buckets);
+
+        cache->m_frames  = NULL;
+        cache->m_buckets = NULL;
+        cache->m_count   = 0;
+
+        latch_destroy(cache);
+    }
+}
+
+/* a capacity of zero disables caching; records are only held while pinned
+ */
+void itzam_cache_set_capacity(itzam_cache * cache, uint32_t capacity)
+{
+    uint32_t n = 0;
+
+    latch(cache);
+
+    cache->m_capacity = capacity;
+    resize_buckets(cache, capacity);
+
+    /* drop unpinned frames beyond the new capacity
+     */
+    while ((cache->m_count > cache->m_capacity) && (n < cache->m_count))
+    {
+        if (cache->m_frames[n]->m_pins == 0)
+            delete_frame(cache, n);
+        else
+            ++n;
+    }
+
+    unlatch(cache);
+}
+
+/* returns a pinned frame containing the record at where, or NULL on failure
+ */
+itzam_cache_frame * itzam_cache_fetch(itzam_cache * cache, itzam_ref where)
+{
+    itzam_cache_frame * frame;
+    itzam_state loaded;
+
+    latch(cache);
+
+    frame = lookup(cache, where);
+
+    if (frame != NULL)
+    {
+        ++cache->m_hits;
+        ++frame->m_pins;
+        frame->m_referenced = itzam_true;
+
+        /* another reader may still be filling the frame
+         */
+        while (frame->m_loading)
+        {
+            yield_latch(cache);
+        }
+
+        /* the read failed; the loader has already reported it
+         */
+        if (frame->m_where != where)
+        {
+            --frame->m_pins;
+            frame = NULL;
+        }
+    }
+    else
+    {
+        ++cache->m_misses;
+
+        frame = claim(cache, where);
+
+        if (frame != NULL)
+        {
+            /* the frame is pinned, so it stays put while the latch is released for I/O
+             */
+            frame->m_loading = itzam_true;
+            unlatch(cache);
+
+            loaded = itzam_datafile_read_at(cache->m_datafile, where, frame->m_data, cache->m_frame_size);
+
+            latch(cache);
+            frame->m_loading = itzam_false;
+
+            if (ITZAM_OKAY != loaded)
+            {
+                if (!frame->m_orphan)
+                    hash_remove(cache, frame);
+
+                --frame->m_pins;
+                frame->m_orphan = itzam_false;
+                frame->m_where = ITZAM_NULL_REF;
+                frame = NULL;
+            }
+        }
+    }
+
+    unlatch(cache);
+
+    return frame;
+}
+
+/* copy a record without claiming a frame for it; used by readers that run alongside a
+   writer, so they never evict (and write) the writer's dirty frames
+ */
+itzam_state itzam_cache_peek(itzam_cache * cache, itzam_ref where, void * data)
+{
+    itzam_state result = ITZAM_FAILED;
+    itzam_bool copied = itzam_false;
+    itzam_cache_frame * frame;
+
+    latch(cache);
+
+    frame = lookup(cache, where);
+
+    if ((frame != NULL) && !frame->m_loading)
+    {
+        memcpy(data, frame->m_data, cache->m_frame_size);
+        copied = itzam_true;
+    }
+
+    unlatch(cache);
+
+    if (copied)
+        result = ITZAM_OKAY;
+    else
+        result = itzam_datafile_read_at(cache->m_datafile, where, data, cache->m_frame_size);
+
+    return result;
+}
+
+/* returns a pinned frame if the record at where is already cached, or NULL; never reads
+ */
+itzam_cache_frame * itzam_cache_probe(itzam_cache * cache, itzam_ref where)
+{
+    itzam_cache_frame * frame;
+
+    latch(cache);
+
+    frame = lookup(cache, where);
+
+    if ((frame != NULL) && !frame->m_loading)
+    {
+        ++cache->m_hits;
+        ++frame->m_pins;
+        frame->m_referenced = itzam_true;
+    }
+    else
+        frame = NULL;
+
+    unlatch(cache);
+
+    return frame;
+}
+
+static void release_frame(itzam_cache * cache, itzam_cache_frame * frame)
+{
+    uint32_t n;
+
+    if ((frame != NULL) && (frame->m_pins > 0))
+    {
+        --frame->m_pins;
+
+        if (frame->m_pins == 0)
+        {
+            if (frame->m_orphan)
+                empty_frame(cache, frame);
+
+            /* frames beyond capacity were only needed while pinned
+             */
+            if (cache->m_count > cache->m_capacity)
+            {
+                for (n = 0; n < cache->m_count; ++n)
+                {
+                    if (cache->m_frames[n] == frame)
+                    {
+                        delete_frame(cache, n);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void itzam_cache_release(itzam_cache * cache, itzam_cache_frame * frame)
+{
+    if (frame != NULL)
+    {
+        latch(cache);
+        release_frame(cache, frame);
+        unlatch(cache);
+    }
+}
+
+/* cache a clean copy of a record read by the caller, unless it is already cached
+ */
+void itzam_cache_fill(itzam_cache * cache, itzam_ref where, const void * data)
+{
+    itzam_cache_frame * frame;
+
+    latch(cache);
+
+    if (lookup(cache, where) == NULL)
+    {
+        ++cache->m_misses;
+
+        frame = claim(cache, where);
+
+        if (frame != NULL)
+        {
+            memcpy(frame->m_data, data, cache->m_frame_size);
+            release_frame(cache, frame);
+        }
+    }
+
+    unlatch(cache);
+}
+
+void itzam_cache_mark_dirty(itzam_cache_frame * frame)
+{
+    if ((frame != NULL) && !frame->m_orphan)
+        frame->m_dirty = itzam_true;
+}
+
+/* replace the cached contents of a record; it will be written by the next flush
+ */
+itzam_state itzam_cache_store(itzam_cache * cache, itzam_ref where, const void * data)
+{
+    itzam_state result = ITZAM_FAILED;
+    itzam_cache_frame * frame;
+
+    latch(cache);
+
+    frame = claim(cache, where);
+
+    if (frame != NULL)
+    {
+        if (frame->m_data != data)
+            memcpy(frame->m_data, data, cache->m_frame_size);
+
+        frame->m_dirty = itzam_true;
+        release_frame(cache, frame);
+        result = ITZAM_OKAY;
+    }
+
+    unlatch(cache);
+
+    return result;
+}
+
+/* write a record immediately, keeping a clean copy in the cache
+ */
+itzam_state itzam_cache_write_through(itzam_cache * cache, itzam_ref where, const void * data)
+{
+    itzam_state result = ITZAM_FAILED;
+    itzam_cache_frame * frame;
+
+    latch(cache);
+
+    frame = claim(cache, where);
+
+    if (frame != NULL)
+    {
+        if (frame->m_data != data)
+            memcpy(frame->m_data, data, cache->m_frame_size);
+
+        result = write_frame(cache, frame);
+        release_frame(cache, frame);
+    }
+
+    unlatch(cache);
+
+    return result;
+}
+
+/* forget a record that is being removed from the file; unwritten changes are lost
+ */
+void itzam_cache_discard(itzam_cache * cache, itzam_ref where)
+{
+    itzam_cache_frame * frame;
+
+    latch(cache);
+
+    frame = lookup(cache, where);
+
+    cache->m_modified = itzam_true;
+
+    if (frame != NULL)
+    {
+        frame->m_dirty = itzam_false;
+
+        if (frame->m_pins > 0)
+        {
+            hash_remove(cache, frame);
+            frame->m_orphan = itzam_true;
+        }
+        else
+            empty_frame(cache, frame);
+    }
+
+    unlatch(cache);
+}
+
+/* write all dirty frames; if the file was changed, tell other instances about it
+ */
+itzam_state itzam_cache_flush(itzam_cache * cache)
+{
+    itzam_state result = ITZAM_OKAY;
+    uint32_t n;
+
+    for (n = 0; n < cache->m_count; ++n)
+    {
+        if (cache->m_frames[n]->m_dirty && !cache->m_frames[n]->m_orphan)
+        {
+            if (ITZAM_OKAY != write_frame(cache, cache->m_frames[n]))
+                result = ITZAM_FAILED;
+        }
+    }
+
+    if (cache->m_modified)
+    {
+        ++cache->m_datafile->m_shared->m_generation;
+        cache->m_modified = itzam_false;
+    }
+
+    cache->m_generation = cache->m_datafile->m_shared->m_generation;
+
+    return result;
+}
+
+/* called before using the cache; drops everything if another instance changed the file
+ */
+void itzam_cache_sync(itzam_cache * cache)
+{
+    latch(cache);
+
+    /* readers of the same cache may race here; the first one to notice does the work
+     */
+    if (cache->m_generation != cache->m_datafile->m_shared->m_generation)
+    {
+        invalidate_frames(cache);
+        cache->m_generation = cache->m_datafile->m_shared->m_generation;
+    }
+
+    unlatch(cache);
+}
+
+/* drop every cached record; pinned frames are orphaned and emptied when released
+ */
+void itzam_cache_invalidate(itzam_cache * cache)
+{
+    latch(cache);
+    invalidate_frames(cache);
+    unlatch(cache);
+}
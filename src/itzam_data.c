@@ -59,6 +59,7 @@
 #include "itzam.h"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <errno.h>
 #include <ctype.h>
 #include <sys/types.h>
@@ -66,154 +67,816 @@
 
 static pthread_mutex_t global_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* mapped reads reach this far past the end of the file, so that records appended later
+ * can be read without a new map; reads are only mapped on POSIX systems
+ */
+#if defined(ITZAM_UNIX)
+#define ITZAM_MAP_SLACK ((itzam_ref)64 * 1024 * 1024)
+#endif
+
+/*-----------------------------------------------------------------------------
+ * every change to the file passes through here, so that the write-ahead log
+ * sees it first; the log records changes made within a transaction, and any
+ * other change made while the log holds records that may need to be repeated
+ */
+static itzam_bool write_file(itzam_datafile * datafile, const itzam_file_vec * vec, int count, itzam_ref where)
+{
+    itzam_bool result = itzam_false;
+
+    itzam_datafile_mutex_lock(datafile);
+
+    if ((!datafile->m_in_transaction && !itzam_log_is_active(datafile))
+     || (ITZAM_OKAY == itzam_log_update(datafile, where, vec, count)))
+        result = itzam_file_pwritev(datafile->m_file, vec, count, where);
+    else
+        datafile->m_error_handler("write_file",ITZAM_ERROR_LOG_FAILED);
+
+    itzam_datafile_mutex_unlock(datafile);
+
+    return result;
+}
+
+static itzam_bool write_bytes(itzam_datafile * datafile, const void * data, size_t len, itzam_ref where)
+{
+    itzam_file_vec vec;
+
+    vec.m_data = (void *)data;
+    vec.m_len  = len;
+
+    return write_file(datafile, &vec, 1, where);
+}
+
+/*-----------------------------------------------------------------------------
+ * record headers; those of files of version 5.1 end before the checksum, which the
+ * rest of the header is filled from
+ */
+static itzam_bool read_header(itzam_datafile * datafile, itzam_record_header * header, itzam_ref where)
+{
+    header->m_checksum = 0;
+    header->m_reserved = 0;
+
+    return itzam_file_pread(datafile->m_file, header, datafile->m_sizeof_header, where);
+}
+
+static itzam_bool is_active(const itzam_record_header * header)
+{
+    return (itzam_bool)((header->m_signature == ITZAM_RECORD_SIGNATURE) && (header->m_flags & ITZAM_RECORD_IN_USE));
+}
+
+/* can the lengths in an active record's header be trusted to say how much to read?
+ */
+static itzam_bool lengths_valid(const itzam_record_header * header)
+{
+    return (itzam_bool)((header->m_rec_len >= 0) && (header->m_length >= header->m_rec_len));
+}
+
+/*-----------------------------------------------------------------------------
+ * record checksums; a checksum covers the header up to it, and the data in use
+ */
+static uint32_t record_checksum(const itzam_record_header * header, const void * data)
+{
+    return itzam_crc32c(itzam_crc32c(0, header, offsetof(itzam_record_header, m_checksum)), data, (size_t)header->m_rec_len);
+}
+
+static itzam_bool has_checksums(const itzam_datafile * datafile)
+{
+    return (itzam_bool)(datafile->m_sizeof_header == sizeof(itzam_record_header));
+}
+
+/* must an active record be checked as it is read? every record but the deleted list carries
+ * a checksum in a file with room for them, so a record without one is damaged
+ */
+static itzam_bool must_verify(const itzam_datafile * datafile, const itzam_record_header * header)
+{
+    return (itzam_bool)((datafile->m_checksums >= ITZAM_CHECKSUM_VERIFY) && has_checksums(datafile) && !(header->m_flags & ITZAM_RECORD_DELLIST));
+}
+
+/* does an active record at where, of which read_len bytes of data have been read, match its
+ * checksum? data not read is taken from the file
+ */
+static itzam_bool verify_record(itzam_datafile * datafile, const itzam_record_header * header, itzam_ref where, const void * data, itzam_int read_len)
+{
+    itzam_byte rest[4096];
+    itzam_int chunk;
+    uint32_t crc;
+
+    if (!must_verify(datafile, header))
+        return itzam_true;
+
+    if (!(header->m_flags & ITZAM_RECORD_CHECKSUM))
+        return itzam_false;
+
+    crc   = itzam_crc32c(itzam_crc32c(0, header, offsetof(itzam_record_header, m_checksum)), data, (size_t)read_len);
+    where = where + datafile->m_sizeof_header + read_len;
+
+    while (read_len < header->m_rec_len)
+    {
+        chunk = header->m_rec_len - read_len;
+
+        if (chunk > (itzam_int)sizeof(rest))
+            chunk = sizeof(rest);
+
+        if (!itzam_file_pread(datafile->m_file, rest, chunk, where))
+            return itzam_false;
+
+        crc       = itzam_crc32c(crc, rest, (size_t)chunk);
+        read_len += chunk;
+        where    += chunk;
+    }
+
+    return (itzam_bool)(crc == header->m_checksum);
+}
+
 /*-----------------------------------------------------------------------------
  * deleted record list management
+ *
+ * Deleted records are indexed in memory by size class and by position. The
+ * deleted list on disk is a table of entries that mirrors the index; each
+ * change rewrites only the entries it touches. Other handles on the same file
+ * notice changes through a serial number in shared memory, and reload the list.
  */
-static itzam_state read_dellist(itzam_datafile * datafile)
+static const itzam_int ITZAM_FREEMAP_BUCKETS = 64;
+
+static uint32_t hash_position(itzam_ref where)
 {
-    itzam_state result = ITZAM_FAILED;
+    uint64_t h = (uint64_t)where;
 
-    if (datafile->m_shared->m_header.m_dellist_ref != ITZAM_NULL_REF)
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return (uint32_t)h;
+}
+
+static int lowest_bit(uint64_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int n = 0;
+
+    while ((bits & 1) == 0)
+    {
+        bits >>= 1;
+        ++n;
+    }
+
+    return n;
+#endif
+}
+
+/* size classes are logarithmic, with ITZAM_FREEMAP_SUBCLASSES linear steps per power of two
+ */
+static int size_class(itzam_int length)
+{
+    uint64_t n = (uint64_t)length;
+    int bits = 0;
+
+    if (n < ITZAM_FREEMAP_SUBCLASSES)
+        return (int)n;
+
+    while ((n >> bits) >= 2 * ITZAM_FREEMAP_SUBCLASSES)
+        ++bits;
+
+    return (bits + 1) * ITZAM_FREEMAP_SUBCLASSES + (int)((n >> bits) - ITZAM_FREEMAP_SUBCLASSES);
+}
+
+static itzam_ref extent_end(const itzam_freemap * map, const itzam_free_extent * extent)
+{
+    return extent->m_where + map->m_sizeof_header + extent->m_length;
+}
+
+/* can a free record hold a new record? any remainder must be large enough to
+ * carry its own header, so that every byte of the file belongs to a record
+ */
+static itzam_bool extent_fits(const itzam_freemap * map, const itzam_free_extent * extent, itzam_int length)
+{
+    return (extent->m_length == length) || (extent->m_length >= length + (itzam_int)map->m_sizeof_header);
+}
+
+static void class_link(itzam_freemap * map, itzam_free_extent * extent)
+{
+    int c = size_class(extent->m_length);
+
+    extent->m_prev = NULL;
+    extent->m_next = map->m_classes[c];
+
+    if (extent->m_next != NULL)
+        extent->m_next->m_prev = extent;
+
+    map->m_classes[c] = extent;
+    map->m_class_bits[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+static void class_unlink(itzam_freemap * map, itzam_free_extent * extent)
+{
+    int c = size_class(extent->m_length);
+
+    if (extent->m_prev != NULL)
+        extent->m_prev->m_next = extent->m_next;
+    else
+        map->m_classes[c] = extent->m_next;
+
+    if (extent->m_next != NULL)
+        extent->m_next->m_prev = extent->m_prev;
+
+    if (map->m_classes[c] == NULL)
+        map->m_class_bits[c / 64] &= ~((uint64_t)1 << (c % 64));
+}
+
+static void start_link(itzam_freemap * map, itzam_free_extent * extent)
+{
+    itzam_free_extent ** bucket = &map->m_by_start[hash_position(extent->m_where) & map->m_bucket_mask];
+
+    extent->m_start_next = *bucket;
+    *bucket = extent;
+}
+
+static void start_unlink(itzam_freemap * map, itzam_free_extent * extent)
+{
+    itzam_free_extent ** link = &map->m_by_start[hash_position(extent->m_where) & map->m_bucket_mask];
+
+    while (*link != extent)
+        link = &(*link)->m_start_next;
+
+    *link = extent->m_start_next;
+}
+
+static void end_link(itzam_freemap * map, itzam_free_extent * extent)
+{
+    itzam_free_extent ** bucket = &map->m_by_end[hash_position(extent_end(map, extent)) & map->m_bucket_mask];
+
+    extent->m_end_next = *bucket;
+    *bucket = extent;
+}
+
+static void end_unlink(itzam_freemap * map, itzam_free_extent * extent)
+{
+    itzam_free_extent ** link = &map->m_by_end[hash_position(extent_end(map, extent)) & map->m_bucket_mask];
+
+    while (*link != extent)
+        link = &(*link)->m_end_next;
+
+    *link = extent->m_end_next;
+}
+
+static itzam_free_extent * find_by_start(itzam_freemap * map, itzam_ref where)
+{
+    itzam_free_extent * extent;
+
+    if (map->m_by_start == NULL)
+        return NULL;
+
+    extent = map->m_by_start[hash_position(where) & map->m_bucket_mask];
+
+    while ((extent != NULL) && (extent->m_where != where))
+        extent = extent->m_start_next;
+
+    return extent;
+}
+
+static itzam_free_extent * find_by_end(itzam_freemap * map, itzam_ref where)
+{
+    itzam_free_extent * extent;
+
+    if (map->m_by_end == NULL)
+        return NULL;
+
+    extent = map->m_by_end[hash_position(where) & map->m_bucket_mask];
+
+    while ((extent != NULL) && (extent_end(map, extent) != where))
+        extent = extent->m_end_next;
+
+    return extent;
+}
+
+/* grow the hash tables so that chains stay short
+ */
+static itzam_bool rehash(itzam_freemap * map, uint32_t buckets)
+{
+    itzam_free_extent ** old_start = map->m_by_start;
+    uint32_t old_count = (old_start != NULL) ? map->m_bucket_mask + 1 : 0;
+    itzam_free_extent ** new_start = (itzam_free_extent **)calloc(buckets, sizeof(itzam_free_extent *));
+    itzam_free_extent ** new_end   = (itzam_free_extent **)calloc(buckets, sizeof(itzam_free_extent *));
+    itzam_free_extent * extent;
+    uint32_t n;
+
+    if ((new_start == NULL) || (new_end == NULL))
+    {
+        free(new_start);
+        free(new_end);
+        return itzam_false;
+    }
+
+    free(map->m_by_end);
+
+    map->m_by_start    = new_start;
+    map->m_by_end      = new_end;
+    map->m_bucket_mask = buckets - 1;
+
+    for (n = 0; n < old_count; ++n)
     {
-        if (-1 != itzam_file_seek(datafile->m_file,datafile->m_shared->m_header.m_dellist_ref + sizeof(itzam_record_header),ITZAM_SEEK_BEGIN))
+        extent = old_start[n];
+
+        while (extent != NULL)
         {
-            /* read the header
-             */
-            if (itzam_file_read(datafile->m_file,&datafile->m_dellist_header,sizeof(itzam_dellist_header)))
-            {
-                itzam_int size = sizeof(itzam_dellist_entry) * datafile->m_dellist_header.m_table_size;
+            itzam_free_extent * next = extent->m_start_next;
+            start_link(map, extent);
+            end_link(map, extent);
+            extent = next;
+        }
+    }
 
-                if (datafile->m_dellist != NULL)
-                    free(datafile->m_dellist);
+    free(old_start);
 
-                datafile->m_dellist = (itzam_dellist_entry *)malloc(size);
+    return itzam_true;
+}
 
-                if (datafile->m_dellist != NULL)
-                {
-                    if (itzam_file_read(datafile->m_file,datafile->m_dellist,size))
-                        result = ITZAM_OKAY;
-                }
-                else
-                    datafile->m_error_handler("read_dellist",ITZAM_ERROR_MALLOC);
+static void freemap_init(itzam_freemap * map, size_t sizeof_header)
+{
+    memset(map, 0, sizeof(itzam_freemap));
+    map->m_sizeof_header = sizeof_header;
+}
+
+static void freemap_clear(itzam_freemap * map)
+{
+    itzam_free_extent * extent;
+    uint32_t n;
+
+    if (map->m_by_start != NULL)
+    {
+        for (n = 0; n <= map->m_bucket_mask; ++n)
+        {
+            extent = map->m_by_start[n];
+
+            while (extent != NULL)
+            {
+                itzam_free_extent * next = extent->m_start_next;
+                free(extent);
+                extent = next;
             }
         }
+    }
 
-        if (result != ITZAM_OKAY)
-            datafile->m_error_handler("read_dellist",ITZAM_ERROR_DELLIST_NOT_READ);
+    while (map->m_spare != NULL)
+    {
+        extent = map->m_spare;
+        map->m_spare = extent->m_next;
+        free(extent);
     }
-    else
-        datafile->m_dellist = NULL;
 
-    return result;
+    free(map->m_by_start);
+    free(map->m_by_end);
+    free(map->m_open_slots);
+
+    freemap_init(map, map->m_sizeof_header);
+}
+
+/* write one entry of the deleted list on disk
+ */
+static itzam_bool write_entry(itzam_datafile * datafile, itzam_int slot, itzam_ref where, itzam_int length)
+{
+    itzam_dellist_entry entry;
+    itzam_ref pos = datafile->m_shared->m_header.m_dellist_ref
+                  + datafile->m_sizeof_header
+                  + sizeof(itzam_dellist_header)
+                  + slot * sizeof(itzam_dellist_entry);
+
+    entry.m_where  = where;
+    entry.m_length = length;
+
+    return write_bytes(datafile, &entry, sizeof(entry), pos);
 }
 
-static itzam_state write_dellist(itzam_datafile * datafile, itzam_bool has_grown)
+/* write the header of a free record
+ */
+static itzam_bool write_free_header(itzam_datafile * datafile, itzam_ref where, itzam_int length)
 {
-    itzam_int   size   = sizeof(itzam_dellist_entry) * datafile->m_dellist_header.m_table_size;
-    itzam_state result = ITZAM_FAILED;
     itzam_record_header header;
 
-    if (has_grown)
+    header.m_signature = ITZAM_RECORD_SIGNATURE;
+    header.m_flags     = 0;
+    header.m_length    = length;
+    header.m_rec_len   = 0;
+    header.m_checksum  = 0;
+    header.m_reserved  = 0;
+
+    return write_bytes(datafile, &header, datafile->m_sizeof_header, where);
+}
+
+/* add a free record to the index without touching the file
+ */
+static itzam_free_extent * link_extent(itzam_freemap * map, itzam_ref where, itzam_int length, itzam_int slot)
+{
+    itzam_free_extent * extent;
+
+    if ((map->m_count >= map->m_bucket_mask + 1) || (map->m_by_start == NULL))
     {
-        /* remove old record if there was one
-         */
-        if (datafile->m_shared->m_header.m_dellist_ref != ITZAM_NULL_REF)
-        {
-            if (-1 != itzam_file_seek(datafile->m_file,datafile->m_shared->m_header.m_dellist_ref,ITZAM_SEEK_BEGIN))
-            {
-                /* read the header
-                 */
-                if (itzam_file_read(datafile->m_file,&header,sizeof(header)))
-                {
-                    /* change record header; make this record the head of the deleted list
-                     */
-                    header.m_flags &= ~ITZAM_RECORD_IN_USE;
-                    header.m_flags &= ~ITZAM_RECORD_DELLIST;
+        if (!rehash(map, (map->m_by_start == NULL) ? ITZAM_FREEMAP_BUCKETS : (map->m_bucket_mask + 1) * 2))
+            return NULL;
+    }
 
-                    /* move to beginning of record header again and rewrite it
-                     */
-                    itzam_file_seek(datafile->m_file,datafile->m_shared->m_header.m_dellist_ref,ITZAM_SEEK_BEGIN);
+    /* records are freed and reused constantly, so their extents are too
+     */
+    extent = map->m_spare;
 
-                    if (itzam_file_write(datafile->m_file,&header,sizeof(header)))
-                        result = ITZAM_OKAY;
-                }
-            }
-        }
+    if (extent != NULL)
+        map->m_spare = extent->m_next;
+    else
+        extent = (itzam_free_extent *)malloc(sizeof(itzam_free_extent));
+
+    if (extent != NULL)
+    {
+        extent->m_where  = where;
+        extent->m_length = length;
+        extent->m_slot   = slot;
+
+        class_link(map, extent);
+        start_link(map, extent);
+        end_link(map, extent);
+
+        ++map->m_count;
+    }
+
+    return extent;
+}
+
+/* remove a free record from the index; its entry on disk is cleared only if asked,
+ * since the caller may be about to reuse it
+ */
+static void unlink_extent(itzam_datafile * datafile, itzam_free_extent * extent, itzam_bool clear_entry)
+{
+    itzam_freemap * map = &datafile->m_freemap;
+
+    class_unlink(map, extent);
+    start_unlink(map, extent);
+    end_unlink(map, extent);
+
+    --map->m_count;
+
+    map->m_open_slots[map->m_open_count++] = extent->m_slot;
+
+    if (clear_entry)
+        write_entry(datafile, extent->m_slot, ITZAM_NULL_REF, 0);
+
+    extent->m_next = map->m_spare;
+    map->m_spare = extent;
+}
+
+/* load the deleted list from disk into the index
+ */
+static itzam_state read_dellist(itzam_datafile * datafile)
+{
+    itzam_state result = ITZAM_FAILED;
+    itzam_freemap * map = &datafile->m_freemap;
+    itzam_dellist_header list_header;
+    itzam_dellist_entry * entries;
+    itzam_int n;
 
-        /* explicitly append; we can't use write because it might try to change the
-         *      deleted list while we're saving it
+    freemap_clear(map);
+
+    map->m_serial = datafile->m_shared->m_dellist_serial;
+
+    if (datafile->m_shared->m_header.m_dellist_ref != ITZAM_NULL_REF)
+    {
+        itzam_ref where = datafile->m_shared->m_header.m_dellist_ref + datafile->m_sizeof_header;
+
+        /* read the header
          */
-        if (-1 != itzam_file_seek(datafile->m_file,0,ITZAM_SEEK_END))
+        if (itzam_file_pread(datafile->m_file,&list_header,sizeof(itzam_dellist_header),where))
         {
-            datafile->m_shared->m_header.m_dellist_ref = itzam_file_tell(datafile->m_file);
+            entries = (itzam_dellist_entry *)malloc(sizeof(itzam_dellist_entry) * list_header.m_table_size);
+            map->m_open_slots = (itzam_int *)malloc(sizeof(itzam_int) * list_header.m_table_size);
 
-            if (datafile->m_shared->m_header.m_dellist_ref > 0)
+            if ((entries != NULL) && (map->m_open_slots != NULL))
             {
-                /* write new record header
-                 */
-                itzam_record_header rec_head;
-
-                rec_head.m_signature = ITZAM_RECORD_SIGNATURE;
-                rec_head.m_flags     = ITZAM_RECORD_IN_USE | ITZAM_RECORD_DELLIST;
-                rec_head.m_length    = sizeof(itzam_dellist_header) + size;
-                rec_head.m_rec_len  = rec_head.m_length;
-
-                if (itzam_file_write(datafile->m_file,&rec_head,sizeof(itzam_record_header)))
+                if (itzam_file_pread(datafile->m_file,entries,sizeof(itzam_dellist_entry) * list_header.m_table_size,where + sizeof(itzam_dellist_header)))
                 {
-                    /* write the list header
+                    map->m_table_size = list_header.m_table_size;
+                    result = ITZAM_OKAY;
+
+                    /* push open slots in reverse so that the lowest is used first
                      */
-                    if (itzam_file_write(datafile->m_file,&datafile->m_dellist_header,sizeof(itzam_dellist_header)))
+                    for (n = map->m_table_size - 1; n >= 0; --n)
                     {
-                        /* write the list
-                         */
-                        if (itzam_file_write(datafile->m_file,datafile->m_dellist,size))
+                        if (entries[n].m_where == ITZAM_NULL_REF)
+                            map->m_open_slots[map->m_open_count++] = n;
+                        else if (NULL == link_extent(map, entries[n].m_where, entries[n].m_length, n))
                         {
-                            /* update the header with the pointer to the new deleted record list
-                             */
-                            if (-1 != itzam_file_seek(datafile->m_file,0,ITZAM_SEEK_BEGIN))
-                            {
-                                if (itzam_file_write(datafile->m_file,&datafile->m_shared->m_header,sizeof(itzam_datafile_header)))
-                                    result = ITZAM_OKAY;
-                            }
+                            datafile->m_error_handler("read_dellist",ITZAM_ERROR_MALLOC);
+                            result = ITZAM_FAILED;
+                            break;
                         }
                     }
                 }
             }
+            else
+                datafile->m_error_handler("read_dellist",ITZAM_ERROR_MALLOC);
+
+            free(entries);
+        }
+
+        if (result != ITZAM_OKAY)
+        {
+            datafile->m_error_handler("read_dellist",ITZAM_ERROR_DELLIST_NOT_READ);
+            freemap_clear(map);
         }
     }
     else
+        result = ITZAM_OKAY;
+
+    map->m_loaded = (result == ITZAM_OKAY);
+
+    return result;
+}
+
+/* reload the index if another handle on this file has changed it
+ */
+static itzam_bool sync_dellist(itzam_datafile * datafile)
+{
+    if ((!datafile->m_freemap.m_loaded) || (datafile->m_freemap.m_serial != datafile->m_shared->m_dellist_serial))
+        read_dellist(datafile);
+
+    return datafile->m_freemap.m_loaded;
+}
+
+/* record that this handle has changed the deleted list
+ */
+static void dellist_changed(itzam_datafile * datafile)
+{
+    datafile->m_freemap.m_serial = ++datafile->m_shared->m_dellist_serial;
+}
+
+static itzam_state add_free(itzam_datafile * datafile, itzam_ref where, itzam_int length);
+
+/* write a larger deleted list at the end of the file, and release the old one
+ */
+static itzam_state write_dellist(itzam_datafile * datafile)
+{
+    itzam_freemap * map = &datafile->m_freemap;
+    itzam_int old_size = map->m_table_size;
+    itzam_int new_size = (old_size < ITZAM_DELLIST_BLOCK_SIZE) ? ITZAM_DELLIST_BLOCK_SIZE : old_size * 2;
+    itzam_int size = sizeof(itzam_dellist_entry) * new_size;
+    itzam_ref old_ref = datafile->m_shared->m_header.m_dellist_ref;
+    itzam_state result = ITZAM_FAILED;
+    itzam_dellist_header list_header;
+    itzam_record_header rec_head;
+    itzam_dellist_entry * entries;
+    itzam_free_extent * extent;
+    itzam_int * slots;
+    itzam_file_vec vec[3];
+    itzam_ref end;
+    itzam_int n;
+
+    entries = (itzam_dellist_entry *)malloc(size);
+    slots   = (itzam_int *)realloc(map->m_open_slots, sizeof(itzam_int) * new_size);
+
+    if ((entries == NULL) || (slots == NULL))
+    {
+        free(entries);
+
+        if (slots != NULL)
+            map->m_open_slots = slots;
+
+        datafile->m_error_handler("write_dellist",ITZAM_ERROR_MALLOC);
+        return ITZAM_FAILED;
+    }
+
+    map->m_open_slots = slots;
+
+    /* build the new table from the index
+     */
+    for (n = 0; n < new_size; ++n)
     {
-        if (-1 != itzam_file_seek(datafile->m_file,datafile->m_shared->m_header.m_dellist_ref + sizeof(itzam_record_header),ITZAM_SEEK_BEGIN))
+        entries[n].m_where  = ITZAM_NULL_REF;
+        entries[n].m_length = 0;
+    }
+
+    if (map->m_by_start != NULL)
+    {
+        for (n = 0; n <= (itzam_int)map->m_bucket_mask; ++n)
+        {
+            for (extent = map->m_by_start[n]; extent != NULL; extent = extent->m_start_next)
+            {
+                entries[extent->m_slot].m_where  = extent->m_where;
+                entries[extent->m_slot].m_length = extent->m_length;
+            }
+        }
+    }
+
+    /* explicitly append; we can't use write because it would allocate from the
+     *      deleted list while we're saving it
+     */
+    end = itzam_file_seek(datafile->m_file,0,ITZAM_SEEK_END);
+
+    if (end > 0)
+    {
+        rec_head.m_signature = ITZAM_RECORD_SIGNATURE;
+        rec_head.m_flags     = ITZAM_RECORD_IN_USE | ITZAM_RECORD_DELLIST;
+        rec_head.m_length    = sizeof(itzam_dellist_header) + size;
+        rec_head.m_rec_len   = rec_head.m_length;
+
+        /* entries are changed one at a time, so the list carries no checksum
+         */
+        rec_head.m_checksum  = 0;
+        rec_head.m_reserved  = 0;
+
+        list_header.m_table_size = new_size;
+
+        /* write the record header, list header, and list together
+         */
+        vec[0].m_data = &rec_head;
+        vec[0].m_len  = datafile->m_sizeof_header;
+        vec[1].m_data = &list_header;
+        vec[1].m_len  = sizeof(itzam_dellist_header);
+        vec[2].m_data = entries;
+        vec[2].m_len  = size;
+
+        if (write_file(datafile,vec,3,end))
         {
-            /* write the header
+            /* update the header with the pointer to the new deleted record list
              */
-            if (itzam_file_write(datafile->m_file,&datafile->m_dellist_header,sizeof(itzam_dellist_header)))
+            datafile->m_shared->m_header.m_dellist_ref = end;
+
+            if (write_bytes(datafile,&datafile->m_shared->m_header,sizeof(itzam_datafile_header),0))
             {
-                /* write the list
+                for (n = new_size - 1; n >= old_size; --n)
+                    map->m_open_slots[map->m_open_count++] = n;
+
+                map->m_table_size = new_size;
+                result = ITZAM_OKAY;
+
+                /* the old list is now free space
                  */
-                if (itzam_file_write(datafile->m_file,datafile->m_dellist,size))
-                    result = ITZAM_OKAY;
+                if (old_ref != ITZAM_NULL_REF)
+                    result = add_free(datafile, old_ref, sizeof(itzam_dellist_header) + sizeof(itzam_dellist_entry) * old_size);
             }
         }
     }
 
+    free(entries);
+
     if (result != ITZAM_OKAY)
         datafile->m_error_handler("write_dellist",ITZAM_ERROR_DELLIST_NOT_WRITTEN);
 
     return result;
 }
 
-/*-----------------------------------------------------------------------------
- * utilities
+/* add a deleted record to the index, merging it with free neighbors; the header
+ * of the resulting free record is rewritten
  */
-static char * get_tranfile_name(const char * filename)
+static itzam_state add_free(itzam_datafile * datafile, itzam_ref where, itzam_int length)
 {
-    static const char * tran_name_mask = "%s.itzamtran";
-    char * result = (char *)malloc(strlen(tran_name_mask) + strlen(filename) + 1);
-    sprintf(result,tran_name_mask,filename);
-    return result;
+    itzam_freemap * map = &datafile->m_freemap;
+    itzam_free_extent * prev;
+    itzam_free_extent * next;
+    itzam_free_extent * extent;
+    itzam_int slot;
+
+    /* make sure the list has room before changing anything
+     */
+    if ((map->m_open_count == 0) && (ITZAM_OKAY != write_dellist(datafile)))
+        return ITZAM_FAILED;
+
+    prev = find_by_end(map, where);
+    next = find_by_start(map, where + datafile->m_sizeof_header + length);
+
+    /* the last neighbor removed leaves its entry to be reused below
+     */
+    if (prev != NULL)
+    {
+        where   = prev->m_where;
+        length += prev->m_length + datafile->m_sizeof_header;
+        unlink_extent(datafile, prev, (next != NULL) ? itzam_true : itzam_false);
+    }
+
+    if (next != NULL)
+    {
+        length += next->m_length + datafile->m_sizeof_header;
+        unlink_extent(datafile, next, itzam_false);
+    }
+
+    slot   = map->m_open_slots[--map->m_open_count];
+    extent = link_extent(map, where, length, slot);
+
+    if (extent == NULL)
+    {
+        map->m_open_count++;
+        datafile->m_error_handler("add_free",ITZAM_ERROR_MALLOC);
+        return ITZAM_FAILED;
+    }
+
+    dellist_changed(datafile);
+
+    if (write_entry(datafile, slot, where, length) && write_free_header(datafile, where, length))
+        return ITZAM_OKAY;
+
+    datafile->m_error_handler("add_free",ITZAM_ERROR_DELLIST_NOT_WRITTEN);
+    return ITZAM_FAILED;
+}
+
+/* find the smallest free record in the first size class that can hold length bytes
+ */
+static itzam_free_extent * find_fit(itzam_freemap * map, itzam_int length)
+{
+    itzam_free_extent * best = NULL;
+    itzam_free_extent * extent;
+    int c = size_class(length);
+    uint64_t bits;
+
+    while (c < ITZAM_FREEMAP_CLASSES)
+    {
+        /* next non-empty class at or above c
+         */
+        bits = map->m_class_bits[c / 64] & (~(uint64_t)0 << (c % 64));
+
+        while (bits == 0)
+        {
+            c = (c / 64 + 1) * 64;
+
+            if (c >= ITZAM_FREEMAP_CLASSES)
+                return NULL;
+
+            bits = map->m_class_bits[c / 64];
+        }
+
+        c = (c / 64) * 64 + lowest_bit(bits);
+
+        for (extent = map->m_classes[c]; extent != NULL; extent = extent->m_next)
+        {
+            if (extent_fits(map, extent, length))
+            {
+                if (extent->m_length == length)
+                    return extent;
+
+                if ((best == NULL) || (extent->m_length < best->m_length))
+                    best = extent;
+            }
+        }
+
+        if (best != NULL)
+            break;
+
+        ++c;
+    }
+
+    return best;
+}
+
+/* take space for a new record from the deleted list; when a larger free record is
+ * split, *rest receives the header to be written after the new record
+ */
+static itzam_ref allocate(itzam_datafile * datafile, itzam_int length, itzam_record_header * rest)
+{
+    itzam_freemap * map = &datafile->m_freemap;
+    itzam_free_extent * extent;
+    itzam_ref where = ITZAM_NULL_REF;
+
+    rest->m_signature = 0;
+
+    if ((datafile->m_shared->m_header.m_dellist_ref != ITZAM_NULL_REF) && sync_dellist(datafile))
+    {
+        extent = find_fit(map, length);
+
+        if (extent != NULL)
+        {
+            where = extent->m_where;
+
+            if (extent->m_length == length)
+                unlink_extent(datafile, extent, itzam_true);
+            else
+            {
+                /* the remainder keeps the entry
+                 */
+                class_unlink(map, extent);
+                start_unlink(map, extent);
+
+                extent->m_where  += datafile->m_sizeof_header + length;
+                extent->m_length -= datafile->m_sizeof_header + length;
+
+                class_link(map, extent);
+                start_link(map, extent);
+
+                write_entry(datafile, extent->m_slot, extent->m_where, extent->m_length);
+
+                rest->m_signature = ITZAM_RECORD_SIGNATURE;
+                rest->m_flags     = 0;
+                rest->m_length    = extent->m_length;
+                rest->m_rec_len   = 0;
+                rest->m_checksum  = 0;
+                rest->m_reserved  = 0;
+            }
+
+            dellist_changed(datafile);
+        }
+    }
+
+    return where;
 }
 
+/*-----------------------------------------------------------------------------
+ * utilities
+ */
 itzam_bool itzam_datafile_exists(const char * filename)
 {
     struct stat info;
@@ -252,15 +915,52 @@ static const char * shared_mask = "Global\\%s_ItzamSharedDatafile";
 static const char * mutex_mask = "Global\\%s_ItzamMutex";
 #endif
 
+#if defined(ITZAM_UNIX)
+/* initialize the locks in a newly-created shared block; they are used by every
+ * process that opens the file
+ */
+static void init_shared_locks(itzam_datafile_shared * shared)
+{
+    pthread_mutexattr_t attr;
+    pthread_rwlockattr_t rwattr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&shared->m_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    pthread_rwlockattr_init(&rwattr);
+    pthread_rwlockattr_setpshared(&rwattr, PTHREAD_PROCESS_SHARED);
+#if defined(ITZAM_LINUX) && defined(__GLIBC__)
+    /* glibc prefers readers by default, which starves writers under a steady read load
+     */
+    pthread_rwlockattr_setkind_np(&rwattr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&shared->m_rwlock, &rwattr);
+    pthread_rwlockattr_destroy(&rwattr);
+
+    shared->m_writer_pid  = 0;
+    shared->m_write_depth = 0;
+}
+#endif
+
 /*-----------------------------------------------------------------------------
  * datafile functions
  */
 itzam_state itzam_datafile_create(itzam_datafile * datafile, const char * filename)
 {
+    return itzam_datafile_create_ex(datafile, filename, NULL);
+}
+
+/* the error handler is installed before anything can be reported, so that errors found while
+ * the file is created reach it rather than the process-wide default handler
+ */
+itzam_state itzam_datafile_create_ex(itzam_datafile * datafile, const char * filename, itzam_error_handler * error_handler)
+{
+    itzam_error_handler * report = (error_handler != NULL) ? error_handler : default_error_handler;
     itzam_datafile_header header;
-#if defined(ITZAM_UNIX)
-    pthread_mutexattr_t attr;
-#else
+#if !defined(ITZAM_UNIX)
     char * mutex_name;
 #endif
     itzam_state result = ITZAM_FAILED;
@@ -291,22 +991,31 @@ itzam_state itzam_datafile_create(itzam_datafile * datafile, const char * filena
         datafile->m_shmem           = NULL;
 #endif
         datafile->m_filename        = strdup(filename);
-        datafile->m_dellist         = NULL;
-        datafile->m_tran_file       = NULL;
-        datafile->m_tran_replacing  = itzam_false;
+        freemap_init(&datafile->m_freemap, sizeof(itzam_record_header));
         datafile->m_shared          = NULL;
         datafile->m_is_open         = itzam_false;
         datafile->m_file_locked          = itzam_false;
         datafile->m_in_transaction  = itzam_false;
-        datafile->m_error_handler   = default_error_handler;
+        datafile->m_error_handler   = report;
+        datafile->m_position        = sizeof(itzam_datafile_header);
+        datafile->m_checksums       = ITZAM_CHECKSUM_VERIFY;
+        datafile->m_sizeof_header   = sizeof(itzam_record_header);
+
+#if defined(ITZAM_UNIX)
+        datafile->m_map             = NULL;
+        datafile->m_map_size        = 0;
+        datafile->m_map_len         = 0;
+
+        pthread_rwlock_init(&datafile->m_map_lock, NULL);
+#endif
 
 #if defined(ITZAM_UNIX)
         memset(&datafile->m_file_lock,0,sizeof(struct flock));
 #endif
 
-        /* generate transaction file name
+        /* prepare the write-ahead log
          */
-        datafile->m_tran_file_name = get_tranfile_name(filename);;
+        itzam_log_init(datafile, filename);
 
         /* generate shared memory for header
          */
@@ -320,22 +1029,30 @@ itzam_state itzam_datafile_create(itzam_datafile * datafile, const char * filena
         {
             /* write header
              */
-            if (itzam_file_write(datafile->m_file,&header,sizeof(itzam_datafile_header)))
+            if (itzam_file_pwrite(datafile->m_file,&header,sizeof(itzam_datafile_header),0))
             {
                 itzam_file_commit(datafile->m_file);
 
                 /* generate shared memory and fill it
                  */
-                datafile->m_shmem = itzam_shmem_obtain(datafile->m_shmem_name, sizeof(itzam_datafile_shared), &creator);
-                datafile->m_shared = (itzam_datafile_shared *)itzam_shmem_getptr(datafile->m_shmem, sizeof(itzam_datafile_shared));
+                datafile->m_shmem = itzam_shmem_obtain(datafile->m_shmem_name, sizeof(itzam_datafile_shared), &creator, report);
+                datafile->m_shared = (itzam_datafile_shared *)itzam_shmem_getptr(datafile->m_shmem, sizeof(itzam_datafile_shared), report);
                 datafile->m_shared->m_count = 1;
+                datafile->m_shared->m_generation = 0;
+                datafile->m_shared->m_dellist_serial = 0;
+                datafile->m_shared->m_log_base = 1;
+                datafile->m_shared->m_log_end = 1;
+                datafile->m_shared->m_next_txn = 0;
+
+                /* a log left behind by an earlier file of the same name is meaningless
+                 */
+                if (itzam_datafile_exists(datafile->m_log.m_filename))
+                    itzam_file_remove(datafile->m_log.m_filename);
 
                 /* obtain mutex
                 */
 #if defined(ITZAM_UNIX)
-                pthread_mutexattr_init(&attr);
-                pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-                pthread_mutex_init(&datafile->m_shared->m_mutex, &attr);
+                init_shared_locks(datafile->m_shared);
 #else
                 mutex_name = get_shared_name(mutex_mask,filename);
 
@@ -352,15 +1069,15 @@ itzam_state itzam_datafile_create(itzam_datafile * datafile, const char * filena
                 result = ITZAM_OKAY;
             }
             else
-                default_error_handler("itzam_datafile_create",ITZAM_ERROR_WRITE_FAILED);
+                report("itzam_datafile_create",ITZAM_ERROR_WRITE_FAILED);
         }
         else
-            default_error_handler("itzam_datafile_create",ITZAM_ERROR_FILE_CREATE);
+            report("itzam_datafile_create",ITZAM_ERROR_FILE_CREATE);
 
         datafile->m_is_open = (result == ITZAM_OKAY);
     }
     else
-        default_error_handler("itzam_datafile_create",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+        report("itzam_datafile_create",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
     pthread_mutex_unlock(&global_mutex);
 
@@ -372,11 +1089,19 @@ itzam_state itzam_datafile_open(itzam_datafile * datafile,
                                 itzam_bool recover,
                                 itzam_bool read_only)
 {
+    return itzam_datafile_open_ex(datafile, filename, recover, read_only, NULL);
+}
+
+itzam_state itzam_datafile_open_ex(itzam_datafile * datafile,
+                                   const char * filename,
+                                   itzam_bool recover,
+                                   itzam_bool read_only,
+                                   itzam_error_handler * error_handler)
+{
+    itzam_error_handler * report = (error_handler != NULL) ? error_handler : default_error_handler;
     itzam_bool have_header = itzam_false;
     itzam_bool creator = itzam_false;
-#if defined(ITZAM_UNIX)
-    pthread_mutexattr_t attr;
-#else
+#if !defined(ITZAM_UNIX)
     char * mutex_name;
 #endif
     itzam_state result = ITZAM_FAILED;
@@ -387,17 +1112,25 @@ itzam_state itzam_datafile_open(itzam_datafile * datafile,
      */
     if (datafile != NULL)
     {
-        /* set default error handler
+        /* set the error handler before anything can be reported
          */
-        datafile->m_error_handler  = default_error_handler;
-        datafile->m_tran_file      = NULL;
-        datafile->m_tran_replacing = itzam_false;
+        datafile->m_error_handler  = report;
         datafile->m_file_locked         = itzam_false;
         datafile->m_is_open        = itzam_false;
-        datafile->m_dellist        = NULL;
+        freemap_init(&datafile->m_freemap, sizeof(itzam_record_header));
         datafile->m_in_transaction = itzam_false;
+        datafile->m_position       = sizeof(itzam_datafile_header);
+        datafile->m_checksums      = ITZAM_CHECKSUM_VERIFY;
+        datafile->m_sizeof_header  = sizeof(itzam_record_header);
+        datafile->m_filename       = NULL;
 
 #if defined(ITZAM_UNIX)
+        datafile->m_map            = NULL;
+        datafile->m_map_size       = 0;
+        datafile->m_map_len        = 0;
+
+        pthread_rwlock_init(&datafile->m_map_lock, NULL);
+
         memset(&datafile->m_file_lock,0,sizeof(struct flock));
 #endif
 
@@ -407,26 +1140,25 @@ itzam_state itzam_datafile_open(itzam_datafile * datafile,
 
         if (ITZAM_GOOD_FILE(datafile->m_file))
         {
-            datafile->m_is_open = itzam_true;
+            datafile->m_is_open  = itzam_true;
+            datafile->m_filename = strdup(filename);
 
             //itzam_datafile_file_lock(datafile);
 
-            /* get tranfile name
+            /* prepare the write-ahead log
              */
-            datafile->m_tran_file_name = get_tranfile_name(filename);;
+            itzam_log_init(datafile, filename);
 
             /* get shared memory
              */
             datafile->m_shmem_name = get_shared_name(shared_mask, filename);
-            datafile->m_shmem = itzam_shmem_obtain(datafile->m_shmem_name, sizeof(itzam_datafile_shared), &creator);
-            datafile->m_shared = (itzam_datafile_shared *)itzam_shmem_getptr(datafile->m_shmem, sizeof(itzam_datafile_shared));
+            datafile->m_shmem = itzam_shmem_obtain(datafile->m_shmem_name, sizeof(itzam_datafile_shared), &creator, report);
+            datafile->m_shared = (itzam_datafile_shared *)itzam_shmem_getptr(datafile->m_shmem, sizeof(itzam_datafile_shared), report);
 
 #if defined(ITZAM_UNIX)
             if (creator)
             {
-                pthread_mutexattr_init(&attr);
-                pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-                pthread_mutex_init(&datafile->m_shared->m_mutex, &attr);
+                init_shared_locks(datafile->m_shared);
             }
 #else
             mutex_name = get_shared_name(mutex_mask,filename);
@@ -442,14 +1174,32 @@ itzam_state itzam_datafile_open(itzam_datafile * datafile,
             datafile->m_read_only  = read_only;
 
             if (creator)
+            {
                 datafile->m_shared->m_count = 1;
+                datafile->m_shared->m_generation = 0;
+                datafile->m_shared->m_dellist_serial = 0;
+                datafile->m_shared->m_log_base = 1;
+                datafile->m_shared->m_log_end = 1;
+                datafile->m_shared->m_next_txn = 0;
+
+                /* a log left by a process that failed holds changes that must be
+                 * repeated or undone before the header is read
+                 */
+                if (!read_only && itzam_datafile_exists(datafile->m_log.m_filename))
+                {
+                    if (recover)
+                        itzam_log_recover(datafile);
+                    else
+                        itzam_file_remove(datafile->m_log.m_filename);
+                }
+            }
             else
                 datafile->m_shared->m_count += 1;
 
             /* read the header
              */
             if (creator) // (datafile->m_shared->m_header.m_signature != ITZAM_DATAFILE_SIGNATURE) && (creator))
-                have_header = itzam_file_read(datafile->m_file, &datafile->m_shared->m_header, sizeof(itzam_datafile_header));
+                have_header = itzam_file_pread(datafile->m_file, &datafile->m_shared->m_header, sizeof(itzam_datafile_header), 0);
             else
                 have_header = itzam_true;
 
@@ -459,19 +1209,23 @@ itzam_state itzam_datafile_open(itzam_datafile * datafile,
                  */
                 if (datafile->m_shared->m_header.m_signature == ITZAM_DATAFILE_SIGNATURE)
                 {
-                    if (datafile->m_shared->m_header.m_version == ITZAM_DATAFILE_VERSION)
+                    if ((datafile->m_shared->m_header.m_version == ITZAM_DATAFILE_VERSION)
+                     || (datafile->m_shared->m_header.m_version == ITZAM_DATAFILE_VERSION_0501))
                     {
+                        /* files of version 5.1 are read and written without checksums
+                         */
+                        if (datafile->m_shared->m_header.m_version == ITZAM_DATAFILE_VERSION_0501)
+                        {
+                            datafile->m_sizeof_header = offsetof(itzam_record_header, m_checksum);
+                            datafile->m_freemap.m_sizeof_header = datafile->m_sizeof_header;
+                        }
+
                         /* read deleted list, if any
                          */
                         if (datafile->m_shared->m_header.m_dellist_ref != ITZAM_NULL_REF)
                             result = read_dellist(datafile);
                         else
                             result = ITZAM_OKAY;
-
-                        /* if we have a dangling transaction, roll it back
-                         */
-                        if (recover && (datafile->m_shared->m_header.m_transaction_tail != ITZAM_NULL_REF))
-                            itzam_datafile_transaction_rollback(datafile);
                     }
                     else
                         datafile->m_error_handler("itzam_datafile_open",ITZAM_ERROR_VERSION);
@@ -496,7 +1250,7 @@ itzam_state itzam_datafile_open(itzam_datafile * datafile,
         //itzam_datafile_file_unlock(datafile);
     }
     else
-        default_error_handler("itzam_datafile_open",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+        report("itzam_datafile_open",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
     pthread_mutex_unlock(&global_mutex);
 
@@ -518,6 +1272,8 @@ itzam_state itzam_datafile_close(itzam_datafile * datafile)
 
         last_owner = (datafile->m_shared->m_count <= 0) ? itzam_true : itzam_false;
 
+        itzam_log_close(datafile, last_owner);
+
         if (last_owner)
         #if defined(ITZAM_UNIX)
             pthread_mutex_destroy(&datafile->m_shared->m_mutex);
@@ -525,13 +1281,7 @@ itzam_state itzam_datafile_close(itzam_datafile * datafile)
             CloseHandle(datafile->m_mutex);
         #endif
 
-        if (datafile->m_dellist != NULL)
-        {
-            free(datafile->m_dellist);
-            datafile->m_dellist = NULL;
-        }
-
-        free(datafile->m_tran_file_name);
+        freemap_clear(&datafile->m_freemap);
 
         itzam_shmem_freeptr(datafile->m_shared, sizeof(itzam_datafile_shared));
 
@@ -539,6 +1289,16 @@ itzam_state itzam_datafile_close(itzam_datafile * datafile)
             itzam_shmem_close(datafile->m_shmem, datafile->m_shmem_name);
 
         free(datafile->m_shmem_name);
+        free(datafile->m_filename);
+        datafile->m_filename = NULL;
+
+#if defined(ITZAM_UNIX)
+        if (datafile->m_map != NULL)
+            itzam_file_unmap(datafile->m_map, datafile->m_map_size);
+
+        datafile->m_map = NULL;
+        pthread_rwlock_destroy(&datafile->m_map_lock);
+#endif
 
         if (itzam_file_close(datafile->m_file))
         {
@@ -574,6 +1334,80 @@ void itzam_datafile_mutex_unlock(itzam_datafile * datafile)
 #endif
 }
 
+#if defined(ITZAM_UNIX)
+/* does the calling thread hold the write lock? only the owner can change the
+ * fields compared here, so the answer is reliable for the caller
+ */
+static itzam_bool is_writer(itzam_datafile * datafile)
+{
+    itzam_datafile_shared * shared = datafile->m_shared;
+
+    return (itzam_bool)((shared->m_write_depth > 0)
+                     && (shared->m_writer_pid == getpid())
+                     && pthread_equal(shared->m_writer, pthread_self()));
+}
+#endif
+
+/* Readers share access to indexes; a thread that already holds the write lock
+ * simply nests. Windows lacks a process-shared reader/writer lock, so readers
+ * there take the datafile mutex.
+ */
+void itzam_datafile_read_lock(itzam_datafile * datafile)
+{
+#if defined(ITZAM_UNIX)
+    if (is_writer(datafile))
+        itzam_datafile_mutex_lock(datafile);
+    else
+        pthread_rwlock_rdlock(&datafile->m_shared->m_rwlock);
+#else
+    itzam_datafile_mutex_lock(datafile);
+#endif
+}
+
+void itzam_datafile_read_unlock(itzam_datafile * datafile)
+{
+#if defined(ITZAM_UNIX)
+    if (is_writer(datafile))
+        itzam_datafile_mutex_unlock(datafile);
+    else
+        pthread_rwlock_unlock(&datafile->m_shared->m_rwlock);
+#else
+    itzam_datafile_mutex_unlock(datafile);
+#endif
+}
+
+/* Writers take the datafile mutex, which serializes them and nests, and then
+ * hold the reader/writer lock exclusively at the outermost level.
+ */
+void itzam_datafile_write_lock(itzam_datafile * datafile)
+{
+    itzam_datafile_mutex_lock(datafile);
+
+#if defined(ITZAM_UNIX)
+    if (datafile->m_shared->m_write_depth == 0)
+    {
+        pthread_rwlock_wrlock(&datafile->m_shared->m_rwlock);
+        datafile->m_shared->m_writer     = pthread_self();
+        datafile->m_shared->m_writer_pid = getpid();
+    }
+
+    ++datafile->m_shared->m_write_depth;
+#endif
+}
+
+void itzam_datafile_write_unlock(itzam_datafile * datafile)
+{
+#if defined(ITZAM_UNIX)
+    if (--datafile->m_shared->m_write_depth == 0)
+    {
+        datafile->m_shared->m_writer_pid = 0;
+        pthread_rwlock_unlock(&datafile->m_shared->m_rwlock);
+    }
+#endif
+
+    itzam_datafile_mutex_unlock(datafile);
+}
+
 itzam_bool itzam_datafile_file_lock(itzam_datafile * datafile)
 {
     itzam_bool result = itzam_false;
@@ -611,8 +1445,23 @@ itzam_bool itzam_datafile_file_unlock(itzam_datafile * datafile)
     {
         if (datafile->m_file_locked)
         {
+            /* another process may take the file next; make changes as durable as the policy asks
+             */
+            switch (datafile->m_log.m_durability)
+            {
+                case ITZAM_DURABILITY_COMMIT:
+                    itzam_file_commit(datafile->m_file);
+                    break;
+
+                case ITZAM_DURABILITY_WRITE_BEHIND:
+                    itzam_file_write_behind(datafile->m_file);
+                    break;
+
+                default:
+                    break;
+            }
+
 #if defined(ITZAM_UNIX)
-            fsync(datafile->m_file);
             datafile->m_file_lock.l_type = F_UNLCK;
             result = (itzam_bool)fcntl(datafile->m_file,F_SETLKW,&datafile->m_file_lock);
 #else
@@ -699,7 +1548,7 @@ itzam_ref itzam_datafile_tell(itzam_datafile * datafile)
     {
         itzam_datafile_mutex_lock(datafile);
 
-        where = (itzam_ref)itzam_file_tell(datafile->m_file);
+        where = datafile->m_position;
 
         itzam_datafile_mutex_unlock(datafile);
     }
@@ -717,10 +1566,13 @@ itzam_state itzam_datafile_seek(itzam_datafile * datafile, itzam_ref  pos)
     {
         itzam_datafile_mutex_lock(datafile);
 
-        /* seek to requested position
+        /* seek to requested position; reads are positional, so this just records it
          */
-        if (-1 != itzam_file_seek(datafile->m_file,(long)pos,ITZAM_SEEK_BEGIN))
+        if (pos >= 0)
+        {
+            datafile->m_position = pos;
             result = ITZAM_OKAY;
+        }
         else
             datafile->m_error_handler("itzam_datafile_seek",ITZAM_ERROR_SEEK_FAILED);
 
@@ -742,10 +1594,8 @@ itzam_state itzam_datafile_rewind(itzam_datafile * datafile)
 
         /* seek to byte after first deleted marker
          */
-        if (-1 != itzam_file_seek(datafile->m_file,(long)sizeof(itzam_datafile_header),ITZAM_SEEK_BEGIN))
-            result = ITZAM_OKAY;
-        else
-            datafile->m_error_handler("itzam_datafile_rewind",ITZAM_ERROR_SEEK_FAILED);
+        datafile->m_position = sizeof(itzam_datafile_header);
+        result = ITZAM_OKAY;
 
         itzam_datafile_mutex_unlock(datafile);
     }
@@ -755,122 +1605,82 @@ itzam_state itzam_datafile_rewind(itzam_datafile * datafile)
     return result;
 }
 
-/* This function should NEVER be called by user code; it is an internal function used by indexes.
- * It assumes that a returned deleted record will be used by the calling function.
+/* find space for a record of length bytes, from the deleted list or at the end of the file
  */
-itzam_ref itzam_datafile_get_next_open(itzam_datafile * datafile, itzam_int length)
+static itzam_ref next_open(itzam_datafile * datafile, itzam_int length, itzam_record_header * rest)
 {
-    itzam_int n;
-    itzam_ref where = ITZAM_NULL_REF;
+    itzam_ref where = allocate(datafile, length, rest);
 
-    if ((datafile != NULL) && (datafile->m_is_open))
+    if (where == ITZAM_NULL_REF)
     {
-        if (ITZAM_OKAY == read_dellist(datafile))
-        {
-            for (n = 0; n < datafile->m_dellist_header.m_table_size; ++n)
-            {
-                if (datafile->m_dellist[n].m_where != ITZAM_NULL_REF)
-                {
-                    if (datafile->m_dellist[n].m_length == length)
-                    {
-                        /* save the location of the deleted record we're replacing
-                         */
-                        where = datafile->m_dellist[n].m_where;
-
-                        /* remove this entry from the table
-                         */
-                        datafile->m_dellist[n].m_where  = ITZAM_NULL_REF;
-                        datafile->m_dellist[n].m_length = 0;
-                        write_dellist(datafile,itzam_false);
-                        break;
-                    }
-                }
-            }
-        }
-
-        if (where == ITZAM_NULL_REF)
-        {
-            /* no deleted records, so append
-             */
-            if (-1 != itzam_file_seek(datafile->m_file,0,ITZAM_SEEK_END))
-            {
-                where = itzam_file_tell(datafile->m_file);
+        /* no suitable deleted record, so append
+         */
+        where = itzam_file_seek(datafile->m_file,0,ITZAM_SEEK_END);
 
-                if (where < 0)
-                    where = ITZAM_NULL_REF;
-            }
-            else
-                where = ITZAM_NULL_REF;
-        }
+        if (where < 0)
+            where = ITZAM_NULL_REF;
     }
-    else
-        default_error_handler("itzam_datafile_get_next_open",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
     return where;
 }
 
-/* internal function to add an operation to the transaction list
+/* This function should NEVER be called by user code; it is an internal function used by indexes.
+ * It assumes that a returned deleted record will be used by the calling function.
  */
-static itzam_bool add_tran_op(itzam_datafile * datafile, itzam_int where, itzam_record_header * header, const void * data, itzam_op_type op_type)
+itzam_ref itzam_datafile_get_next_open(itzam_datafile * datafile, itzam_int length)
 {
-    itzam_bool result = itzam_false;
-    itzam_op_header op_header;
-    itzam_int op_where;
+    itzam_record_header rest;
+    itzam_ref where = ITZAM_NULL_REF;
 
-    if (datafile->m_in_transaction)
+    if ((datafile != NULL) && (datafile->m_is_open))
     {
-        /* initialize operation header and copy data in
-         */
-        op_header.m_type         = op_type;
-        op_header.m_where        = where;
-        op_header.m_prev_tran    = datafile->m_shared->m_header.m_transaction_tail;
-        memcpy(&op_header.m_record_header,header,sizeof(itzam_record_header));
-        op_header.m_record_header.m_flags |= ITZAM_RECORD_TRAN_RECORD;
-        op_header.m_record_where = ITZAM_NULL_REF;
-
-        /* turn off transactions for a moment
-         */
-        datafile->m_in_transaction = itzam_false;
-
-        /* write op data to the file
-         */
-        if (op_type != ITZAM_TRAN_OP_WRITE)
-        {
-            op_header.m_record_where = itzam_datafile_get_next_open(datafile->m_tran_file,op_header.m_record_header.m_length);
-            itzam_datafile_write_flags(datafile->m_tran_file,data,op_header.m_record_header.m_length,op_header.m_record_where,ITZAM_RECORD_TRAN_RECORD);
-        }
-
-        /* write op header
-         */
-        op_where = itzam_datafile_get_next_open(datafile->m_tran_file,sizeof(itzam_op_header));
-        itzam_datafile_write_flags(datafile->m_tran_file,&op_header,sizeof(op_header),op_where,ITZAM_RECORD_TRAN_HEADER);
+        itzam_datafile_mutex_lock(datafile);
 
-        /* turn transactions on again
-         */
-        datafile->m_in_transaction = itzam_true;
+        where = next_open(datafile, length, &rest);
 
-        /* rewrite datafile header
+        /* a split record leaves a smaller free record behind the new one
          */
-        datafile->m_shared->m_header.m_transaction_tail = op_where;
-
-        if (-1 != itzam_file_seek(datafile->m_file,0,ITZAM_SEEK_BEGIN))
+        if ((where != ITZAM_NULL_REF) && (rest.m_signature == ITZAM_RECORD_SIGNATURE))
         {
-            if (itzam_file_write(datafile->m_file,&datafile->m_shared->m_header,sizeof(itzam_datafile_header)))
-                result = itzam_true;
+            if (!write_bytes(datafile,&rest,datafile->m_sizeof_header,where + datafile->m_sizeof_header + length))
+                datafile->m_error_handler("itzam_datafile_get_next_open",ITZAM_ERROR_WRITE_FAILED);
         }
+
+        itzam_datafile_mutex_unlock(datafile);
     }
+    else
+        default_error_handler("itzam_datafile_get_next_open",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
-    return result;
+    return where;
 }
 
 itzam_ref itzam_datafile_write_flags(itzam_datafile * datafile, const void * data, itzam_int length, itzam_ref where, int32_t flags)
 {
     itzam_record_header rec_header;
+    itzam_record_header rest;
+    itzam_file_vec vec[3];
+    int vec_count = 2;
 
     /* make sure the arguments make sense
      */
     if ((datafile != NULL) && (data != NULL) && (length > 0)  && (datafile->m_is_open))
     {
+        rec_header.m_signature = ITZAM_RECORD_SIGNATURE;
+        rec_header.m_flags     = ITZAM_RECORD_IN_USE | flags;
+        rec_header.m_length    = length;
+        rec_header.m_rec_len   = length;
+        rec_header.m_checksum  = 0;
+        rec_header.m_reserved  = 0;
+
+        /* the checksum doesn't depend on where the record goes, so it is found before
+         * taking the mutex
+         */
+        if (has_checksums(datafile))
+        {
+            rec_header.m_flags   |= ITZAM_RECORD_CHECKSUM;
+            rec_header.m_checksum = record_checksum(&rec_header, data);
+        }
+
         itzam_datafile_mutex_lock(datafile);
 
         if (datafile->m_read_only)
@@ -879,94 +1689,36 @@ itzam_ref itzam_datafile_write_flags(itzam_datafile * datafile, const void * dat
         {
             /* if we aren't told where to put the record, find a place
             */
-            if (where == ITZAM_NULL_REF)
-                where = itzam_datafile_get_next_open(datafile,length);
-            else
-            {
-                /* are we in a transaction?
-                */
-                if (datafile->m_in_transaction)
-                {
-                    /* read the old record rec_header
-                    */
-                    if (-1 != itzam_file_seek(datafile->m_file,where,ITZAM_SEEK_BEGIN))
-                    {
-                        if (itzam_file_read(datafile->m_file,&rec_header,sizeof(itzam_record_header)))
-                        {
-                            /* if the record is active, then we need to save it
-                            */
-                            if (rec_header.m_flags & ITZAM_RECORD_IN_USE)
-                            {
-                                /* create a temporary buffer
-                                */
-                                void * op_data = malloc(rec_header.m_rec_len);
-
-                                /* read data
-                                */
-                                if (op_data != NULL)
-                                {
-                                    /* now save record information
-                                    */
-                                    if (itzam_file_read(datafile->m_file,op_data,rec_header.m_length))
-                                    {
-                                        add_tran_op(datafile,where,&rec_header,op_data,ITZAM_TRAN_OP_REMOVE);
-                                        free(op_data);
-                                    }
-                                    else
-                                        datafile->m_error_handler("itzam_datafile_write_flags (1)",ITZAM_ERROR_READ_FAILED);
-                                }
-                                else
-                                    datafile->m_error_handler("itzam_datafile_write_flags (2)",ITZAM_ERROR_MALLOC);
-                            }
-                        }
-                    }
-                }
-            }
+            rest.m_signature = 0;
 
-            rec_header.m_signature = ITZAM_RECORD_SIGNATURE;
-            rec_header.m_flags     = ITZAM_RECORD_IN_USE | flags;
-            rec_header.m_length    = 0;
-            rec_header.m_rec_len   = 0;
+            if (where == ITZAM_NULL_REF)
+                where = next_open(datafile,length,&rest);
 
             /* do we have a good place to write?
             */
             if (where != ITZAM_NULL_REF)
             {
-                /* modify record rec_header
+                /* write the record header and the record together
                 */
-                rec_header.m_rec_len = length;
-                rec_header.m_length  = length;
+                vec[0].m_data = &rec_header;
+                vec[0].m_len  = datafile->m_sizeof_header;
+                vec[1].m_data = (void *)data;
+                vec[1].m_len  = length;
 
-                /* ITZAM_SEEK to beginning of new record
+                /* a split deleted record leaves a smaller free record directly behind this one
                 */
-                if (-1 != itzam_file_seek(datafile->m_file,where,ITZAM_SEEK_BEGIN))
+                if (rest.m_signature == ITZAM_RECORD_SIGNATURE)
                 {
-                    /* write the record rec_header
-                    */
-                    if (itzam_file_write(datafile->m_file,&rec_header,sizeof(rec_header)))
-                    {
-                        /* write the record
-                        */
-                        if (!itzam_file_write(datafile->m_file,data,length))
-                        {
-                            datafile->m_error_handler("itzam_datafile_write_flags (4)",ITZAM_ERROR_WRITE_FAILED);
-                            where = ITZAM_NULL_REF;
-                        }
-                    }
-                    else
-                    {
-                        datafile->m_error_handler("itzam_datafile_write_flags (5)", ITZAM_ERROR_WRITE_FAILED);
-                        where = ITZAM_NULL_REF;
-                    }
+                    vec[2].m_data = &rest;
+                    vec[2].m_len  = datafile->m_sizeof_header;
+                    vec_count = 3;
                 }
-                else
+
+                if (!write_file(datafile,vec,vec_count,where))
                 {
-                    datafile->m_error_handler("itzam_datafile_write_flags (6)",ITZAM_ERROR_SEEK_FAILED);
+                    datafile->m_error_handler("itzam_datafile_write_flags (4)",ITZAM_ERROR_WRITE_FAILED);
                     where = ITZAM_NULL_REF;
                 }
-
-                if ((where != ITZAM_NULL_REF) && (datafile->m_in_transaction))
-                    add_tran_op(datafile,where,&rec_header,data,ITZAM_TRAN_OP_WRITE);
             }
         }
 
@@ -988,6 +1740,9 @@ itzam_state itzam_datafile_overwrite(itzam_datafile * datafile, const void * dat
 {
     itzam_state result = ITZAM_FAILED;
     itzam_record_header rec_header;
+    itzam_file_vec vec[2];
+    itzam_byte * whole = NULL;
+    itzam_int whole_len;
 
     if ((datafile != NULL) && (data != NULL) && (length > 0)  && (datafile->m_is_open) && (where != ITZAM_NULL_REF))
     {
@@ -999,70 +1754,225 @@ itzam_state itzam_datafile_overwrite(itzam_datafile * datafile, const void * dat
 
         itzam_datafile_mutex_lock(datafile);
 
-        /* read header file
+        /* read header file
+         */
+        if (!read_header(datafile,&rec_header,where))
+             datafile->m_error_handler("itzam_datafile_explicit_write (1)",ITZAM_ERROR_READ_FAILED);
+
+        if ((0 == (rec_header.m_flags & ITZAM_RECORD_IN_USE)) || (rec_header.m_signature != ITZAM_RECORD_SIGNATURE))
+             datafile->m_error_handler("itzam_datafile_explicit_write (2)",ITZAM_ERROR_INVALID_RECORD);
+
+        /* make sure we fit inside the record
+         */
+        if (!lengths_valid(&rec_header))
+            datafile->m_error_handler("itzam_datafile_explicit_write (2)",ITZAM_ERROR_INVALID_RECORD);
+        else if (rec_header.m_length < (length + offset))
+            result = ITZAM_OVERWRITE_TOO_LONG;
+        else if (rec_header.m_flags & ITZAM_RECORD_CHECKSUM)
+        {
+            /* the checksum covers the whole record, so the record is written again with a
+             * new one; its old data is only needed if the change doesn't replace all of it
+             */
+            whole_len = (rec_header.m_rec_len > (length + offset)) ? rec_header.m_rec_len : (length + offset);
+            vec[1].m_data = NULL;
+
+            if ((offset == 0) && (length >= rec_header.m_rec_len))
+                vec[1].m_data = (void *)data;
+            else
+            {
+                whole = (itzam_byte *)malloc(whole_len);
+
+                if (whole == NULL)
+                    datafile->m_error_handler("itzam_datafile_explicit_write (3)",ITZAM_ERROR_MALLOC);
+                else if (!itzam_file_pread(datafile->m_file, whole, whole_len, where + datafile->m_sizeof_header))
+                    datafile->m_error_handler("itzam_datafile_explicit_write (1)",ITZAM_ERROR_READ_FAILED);
+                else
+                {
+                    memcpy(whole + offset, data, length);
+                    vec[1].m_data = whole;
+                }
+            }
+
+            if (vec[1].m_data != NULL)
+            {
+                rec_header.m_checksum = record_checksum(&rec_header, vec[1].m_data);
+
+                vec[0].m_data = &rec_header;
+                vec[0].m_len  = datafile->m_sizeof_header;
+                vec[1].m_len  = whole_len;
+
+                if (write_file(datafile, vec, 2, where))
+                    result = ITZAM_OKAY;
+                else
+                    datafile->m_error_handler("itzam_datafile_explicit_write (4)",ITZAM_ERROR_WRITE_FAILED);
+            }
+
+            free(whole);
+        }
+        else
+        {
+            /* modify record at given offset
+             */
+            if (write_bytes(datafile, data, length, where + datafile->m_sizeof_header + offset))
+                result = ITZAM_OKAY;
+            else
+                datafile->m_error_handler("itzam_datafile_explicit_write (4)",ITZAM_ERROR_WRITE_FAILED);
+        }
+
+        itzam_datafile_mutex_unlock(datafile);
+    }
+    else
+        default_error_handler("itzam_datafile_write_flags (5)",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+#if defined(ITZAM_UNIX)
+/* make the map cover at least end bytes of the file, mapping it again if the file has grown
+ * beyond it; the map lock must be held exclusively
+ */
+static itzam_bool extend_map(itzam_datafile * datafile, itzam_ref end)
+{
+    const itzam_byte * map;
+    itzam_ref file_len;
+
+    if ((datafile->m_map != NULL) && (end > datafile->m_map_len))
+    {
+        file_len = itzam_file_seek(datafile->m_file, 0, ITZAM_SEEK_END);
+
+        if (file_len > datafile->m_map_size)
+        {
+            map = (const itzam_byte *)itzam_file_map(datafile->m_file, file_len + ITZAM_MAP_SLACK);
+
+            if (map != NULL)
+            {
+                itzam_file_unmap(datafile->m_map, datafile->m_map_size);
+                datafile->m_map      = map;
+                datafile->m_map_size = file_len + ITZAM_MAP_SLACK;
+            }
+            else
+                file_len = datafile->m_map_size;
+        }
+
+        if (file_len > 0)
+            datafile->m_map_len = file_len;
+    }
+
+    return (itzam_bool)((datafile->m_map != NULL) && (end <= datafile->m_map_len));
+}
+
+/* read a record by copying it from the map; returns itzam_false if reads are not mapped or
+ * the map cannot reach the record, leaving the caller to read the file. Otherwise *state is
+ * ITZAM_OKAY, ITZAM_NOT_FOUND if there is no active record at where, or ITZAM_FAILED if the
+ * record is damaged
+ */
+static itzam_bool read_mapped(itzam_datafile * datafile, itzam_ref where, void * record, itzam_int max_length, itzam_record_header * header, itzam_state * state)
+{
+    itzam_ref end = where + datafile->m_sizeof_header + max_length;
+    itzam_bool result = itzam_false;
+    const itzam_byte * data;
+    itzam_int read_len;
+
+    pthread_rwlock_rdlock(&datafile->m_map_lock);
+
+    if ((datafile->m_map != NULL) && (end > datafile->m_map_len))
+    {
+        /* the file has grown since the map last looked; the copy is made under the
+         * exclusive lock, which only happens when the file grows
+         */
+        pthread_rwlock_unlock(&datafile->m_map_lock);
+        pthread_rwlock_wrlock(&datafile->m_map_lock);
+        extend_map(datafile, end);
+    }
+
+    if ((datafile->m_map != NULL) && (end <= datafile->m_map_len))
+    {
+        memset(header, 0, sizeof(itzam_record_header));
+        memcpy(header, datafile->m_map + where, datafile->m_sizeof_header);
+
+        *state = ITZAM_NOT_FOUND;
+        result = itzam_true;
+
+        if (is_active(header))
+        {
+            /* nothing is copied until the whole record is known to lie within the map
+             */
+            data = datafile->m_map + where + datafile->m_sizeof_header;
+
+            if (!lengths_valid(header))
+                *state = ITZAM_FAILED;
+            else if (where + (itzam_ref)datafile->m_sizeof_header + header->m_length > datafile->m_map_len)
+                result = itzam_false;
+            else if (!verify_record(datafile, header, where, data, header->m_rec_len))
+                *state = ITZAM_FAILED;
+            else
+            {
+                read_len = (max_length < header->m_rec_len) ? max_length : header->m_rec_len;
+                memcpy(record, data, read_len);
+                *state = ITZAM_OKAY;
+            }
+        }
+    }
+
+    pthread_rwlock_unlock(&datafile->m_map_lock);
+
+    return result;
+}
+
+#else
+/* reads are only mapped on POSIX systems
+ */
+static itzam_bool read_mapped(itzam_datafile * datafile, itzam_ref where, void * record, itzam_int max_length, itzam_record_header * header, itzam_state * state)
+{
+    return itzam_false;
+}
+#endif
+
+/* read the active record at where, and set *next to the position following it; returns
+ * ITZAM_NOT_FOUND if there is no record there, and ITZAM_FAILED if the record's lengths are
+ * impossible or it does not match its checksum
+ */
+static itzam_state read_record(itzam_datafile * datafile, itzam_ref where, void * record, itzam_int max_length, itzam_ref * next)
+{
+    itzam_state result = ITZAM_NOT_FOUND;
+    itzam_record_header header;
+    itzam_file_vec vec[2];
+    itzam_int read_len;
+    itzam_bool filled = itzam_false;
+
+    if (!read_mapped(datafile, where, record, max_length, &header, &result))
+    {
+        /* most records are read into a buffer of exactly their size, so try to get the
+         * header and data in one call
          */
-        if (-1 != itzam_file_seek(datafile->m_file,where,ITZAM_SEEK_BEGIN))
-        {
-            if (!itzam_file_read(datafile->m_file,&rec_header,sizeof(itzam_record_header)))
-                 datafile->m_error_handler("itzam_datafile_explicit_write (1)",ITZAM_ERROR_READ_FAILED);
+        header.m_checksum = 0;
+        header.m_reserved = 0;
 
-            if ((0 == (rec_header.m_flags & ITZAM_RECORD_IN_USE)) || (rec_header.m_signature != ITZAM_RECORD_SIGNATURE))
-                 datafile->m_error_handler("itzam_datafile_explicit_write (2)",ITZAM_ERROR_INVALID_RECORD);
-        }
+        vec[0].m_data = &header;
+        vec[0].m_len  = datafile->m_sizeof_header;
+        vec[1].m_data = record;
+        vec[1].m_len  = max_length;
 
-        /* make sure we fit inside the record
-         */
-        if (rec_header.m_length < (length + offset))
-            return ITZAM_OVERWRITE_TOO_LONG;
+        if (itzam_file_preadv(datafile->m_file, vec, 2, where))
+            filled = itzam_true;
+        else if (!read_header(datafile, &header, where))
+            return ITZAM_NOT_FOUND;
 
-        /* are we in a transaction? if so, save the rec we're changing
-        */
-        if (datafile->m_in_transaction)
+        if (is_active(&header))
         {
-            /* create a temporary buffer
-             */
-            void * op_data = malloc(rec_header.m_rec_len);
+            read_len = (max_length < header.m_rec_len) ? max_length : header.m_rec_len;
 
-            /* read data
+            /* if the buffer reached past the end of the file, read only the record's own data
              */
-            if (op_data != NULL)
-            {
-                /* now save record information
-                 */
-                if (itzam_file_read(datafile->m_file,op_data,rec_header.m_length))
-                {
-                    add_tran_op(datafile, where, &rec_header, op_data, ITZAM_TRAN_OP_OVERWRITE);
-                    free(op_data);
-                }
-                else
-                    datafile->m_error_handler("itzam_datafile_explicit_write (2)",ITZAM_ERROR_READ_FAILED);
-            }
-            else
-                datafile->m_error_handler("itzam_datafile_explicit_write (3)",ITZAM_ERROR_MALLOC);
+            if (!lengths_valid(&header))
+                result = ITZAM_FAILED;
+            else if (filled || itzam_file_pread(datafile->m_file, record, read_len, where + datafile->m_sizeof_header))
+                result = verify_record(datafile, &header, where, record, read_len) ? ITZAM_OKAY : ITZAM_FAILED;
         }
-
-        /* modify record at given offset
-         */
-        if (-1 != itzam_file_seek(datafile->m_file, where + sizeof(itzam_record_header) + offset, ITZAM_SEEK_BEGIN))
-        {
-            if (!itzam_file_write(datafile->m_file,data,length))
-            {
-                datafile->m_error_handler("itzam_datafile_explicit_write (4)",ITZAM_ERROR_WRITE_FAILED);
-                where = ITZAM_NULL_REF;
-            }
-        }
-        else
-        {
-            datafile->m_error_handler("itzam_datafile_explicit_write (5)",ITZAM_ERROR_SEEK_FAILED);
-            where = ITZAM_NULL_REF;
-        }
-
-        itzam_datafile_mutex_unlock(datafile);
-
-        result = ITZAM_OKAY;
     }
-    else
-        default_error_handler("itzam_datafile_write_flags (5)",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    if (result == ITZAM_OKAY)
+        *next = where + datafile->m_sizeof_header + header.m_length;
 
     return result;
 }
@@ -1070,18 +1980,21 @@ itzam_state itzam_datafile_overwrite(itzam_datafile * datafile, const void * dat
 itzam_state itzam_datafile_read(itzam_datafile * datafile, void * record, itzam_int max_length)
 {
     itzam_state result = ITZAM_FAILED;
-    itzam_record_header header = { 0, 0, 0, 0 };
+    itzam_record_header header = { 0 };
     itzam_bool error = itzam_false;
+    itzam_ref where;
 
     if ((datafile != NULL) && (record != NULL) && (max_length > 0) && (datafile->m_is_open))
     {
         itzam_datafile_mutex_lock(datafile);
 
+        where = datafile->m_position;
+
         while (!error)
         {
             /* read the record header
              */
-            if (itzam_file_read(datafile->m_file,&header,sizeof(itzam_record_header)))
+            if (read_header(datafile,&header,where))
             {
                 /* if the record is active, we can read it
                  */
@@ -1090,7 +2003,7 @@ itzam_state itzam_datafile_read(itzam_datafile * datafile, void * record, itzam_
 
                 /* if the record signature is invalid, we have an error
                  */
-                if (header.m_signature != ITZAM_RECORD_SIGNATURE)
+                if ((header.m_signature != ITZAM_RECORD_SIGNATURE) || (header.m_length < 0))
                 {
                     datafile->m_error_handler("itzam_datafile_read",ITZAM_ERROR_INVALID_RECORD);
                     error = itzam_true;
@@ -1098,11 +2011,7 @@ itzam_state itzam_datafile_read(itzam_datafile * datafile, void * record, itzam_
 
                 /* move to the next record
                  */
-                if (-1 == itzam_file_seek(datafile->m_file,header.m_length,ITZAM_SEEK_CURRENT))
-                {
-                    datafile->m_error_handler("itzam_datafile_read",ITZAM_ERROR_SEEK_FAILED);
-                    error = itzam_true;
-                }
+                where += datafile->m_sizeof_header + header.m_length;
             }
             else
             {
@@ -1113,24 +2022,31 @@ itzam_state itzam_datafile_read(itzam_datafile * datafile, void * record, itzam_
 
         /* only read actual data if no errors
          */
+        if (!error && !lengths_valid(&header))
+        {
+            /* the record's length may still be enough to move past it
+             */
+            if (header.m_length >= 0)
+                datafile->m_position = where + datafile->m_sizeof_header + header.m_length;
+
+            datafile->m_error_handler("itzam_datafile_read",ITZAM_ERROR_CHECKSUM);
+            error = itzam_true;
+        }
+
         if (!error)
         {
             itzam_int read_len = (max_length < header.m_rec_len) ? max_length : header.m_rec_len;
 
-            if (itzam_file_read(datafile->m_file, record, read_len))
+            if (itzam_file_pread(datafile->m_file, record, read_len, where + datafile->m_sizeof_header))
             {
                 /* skip any "padding" between record size and record buffer length
                  */
-                if (read_len < header.m_length)
-                {
-                    if (-1 == itzam_file_seek(datafile->m_file,header.m_length - read_len,ITZAM_SEEK_CURRENT))
-                    {
-                        datafile->m_error_handler("itzam_datafile_read",ITZAM_ERROR_SEEK_FAILED);
-                        error = itzam_true;
-                    }
-                }
+                datafile->m_position = where + datafile->m_sizeof_header + header.m_length;
 
-                result = ITZAM_OKAY;
+                if (!verify_record(datafile, &header, where, record, read_len))
+                    datafile->m_error_handler("itzam_datafile_read",ITZAM_ERROR_CHECKSUM);
+                else
+                    result = ITZAM_OKAY;
             }
             else
             {
@@ -1147,20 +2063,51 @@ itzam_state itzam_datafile_read(itzam_datafile * datafile, void * record, itzam_
     return result;
 }
 
+/* reads the record at a known location; neither uses nor changes the read position,
+ * so it does not need the datafile mutex
+ */
+itzam_state itzam_datafile_read_at(itzam_datafile * datafile, itzam_ref where, void * record, itzam_int max_length)
+{
+    itzam_state result = ITZAM_FAILED;
+    itzam_ref next;
+
+    if ((datafile != NULL) && (record != NULL) && (max_length > 0) && (datafile->m_is_open) && (where != ITZAM_NULL_REF))
+    {
+        result = read_record(datafile, where, record, max_length, &next);
+
+        if (result == ITZAM_FAILED)
+            datafile->m_error_handler("itzam_datafile_read_at",ITZAM_ERROR_CHECKSUM);
+        else if (result != ITZAM_OKAY)
+        {
+            datafile->m_error_handler("itzam_datafile_read_at",ITZAM_ERROR_READ_FAILED);
+            result = ITZAM_FAILED;
+        }
+    }
+    else
+        default_error_handler("itzam_datafile_read_at",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
 itzam_state itzam_datafile_read_alloc(itzam_datafile * datafile, void ** data, itzam_int * length)
 {
     itzam_state result = ITZAM_FAILED;
     itzam_record_header header;
+    itzam_ref where;
 
     if ((datafile != NULL) && (data != NULL) && (datafile->m_is_open))
     {
         itzam_datafile_mutex_lock(datafile);
 
-        if (itzam_file_read(datafile->m_file,&header,sizeof(header)))
+        where = datafile->m_position;
+
+        if (read_header(datafile,&header,where))
         {
             /* if the record is active, we can read it
              */
-            if (header.m_flags & ITZAM_RECORD_IN_USE)
+            if (!lengths_valid(&header))
+                datafile->m_error_handler("itzam_datafile_read_alloc",ITZAM_ERROR_CHECKSUM);
+            else if (header.m_flags & ITZAM_RECORD_IN_USE)
             {
                 /* create a temporary buffer
                  */
@@ -1173,14 +2120,20 @@ itzam_state itzam_datafile_read_alloc(itzam_datafile * datafile, void ** data, i
                  */
                 if (*data != NULL)
                 {
-                    if (itzam_file_read(datafile->m_file,*data,header.m_length))
+                    if (itzam_file_pread(datafile->m_file,*data,header.m_rec_len,where + datafile->m_sizeof_header))
                     {
                         /* skip any "padding" between record size and record buffer length
                          */
-                        if (header.m_rec_len < header.m_length)
-                            itzam_file_seek(datafile->m_file,header.m_length - header.m_rec_len,ITZAM_SEEK_CURRENT);
+                        datafile->m_position = where + datafile->m_sizeof_header + header.m_length;
 
-                        result = ITZAM_OKAY;
+                        if (!verify_record(datafile, &header, where, *data, header.m_rec_len))
+                        {
+                            free(*data);
+                            *data = NULL;
+                            datafile->m_error_handler("itzam_datafile_read_alloc",ITZAM_ERROR_CHECKSUM);
+                        }
+                        else
+                            result = ITZAM_OKAY;
                     }
                     else
                         datafile->m_error_handler("1) itzam_datafile_read_alloc",ITZAM_ERROR_READ_FAILED);
@@ -1205,7 +2158,6 @@ itzam_state itzam_datafile_read_alloc(itzam_datafile * datafile, void ** data, i
 itzam_state itzam_datafile_remove(itzam_datafile * datafile)
 {
     itzam_state result = ITZAM_FAILED;
-    int n;
     itzam_ref where;
 
     if ((datafile != NULL) && (datafile->m_is_open))
@@ -1218,7 +2170,7 @@ itzam_state itzam_datafile_remove(itzam_datafile * datafile)
         {
             /* get our position
             */
-            where = itzam_file_tell(datafile->m_file);
+            where = datafile->m_position;
 
             /* make sure we're not in the file header
             */
@@ -1228,147 +2180,27 @@ itzam_state itzam_datafile_remove(itzam_datafile * datafile)
 
                 /* read the header
                 */
-                if (itzam_file_read(datafile->m_file,&header,sizeof(header)))
+                if (read_header(datafile,&header,where))
                 {
                     /* only delete if it isn't already deleted
                     */
                     if (header.m_flags & ITZAM_RECORD_IN_USE)
                     {
-                        /* save this record if we're in a transaction
-                        */
-                        if (datafile->m_in_transaction)
-                        {
-                            /**
-                            * create a temporary buffer
-                            */
-                            void * op_data = malloc(header.m_rec_len);
-
-                            /* read data
-                            */
-                            if (op_data != NULL)
-                            {
-                                /* now save record information
-                                */
-                                if (itzam_file_read(datafile->m_file,op_data,header.m_length))
-                                {
-                                    add_tran_op(datafile,where,&header,op_data,ITZAM_TRAN_OP_REMOVE);
-                                    free(op_data);
-                                }
-                                else
-                                    datafile->m_error_handler("itzam_datafile_remove",ITZAM_ERROR_READ_FAILED);
-                            }
-                            else
-                                datafile->m_error_handler("itzam_datafile_remove",ITZAM_ERROR_MALLOC);
-                        }
-
-                        /* change record header; make this record the head of the deleted list
+                        /* change record header; it's no longer in use
                         */
                         header.m_flags &= ~ITZAM_RECORD_IN_USE;
 
-                        /* move to beginning of record header
-                        */
-                        if (-1 != itzam_file_seek(datafile->m_file,where,ITZAM_SEEK_BEGIN))
+                        if (sync_dellist(datafile))
                         {
-                            /* write revised record header
-                            */
-                            if (itzam_file_write(datafile->m_file,&header,sizeof(header)))
-                            {
-                                /* update deleted list
-                                */
-                                if (ITZAM_FAILED == read_dellist(datafile))
-                                {
-                                    datafile->m_dellist_header.m_table_size = ITZAM_DELLIST_BLOCK_SIZE;
-                                    datafile->m_dellist = (itzam_dellist_entry *)malloc(sizeof(itzam_dellist_entry) * datafile->m_dellist_header.m_table_size);
-
-                                    if (datafile->m_dellist != NULL)
-                                    {
-                                        datafile->m_dellist[0].m_where  = where;
-                                        datafile->m_dellist[0].m_length = header.m_length;
-
-                                        for (n = 1; n < datafile->m_dellist_header.m_table_size; ++n)
-                                        {
-                                            datafile->m_dellist[n].m_where  = ITZAM_NULL_REF;
-                                            datafile->m_dellist[n].m_length = 0;
-                                        }
-
-                                        result = write_dellist(datafile,itzam_true);
-                                    }
-                                    else
-                                        datafile->m_error_handler("itzam_datafile_remove",ITZAM_ERROR_MALLOC);
-                                }
-                                else
-                                {
-                                    for (n = 0; n < datafile->m_dellist_header.m_table_size; ++n)
-                                    {
-                                        if (datafile->m_dellist[n].m_where == ITZAM_NULL_REF)
-                                        {
-                                            datafile->m_dellist[n].m_where  = where;
-                                            datafile->m_dellist[n].m_length = header.m_length;
-                                            result = write_dellist(datafile,itzam_false);
-                                            break;
-                                        }
-                                    }
-
-                                    /* if the entry didn't fit, we have to expand it
-                                    */
-                                    if (n == datafile->m_dellist_header.m_table_size)
-                                    {
-                                        /* create new table
-                                        */
-                                        itzam_int newsize = datafile->m_dellist_header.m_table_size + ITZAM_DELLIST_BLOCK_SIZE;
-                                        itzam_dellist_entry * newlist = (itzam_dellist_entry *)malloc(sizeof(itzam_dellist_entry) * newsize);
-
-                                        if (newlist != NULL)
-                                        {
-                                            /* copy old entries; could (?should) use memcpy here I suppose
-                                            */
-                                            for (n = 0; n < datafile->m_dellist_header.m_table_size; ++n)
-                                            {
-                                                newlist[n].m_where  = datafile->m_dellist[n].m_where;
-                                                newlist[n].m_length = datafile->m_dellist[n].m_length;
-                                            }
-
-                                            /* add the newly-deleted record
-                                            */
-                                            newlist[n].m_where  = where;
-                                            newlist[n].m_length = header.m_length;
-
-                                            /* add the old deleted list record
-                                            */
-                                            newlist[n+1].m_where  = datafile->m_shared->m_header.m_dellist_ref;
-                                            newlist[n+1].m_length = datafile->m_dellist_header.m_table_size;
-
-                                            /* initialize remaining unused new entries
-                                            */
-                                            for (n += 2 ; n < newsize; ++n)
-                                            {
-                                                newlist[n].m_where  = ITZAM_NULL_REF;
-                                                newlist[n].m_length = 0;
-                                            }
-
-                                            /* free space used by old list
-                                            */
-                                            free(datafile->m_dellist);
-
-                                            /* exchange new list for old
-                                            */
-                                            datafile->m_dellist = newlist;
-                                            datafile->m_dellist_header.m_table_size = newsize;
-
-                                            /* write it
-                                            */
-                                            result = write_dellist(datafile,itzam_true);
-                                        }
-                                        else
-                                            datafile->m_error_handler("itzam_datafile_read_alloc",ITZAM_ERROR_MALLOC);
-                                    }
-                                }
-                            }
+                            /* the free record we join rewrites its own header, so ours is only
+                             * written when it is merged into a free record that precedes it
+                             */
+                            if ((NULL == find_by_end(&datafile->m_freemap, where))
+                             || write_bytes(datafile,&header,datafile->m_sizeof_header,where))
+                                result = add_free(datafile, where, header.m_length);
                             else
                                 datafile->m_error_handler("itzam_datafile_remove",ITZAM_ERROR_WRITE_FAILED);
                         }
-                        else
-                            datafile->m_error_handler("itzam_datafile_remove",ITZAM_ERROR_SEEK_FAILED);
                     }
                     else
                         datafile->m_error_handler("itzam_datafile_remove",ITZAM_ERROR_DUPE_REMOVE);
@@ -1392,9 +2224,7 @@ itzam_state itzam_datafile_transaction_start(itzam_datafile * datafile)
 {
     itzam_state result = ITZAM_FAILED;
 
-    /* only start a transaction is one isn't already in progress
-     */
-    if ((datafile != NULL) && (datafile->m_is_open) && (!datafile->m_in_transaction))
+    if ((datafile != NULL) && (datafile->m_is_open))
     {
         if (datafile->m_read_only)
         {
@@ -1402,20 +2232,28 @@ itzam_state itzam_datafile_transaction_start(itzam_datafile * datafile)
             return ITZAM_READ_ONLY;
         }
 
+        /* the mutex is held until the transaction ends, so transactions are
+         * serialized; another thread using this datafile waits here for its turn
+         */
         itzam_datafile_mutex_lock(datafile);
 
-        datafile->m_tran_file = (itzam_datafile *)malloc(sizeof(itzam_datafile));
-
-        if (datafile->m_tran_file != NULL)
+        /* only start a transaction is one isn't already in progress
+         */
+        if (datafile->m_in_transaction)
         {
-            /* create a datafile to contain the transaction operations
-            */
-            result = itzam_datafile_create(datafile->m_tran_file,datafile->m_tran_file_name);
+            itzam_datafile_mutex_unlock(datafile);
+            default_error_handler("itzam_datafile_transaction_start",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+            return ITZAM_FAILED;
+        }
 
-            if (ITZAM_OKAY == result)
-                datafile->m_in_transaction = itzam_true;
-            else
-                default_error_handler("itzam_datafile_transaction_start",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+        result = itzam_log_begin(datafile);
+
+        if (ITZAM_OKAY == result)
+            datafile->m_in_transaction = itzam_true;
+        else
+        {
+            itzam_datafile_mutex_unlock(datafile);
+            datafile->m_error_handler("itzam_datafile_transaction_start",ITZAM_ERROR_LOG_FAILED);
         }
     }
     else
@@ -1424,150 +2262,265 @@ itzam_state itzam_datafile_transaction_start(itzam_datafile * datafile)
     return result;
 }
 
-static void transaction_cleanup(itzam_datafile * datafile, itzam_bool rollback)
+itzam_state itzam_datafile_transaction_commit(itzam_datafile * datafile)
 {
-    itzam_op_header * op_header;
-    itzam_int dont_care;
-    void * op_record;
-    itzam_int data_len;
-    itzam_int n;
-    itzam_bool dummy;
+    itzam_state result = ITZAM_FAILED;
+    itzam_lsn flush_to;
 
-    if (rollback)
+    /* only commit if a transaction is active
+     */
+    if ((datafile != NULL) && (datafile->m_is_open) && (datafile->m_in_transaction))
     {
-        /* start at the beginning
+        /* we're no longer in a transaction
          */
-        itzam_ref op_where = datafile->m_shared->m_header.m_transaction_tail;
+        datafile->m_in_transaction = itzam_false;
 
-        /* while we have something to process
+        result = itzam_log_commit(datafile, &flush_to);
+
+        /* keep the log short by writing its changes through to the datafile
          */
-        while (op_where != ITZAM_NULL_REF)
-        {
-            /* read the operation header
-             */
-            itzam_datafile_seek(datafile->m_tran_file,op_where);
+        if ((ITZAM_OKAY == result) && (datafile->m_shared->m_log_end - datafile->m_shared->m_log_base > ITZAM_LOG_CHECKPOINT_SIZE))
+            result = itzam_log_checkpoint(datafile);
 
-            /* read the rolled-back record
-             */
-            itzam_datafile_read_alloc(datafile->m_tran_file,(void **)(void*)&op_header,&dont_care);
+        itzam_datafile_mutex_unlock(datafile);
 
-            /* act upon the op_record....
-             */
-            switch (op_header->m_type)
-            {
-                /* remove a record that was written
-                 */
-                case ITZAM_TRAN_OP_WRITE:
-                    itzam_datafile_seek(datafile,op_header->m_where);
-                    itzam_datafile_remove(datafile);
-                    break;
+        /* wait for the log outside the mutex, so that concurrent commits share a flush
+         */
+        if ((ITZAM_OKAY == result) && (flush_to != ITZAM_NULL_LSN))
+            result = itzam_log_force(datafile, flush_to);
+    }
+    else
+        default_error_handler("itzam_datafile_transaction_commit",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
-                /* replace a record that was removed
-                 */
-                case ITZAM_TRAN_OP_REMOVE:
-                    itzam_datafile_seek(datafile->m_tran_file,op_header->m_record_where);
-                    itzam_datafile_read_alloc(datafile->m_tran_file,(void **)&op_record,&data_len);
-                    itzam_datafile_write(datafile,op_record,op_header->m_record_header.m_length,op_header->m_where);
-                    free(op_record);
+    return result;
+}
 
-                    if (ITZAM_OKAY == read_dellist(datafile))
-                    {
-                        for (n = 0; n < datafile->m_dellist_header.m_table_size; ++n)
-                        {
-                            if (datafile->m_dellist[n].m_where == op_header->m_where)
-                            {
-                                /* remove this entry from the table
-                                 */
-                                datafile->m_dellist[n].m_where  = ITZAM_NULL_REF;
-                                datafile->m_dellist[n].m_length = 0;
-                                break;
-                            }
-                        }
-                    }
+itzam_state itzam_datafile_transaction_rollback(itzam_datafile * datafile)
+{
+    itzam_state result = ITZAM_FAILED;
+
+    /* only rollback if a transaction is active
+     */
+    if ((datafile != NULL) && (datafile->m_is_open) && (datafile->m_in_transaction))
+    {
+        /* we're no longer in a transaction
+         */
+        datafile->m_in_transaction = itzam_false;
 
-                    write_dellist(datafile,itzam_false);
+        result = itzam_log_rollback(datafile);
 
-                    break;
+        if (ITZAM_OKAY != result)
+            datafile->m_error_handler("itzam_datafile_transaction_rollback",ITZAM_ERROR_LOG_FAILED);
 
-                /* restore a record that was over-written
-                 */
-                case ITZAM_TRAN_OP_OVERWRITE:
-                    itzam_datafile_seek(datafile->m_tran_file,op_header->m_record_where);
-                    itzam_datafile_read_alloc(datafile->m_tran_file,(void **)&op_record,&data_len);
-                    itzam_datafile_write(datafile, op_record, op_header->m_record_header.m_length, op_header->m_where);
-                    free(op_record);
+        /* the file header, the deleted list, and any cached records may all have been restored
+         */
+        if (!itzam_file_pread(datafile->m_file,&datafile->m_shared->m_header,sizeof(itzam_datafile_header),0))
+            datafile->m_error_handler("itzam_datafile_transaction_rollback",ITZAM_ERROR_READ_FAILED);
 
-                    break;
+        datafile->m_freemap.m_loaded = itzam_false;
+        dellist_changed(datafile);
+        ++datafile->m_shared->m_generation;
+
+#if defined(ITZAM_UNIX)
+        /* the rollback may have shortened the file; the map finds its length again when needed
+         */
+        pthread_rwlock_wrlock(&datafile->m_map_lock);
+        datafile->m_map_len = 0;
+        pthread_rwlock_unlock(&datafile->m_map_lock);
+#endif
+
+        itzam_datafile_mutex_unlock(datafile);
+    }
+    else
+        default_error_handler("itzam_datafile_transaction_rollback",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+/* switch reads between the file and a read-only map of it; writes always go to the file.
+ * Elsewhere than POSIX systems reads are never mapped, and asking for a map fails
+ */
+itzam_state itzam_datafile_set_mapped(itzam_datafile * datafile, itzam_bool mapped)
+{
+    itzam_state result = ITZAM_FAILED;
+#if defined(ITZAM_UNIX)
+    itzam_ref file_len;
+#endif
+
+    if ((datafile != NULL) && (datafile->m_is_open))
+    {
+#if defined(ITZAM_UNIX)
+        pthread_rwlock_wrlock(&datafile->m_map_lock);
+
+        if (mapped && (datafile->m_map == NULL))
+        {
+            file_len = itzam_file_seek(datafile->m_file, 0, ITZAM_SEEK_END);
+            datafile->m_map = (const itzam_byte *)itzam_file_map(datafile->m_file, file_len + ITZAM_MAP_SLACK);
+
+            if (datafile->m_map != NULL)
+            {
+                datafile->m_map_size = file_len + ITZAM_MAP_SLACK;
+                datafile->m_map_len  = file_len;
+                result = ITZAM_OKAY;
+            }
+            else
+                datafile->m_error_handler("itzam_datafile_set_mapped",ITZAM_ERROR_MAP_FAILED);
+        }
+        else
+        {
+            if (!mapped && (datafile->m_map != NULL))
+            {
+                itzam_file_unmap(datafile->m_map, datafile->m_map_size);
+                datafile->m_map      = NULL;
+                datafile->m_map_size = 0;
+                datafile->m_map_len  = 0;
             }
 
-            /* save next operation
-             */
-            op_where = op_header->m_prev_tran;
+            result = ITZAM_OKAY;
+        }
+
+        pthread_rwlock_unlock(&datafile->m_map_lock);
+#else
+        if (mapped)
+            datafile->m_error_handler("itzam_datafile_set_mapped",ITZAM_ERROR_MAP_FAILED);
+        else
+            result = ITZAM_OKAY;
+#endif
+    }
+    else
+        default_error_handler("itzam_datafile_set_mapped",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+
+    return result;
+}
+
+/* hold the map in place while pointers from itzam_datafile_map_record are in use; returns
+ * itzam_false, holding nothing, if reads are not mapped
+ */
+itzam_bool itzam_datafile_map_lock(itzam_datafile * datafile)
+{
+    itzam_bool result = itzam_false;
+
+#if defined(ITZAM_UNIX)
+    if (datafile != NULL)
+    {
+        pthread_rwlock_rdlock(&datafile->m_map_lock);
+
+        result = (datafile->m_map != NULL) ? itzam_true : itzam_false;
+
+        if (!result)
+            pthread_rwlock_unlock(&datafile->m_map_lock);
+    }
+#endif
+
+    return result;
+}
+
+void itzam_datafile_map_unlock(itzam_datafile * datafile)
+{
+#if defined(ITZAM_UNIX)
+    if (datafile != NULL)
+        pthread_rwlock_unlock(&datafile->m_map_lock);
+#endif
+}
+
+/* the data of the active record at where, read in place from the map; NULL if the record is
+ * not active, is shorter than length, or was added after the map last looked at the file.
+ * With ITZAM_CHECKSUM_MAPPED, it is also NULL if the record does not match its checksum,
+ * leaving the caller to read the record, which reports it. The map lock must be held
+ */
+const void * itzam_datafile_map_record(itzam_datafile * datafile, itzam_ref where, itzam_int length)
+{
+    const void * result = NULL;
+#if defined(ITZAM_UNIX)
+    itzam_record_header header;
+
+    if ((where != ITZAM_NULL_REF) && (where + (itzam_ref)datafile->m_sizeof_header + length <= datafile->m_map_len))
+    {
+        memset(&header, 0, sizeof(itzam_record_header));
+        memcpy(&header, datafile->m_map + where, datafile->m_sizeof_header);
+
+        if (is_active(&header) && (header.m_rec_len >= length))
+        {
+            result = datafile->m_map + where + datafile->m_sizeof_header;
 
-            /* release memory
+            /* this costs a checksum on every visit, rather than once per read from the file;
+             * the whole record must lie within the map to be checked
              */
-            free(op_header);
+            if ((datafile->m_checksums == ITZAM_CHECKSUM_MAPPED)
+             && (!lengths_valid(&header)
+              || (where + (itzam_ref)datafile->m_sizeof_header + header.m_length > datafile->m_map_len)
+              || !verify_record(datafile, &header, where, result, header.m_rec_len)))
+                result = NULL;
         }
     }
+#endif
 
-    /* update the header
-     */
-    datafile->m_shared->m_header.m_transaction_tail = ITZAM_NULL_REF;
-    itzam_file_seek(datafile->m_file,0,ITZAM_SEEK_BEGIN);
-    dummy = itzam_file_write(datafile->m_file,&datafile->m_shared->m_header,sizeof(itzam_datafile_header));
+    return result;
+}
 
-    /* close and remove transaction file
-     */
-    itzam_datafile_close(datafile->m_tran_file);
-    itzam_file_remove(datafile->m_tran_file_name);
-    free(datafile->m_tran_file);
-    datafile->m_tran_file = NULL;
+/* the data of a record read, header first, into buffer; NULL unless it is an active record
+ * of at least length bytes. When the datafile verifies checksums, it must be exactly that
+ * long, and match its checksum. A mismatch is not reported, so that the caller can read the
+ * record again from the file
+ */
+const void * itzam_datafile_record_data(itzam_datafile * datafile, const void * buffer, itzam_int length)
+{
+    const void * result = NULL;
+    itzam_record_header header;
 
-    itzam_datafile_mutex_unlock(datafile);
+    memset(&header, 0, sizeof(itzam_record_header));
+    memcpy(&header, buffer, datafile->m_sizeof_header);
+
+    if (is_active(&header) && lengths_valid(&header) && (header.m_rec_len >= length))
+    {
+        result = (const itzam_byte *)buffer + datafile->m_sizeof_header;
+
+        /* the buffer holds all of the data only if the record is no longer than length
+         */
+        if (must_verify(datafile, &header)
+         && ((header.m_rec_len != length) || !verify_record(datafile, &header, ITZAM_NULL_REF, result, length)))
+            result = NULL;
+    }
+
+    return result;
 }
 
-itzam_state itzam_datafile_transaction_commit(itzam_datafile * datafile)
+/* when records read from this handle are checked; records are written with checksums in
+ * every mode, so that other handles on the file can check them
+ */
+itzam_state itzam_datafile_set_checksums(itzam_datafile * datafile, itzam_checksum_mode mode)
 {
     itzam_state result = ITZAM_FAILED;
 
-    /* only commit if a transaction is active
-     */
-    if ((datafile != NULL) && (datafile->m_is_open) && (datafile->m_in_transaction))
+    if ((datafile != NULL) && (datafile->m_is_open))
     {
-        /* we're no longer in a transaction
-         */
-        datafile->m_in_transaction = itzam_false;
-
-        /* clean up transactioon data; it's no longer needed
-         */
-        transaction_cleanup(datafile,itzam_false);
-        result = ITZAM_OKAY;
+        if ((mode >= ITZAM_CHECKSUM_NONE) && (mode <= ITZAM_CHECKSUM_MAPPED))
+        {
+            datafile->m_checksums = mode;
+            result = ITZAM_OKAY;
+        }
+        else
+            datafile->m_error_handler("itzam_datafile_set_checksums",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
     }
     else
-        default_error_handler("itzam_datafile_transaction_commit",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+        default_error_handler("itzam_datafile_set_checksums",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
     return result;
 }
 
-itzam_state itzam_datafile_transaction_rollback(itzam_datafile * datafile)
+itzam_state itzam_datafile_set_durability(itzam_datafile * datafile, itzam_durability durability, uint32_t interval)
 {
     itzam_state result = ITZAM_FAILED;
 
-    /* only rollback if a transaction is active
-     */
-    if ((datafile != NULL) && (datafile->m_is_open) && (datafile->m_in_transaction))
+    if ((datafile != NULL) && (datafile->m_is_open))
     {
-        /* we're no longer in a transaction
-         */
-        datafile->m_in_transaction = itzam_false;
+        result = itzam_log_set_durability(datafile, durability, interval);
 
-        /* clean up transaction data; it's no longer needed
-         */
-        transaction_cleanup(datafile,itzam_true);
-        result = ITZAM_OKAY;
+        if (result != ITZAM_OKAY)
+            datafile->m_error_handler("itzam_datafile_set_durability",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
     }
     else
-        default_error_handler("itzam_datafile_transaction_rollback",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
+        default_error_handler("itzam_datafile_set_durability",ITZAM_ERROR_INVALID_DATAFILE_OBJECT);
 
     return result;
 }
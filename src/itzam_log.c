@@ -0,0 +1,1008 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+
+#include "itzam.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+/*-----------------------------------------------------------------------------
+ * internal utilities
+ */
+static char * get_log_name(const char * filename)
+{
+    static const char * log_name_mask = "%s.itzamlog";
+    char * result = (char *)malloc(strlen(log_name_mask) + strlen(filename) + 1);
+    sprintf(result,log_name_mask,filename);
+    return result;
+}
+
+/* FNV-1a, used to detect torn or partial log records
+ */
+static uint32_t checksum(uint32_t hash, const void * data, size_t len)
+{
+    const uint8_t * bytes = (const uint8_t *)data;
+
+    while (len-- > 0)
+    {
+        hash ^= *bytes++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static uint32_t record_checksum(const itzam_log_record * record, const itzam_file_vec * images, int count)
+{
+    itzam_log_record temp = *record;
+    uint32_t hash = 2166136261U;
+    int n;
+
+    temp.m_checksum = 0;
+    hash = checksum(hash, &temp, sizeof(temp));
+
+    for (n = 0; n < count; ++n)
+        hash = checksum(hash, images[n].m_data, images[n].m_len);
+
+    return hash;
+}
+
+/* position of a record in the log file
+ */
+static itzam_ref log_offset(itzam_lsn base, itzam_lsn lsn)
+{
+    return (itzam_ref)(sizeof(itzam_log_header) + (lsn - base));
+}
+
+static itzam_bool write_log_header(ITZAM_FILE_TYPE file, itzam_lsn base)
+{
+    itzam_log_header header;
+
+    header.m_signature = ITZAM_LOG_SIGNATURE;
+    header.m_version   = ITZAM_DATAFILE_VERSION;
+    header.m_base      = base;
+
+    return itzam_file_pwrite(file, &header, sizeof(header), 0);
+}
+
+/* open the log file, creating it if no other instance has done so
+ */
+static itzam_bool log_open(itzam_datafile * datafile)
+{
+    itzam_log * log = &datafile->m_log;
+
+    if (!log->m_is_open)
+    {
+        if (itzam_datafile_exists(log->m_filename))
+        {
+            log->m_file = itzam_file_open(log->m_filename);
+        }
+        else
+        {
+            log->m_file = itzam_file_create(log->m_filename);
+
+            if (ITZAM_GOOD_FILE(log->m_file) && !write_log_header(log->m_file, datafile->m_shared->m_log_base))
+            {
+                itzam_file_close(log->m_file);
+                return itzam_false;
+            }
+        }
+
+        log->m_is_open = ITZAM_GOOD_FILE(log->m_file) ? itzam_true : itzam_false;
+    }
+
+    return log->m_is_open;
+}
+
+/* append a record, followed by its images, to the end of the log
+ */
+static itzam_lsn append(itzam_datafile * datafile, itzam_log_record * record, const itzam_file_vec * images, int count)
+{
+    itzam_datafile_shared * shared = datafile->m_shared;
+    itzam_file_vec vec[ITZAM_LOG_MAX_IMAGES + 1];
+    itzam_lsn end = shared->m_log_end;
+    int n;
+
+    record->m_signature = ITZAM_LOG_RECORD_SIGNATURE;
+    record->m_lsn       = end;
+    record->m_reserved  = 0;
+    record->m_checksum  = record_checksum(record, images, count);
+
+    vec[0].m_data = record;
+    vec[0].m_len  = sizeof(itzam_log_record);
+    end += sizeof(itzam_log_record);
+
+    for (n = 0; n < count; ++n)
+    {
+        vec[n + 1] = images[n];
+        end += images[n].m_len;
+    }
+
+    if (!itzam_file_pwritev(datafile->m_log.m_file, vec, count + 1, log_offset(shared->m_log_base, record->m_lsn)))
+        return ITZAM_NULL_LSN;
+
+    shared->m_log_end = end;
+
+    return record->m_lsn;
+}
+
+/* read a record header from the log, and optionally its before image
+ */
+static itzam_bool read_record(ITZAM_FILE_TYPE file, itzam_lsn base, itzam_lsn lsn, itzam_log_record * record, void ** undo)
+{
+    itzam_ref where = log_offset(base, lsn);
+
+    if (!itzam_file_pread(file, record, sizeof(itzam_log_record), where)
+     || (record->m_signature != ITZAM_LOG_RECORD_SIGNATURE)
+     || (record->m_lsn != lsn))
+        return itzam_false;
+
+    if (undo != NULL)
+    {
+        *undo = NULL;
+
+        if (record->m_undo_length > 0)
+        {
+            *undo = malloc(record->m_undo_length);
+
+            if ((*undo == NULL) || !itzam_file_pread(file, *undo, record->m_undo_length, where + sizeof(itzam_log_record)))
+            {
+                free(*undo);
+                return itzam_false;
+            }
+        }
+    }
+
+    return itzam_true;
+}
+
+/* apply the before images of a transaction, newest first, ending with the file
+ * at its length before the transaction began
+ */
+static itzam_bool undo_chain(itzam_datafile * datafile, ITZAM_FILE_TYPE file, itzam_lsn base, itzam_lsn lsn)
+{
+    itzam_log_record record;
+    itzam_ref old_size = 0;
+    itzam_bool truncate = itzam_false;
+    void * undo;
+
+    while (lsn != ITZAM_NULL_LSN)
+    {
+        if (!read_record(file, base, lsn, &record, &undo))
+            return itzam_false;
+
+        if (record.m_type == ITZAM_LOG_UPDATE)
+        {
+            if ((undo != NULL) && !itzam_file_pwrite(datafile->m_file, undo, record.m_undo_length, record.m_where))
+            {
+                free(undo);
+                return itzam_false;
+            }
+
+            if (!truncate || (record.m_old_size < old_size))
+                old_size = record.m_old_size;
+
+            truncate = itzam_true;
+        }
+
+        free(undo);
+        lsn = record.m_prev_lsn;
+    }
+
+    if (truncate && (itzam_file_seek(datafile->m_file, 0, ITZAM_SEEK_END) > old_size))
+        return itzam_file_truncate(datafile->m_file, old_size);
+
+    return itzam_true;
+}
+
+/* the lock and condition variables that coordinate committers with the flush
+ * thread; POSIX threads, or their Windows equivalents
+ */
+static void log_lock(itzam_log * log)
+{
+#if defined(ITZAM_UNIX)
+    pthread_mutex_lock(&log->m_lock);
+#else
+    EnterCriticalSection(&log->m_lock);
+#endif
+}
+
+static void log_unlock(itzam_log * log)
+{
+#if defined(ITZAM_UNIX)
+    pthread_mutex_unlock(&log->m_lock);
+#else
+    LeaveCriticalSection(&log->m_lock);
+#endif
+}
+
+#if defined(ITZAM_UNIX)
+typedef pthread_cond_t     log_condition;
+#else
+typedef CONDITION_VARIABLE log_condition;
+#endif
+
+static void log_signal(log_condition * condition)
+{
+#if defined(ITZAM_UNIX)
+    pthread_cond_signal(condition);
+#else
+    WakeConditionVariable(condition);
+#endif
+}
+
+static void log_broadcast(log_condition * condition)
+{
+#if defined(ITZAM_UNIX)
+    pthread_cond_broadcast(condition);
+#else
+    WakeAllConditionVariable(condition);
+#endif
+}
+
+static void log_wait(itzam_log * log, log_condition * condition)
+{
+#if defined(ITZAM_UNIX)
+    pthread_cond_wait(condition, &log->m_lock);
+#else
+    SleepConditionVariableCS(condition, &log->m_lock, INFINITE);
+#endif
+}
+
+/* waits at most ms milliseconds
+ */
+static void log_wait_for(itzam_log * log, log_condition * condition, uint32_t ms)
+{
+#if defined(ITZAM_UNIX)
+    struct timespec when;
+
+    clock_gettime(CLOCK_REALTIME, &when);
+
+    when.tv_sec  += ms / 1000;
+    when.tv_nsec += (long)(ms % 1000) * 1000000L;
+
+    if (when.tv_nsec >= 1000000000L)
+    {
+        when.tv_sec  += 1;
+        when.tv_nsec -= 1000000000L;
+    }
+
+    pthread_cond_timedwait(condition, &log->m_lock, &when);
+#else
+    SleepConditionVariableCS(condition, &log->m_lock, ms);
+#endif
+}
+
+/* writes batches of commits to stable storage; a committer that arrives while
+ * a flush is in progress is covered by the next one, along with every other
+ * committer that arrived in the meantime; with periodic durability, the thread
+ * also wakes on its own to flush whatever has been committed
+ */
+#if defined(ITZAM_UNIX)
+static void * flush_thread(void * arg)
+#else
+static unsigned __stdcall flush_thread(void * arg)
+#endif
+{
+    itzam_log * log = &((itzam_datafile *)arg)->m_log;
+    itzam_lsn target;
+    itzam_bool flushed;
+
+    log_lock(log);
+
+    while (log->m_running)
+    {
+        if ((log->m_durability == ITZAM_DURABILITY_PERIODIC) && (log->m_written > log->m_requested))
+            log->m_requested = log->m_written;
+
+        if (log->m_requested > log->m_durable)
+        {
+            target = log->m_requested;
+
+            log_unlock(log);
+            flushed = itzam_file_commit(log->m_file);
+            log_lock(log);
+
+            if (flushed)
+            {
+                if (target > log->m_durable)
+                    log->m_durable = target;
+
+                ++log->m_flushes;
+            }
+            else
+            {
+                /* waiting committers fail; the next commit tries again
+                 */
+                log->m_failed    = itzam_true;
+                log->m_requested = log->m_durable;
+            }
+
+            log_broadcast(&log->m_done);
+
+            /* let periodic commits accumulate
+             */
+            if (log->m_running && (log->m_durability == ITZAM_DURABILITY_PERIODIC))
+                log_wait_for(log, &log->m_work, log->m_interval);
+        }
+        else if (log->m_durability == ITZAM_DURABILITY_PERIODIC)
+            log_wait_for(log, &log->m_work, log->m_interval);
+        else
+            log_wait(log, &log->m_work);
+    }
+
+    log_unlock(log);
+
+#if defined(ITZAM_UNIX)
+    return NULL;
+#else
+    return 0;
+#endif
+}
+
+/* start the flush thread if it isn't running; called with m_lock held
+ */
+static itzam_bool start_flusher(itzam_datafile * datafile)
+{
+    itzam_log * log = &datafile->m_log;
+
+    if (!log->m_running)
+    {
+        log->m_running = itzam_true;
+        log->m_failed  = itzam_false;
+
+#if defined(ITZAM_UNIX)
+        if (0 != pthread_create(&log->m_thread, NULL, flush_thread, datafile))
+            log->m_running = itzam_false;
+#else
+        log->m_thread = (HANDLE)_beginthreadex(NULL, 0, flush_thread, datafile, 0, NULL);
+
+        if (log->m_thread == NULL)
+            log->m_running = itzam_false;
+#endif
+    }
+
+    return log->m_running;
+}
+
+/* flush the log through lsn, unless commits are never flushed
+ */
+static itzam_bool flush_through(itzam_datafile * datafile, itzam_lsn lsn)
+{
+    itzam_log * log = &datafile->m_log;
+    itzam_bool result = itzam_true;
+
+    log_lock(log);
+
+    if ((log->m_durability != ITZAM_DURABILITY_NONE) && (log->m_durable < lsn))
+    {
+        log_unlock(log);
+        result = itzam_file_commit(log->m_file);
+        log_lock(log);
+
+        if (result && (log->m_durable < lsn))
+        {
+            log->m_durable = lsn;
+            log_broadcast(&log->m_done);
+        }
+    }
+
+    log_unlock(log);
+
+    return result;
+}
+
+/* the before image of an overwrite must reach stable storage before the bytes it
+ * holds are replaced, or a system failure could leave a change that recovery cannot
+ * undo. Bytes appended by the transaction need no such care, since recovery cuts the
+ * file back to its old length, and neither do bytes inside a region whose image is
+ * already safe, since undo applies the oldest image last
+ */
+static itzam_bool guard_overwrite(itzam_datafile * datafile, itzam_ref where, itzam_int length, itzam_lsn end)
+{
+    itzam_log * log = &datafile->m_log;
+    uint32_t slot = (uint32_t)((((uint64_t)where * 0x9E3779B97F4A7C15ULL) >> 32) % ITZAM_LOG_GUARDS);
+
+    if (where >= log->m_txn_size)
+        return itzam_true;
+
+    if ((log->m_guard_where[slot] != ITZAM_NULL_REF)
+     && (log->m_guard_where[slot] <= where)
+     && (where + length <= log->m_guard_where[slot] + log->m_guard_length[slot]))
+        return itzam_true;
+
+    if (!flush_through(datafile, end))
+        return itzam_false;
+
+    log->m_guard_where[slot]  = where;
+    log->m_guard_length[slot] = length;
+
+    return itzam_true;
+}
+
+/*-----------------------------------------------------------------------------
+ * log functions
+ */
+void itzam_log_init(itzam_datafile * datafile, const char * filename)
+{
+    itzam_log * log = &datafile->m_log;
+
+#if defined(ITZAM_UNIX)
+    log->m_file      = -1;
+#else
+    log->m_file      = NULL;
+#endif
+    log->m_filename  = get_log_name(filename);
+    log->m_is_open   = itzam_false;
+    log->m_txn       = 0;
+    log->m_last_lsn  = ITZAM_NULL_LSN;
+    log->m_undo      = NULL;
+    log->m_undo_size = 0;
+    log->m_txn_size  = 0;
+    log->m_durability = ITZAM_DURABILITY_COMMIT;
+    log->m_interval  = ITZAM_DURABILITY_DEFAULT_INTERVAL;
+    log->m_running   = itzam_false;
+    log->m_failed    = itzam_false;
+    log->m_written   = ITZAM_NULL_LSN;
+    log->m_requested = ITZAM_NULL_LSN;
+    log->m_durable   = ITZAM_NULL_LSN;
+    log->m_flushes   = 0;
+    log->m_commits   = 0;
+
+#if defined(ITZAM_UNIX)
+    pthread_mutex_init(&log->m_lock, NULL);
+    pthread_cond_init(&log->m_work, NULL);
+    pthread_cond_init(&log->m_done, NULL);
+#else
+    InitializeCriticalSection(&log->m_lock);
+    InitializeConditionVariable(&log->m_work);
+    InitializeConditionVariable(&log->m_done);
+#endif
+}
+
+/* stop the flush thread and close the log; commits that have not been flushed
+ * are flushed now, unless durability is ITZAM_DURABILITY_NONE. The last
+ * instance of a datafile flushes the datafile, after which the log is no longer
+ * needed.
+ */
+void itzam_log_close(itzam_datafile * datafile, itzam_bool last_owner)
+{
+    itzam_log * log = &datafile->m_log;
+    itzam_bool flush = (log->m_durability != ITZAM_DURABILITY_NONE) ? itzam_true : itzam_false;
+
+    log_lock(log);
+
+    if (log->m_running)
+    {
+        log->m_running = itzam_false;
+        log_signal(&log->m_work);
+        log_unlock(log);
+#if defined(ITZAM_UNIX)
+        pthread_join(log->m_thread, NULL);
+#else
+        WaitForSingleObject(log->m_thread, INFINITE);
+        CloseHandle(log->m_thread);
+#endif
+    }
+    else
+        log_unlock(log);
+
+    if (log->m_is_open)
+    {
+        if (flush && !last_owner && (log->m_written > log->m_durable) && !itzam_file_commit(log->m_file))
+            datafile->m_error_handler("itzam_log_close",ITZAM_ERROR_LOG_FAILED);
+
+        itzam_file_close(log->m_file);
+        log->m_is_open = itzam_false;
+    }
+
+    if (last_owner && !datafile->m_read_only && itzam_datafile_exists(log->m_filename))
+    {
+        if (!flush || itzam_file_commit(datafile->m_file))
+            itzam_file_remove(log->m_filename);
+        else
+            datafile->m_error_handler("itzam_log_close",ITZAM_ERROR_LOG_FAILED);
+    }
+
+#if defined(ITZAM_UNIX)
+    pthread_mutex_destroy(&log->m_lock);
+    pthread_cond_destroy(&log->m_work);
+    pthread_cond_destroy(&log->m_done);
+#else
+    DeleteCriticalSection(&log->m_lock);
+#endif
+
+    free(log->m_filename);
+    log->m_filename = NULL;
+
+    free(log->m_undo);
+    log->m_undo = NULL;
+    log->m_undo_size = 0;
+}
+
+/* does the log hold changes that may not yet be in the datafile?
+ */
+itzam_bool itzam_log_is_active(itzam_datafile * datafile)
+{
+    return (datafile->m_shared->m_log_end != datafile->m_shared->m_log_base) ? itzam_true : itzam_false;
+}
+
+/* start a transaction
+ */
+itzam_state itzam_log_begin(itzam_datafile * datafile)
+{
+    itzam_log * log = &datafile->m_log;
+    int n;
+
+    /* recovery starts from the datafile as it was when the log was empty
+     */
+    if (!itzam_log_is_active(datafile) && !itzam_file_commit(datafile->m_file))
+        return ITZAM_FAILED;
+
+    if (!log_open(datafile))
+        return ITZAM_FAILED;
+
+    log->m_txn      = ++datafile->m_shared->m_next_txn;
+    log->m_last_lsn = ITZAM_NULL_LSN;
+    log->m_txn_size = itzam_file_seek(datafile->m_file, 0, ITZAM_SEEK_END);
+
+    for (n = 0; n < ITZAM_LOG_GUARDS; ++n)
+        log->m_guard_where[n] = ITZAM_NULL_REF;
+
+    return ITZAM_OKAY;
+}
+
+/* record a change before it is written to the datafile; within a transaction
+ * the record includes the bytes being replaced, and is on stable storage before
+ * they are
+ */
+itzam_state itzam_log_update(itzam_datafile * datafile, itzam_ref where, const itzam_file_vec * vec, int count)
+{
+    itzam_log * log = &datafile->m_log;
+    itzam_file_vec images[ITZAM_LOG_MAX_IMAGES];
+    itzam_log_record record;
+    itzam_state result = ITZAM_FAILED;
+    itzam_int length = 0;
+    itzam_lsn lsn;
+    int n;
+
+    if ((count >= ITZAM_LOG_MAX_IMAGES) || !log_open(datafile))
+        return ITZAM_FAILED;
+
+    for (n = 0; n < count; ++n)
+    {
+        images[n + 1] = vec[n];
+        length += (itzam_int)vec[n].m_len;
+    }
+
+    record.m_type        = ITZAM_LOG_UPDATE;
+    record.m_txn         = log->m_txn;
+    record.m_prev_lsn    = log->m_last_lsn;
+    record.m_where       = where;
+    record.m_old_size    = itzam_file_seek(datafile->m_file, 0, ITZAM_SEEK_END);
+    record.m_undo_length = 0;
+    record.m_length      = length;
+
+    if ((log->m_txn != 0) && (where < record.m_old_size))
+    {
+        record.m_undo_length = (record.m_old_size - where < length) ? (itzam_int)(record.m_old_size - where) : length;
+
+        /* the buffer only grows; updates are made under the datafile mutex
+         */
+        if (record.m_undo_length > log->m_undo_size)
+        {
+            void * undo = realloc(log->m_undo, record.m_undo_length);
+
+            if (undo == NULL)
+                return ITZAM_FAILED;
+
+            log->m_undo = undo;
+            log->m_undo_size = record.m_undo_length;
+        }
+
+        if (!itzam_file_pread(datafile->m_file, log->m_undo, record.m_undo_length, where))
+            return ITZAM_FAILED;
+    }
+
+    images[0].m_data = log->m_undo;
+    images[0].m_len  = record.m_undo_length;
+
+    lsn = append(datafile, &record, images, count + 1);
+
+    if (lsn != ITZAM_NULL_LSN)
+    {
+        if (log->m_txn != 0)
+            log->m_last_lsn = lsn;
+
+        if ((record.m_undo_length == 0) || guard_overwrite(datafile, where, record.m_undo_length, datafile->m_shared->m_log_end))
+            result = ITZAM_OKAY;
+    }
+
+    return result;
+}
+
+/* end a transaction; the commit is durable once the log has been flushed
+ * through *flush_to, which is ITZAM_NULL_LSN if nothing was changed
+ */
+itzam_state itzam_log_commit(itzam_datafile * datafile, itzam_lsn * flush_to)
+{
+    itzam_log * log = &datafile->m_log;
+    itzam_log_record record;
+    itzam_state result = ITZAM_OKAY;
+
+    *flush_to = ITZAM_NULL_LSN;
+
+    if (log->m_last_lsn != ITZAM_NULL_LSN)
+    {
+        memset(&record, 0, sizeof(record));
+        record.m_type     = ITZAM_LOG_COMMIT;
+        record.m_txn      = log->m_txn;
+        record.m_prev_lsn = log->m_last_lsn;
+
+        if (append(datafile, &record, NULL, 0) != ITZAM_NULL_LSN)
+            *flush_to = datafile->m_shared->m_log_end;
+        else
+            result = ITZAM_FAILED;
+
+        log_lock(log);
+
+        if (*flush_to > log->m_written)
+            log->m_written = *flush_to;
+
+        ++log->m_commits;
+
+        log_unlock(log);
+    }
+
+    log->m_txn      = 0;
+    log->m_last_lsn = ITZAM_NULL_LSN;
+
+    return result;
+}
+
+/* undo the current transaction, and mark it as aborted so that recovery
+ * repeats the undo
+ */
+itzam_state itzam_log_rollback(itzam_datafile * datafile)
+{
+    itzam_log * log = &datafile->m_log;
+    itzam_log_record record;
+    itzam_state result = ITZAM_OKAY;
+
+    if (log->m_last_lsn != ITZAM_NULL_LSN)
+    {
+        if (!undo_chain(datafile, log->m_file, datafile->m_shared->m_log_base, log->m_last_lsn))
+            result = ITZAM_FAILED;
+
+        memset(&record, 0, sizeof(record));
+        record.m_type     = ITZAM_LOG_ABORT;
+        record.m_txn      = log->m_txn;
+        record.m_prev_lsn = log->m_last_lsn;
+
+        if (append(datafile, &record, NULL, 0) == ITZAM_NULL_LSN)
+            result = ITZAM_FAILED;
+    }
+
+    log->m_txn      = 0;
+    log->m_last_lsn = ITZAM_NULL_LSN;
+
+    return result;
+}
+
+/* make a commit as durable as the datafile's policy requires; with
+ * ITZAM_DURABILITY_COMMIT, wait until the log is on stable storage through lsn.
+ * Called without the datafile mutex, so that other transactions proceed while
+ * this one waits.
+ */
+itzam_state itzam_log_force(itzam_datafile * datafile, itzam_lsn lsn)
+{
+    itzam_log * log = &datafile->m_log;
+    itzam_state result = ITZAM_OKAY;
+
+    log_lock(log);
+
+    switch (log->m_durability)
+    {
+        case ITZAM_DURABILITY_NONE:
+            lsn = ITZAM_NULL_LSN;
+            break;
+
+        case ITZAM_DURABILITY_PERIODIC:
+            /* the flush thread picks the commit up on its next round
+             */
+            if (!start_flusher(datafile) && itzam_file_commit(log->m_file))
+                log->m_durable = lsn;
+
+            lsn = ITZAM_NULL_LSN;
+            break;
+
+        case ITZAM_DURABILITY_WRITE_BEHIND:
+            if (!itzam_file_write_behind(log->m_file))
+                result = ITZAM_FAILED;
+
+            lsn = ITZAM_NULL_LSN;
+            break;
+
+        default:
+            break;
+    }
+
+    if (log->m_durable < lsn)
+    {
+        if (start_flusher(datafile))
+        {
+            if (log->m_requested < lsn)
+            {
+                log->m_requested = lsn;
+                log->m_failed    = itzam_false;
+                log_signal(&log->m_work);
+            }
+
+            while ((log->m_durable < lsn) && !log->m_failed)
+                log_wait(log, &log->m_done);
+        }
+        else if (itzam_file_commit(log->m_file))
+        {
+            /* no thread; flush here
+             */
+            log->m_durable = lsn;
+            ++log->m_flushes;
+        }
+
+        if (log->m_durable < lsn)
+            result = ITZAM_FAILED;
+    }
+
+    log_unlock(log);
+
+    if (result != ITZAM_OKAY)
+        datafile->m_error_handler("itzam_log_force",ITZAM_ERROR_LOG_FAILED);
+
+    return result;
+}
+
+/* choose when commits are flushed; interval applies to ITZAM_DURABILITY_PERIODIC,
+ * and zero selects ITZAM_DURABILITY_DEFAULT_INTERVAL
+ */
+itzam_state itzam_log_set_durability(itzam_datafile * datafile, itzam_durability durability, uint32_t interval)
+{
+    itzam_log * log = &datafile->m_log;
+
+    if ((durability < ITZAM_DURABILITY_NONE) || (durability > ITZAM_DURABILITY_WRITE_BEHIND))
+        return ITZAM_FAILED;
+
+    log_lock(log);
+
+    log->m_durability = durability;
+    log->m_interval   = (interval > 0) ? interval : ITZAM_DURABILITY_DEFAULT_INTERVAL;
+
+    /* wake the flush thread, which may be waiting under the old policy
+     */
+    log_signal(&log->m_work);
+
+    log_unlock(log);
+
+    return ITZAM_OKAY;
+}
+
+/* flush the datafile and empty the log; called between transactions
+ */
+itzam_state itzam_log_checkpoint(itzam_datafile * datafile)
+{
+    itzam_log * log = &datafile->m_log;
+    itzam_datafile_shared * shared = datafile->m_shared;
+    itzam_lsn end = shared->m_log_end;
+
+    if (!itzam_log_is_active(datafile))
+        return ITZAM_OKAY;
+
+    if (!log_open(datafile)
+     || !itzam_file_commit(datafile->m_file)
+     || !itzam_file_truncate(log->m_file, sizeof(itzam_log_header))
+     || !write_log_header(log->m_file, end)
+     || !itzam_file_commit(log->m_file))
+    {
+        datafile->m_error_handler("itzam_log_checkpoint",ITZAM_ERROR_LOG_FAILED);
+        return ITZAM_FAILED;
+    }
+
+    shared->m_log_base = end;
+
+    /* everything in the old log is now in the datafile
+     */
+    log_lock(log);
+
+    if (log->m_durable < end)
+    {
+        log->m_durable = end;
+        log_broadcast(&log->m_done);
+    }
+
+    log_unlock(log);
+
+    return ITZAM_OKAY;
+}
+
+/* repeat the history recorded in a log left by a failed process: every change
+ * is reapplied in order, rolled back transactions are undone again where their
+ * rollback was recorded, and a transaction left incomplete is undone at the
+ * end; the log ends at the first record that was not completely written
+ */
+itzam_state itzam_log_recover(itzam_datafile * datafile)
+{
+    itzam_log * log = &datafile->m_log;
+    itzam_state result = ITZAM_OKAY;
+    itzam_log_header header;
+    itzam_log_record record;
+    itzam_lsn open_lsn = ITZAM_NULL_LSN;
+    itzam_file_vec images[2];
+    itzam_ref pos, size, total;
+    char * buffer;
+    ITZAM_FILE_TYPE file;
+
+    if (!itzam_datafile_exists(log->m_filename))
+        return ITZAM_OKAY;
+
+    file = itzam_file_open(log->m_filename);
+
+    if (!ITZAM_GOOD_FILE(file))
+    {
+        datafile->m_error_handler("itzam_log_recover",ITZAM_ERROR_LOG_FAILED);
+        return ITZAM_FAILED;
+    }
+
+    size = itzam_file_seek(file, 0, ITZAM_SEEK_END);
+
+    if (itzam_file_pread(file, &header, sizeof(header), 0)
+     && (header.m_signature == ITZAM_LOG_SIGNATURE)
+     && (header.m_version == ITZAM_DATAFILE_VERSION))
+    {
+        pos = sizeof(header);
+
+        while (result == ITZAM_OKAY)
+        {
+            if ((pos + (itzam_ref)sizeof(record) > size)
+             || !read_record(file, header.m_base, header.m_base + (pos - sizeof(header)), &record, NULL))
+                break;
+
+            total = (itzam_ref)record.m_undo_length + (itzam_ref)record.m_length;
+
+            if ((record.m_undo_length < 0) || (record.m_length < 0) || (pos + (itzam_ref)sizeof(record) + total > size))
+                break;
+
+            buffer = (char *)malloc(total > 0 ? total : 1);
+
+            if (buffer == NULL)
+            {
+                result = ITZAM_FAILED;
+                break;
+            }
+
+            images[0].m_data = buffer;
+            images[0].m_len  = record.m_undo_length;
+            images[1].m_data = buffer + record.m_undo_length;
+            images[1].m_len  = record.m_length;
+
+            if (!itzam_file_pread(file, buffer, total, pos + sizeof(record))
+             || (record.m_checksum != record_checksum(&record, images, 2)))
+            {
+                free(buffer);
+                break;
+            }
+
+            switch (record.m_type)
+            {
+                case ITZAM_LOG_UPDATE:
+                    if (!itzam_file_pwrite(datafile->m_file, images[1].m_data, images[1].m_len, record.m_where))
+                        result = ITZAM_FAILED;
+
+                    if (record.m_txn != 0)
+                        open_lsn = record.m_lsn;
+
+                    break;
+
+                case ITZAM_LOG_ABORT:
+                    if (!undo_chain(datafile, file, header.m_base, record.m_prev_lsn))
+                        result = ITZAM_FAILED;
+
+                    open_lsn = ITZAM_NULL_LSN;
+                    break;
+
+                default:
+                    open_lsn = ITZAM_NULL_LSN;
+                    break;
+            }
+
+            free(buffer);
+            pos += sizeof(record) + total;
+        }
+
+        /* undo a transaction that never finished
+         */
+        if ((result == ITZAM_OKAY) && (open_lsn != ITZAM_NULL_LSN) && !undo_chain(datafile, file, header.m_base, open_lsn))
+            result = ITZAM_FAILED;
+    }
+
+    itzam_file_close(file);
+
+    if ((result == ITZAM_OKAY) && itzam_file_commit(datafile->m_file))
+        itzam_file_remove(log->m_filename);
+    else
+    {
+        datafile->m_error_handler("itzam_log_recover",ITZAM_ERROR_LOG_FAILED);
+        result = ITZAM_FAILED;
+    }
+
+    return result;
+}
+
+void itzam_log_get_stats(itzam_datafile * datafile, uint64_t * commits, uint64_t * flushes)
+{
+    itzam_log * log = &datafile->m_log;
+
+    log_lock(log);
+
+    if (commits != NULL)
+        *commits = log->m_commits;
+
+    if (flushes != NULL)
+        *flushes = log->m_flushes;
+
+    log_unlock(log);
+}
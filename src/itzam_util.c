@@ -56,6 +56,10 @@
           http:www.coyotegulch.com
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for sync_file_range */
+#endif
+
 #include "itzam.h"
 
 #include <stdlib.h>
@@ -66,6 +70,39 @@
 
 #if defined(ITZAM_UNIX)
 #include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+
+/* asynchronous reads use io_uring where the kernel headers offer it
+ */
+#if defined(ITZAM_LINUX) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ITZAM_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+/* most vectors passed to the positional I/O functions are a header and a record
+ */
+#define ITZAM_FILE_MAX_VEC 8
+
+/* CRC-32C uses the SSE4.2 instruction on x86 processors that have it; unless the compiler
+ * may assume it, the processor is asked at run time
+ */
+#if defined(__SSE4_2__)
+#define ITZAM_CRC32C_HARDWARE
+#define ITZAM_CRC32C_TARGET
+#include <nmmintrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ITZAM_CRC32C_HARDWARE
+#define ITZAM_CRC32C_TARGET __attribute__((target("sse4.2")))
+#include <nmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ITZAM_CRC32C_HARDWARE
+#define ITZAM_CRC32C_TARGET
+#include <nmmintrin.h>
+#include <intrin.h>
 #endif
 
 /*-----------------------------------------------------------------------------
@@ -91,8 +128,10 @@ void itzam_set_default_error_handler(itzam_error_handler * handler)
  * shared memory
  */
 
-ITZAM_SHMEM_TYPE itzam_shmem_obtain(const char * name, size_t len, itzam_bool * creator)
+ITZAM_SHMEM_TYPE itzam_shmem_obtain(const char * name, size_t len, itzam_bool * creator, itzam_error_handler * error_handler)
 {
+    itzam_error_handler * report = (error_handler != NULL) ? error_handler : default_error_handler;
+
 #if defined(ITZAM_UNIX)
     int result;
 
@@ -107,7 +146,7 @@ ITZAM_SHMEM_TYPE itzam_shmem_obtain(const char * name, size_t len, itzam_bool *
             result = shm_open(name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
 
             if (result < 0)
-                default_error_handler("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
+                report("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
         }
     }
     else
@@ -115,7 +154,7 @@ ITZAM_SHMEM_TYPE itzam_shmem_obtain(const char * name, size_t len, itzam_bool *
         *creator = itzam_true;
 
         if (ftruncate(result, len))
-            default_error_handler("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
+            report("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
     }
 
     return result;
@@ -135,9 +174,9 @@ ITZAM_SHMEM_TYPE itzam_shmem_obtain(const char * name, size_t len, itzam_bool *
     if (result == NULL)
     {
         if (ERROR_ACCESS_DENIED == GetLastError())
-            default_error_handler("itzam_shmem_obtain",ITZAM_ERROR_SHMEM_PRIVILEGE);
+            report("itzam_shmem_obtain",ITZAM_ERROR_SHMEM_PRIVILEGE);
         else
-            default_error_handler("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
+            report("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
     }
 
     return result;
@@ -155,13 +194,15 @@ void itzam_shmem_close(ITZAM_SHMEM_TYPE shmem, const char * name)
 #endif
 }
 
-void * itzam_shmem_getptr(ITZAM_SHMEM_TYPE shmem, size_t len)
+void * itzam_shmem_getptr(ITZAM_SHMEM_TYPE shmem, size_t len, itzam_error_handler * error_handler)
 {
+    itzam_error_handler * report = (error_handler != NULL) ? error_handler : default_error_handler;
+
 #if defined(ITZAM_UNIX)
     void * result = mmap(NULL, len, PROT_READ | PROT_WRITE,  MAP_SHARED, shmem, 0);
 
     if (result == MAP_FAILED)
-        default_error_handler("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
+        report("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
 
     return result;
 #else
@@ -172,9 +213,9 @@ void * itzam_shmem_getptr(ITZAM_SHMEM_TYPE shmem, size_t len)
     if (result == NULL)
     {
         if (ERROR_ACCESS_DENIED == GetLastError())
-            default_error_handler("itzam_shmem_obtain",ITZAM_ERROR_SHMEM_PRIVILEGE);
+            report("itzam_shmem_obtain",ITZAM_ERROR_SHMEM_PRIVILEGE);
         else
-            default_error_handler("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
+            report("itzam_shmem_obtain",ITZAM_ERROR_SHMEM);
     }
 
     return result;
@@ -271,6 +312,109 @@ itzam_bool itzam_file_write(ITZAM_FILE_TYPE file, const void * data, size_t len)
 #endif
 }
 
+#if defined(ITZAM_WINDOWS)
+static OVERLAPPED file_offset(itzam_ref pos)
+{
+    OVERLAPPED overlapped;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset     = (DWORD)((uint64_t)pos & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (DWORD)((uint64_t)pos >> 32);
+
+    return overlapped;
+}
+#endif
+
+itzam_bool itzam_file_pread(ITZAM_FILE_TYPE file, void * data, size_t len, itzam_ref pos)
+{
+#if defined(ITZAM_UNIX)
+    return (itzam_bool)((ssize_t)len == pread(file,data,len,(off_t)pos));
+#else
+    DWORD count;
+    OVERLAPPED overlapped = file_offset(pos);
+    return (itzam_bool)(ReadFile(file, (LPVOID)data, (DWORD)len, &count, &overlapped) && (count == (DWORD)len));
+#endif
+}
+
+itzam_bool itzam_file_pwrite(ITZAM_FILE_TYPE file, const void * data, size_t len, itzam_ref pos)
+{
+#if defined(ITZAM_UNIX)
+    return (itzam_bool)((ssize_t)len == pwrite(file,data,len,(off_t)pos));
+#else
+    DWORD count;
+    OVERLAPPED overlapped = file_offset(pos);
+    return (itzam_bool)(WriteFile(file, (LPCVOID)data, (DWORD)len, &count, &overlapped) && (count == (DWORD)len));
+#endif
+}
+
+/* scatter/gather versions; a record header and its data move in one call
+ */
+itzam_bool itzam_file_preadv(ITZAM_FILE_TYPE file, const itzam_file_vec * vec, int count, itzam_ref pos)
+{
+#if defined(ITZAM_UNIX)
+    struct iovec iov[ITZAM_FILE_MAX_VEC];
+    ssize_t total = 0;
+    int n;
+
+    if (count > ITZAM_FILE_MAX_VEC)
+        return itzam_false;
+
+    for (n = 0; n < count; ++n)
+    {
+        iov[n].iov_base = vec[n].m_data;
+        iov[n].iov_len  = vec[n].m_len;
+        total += (ssize_t)vec[n].m_len;
+    }
+
+    return (itzam_bool)(total == preadv(file,iov,count,(off_t)pos));
+#else
+    int n;
+
+    for (n = 0; n < count; ++n)
+    {
+        if (!itzam_file_pread(file, vec[n].m_data, vec[n].m_len, pos))
+            return itzam_false;
+
+        pos += vec[n].m_len;
+    }
+
+    return itzam_true;
+#endif
+}
+
+itzam_bool itzam_file_pwritev(ITZAM_FILE_TYPE file, const itzam_file_vec * vec, int count, itzam_ref pos)
+{
+#if defined(ITZAM_UNIX)
+    struct iovec iov[ITZAM_FILE_MAX_VEC];
+    ssize_t total = 0;
+    int n;
+
+    if (count > ITZAM_FILE_MAX_VEC)
+        return itzam_false;
+
+    for (n = 0; n < count; ++n)
+    {
+        iov[n].iov_base = vec[n].m_data;
+        iov[n].iov_len  = vec[n].m_len;
+        total += (ssize_t)vec[n].m_len;
+    }
+
+    return (itzam_bool)(total == pwritev(file,iov,count,(off_t)pos));
+#else
+    int n;
+
+    for (n = 0; n < count; ++n)
+    {
+        if (!itzam_file_pwrite(file, vec[n].m_data, vec[n].m_len, pos))
+            return itzam_false;
+
+        pos += vec[n].m_len;
+    }
+
+    return itzam_true;
+#endif
+}
+
 itzam_ref itzam_file_seek(ITZAM_FILE_TYPE file, itzam_ref pos, int mode)
 {
 #if defined(ITZAM_UNIX)
@@ -289,15 +433,80 @@ itzam_ref itzam_file_tell(ITZAM_FILE_TYPE file)
 #endif
 }
 
+/* force written data to stable storage
+ */
 itzam_bool itzam_file_commit(ITZAM_FILE_TYPE file)
 {
-#if defined(ITZAM_UNIX)
-    return true; // (itzam_bool)commit(file);
+#if defined(ITZAM_LINUX)
+    return (itzam_bool)(0 == fdatasync(file));
+#elif defined(ITZAM_UNIX)
+    return (itzam_bool)(0 == fsync(file));
 #else
     return (itzam_bool)FlushFileBuffers(file);
 #endif
 }
 
+itzam_bool itzam_file_truncate(ITZAM_FILE_TYPE file, itzam_ref len)
+{
+#if defined(ITZAM_UNIX)
+    return (itzam_bool)(0 == ftruncate(file,(off_t)len));
+#else
+    LARGE_INTEGER pos;
+    pos.QuadPart = (LONGLONG)len;
+    return (itzam_bool)(SetFilePointerEx(file, pos, NULL, FILE_BEGIN) && SetEndOfFile(file));
+#endif
+}
+
+/* start writing changed data to storage without waiting for it; there is no
+ * guarantee that the data is stable when this returns
+ */
+itzam_bool itzam_file_write_behind(ITZAM_FILE_TYPE file)
+{
+#if defined(ITZAM_LINUX)
+    return (itzam_bool)(0 == sync_file_range(file, 0, 0, SYNC_FILE_RANGE_WRITE));
+#else
+    return itzam_true;
+#endif
+}
+
+/* map a file for reading; returns NULL on failure. On POSIX systems the map may reach past
+ * the end of the file, and bytes appended later become readable through it, but only bytes
+ * within the file may be touched. Windows cannot map past the end of a read-only file.
+ */
+const void * itzam_file_map(ITZAM_FILE_TYPE file, itzam_ref len)
+{
+#if defined(ITZAM_UNIX)
+    void * result = mmap(NULL, (size_t)len, PROT_READ, MAP_SHARED, file, 0);
+
+    if (result == MAP_FAILED)
+        result = NULL;
+
+    return result;
+#else
+    void * result = NULL;
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, (DWORD)((uint64_t)len >> 32), (DWORD)len, NULL);
+
+    /* the view keeps the mapping alive
+     */
+    if (mapping != NULL)
+    {
+        result = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T)len);
+        CloseHandle(mapping);
+    }
+
+    return result;
+#endif
+}
+
+itzam_bool itzam_file_unmap(const void * map, itzam_ref len)
+{
+#if defined(ITZAM_UNIX)
+    return (itzam_bool)(0 == munmap((void *)map, (size_t)len));
+#else
+    return (itzam_bool)UnmapViewOfFile(map);
+#endif
+}
+
 itzam_bool itzam_file_remove(const char * filename)
 {
 #if defined(ITZAM_UNIX)
@@ -306,3 +515,524 @@ itzam_bool itzam_file_remove(const char * filename)
     return (itzam_bool)DeleteFile((LPCSTR)filename);
 #endif
 }
+
+/*-----------------------------------------------------------------------------
+ * asynchronous reads; with io_uring, reads queued on a ring are in flight together until
+ * they are reaped. Without it, each read is done when it is queued, and only its completion
+ * waits to be reaped, so callers need not care which they have
+ */
+
+/* a queued read, kept so that a short or failed asynchronous read can be done again
+ */
+typedef struct t_itzam_ring_read
+{
+    uint64_t         m_tag;
+    ITZAM_FILE_TYPE  m_file;
+    void *           m_data;
+    size_t           m_len;
+    itzam_ref        m_pos;
+    itzam_bool       m_result;
+}
+itzam_ring_read;
+
+struct t_itzam_file_ring
+{
+    uint32_t          m_depth;        /* most reads queued at once */
+    uint32_t          m_queued;       /* reads queued and not yet reaped */
+    itzam_ring_read * m_reads;        /* one per slot */
+    uint32_t *        m_free;         /* stack of unused slots */
+    uint32_t          m_free_count;
+    uint32_t *        m_done;         /* slots completed at once, in order, without io_uring */
+    uint32_t          m_done_count;
+#if defined(ITZAM_IO_URING)
+    int               m_fd;           /* io_uring descriptor, or -1 */
+    uint32_t          m_unsubmitted;  /* queued since the kernel was last told */
+    void *            m_sq_ring;
+    size_t            m_sq_ring_len;
+    void *            m_cq_ring;
+    size_t            m_cq_ring_len;
+    struct io_uring_sqe * m_sqes;
+    size_t            m_sqes_len;
+    unsigned *        m_sq_tail;
+    unsigned *        m_sq_mask;
+    unsigned *        m_sq_array;
+    unsigned *        m_cq_head;
+    unsigned *        m_cq_tail;
+    unsigned *        m_cq_mask;
+    struct io_uring_cqe * m_cqes;
+#endif
+};
+
+#if defined(ITZAM_IO_URING)
+static itzam_bool uring_setup(itzam_file_ring * ring)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    ring->m_fd = (int)syscall(__NR_io_uring_setup, ring->m_depth, &params);
+
+    if (ring->m_fd < 0)
+        return itzam_false;
+
+    ring->m_sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->m_cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->m_sqes_len    = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->m_sq_ring = mmap(NULL, ring->m_sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->m_fd, IORING_OFF_SQ_RING);
+    ring->m_cq_ring = mmap(NULL, ring->m_cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->m_fd, IORING_OFF_CQ_RING);
+    ring->m_sqes    = (struct io_uring_sqe *)mmap(NULL, ring->m_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->m_fd, IORING_OFF_SQES);
+
+    if ((ring->m_sq_ring == MAP_FAILED) || (ring->m_cq_ring == MAP_FAILED) || (ring->m_sqes == MAP_FAILED))
+    {
+        if (ring->m_sq_ring != MAP_FAILED)
+            munmap(ring->m_sq_ring, ring->m_sq_ring_len);
+
+        if (ring->m_cq_ring != MAP_FAILED)
+            munmap(ring->m_cq_ring, ring->m_cq_ring_len);
+
+        if (ring->m_sqes != MAP_FAILED)
+            munmap(ring->m_sqes, ring->m_sqes_len);
+
+        close(ring->m_fd);
+        ring->m_fd = -1;
+        return itzam_false;
+    }
+
+    ring->m_sq_tail  = (unsigned *)((char *)ring->m_sq_ring + params.sq_off.tail);
+    ring->m_sq_mask  = (unsigned *)((char *)ring->m_sq_ring + params.sq_off.ring_mask);
+    ring->m_sq_array = (unsigned *)((char *)ring->m_sq_ring + params.sq_off.array);
+    ring->m_cq_head  = (unsigned *)((char *)ring->m_cq_ring + params.cq_off.head);
+    ring->m_cq_tail  = (unsigned *)((char *)ring->m_cq_ring + params.cq_off.tail);
+    ring->m_cq_mask  = (unsigned *)((char *)ring->m_cq_ring + params.cq_off.ring_mask);
+    ring->m_cqes     = (struct io_uring_cqe *)((char *)ring->m_cq_ring + params.cq_off.cqes);
+
+    ring->m_unsubmitted = 0;
+
+    return itzam_true;
+}
+
+/* tell the kernel about queued reads, and optionally wait for one to complete
+ */
+static void uring_enter(itzam_file_ring * ring, itzam_bool wait)
+{
+    long submitted;
+
+    do
+    {
+        submitted = syscall(__NR_io_uring_enter, ring->m_fd, ring->m_unsubmitted, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    }
+    while ((submitted < 0) && (errno == EINTR));
+
+    if (submitted > 0)
+        ring->m_unsubmitted -= (uint32_t)submitted;
+}
+#endif
+
+/* a ring for up to depth reads at once; returns NULL if memory is short
+ */
+itzam_file_ring * itzam_file_ring_create(uint32_t depth)
+{
+    itzam_file_ring * ring = (itzam_file_ring *)malloc(sizeof(itzam_file_ring));
+    uint32_t n;
+
+    if (ring == NULL)
+        return NULL;
+
+    if (depth == 0)
+        depth = 1;
+
+    ring->m_depth      = depth;
+    ring->m_queued     = 0;
+    ring->m_done_count = 0;
+    ring->m_free_count = depth;
+    ring->m_reads      = (itzam_ring_read *)malloc(depth * sizeof(itzam_ring_read));
+    ring->m_free       = (uint32_t *)malloc(depth * sizeof(uint32_t));
+    ring->m_done       = (uint32_t *)malloc(depth * sizeof(uint32_t));
+
+    if ((ring->m_reads == NULL) || (ring->m_free == NULL) || (ring->m_done == NULL))
+    {
+        free(ring->m_reads);
+        free(ring->m_free);
+        free(ring->m_done);
+        free(ring);
+        return NULL;
+    }
+
+    for (n = 0; n < depth; ++n)
+        ring->m_free[n] = depth - 1 - n;
+
+#if defined(ITZAM_IO_URING)
+    /* a kernel without io_uring, or one that forbids it, leaves the ring doing reads at once
+     */
+    uring_setup(ring);
+#endif
+
+    return ring;
+}
+
+void itzam_file_ring_destroy(itzam_file_ring * ring)
+{
+    if (ring != NULL)
+    {
+#if defined(ITZAM_IO_URING)
+        if (ring->m_fd >= 0)
+        {
+            munmap(ring->m_sq_ring, ring->m_sq_ring_len);
+            munmap(ring->m_cq_ring, ring->m_cq_ring_len);
+            munmap(ring->m_sqes, ring->m_sqes_len);
+            close(ring->m_fd);
+        }
+#endif
+        free(ring->m_reads);
+        free(ring->m_free);
+        free(ring->m_done);
+        free(ring);
+    }
+}
+
+/* does the ring keep reads in flight, or do them as they are queued?
+ */
+itzam_bool itzam_file_ring_is_async(const itzam_file_ring * ring)
+{
+#if defined(ITZAM_IO_URING)
+    return (itzam_bool)((ring != NULL) && (ring->m_fd >= 0));
+#else
+    return itzam_false;
+#endif
+}
+
+/* queue a read of len bytes at pos; its tag comes back from itzam_file_ring_reap. Returns
+ * itzam_false if depth reads are already queued
+ */
+itzam_bool itzam_file_ring_read(itzam_file_ring * ring, ITZAM_FILE_TYPE file, void * data, size_t len, itzam_ref pos, uint64_t tag)
+{
+    itzam_ring_read * read;
+    uint32_t slot;
+
+    if ((ring == NULL) || (ring->m_free_count == 0))
+        return itzam_false;
+
+    slot = ring->m_free[--ring->m_free_count];
+    read = &ring->m_reads[slot];
+
+    read->m_tag  = tag;
+    read->m_file = file;
+    read->m_data = data;
+    read->m_len  = len;
+    read->m_pos  = pos;
+
+    ++ring->m_queued;
+
+#if defined(ITZAM_IO_URING)
+    if (ring->m_fd >= 0)
+    {
+        unsigned tail  = *ring->m_sq_tail;
+        unsigned index = tail & *ring->m_sq_mask;
+        struct io_uring_sqe * sqe = &ring->m_sqes[index];
+
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+        sqe->opcode    = IORING_OP_READ;
+        sqe->fd        = file;
+        sqe->addr      = (uint64_t)(uintptr_t)data;
+        sqe->len       = (uint32_t)len;
+        sqe->off       = (uint64_t)pos;
+        sqe->user_data = slot;
+
+        ring->m_sq_array[index] = index;
+
+        /* the kernel must see the entry before the new tail
+         */
+        __atomic_store_n(ring->m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        ++ring->m_unsubmitted;
+
+        return itzam_true;
+    }
+#endif
+
+    read->m_result = itzam_file_pread(file, data, len, pos);
+    ring->m_done[ring->m_done_count++] = slot;
+
+    return itzam_true;
+}
+
+/* collect up to max completed reads, with their tags and whether each read all its bytes;
+ * if wait is true and reads are queued, waits for at least one. Queued reads are started
+ * here, so many reads queued between calls go to the kernel together
+ */
+uint32_t itzam_file_ring_reap(itzam_file_ring * ring, uint64_t * tags, itzam_bool * results, uint32_t max, itzam_bool wait)
+{
+    itzam_ring_read * read;
+    uint32_t count = 0;
+    uint32_t slot;
+
+    if ((ring == NULL) || (ring->m_queued == 0))
+        return 0;
+
+#if defined(ITZAM_IO_URING)
+    if (ring->m_fd >= 0)
+    {
+        unsigned head = *ring->m_cq_head;
+        unsigned tail = __atomic_load_n(ring->m_cq_tail, __ATOMIC_ACQUIRE);
+
+        if ((ring->m_unsubmitted > 0) || (wait && (head == tail)))
+        {
+            uring_enter(ring, (itzam_bool)(wait && (head == tail)));
+            tail = __atomic_load_n(ring->m_cq_tail, __ATOMIC_ACQUIRE);
+        }
+
+        while ((head != tail) && (count < max))
+        {
+            struct io_uring_cqe * cqe = &ring->m_cqes[head & *ring->m_cq_mask];
+
+            slot = (uint32_t)cqe->user_data;
+            read = &ring->m_reads[slot];
+
+            /* a short or failed read is done again, the slow way
+             */
+            if (cqe->res == (int32_t)read->m_len)
+                read->m_result = itzam_true;
+            else
+                read->m_result = itzam_file_pread(read->m_file, read->m_data, read->m_len, read->m_pos);
+
+            tags[count]    = read->m_tag;
+            results[count] = read->m_result;
+            ++count;
+
+            ring->m_free[ring->m_free_count++] = slot;
+            ++head;
+        }
+
+        __atomic_store_n(ring->m_cq_head, head, __ATOMIC_RELEASE);
+
+        ring->m_queued -= count;
+
+        return count;
+    }
+#endif
+
+    while ((count < max) && (count < ring->m_done_count))
+    {
+        slot = ring->m_done[count];
+        read = &ring->m_reads[slot];
+
+        tags[count]    = read->m_tag;
+        results[count] = read->m_result;
+        ++count;
+
+        ring->m_free[ring->m_free_count++] = slot;
+    }
+
+    /* keep the rest in order
+     */
+    memmove(ring->m_done, ring->m_done + count, (ring->m_done_count - count) * sizeof(uint32_t));
+    ring->m_done_count -= count;
+    ring->m_queued     -= count;
+
+    return count;
+}
+
+/*-----------------------------------------------------------------------------
+ * checksums
+ *
+ * CRC-32C, the Castagnoli polynomial, reflected. Without the instruction, tables
+ * take eight bytes at a step. With it, long buffers are taken in three streams at
+ * once, since each instruction waits on the one before it in a stream; the streams
+ * are joined by tables that advance a CRC past the length of a stream in zeros.
+ */
+#define ITZAM_CRC32C_POLY   0x82F63B78
+#define ITZAM_CRC32C_STREAM 256
+
+#if defined(ITZAM_UNIX)
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+#else
+static INIT_ONCE crc32c_once = INIT_ONCE_STATIC_INIT;
+#endif
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_skip[4][256];
+static itzam_bool crc32c_hardware = itzam_false;
+
+/* the CRC of len zeros following crc, without the inversions at either end
+ */
+static uint32_t crc32c_zeros(uint32_t crc, size_t len)
+{
+    while (len-- > 0)
+        crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+static uint32_t crc32c_shift(uint32_t crc)
+{
+    return crc32c_skip[0][crc & 0xff] ^ crc32c_skip[1][(crc >> 8) & 0xff]
+         ^ crc32c_skip[2][(crc >> 16) & 0xff] ^ crc32c_skip[3][crc >> 24];
+}
+
+#if defined(ITZAM_CRC32C_HARDWARE)
+static itzam_bool crc32c_has_instruction(void)
+{
+#if defined(__SSE4_2__)
+    return itzam_true;
+#elif defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") ? itzam_true : itzam_false;
+#else
+    int info[4];
+
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) ? itzam_true : itzam_false;
+#endif
+}
+
+ITZAM_CRC32C_TARGET
+static uint32_t crc32c_instruction(uint32_t crc, const itzam_byte * data, size_t len)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t crc0 = crc, crc1, crc2, word;
+    const itzam_byte * end;
+
+    while (len >= 3 * ITZAM_CRC32C_STREAM)
+    {
+        crc1 = 0;
+        crc2 = 0;
+
+        for (end = data + ITZAM_CRC32C_STREAM; data < end; data += 8)
+        {
+            memcpy(&word, data, 8);
+            crc0 = _mm_crc32_u64(crc0, word);
+            memcpy(&word, data + ITZAM_CRC32C_STREAM, 8);
+            crc1 = _mm_crc32_u64(crc1, word);
+            memcpy(&word, data + 2 * ITZAM_CRC32C_STREAM, 8);
+            crc2 = _mm_crc32_u64(crc2, word);
+        }
+
+        crc0 = crc32c_shift((uint32_t)crc0) ^ crc1;
+        crc0 = crc32c_shift((uint32_t)crc0) ^ crc2;
+
+        data += 2 * ITZAM_CRC32C_STREAM;
+        len  -= 3 * ITZAM_CRC32C_STREAM;
+    }
+
+    while (len >= 8)
+    {
+        memcpy(&word, data, 8);
+        crc0 = _mm_crc32_u64(crc0, word);
+        data += 8;
+        len  -= 8;
+    }
+
+    crc = (uint32_t)crc0;
+#else
+    uint32_t word;
+
+    while (len >= 4)
+    {
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        len  -= 4;
+    }
+#endif
+
+    while (len-- > 0)
+        crc = _mm_crc32_u8(crc, *data++);
+
+    return crc;
+}
+#endif
+
+static uint32_t crc32c_tables(uint32_t crc, const itzam_byte * data, size_t len)
+{
+    while (len >= 8)
+    {
+        crc ^= (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+
+        crc = crc32c_table[7][crc & 0xff] ^ crc32c_table[6][(crc >> 8) & 0xff]
+            ^ crc32c_table[5][(crc >> 16) & 0xff] ^ crc32c_table[4][crc >> 24]
+            ^ crc32c_table[3][data[4]] ^ crc32c_table[2][data[5]]
+            ^ crc32c_table[1][data[6]] ^ crc32c_table[0][data[7]];
+
+        data += 8;
+        len  -= 8;
+    }
+
+    while (len-- > 0)
+        crc = crc32c_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+static void crc32c_init(void)
+{
+    uint32_t crc, bit[32];
+    int n, k, b;
+
+    for (n = 0; n < 256; ++n)
+    {
+        crc = (uint32_t)n;
+
+        for (k = 0; k < 8; ++k)
+            crc = (crc & 1) ? ((crc >> 1) ^ ITZAM_CRC32C_POLY) : (crc >> 1);
+
+        crc32c_table[0][n] = crc;
+    }
+
+    for (n = 0; n < 256; ++n)
+    {
+        for (k = 1; k < 8; ++k)
+            crc32c_table[k][n] = crc32c_table[0][crc32c_table[k - 1][n] & 0xff] ^ (crc32c_table[k - 1][n] >> 8);
+    }
+
+    /* passing zeros is linear in the CRC, so each table entry is a sum of bits
+     */
+    for (b = 0; b < 32; ++b)
+        bit[b] = crc32c_zeros((uint32_t)1 << b, ITZAM_CRC32C_STREAM);
+
+    for (k = 0; k < 4; ++k)
+    {
+        for (n = 0; n < 256; ++n)
+        {
+            crc = 0;
+
+            for (b = 0; b < 8; ++b)
+            {
+                if (n & (1 << b))
+                    crc ^= bit[8 * k + b];
+            }
+
+            crc32c_skip[k][n] = crc;
+        }
+    }
+
+#if defined(ITZAM_CRC32C_HARDWARE)
+    crc32c_hardware = crc32c_has_instruction();
+#endif
+}
+
+#if !defined(ITZAM_UNIX)
+static BOOL CALLBACK crc32c_init_once(PINIT_ONCE once, PVOID parameter, PVOID * context)
+{
+    crc32c_init();
+    return TRUE;
+}
+#endif
+
+uint32_t itzam_crc32c(uint32_t crc, const void * data, size_t len)
+{
+#if defined(ITZAM_UNIX)
+    pthread_once(&crc32c_once, crc32c_init);
+#else
+    InitOnceExecuteOnce(&crc32c_once, crc32c_init_once, NULL, NULL);
+#endif
+
+    crc = ~crc;
+
+#if defined(ITZAM_CRC32C_HARDWARE)
+    if (crc32c_hardware)
+        return ~crc32c_instruction(crc, (const itzam_byte *)data, len);
+#endif
+
+    return ~crc32c_tables(crc, (const itzam_byte *)data, len);
+}
@@ -0,0 +1,400 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY    40000
+#define DEPTH      32
+
+static const char * filename = "async.itz";
+
+#include "itzam_test_model.h"
+
+/*----------------------------------------------------------
+ * callbacks compare each result with the model
+ */
+typedef struct
+{
+    itzam_btree_async * m_async;
+    uint32_t            m_calls;
+    uint32_t            m_chained;   // further lookups to start from callbacks
+    itzam_bool          m_failed;
+}
+results;
+
+static void check_result(void * context, const void * key, const void * found_key)
+{
+    results * r = (results *)context;
+    int32_t k = *(const int32_t *)key;
+
+    ++r->m_calls;
+
+    if (!found_key != !present[k])
+    {
+        printf("ERROR: %s %d\n", present[k] ? "lost" : "found", k);
+        r->m_failed = itzam_true;
+    }
+    else if ((found_key != NULL) && (*(const int32_t *)found_key != k))
+    {
+        printf("ERROR: found %d for %d\n", *(const int32_t *)found_key, k);
+        r->m_failed = itzam_true;
+    }
+
+    // look for the next key from inside the callback
+    if ((r->m_chained > 0) && (k + 1 < MAX_KEY))
+    {
+        --r->m_chained;
+        ++k;
+        itzam_btree_find_async(r->m_async, &k, check_result, r);
+    }
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* every key, looked up asynchronously with a cache too small for the tree */
+static itzam_bool test_finds(itzam_btree * btree, itzam_btree_async * async)
+{
+    results r = { async, 0, 0, itzam_false };
+    int32_t key;
+
+    printf("Finding every key...\n");
+
+    for (key = 0; key < MAX_KEY; ++key)
+        itzam_btree_find_async(async, &key, check_result, &r);
+
+    while (itzam_btree_async_pending(async) > 0)
+        itzam_btree_async_poll(async, itzam_true);
+
+    if (r.m_calls != MAX_KEY)
+    {
+        printf("ERROR: %u callbacks for %d lookups\n", r.m_calls, MAX_KEY);
+        return itzam_false;
+    }
+
+    // callbacks that start more lookups, more than fit at once
+    printf("Chaining lookups from callbacks...\n");
+
+    r.m_calls   = 0;
+    r.m_chained = 1000;
+
+    for (key = 0; key < DEPTH; ++key)
+        itzam_btree_find_async(async, &key, check_result, &r);
+
+    while (itzam_btree_async_pending(async) > 0)
+        itzam_btree_async_poll(async, itzam_true);
+
+    if (r.m_calls != DEPTH + 1000)
+    {
+        printf("ERROR: %u callbacks for %d chained lookups\n", r.m_calls, DEPTH + 1000);
+        return itzam_false;
+    }
+
+    return !r.m_failed;
+}
+
+/* the same thread changes odd keys while lookups of even keys are in flight */
+static itzam_bool test_interleaved(itzam_btree * btree, itzam_btree_async * async)
+{
+    results r = { async, 0, 0, itzam_false };
+    int32_t key, n;
+
+    printf("Changing the tree between lookups...\n");
+
+    for (n = 0; n < MAX_KEY; ++n)
+    {
+        key = random_int32(MAX_KEY / 2) * 2;
+        itzam_btree_find_async(async, &key, check_result, &r);
+
+        change_key(btree, random_int32(MAX_KEY / 2) * 2 + 1, 3);
+
+        if ((n % 7) == 0)
+            itzam_btree_async_poll(async, itzam_false);
+    }
+
+    while (itzam_btree_async_pending(async) > 0)
+        itzam_btree_async_poll(async, itzam_true);
+
+    return (itzam_bool)(!r.m_failed && (r.m_calls == MAX_KEY));
+}
+
+/*----------------------------------------------------------
+ * asynchronous lookups of even keys while another thread writes odd ones
+ */
+static volatile int writer_running = 1;
+
+static void * writer(void * arg)
+{
+    itzam_btree * btree = (itzam_btree *)arg;
+    unsigned int state = 1;
+    int32_t key;
+
+    while (writer_running)
+    {
+        key = (int32_t)(rand_r(&state) % (MAX_KEY / 2)) * 2 + 1;
+
+        if (rand_r(&state) & 1)
+            itzam_btree_insert(btree, &key);
+        else
+            itzam_btree_remove(btree, &key);
+    }
+
+    return NULL;
+}
+
+static itzam_bool test_concurrent(itzam_btree * btree, itzam_btree_async * async)
+{
+    results r = { async, 0, 0, itzam_false };
+    pthread_t writer_thread;
+    int32_t key, n;
+
+    printf("Finding keys while another thread writes...\n");
+
+    writer_running = 1;
+    pthread_create(&writer_thread, NULL, writer, btree);
+
+    for (n = 0; n < 200000; ++n)
+    {
+        key = random_int32(MAX_KEY / 2) * 2;
+        itzam_btree_find_async(async, &key, check_result, &r);
+    }
+
+    while (itzam_btree_async_pending(async) > 0)
+        itzam_btree_async_poll(async, itzam_true);
+
+    writer_running = 0;
+    pthread_join(writer_thread, NULL);
+
+    if (r.m_failed)
+        printf("ERROR: a lookup disagreed with the model\n");
+
+    return (itzam_bool)(!r.m_failed && (r.m_calls == 200000));
+}
+
+/* random finds with a small cache, one at a time and asynchronously */
+static void count_found(void * context, const void * key, const void * found_key)
+{
+    if (found_key != NULL)
+        ++*(uint32_t *)context;
+}
+
+static void test_speed(itzam_btree * btree, itzam_btree_async * async)
+{
+    uint32_t found[2] = { 0, 0 };
+    int32_t key, n, pass;
+    struct timespec start, stop;
+
+    printf("\nFinding keys with a 64-page cache\n");
+
+    itzam_btree_set_cache_size(btree, 64);
+
+    for (pass = 0; pass < 2; ++pass)
+    {
+        init_test_prng(1325);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (n = 0; n < 1000000; ++n)
+        {
+            key = random_int32(MAX_KEY);
+
+            if (pass == 0)
+            {
+                if (itzam_btree_find(btree, &key, NULL))
+                    ++found[0];
+            }
+            else
+                itzam_btree_find_async(async, &key, count_found, &found[1]);
+        }
+
+        while (itzam_btree_async_pending(async) > 0)
+            itzam_btree_async_poll(async, itzam_true);
+
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+
+        printf("    %-8s %.2f seconds\n", pass ? "async" : "sync",
+               (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_nsec - start.tv_nsec) / 1e9);
+    }
+
+    if (found[0] != found[1])
+        printf("ERROR: sync found %u keys, async %u\n", found[0], found[1]);
+}
+
+itzam_bool test_btree_async()
+{
+    static const uint16_t orders[] = { 5, 6, 25 };
+
+    itzam_btree btree;
+    itzam_btree_async async;
+    int32_t key;
+    int o, linked;
+
+    printf("\nItzam/C B-Tree Test\nAsynchronous Finds\n");
+
+    for (linked = 0; linked < 2; ++linked)
+    {
+        for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+        {
+            printf("\nOrder %d%s\n", orders[o], linked ? ", linked leaves" : "");
+
+            create_tree(&btree, orders[o], linked ? itzam_true : itzam_false);
+
+            for (key = 0; key < MAX_KEY; ++key)
+                change_key(&btree, random_int32(MAX_KEY), 3);
+
+            itzam_btree_set_cache_size(&btree, 16);
+
+            if (ITZAM_OKAY != itzam_btree_async_create(&async, &btree, DEPTH))
+                return itzam_false;
+
+            if ((linked == 0) && (o == 0))
+                printf("    reads are %s\n", itzam_file_ring_is_async(async.m_ring) ? "asynchronous (io_uring)" : "done as they are queued");
+
+            if (!test_finds(&btree, &async) || !test_interleaved(&btree, &async))
+                return itzam_false;
+
+            if (o == sizeof(orders) / sizeof(orders[0]) - 1)
+            {
+                if (!test_concurrent(&btree, &async))
+                    return itzam_false;
+
+                if (!linked)
+                    test_speed(&btree, &async);
+            }
+
+            itzam_btree_async_free(&async);
+            itzam_btree_close(&btree);
+        }
+    }
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_async())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
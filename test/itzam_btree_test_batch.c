@@ -0,0 +1,349 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY     100000
+#define NUM_BATCHES 400
+#define MAX_BATCH   10000
+
+static const char * filename = "batch.itz";
+
+static int32_t    batch[MAX_BATCH];
+static itzam_state states[MAX_BATCH];
+static itzam_bool  found[MAX_BATCH];
+static int32_t    returned[MAX_BATCH];
+
+#include "itzam_test_walk.h"
+
+/*----------------------------------------------------------
+ * tests
+ */
+static itzam_bool test_random_batches(itzam_btree * btree, itzam_bool * present)
+{
+    int32_t size;
+    int n, b;
+    itzam_state state;
+    itzam_bool  expected;
+    size_t      hits, expected_hits;
+
+    printf("\nApplying random batches of inserts, finds and removes...\n");
+
+    for (b = 0; b < NUM_BATCHES; ++b)
+    {
+        int op = random_int32(3);
+
+        size = 1 + random_int32(MAX_BATCH);
+
+        // random keys, including repeats within the batch
+        for (n = 0; n < size; ++n)
+            batch[n] = random_int32(MAX_KEY);
+
+        switch (op)
+        {
+            case 0:
+                state = itzam_btree_insert_batch(btree, batch, size, states);
+
+                for (n = 0; n < size; ++n)
+                {
+                    if (states[n] == ITZAM_OKAY)
+                    {
+                        if (present[batch[n]])
+                        {
+                            printf("ERROR: key %d inserted twice\n", batch[n]);
+                            return itzam_false;
+                        }
+
+                        present[batch[n]] = itzam_true;
+                    }
+                    else if ((states[n] != ITZAM_DUPLICATE) || !present[batch[n]])
+                    {
+                        printf("ERROR: key %d not inserted\n", batch[n]);
+                        return itzam_false;
+                    }
+                }
+
+                if ((state != ITZAM_OKAY) && (state != ITZAM_DUPLICATE))
+                    not_okay(state);
+
+                break;
+
+            case 1:
+                state = itzam_btree_remove_batch(btree, batch, size, states);
+
+                for (n = 0; n < size; ++n)
+                {
+                    if (states[n] == ITZAM_OKAY)
+                    {
+                        if (!present[batch[n]])
+                        {
+                            printf("ERROR: key %d removed twice\n", batch[n]);
+                            return itzam_false;
+                        }
+
+                        present[batch[n]] = itzam_false;
+                    }
+                    else if ((states[n] != ITZAM_NOT_FOUND) || present[batch[n]])
+                    {
+                        printf("ERROR: key %d not removed\n", batch[n]);
+                        return itzam_false;
+                    }
+                }
+
+                if ((state != ITZAM_OKAY) && (state != ITZAM_NOT_FOUND))
+                    not_okay(state);
+
+                break;
+
+            default:
+                hits = itzam_btree_find_batch(btree, batch, size, returned, found);
+                expected_hits = 0;
+
+                for (n = 0; n < size; ++n)
+                {
+                    expected = present[batch[n]];
+
+                    if (expected)
+                        ++expected_hits;
+
+                    if ((!found[n] != !expected) || (expected && (returned[n] != batch[n])))
+                    {
+                        printf("ERROR: find of key %d is wrong\n", batch[n]);
+                        return itzam_false;
+                    }
+                }
+
+                if (hits != expected_hits)
+                {
+                    printf("ERROR: find reported %d keys, expected %d\n", (int)hits, (int)expected_hits);
+                    return itzam_false;
+                }
+
+                break;
+        }
+
+        if ((b % 50 == 49) && !check_tree(btree))
+            return itzam_false;
+    }
+
+    if (!check_tree(btree))
+        return itzam_false;
+
+    printf("Okay\n");
+
+    return itzam_true;
+}
+
+static itzam_bool test_speed(int32_t size)
+{
+    itzam_btree btree;
+    itzam_state state;
+    clock_t     start;
+    double      single_time, batch_time;
+    int32_t     count = 200000;
+    int32_t     n, b;
+
+    state = itzam_btree_create(&btree, filename, 25, sizeof(int32_t), itzam_comparator_int32, error_handler);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    init_test_prng(size);
+    start = clock();
+
+    for (n = 0; n < count; ++n)
+    {
+        int32_t key = random_int32(MAX_KEY * 10);
+        itzam_btree_insert(&btree, &key);
+    }
+
+    single_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    itzam_btree_close(&btree);
+
+    state = itzam_btree_create(&btree, filename, 25, sizeof(int32_t), itzam_comparator_int32, error_handler);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    init_test_prng(size);
+    start = clock();
+
+    for (b = 0; b < count; b += size)
+    {
+        for (n = 0; n < size; ++n)
+            batch[n] = random_int32(MAX_KEY * 10);
+
+        state = itzam_btree_insert_batch(&btree, batch, size, NULL);
+
+        if ((state != ITZAM_OKAY) && (state != ITZAM_DUPLICATE))
+            not_okay(state);
+    }
+
+    batch_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (!check_tree(&btree))
+        return itzam_false;
+
+    itzam_btree_close(&btree);
+
+    printf("%8d %10.2f %10.2f\n", size, single_time, batch_time);
+
+    return itzam_true;
+}
+
+itzam_bool test_btree_batch()
+{
+    itzam_btree  btree;
+    itzam_state  state;
+    itzam_bool * present = (itzam_bool *)calloc(MAX_KEY, sizeof(itzam_bool));
+
+    printf("\nItzam/C B-Tree Test\nBatched Inserts, Finds and Removes\n");
+
+    state = itzam_btree_create(&btree, filename, 16, sizeof(int32_t), itzam_comparator_int32, error_handler);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    if (!test_random_batches(&btree, present))
+        return itzam_false;
+
+    itzam_btree_close(&btree);
+    free(present);
+
+    printf("\nInserting %d random keys, one at a time and in batches...\n", 200000);
+    printf("\n   batch     single    batched\n");
+
+    return test_speed(1000) && test_speed(10000);
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_batch())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
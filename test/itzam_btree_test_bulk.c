@@ -0,0 +1,392 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * key source; produces first, first + step, ... up to count keys, then
+ * optionally one key out of order
+ */
+typedef struct t_key_range
+{
+    int32_t m_next;
+    int32_t m_step;
+    int32_t m_left;
+    int32_t m_bad_key;
+    itzam_bool m_add_bad;
+}
+key_range;
+
+static itzam_bool next_key(void * context, void * key)
+{
+    key_range * range = (key_range *)context;
+
+    if (range->m_left > 0)
+    {
+        *(int32_t *)key = range->m_next;
+        range->m_next += range->m_step;
+        --range->m_left;
+        return itzam_true;
+    }
+
+    if (range->m_add_bad)
+    {
+        *(int32_t *)key = range->m_bad_key;
+        range->m_add_bad = itzam_false;
+        return itzam_true;
+    }
+
+    return itzam_false;
+}
+
+static void init_range(key_range * range, int32_t first, int32_t step, int32_t count)
+{
+    range->m_next    = first;
+    range->m_step    = step;
+    range->m_left    = count;
+    range->m_bad_key = 0;
+    range->m_add_bad = itzam_false;
+}
+
+#include "itzam_test_walk.h"
+
+/* a cursor must visit exactly the keys first, first + step, ...
+ */
+static itzam_bool check_keys(itzam_btree * btree, int32_t first, int32_t step, int32_t count)
+{
+    itzam_btree_cursor cursor;
+    int32_t key, expected = first;
+    int32_t visited = 0;
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    if (itzam_btree_cursor_valid(&cursor))
+    {
+        do
+        {
+            itzam_btree_cursor_read(&cursor, &key);
+
+            if (key != expected)
+            {
+                printf("ERROR: cursor read %d, expected %d\n", key, expected);
+                itzam_btree_cursor_free(&cursor);
+                return itzam_false;
+            }
+
+            expected += step;
+            ++visited;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    if (visited != count)
+    {
+        printf("ERROR: cursor visited %d keys, expected %d\n", visited, count);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+static const char * filename = "bulk.itz";
+
+static itzam_bool test_shapes()
+{
+    static const uint16_t orders[] = { 5, 6, 25 };
+    static const double   fills[]  = { 0.5, 0.75, 1.0 };
+    static const int32_t  counts[] = { 1, 2, 7, 100, 5000 };
+
+    itzam_btree btree;
+    itzam_state state;
+    key_range   range;
+    int32_t     key;
+    int o, f, c, n;
+
+    printf("\nLoading trees of different orders, fill factors and sizes...\n");
+
+    for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+    {
+        for (f = 0; f < sizeof(fills) / sizeof(fills[0]); ++f)
+        {
+            for (c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+            {
+                state = itzam_btree_create(&btree, filename, orders[o], sizeof(int32_t), itzam_comparator_int32, error_handler);
+
+                if (state != ITZAM_OKAY)
+                    not_okay(state);
+
+                itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+                // even keys, leaving room for the odd ones
+                init_range(&range, 0, 2, counts[c]);
+                state = itzam_btree_bulk_load(&btree, next_key, &range, fills[f]);
+
+                if (state != ITZAM_OKAY)
+                    not_okay(state);
+
+                if (!check_tree(&btree) || !check_keys(&btree, 0, 2, counts[c]))
+                {
+                    printf("ERROR: order %d, fill %.2f, %d keys\n", orders[o], fills[f], counts[c]);
+                    return itzam_false;
+                }
+
+                // the loaded tree must accept ordinary changes
+                for (n = 0; n < counts[c]; ++n)
+                {
+                    key = 2 * n + 1;
+
+                    if (ITZAM_OKAY != itzam_btree_insert(&btree, &key))
+                        not_okay(ITZAM_FAILED);
+                }
+
+                for (n = 0; n < counts[c]; ++n)
+                {
+                    key = 2 * random_int32(counts[c]);
+                    itzam_btree_remove(&btree, &key);
+                }
+
+                if (!check_tree(&btree))
+                {
+                    printf("ERROR: order %d, fill %.2f, %d keys after changes\n", orders[o], fills[f], counts[c]);
+                    return itzam_false;
+                }
+
+                itzam_btree_close(&btree);
+            }
+        }
+    }
+
+    printf("Okay\n");
+
+    return itzam_true;
+}
+
+static itzam_bool test_rejects()
+{
+    itzam_btree btree;
+    itzam_state state;
+    key_range   range;
+
+    printf("\nRejecting unsorted input and non-empty trees...\n");
+
+    state = itzam_btree_create(&btree, filename, 6, sizeof(int32_t), itzam_comparator_int32, error_handler);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    // loading stops at the key out of order, keeping those before it
+    init_range(&range, 0, 1, 1000);
+    range.m_bad_key = 500;
+    range.m_add_bad = itzam_true;
+
+    state = itzam_btree_bulk_load(&btree, next_key, &range, 1.0);
+
+    if (state != ITZAM_NOT_SORTED)
+    {
+        printf("ERROR: unsorted keys were accepted\n");
+        return itzam_false;
+    }
+
+    if (!check_tree(&btree) || !check_keys(&btree, 0, 1, 1000))
+        return itzam_false;
+
+    init_range(&range, 2000, 1, 10);
+
+    if (ITZAM_FAILED != itzam_btree_bulk_load(&btree, next_key, &range, 1.0))
+    {
+        printf("ERROR: a non-empty tree was loaded\n");
+        return itzam_false;
+    }
+
+    itzam_btree_close(&btree);
+
+    printf("Okay\n");
+
+    return itzam_true;
+}
+
+static itzam_bool test_speed()
+{
+    itzam_btree btree;
+    itzam_state state;
+    key_range   range;
+    int32_t     key;
+    int32_t     count = 1000000;
+    clock_t     start;
+    double      bulk_time, insert_time;
+
+    printf("\nLoading %d keys...\n", count);
+
+    state = itzam_btree_create(&btree, filename, 64, sizeof(int32_t), itzam_comparator_int32, error_handler);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    start = clock();
+    init_range(&range, 0, 1, count);
+    state = itzam_btree_bulk_load(&btree, next_key, &range, 0.9);
+    bulk_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    if (!check_tree(&btree))
+        return itzam_false;
+
+    itzam_btree_close(&btree);
+
+    state = itzam_btree_create(&btree, filename, 64, sizeof(int32_t), itzam_comparator_int32, error_handler);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    start = clock();
+
+    for (key = 0; key < count; ++key)
+    {
+        if (ITZAM_OKAY != itzam_btree_insert(&btree, &key))
+            not_okay(ITZAM_FAILED);
+    }
+
+    insert_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    itzam_btree_close(&btree);
+
+    printf("%10.2f seconds bulk loading\n%10.2f seconds inserting\n", bulk_time, insert_time);
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    printf("\nItzam/C B-Tree Test\nBulk Loading from Sorted Keys\n");
+
+    if (test_shapes() && test_rejects() && test_speed())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
@@ -0,0 +1,406 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY     20000
+#define NUM_KEYS    10000
+#define NUM_CURSORS 6
+#define NUM_STEPS   6000
+#define CHECK_EVERY 1500
+
+static const char * filename = "cache.itz";
+
+#include "itzam_test_model.h"
+
+/* a cursor moving in one direction, and the last key it read */
+typedef struct t_walker
+{
+    itzam_btree_cursor m_cursor;
+    itzam_bool         m_backwards;
+    itzam_bool         m_on_key;
+    int32_t            m_last;
+}
+walker;
+
+static walker walkers[NUM_CURSORS];
+
+/* the most frames the cache has held */
+static uint32_t peak_frames;
+
+/*----------------------------------------------------------
+ * checks
+ */
+
+/* frames beyond the configured size are only kept while they are pinned, and each
+ * cursor pins one page at most
+ */
+static itzam_bool check_frames(itzam_btree * btree, uint32_t size, uint32_t most_pinned)
+{
+    uint32_t pinned = 0;
+    uint32_t n;
+
+    if (btree->m_cache.m_count > peak_frames)
+        peak_frames = btree->m_cache.m_count;
+
+    for (n = 0; n < btree->m_cache.m_count; ++n)
+    {
+        if (btree->m_cache.m_frames[n]->m_pins > 0)
+            ++pinned;
+    }
+
+    if (pinned > most_pinned)
+    {
+        printf("ERROR: %u frames are pinned by %u cursors\n", pinned, most_pinned);
+        return itzam_false;
+    }
+
+    if (btree->m_cache.m_count > size + pinned)
+    {
+        printf("ERROR: cache of %u pages holds %u frames, %u of them pinned\n", size, btree->m_cache.m_count, pinned);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/* the tree agrees with the model, through finds and a cursor */
+static itzam_bool check_keys(itzam_btree * btree)
+{
+    itzam_btree_cursor cursor;
+    int32_t key, found_key, n;
+
+    build_model();
+
+    if (itzam_btree_count(btree) != (uint64_t)model_count)
+    {
+        printf("ERROR: tree holds %ld keys, expected %d\n", (long)itzam_btree_count(btree), model_count);
+        return itzam_false;
+    }
+
+    for (key = 0; key < MAX_KEY; ++key)
+    {
+        if (!itzam_btree_find(btree, &key, &found_key) != !present[key])
+        {
+            printf("ERROR: find of %d disagrees with the model\n", key);
+            return itzam_false;
+        }
+    }
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    n = 0;
+
+    if (model_count > 0)
+    {
+        do
+        {
+            if ((n >= model_count) || (ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[n]))
+            {
+                printf("ERROR: cursor disagrees with the model at position %d\n", n);
+                return itzam_false;
+            }
+
+            ++n;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    if (n != model_count)
+    {
+        printf("ERROR: cursor visited %d keys, expected %d\n", n, model_count);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * cursors
+ */
+
+/* place a walker at a random key; a forward walker at the first key not below it, and a
+ * backward one at the last key not above it
+ */
+static itzam_bool place_walker(walker * w)
+{
+    int32_t target = random_int32(MAX_KEY);
+    int32_t key, expected;
+
+    w->m_on_key = itzam_btree_cursor_seek(&w->m_cursor, &target, w->m_backwards ? ITZAM_KEY_LE : ITZAM_KEY_GE);
+
+    expected = target;
+
+    while ((expected >= 0) && (expected < MAX_KEY) && !present[expected])
+        expected += w->m_backwards ? -1 : 1;
+
+    if (!w->m_on_key != ((expected < 0) || (expected >= MAX_KEY)))
+    {
+        printf("ERROR: seek for %d disagrees with the model\n", target);
+        return itzam_false;
+    }
+
+    if (w->m_on_key)
+    {
+        if ((ITZAM_OKAY != itzam_btree_cursor_read(&w->m_cursor, &key)) || (key != expected))
+        {
+            printf("ERROR: seek for %d read %d, expected %d\n", target, key, expected);
+            return itzam_false;
+        }
+
+        w->m_last = key;
+    }
+
+    return itzam_true;
+}
+
+/* move a walker one key on; the key read must be in the tree and beyond the last one,
+ * which the tree may have changed under the cursor since
+ */
+static itzam_bool step_walker(walker * w)
+{
+    int32_t key;
+
+    if (!w->m_on_key)
+        return place_walker(w);
+
+    if (!(w->m_backwards ? itzam_btree_cursor_prev(&w->m_cursor) : itzam_btree_cursor_next(&w->m_cursor)))
+        return place_walker(w);
+
+    if (ITZAM_OKAY != itzam_btree_cursor_read(&w->m_cursor, &key))
+    {
+        printf("ERROR: cursor could not read after stepping from %d\n", w->m_last);
+        return itzam_false;
+    }
+
+    if (!present[key] || (w->m_backwards ? (key >= w->m_last) : (key <= w->m_last)))
+    {
+        printf("ERROR: cursor read %d after %d, %s\n", key, w->m_last, present[key] ? "out of order" : "which is not in the tree");
+        return itzam_false;
+    }
+
+    w->m_last = key;
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* cursors pin pages while keys are inserted and removed around them, in a cache of size
+ * pages; afterwards the cache holds exactly that many frames
+ */
+static itzam_bool test_size(uint32_t size, itzam_bool linked)
+{
+    itzam_btree btree;
+    int32_t step;
+    int c;
+
+    printf("    %u pages, %s\n", size, linked ? "linked leaves" : "unlinked leaves");
+
+    create_tree(&btree, 5, linked);
+    fill_tree(&btree, NUM_KEYS);
+
+    // pages cached while the tree was filled are dropped
+    itzam_btree_set_cache_size(&btree, size);
+
+    if (!check_frames(&btree, size, 0))
+        return itzam_false;
+
+    peak_frames = 0;
+
+    for (c = 0; c < NUM_CURSORS; ++c)
+    {
+        if (ITZAM_OKAY != itzam_btree_cursor_create(&walkers[c].m_cursor, &btree))
+            return itzam_false;
+
+        walkers[c].m_backwards = (c & 1) ? itzam_true : itzam_false;
+
+        if (!place_walker(&walkers[c]))
+            return itzam_false;
+    }
+
+    for (step = 1; step <= NUM_STEPS; ++step)
+    {
+        change_tree(&btree, 1);
+
+        if (!step_walker(&walkers[random_int32(NUM_CURSORS)]) || !check_frames(&btree, size, NUM_CURSORS))
+            return itzam_false;
+
+        if ((step % CHECK_EVERY == 0) && (!check_keys(&btree) || !check_frames(&btree, size, NUM_CURSORS)))
+            return itzam_false;
+    }
+
+    // pinned pages took the cache past its size
+    if (peak_frames <= size)
+    {
+        printf("ERROR: cursors never held more than %u frames in a cache of %u pages\n", peak_frames, size);
+        return itzam_false;
+    }
+
+    for (c = 0; c < NUM_CURSORS; ++c)
+        itzam_btree_cursor_free(&walkers[c].m_cursor);
+
+    if (!check_keys(&btree) || !check_frames(&btree, size, 0))
+        return itzam_false;
+
+    if (btree.m_cache.m_count != size)
+    {
+        printf("ERROR: cache of %u pages holds %u frames once the cursors are freed\n", size, btree.m_cache.m_count);
+        return itzam_false;
+    }
+
+    printf("        at most %u frames while cursors were open\n", peak_frames);
+
+    itzam_btree_close(&btree);
+
+    return itzam_true;
+}
+
+itzam_bool test_btree_cache()
+{
+    static const uint32_t sizes[] = { 0, 1, 2 };
+
+    int s;
+
+    printf("\nItzam/C B-Tree Test\nPage Cache\n\n");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        if (!test_size(sizes[s], itzam_false) || !test_size(sizes[s], itzam_true))
+            return itzam_false;
+    }
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_cache())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
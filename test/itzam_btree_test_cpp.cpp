@@ -0,0 +1,340 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.hpp"
+#include "itzam_errors.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <set>
+#include <vector>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY   20000
+#define NUM_KEYS  20000
+
+static const char * filename = "cpp.itz";
+
+/* a key ordered by two of its parts, carrying a third */
+struct point
+{
+    int32_t  m_x;
+    int32_t  m_y;
+    uint32_t m_payload;
+};
+
+struct by_row
+{
+    bool operator()(const point & a, const point & b) const
+    {
+        return (a.m_y < b.m_y) || ((a.m_y == b.m_y) && (a.m_x < b.m_x));
+    }
+};
+
+static point make_point(int32_t n)
+{
+    point result = { n % 97 - 48, n / 97 - 100, (uint32_t)n * 7u };
+    return result;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* a tree and a std::set given the same changes hold the same keys, in the same order */
+template <typename Key, typename Compare, typename Make>
+static bool test_tree(const char * description, Make make)
+{
+    typedef itzam::btree<Key, Compare> tree_type;
+
+    std::set<Key, Compare> model;
+    Key key;
+    int n;
+
+    printf("%s, searched %s...\n", description,
+           (tree_type::builtin_key_type == ITZAM_KEY_CUSTOM) ? "through a comparator" : "by key type");
+
+    {
+        tree_type tree = tree_type::create(filename, 25, nullptr, error_handler);
+        itzam_btree_set_durability(tree.native(), ITZAM_DURABILITY_NONE, 0);
+
+        for (n = 0; n < NUM_KEYS; ++n)
+        {
+            key = make(random_int32(MAX_KEY));
+
+            if (random_int32(4))
+            {
+                if (tree.insert(key) != model.insert(key).second)
+                {
+                    printf("ERROR: insert disagreed with the model\n");
+                    return false;
+                }
+            }
+            else if (tree.erase(key) != (model.erase(key) == 1))
+            {
+                printf("ERROR: erase disagreed with the model\n");
+                return false;
+            }
+        }
+
+        // changes in a transaction that is not committed are undone
+        {
+            typename tree_type::transaction changes(tree);
+
+            for (n = 0; n < 1000; ++n)
+                tree.insert(make(random_int32(MAX_KEY)));
+        }
+
+        if ((tree.size() != model.size()) || !std::equal(tree.begin(), tree.end(), model.begin(), model.end(),
+                                                         [](const Key & a, const Key & b) { return std::memcmp(&a, &b, sizeof(Key)) == 0; }))
+        {
+            printf("ERROR: the tree does not hold the keys of the model, in order\n");
+            return false;
+        }
+    }
+
+    // the file is closed, and can be opened again, with the tree moved to another
+    tree_type tree = tree_type::open(filename, false, false, error_handler);
+    tree_type moved(std::move(tree));
+
+    for (n = 0; n < MAX_KEY; n += 7)
+    {
+        key = make(n);
+
+        std::optional<Key> found = moved.find(key);
+        auto lower = moved.lower_bound(key);
+        auto model_lower = model.lower_bound(key);
+
+        if (found.has_value() != (model.count(key) == 1) || (moved.contains(key) != found.has_value()))
+        {
+            printf("ERROR: find disagreed with the model\n");
+            return false;
+        }
+
+        if ((lower == moved.end()) != (model_lower == model.end())
+         || ((lower != moved.end()) && (std::memcmp(&*lower, &*model_lower, sizeof(Key)) != 0)))
+        {
+            printf("ERROR: lower_bound disagreed with the model\n");
+            return false;
+        }
+
+        if (std::distance(moved.upper_bound(key), moved.end()) != std::distance(model.upper_bound(key), model.end()))
+        {
+            printf("ERROR: upper_bound disagreed with the model\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* files of other keys are refused, and an empty tree has no keys to visit */
+static bool test_refusals()
+{
+    printf("Refusing files of other keys, and other files...\n");
+
+    {
+        itzam::btree<int64_t> tree = itzam::btree<int64_t>::create(filename);
+
+        if ((tree.begin() != tree.end()) || !tree.empty())
+        {
+            printf("ERROR: an empty tree has keys\n");
+            return false;
+        }
+    }
+
+    try
+    {
+        itzam::btree<int32_t> tree = itzam::btree<int32_t>::open(filename);
+        printf("ERROR: a file of 64-bit keys was opened as one of 32-bit keys\n");
+        return false;
+    }
+    catch (const itzam::error & e)
+    {
+        if (e.state() != ITZAM_VERSION_ERROR)
+        {
+            printf("ERROR: %s\n", e.what());
+            return false;
+        }
+    }
+
+    // a file that is not an Itzam file is reported by an exception, not by the default handler
+    FILE * other = fopen(filename, "wb");
+
+    if (other == NULL)
+    {
+        printf("ERROR: unable to replace the test file\n");
+        return false;
+    }
+
+    fputs("this is not an Itzam file; it is only long enough to hold a header\n", other);
+    fclose(other);
+
+    try
+    {
+        itzam::btree<int64_t> tree = itzam::btree<int64_t>::open(filename);
+        printf("ERROR: a file without a signature was opened\n");
+        return false;
+    }
+    catch (const itzam::error & e)
+    {
+        if (!e.reported().has_value() || (e.reported().value() != ITZAM_ERROR_SIGNATURE))
+        {
+            printf("ERROR: %s\n", e.what());
+            return false;
+        }
+    }
+
+    // the tree's handler is given to the file; the process-wide default is left alone
+    if (default_error_handler != error_handler)
+    {
+        printf("ERROR: the default error handler was replaced\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool test_btree_cpp()
+{
+    printf("\nItzam/C B-Tree Test\nC++ Interface\n\n");
+
+    if (!test_tree<int32_t, std::less<int32_t>>("int32_t keys", [](int32_t n) { return n * 3 - MAX_KEY; }))
+        return false;
+
+    if (!test_tree<uint64_t, std::greater<uint64_t>>("uint64_t keys in reverse", [](int32_t n) { return (uint64_t)n << 40; }))
+        return false;
+
+    if (!test_tree<point, by_row>("point keys by row", make_point))
+        return false;
+
+    if (!test_refusals())
+        return false;
+
+    printf("\nOkay\n");
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    try
+    {
+        if (test_btree_cpp())
+            result = EXIT_SUCCESS;
+    }
+    catch (const itzam::error & e)
+    {
+        printf("ERROR: %s\n", e.what());
+    }
+
+    return result;
+}
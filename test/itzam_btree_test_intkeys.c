@@ -0,0 +1,498 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY     20000
+#define NUM_KEYS    20000
+#define TIMED_KEYS  1000000
+#define PAYLOAD     12
+#define MAX_RECORD  (sizeof(int64_t) + PAYLOAD)
+
+static const char * filename = "intkeys.itz";
+
+static const char * TYPE_NAMES[] = { "custom", "int32", "uint32", "int64", "uint64" };
+
+static itzam_bool present[MAX_KEY];
+
+/* the layout of the records in a tree: an integer key, and perhaps a payload after it */
+static itzam_key_type key_type;
+static size_t key_width;
+static size_t record_size;
+
+/* the nth key, rising with n from the bottom of the type's range to near its top */
+static void make_record(int32_t n, itzam_byte * record)
+{
+    uint32_t u32;
+    uint64_t u64;
+
+    memset(record, 0, MAX_RECORD);
+
+    switch (key_type)
+    {
+        case ITZAM_KEY_INT32:
+        case ITZAM_KEY_UINT32:
+            u32 = (uint32_t)n * (UINT32_MAX / MAX_KEY);
+
+            if (key_type == ITZAM_KEY_INT32)
+                u32 ^= 0x80000000u;
+
+            memcpy(record, &u32, sizeof(u32));
+            break;
+        default:
+            u64 = (uint64_t)n * (UINT64_MAX / MAX_KEY) + (uint64_t)n;
+
+            if (key_type == ITZAM_KEY_INT64)
+                u64 ^= 0x8000000000000000ull;
+
+            memcpy(record, &u64, sizeof(u64));
+            break;
+    }
+
+    if (record_size > key_width)
+        memcpy(record + key_width, &n, sizeof(n));
+}
+
+static void create_tree(itzam_btree * btree, uint16_t order, itzam_bool linked)
+{
+    itzam_btree_options options;
+    itzam_state state;
+
+    itzam_btree_options_init(&options);
+    options.m_linked_leaves = linked;
+    options.m_key_type = key_type;
+
+    state = itzam_btree_create_ex(btree, filename, order, record_size, NULL, error_handler, &options);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(btree, ITZAM_DURABILITY_NONE, 0);
+
+    memset(present, 0, sizeof(present));
+}
+
+static void change_tree(itzam_btree * btree, int changes, int removals)
+{
+    itzam_byte record[MAX_RECORD];
+    int32_t n;
+
+    while (changes-- > 0)
+    {
+        n = random_int32(MAX_KEY);
+        make_record(n, record);
+
+        if (random_int32(100) >= removals)
+        {
+            if (ITZAM_OKAY == itzam_btree_insert(btree, record))
+                present[n] = itzam_true;
+        }
+        else
+        {
+            if (ITZAM_OKAY == itzam_btree_remove(btree, record))
+                present[n] = itzam_false;
+        }
+    }
+}
+
+/* every key is found, or not, as the model says, with its payload; a cursor sees them in order */
+static itzam_bool check_tree(itzam_btree * btree)
+{
+    itzam_byte record[MAX_RECORD], found_record[MAX_RECORD];
+    itzam_btree_cursor cursor;
+    int32_t n, next;
+
+    for (n = 0; n < MAX_KEY; ++n)
+    {
+        make_record(n, record);
+        memset(found_record, 0xff, sizeof(found_record));
+
+        if (!itzam_btree_find(btree, record, found_record) != !present[n])
+        {
+            printf("ERROR: %s %d\n", present[n] ? "lost" : "found", n);
+            return itzam_false;
+        }
+
+        if (present[n] && (memcmp(record, found_record, record_size) != 0))
+        {
+            printf("ERROR: find returned another record for %d\n", n);
+            return itzam_false;
+        }
+    }
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    next = 0;
+
+    if (itzam_btree_cursor_valid(&cursor))
+    {
+        do
+        {
+            itzam_btree_cursor_read(&cursor, found_record);
+
+            while ((next < MAX_KEY) && !present[next])
+                ++next;
+
+            make_record(next, record);
+
+            if ((next == MAX_KEY) || (memcmp(record, found_record, record_size) != 0))
+            {
+                printf("ERROR: the cursor did not find %d next\n", next);
+                return itzam_false;
+            }
+
+            ++next;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    while ((next < MAX_KEY) && !present[next])
+        ++next;
+
+    if (next != MAX_KEY)
+    {
+        printf("ERROR: the cursor missed %d\n", next);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* grow and shrink the tree, and reopen it */
+static itzam_bool test_changes(itzam_btree * btree)
+{
+    int n;
+
+    for (n = 0; n < 3; ++n)
+    {
+        change_tree(btree, NUM_KEYS / 2, 25);
+
+        if (!check_tree(btree))
+            return itzam_false;
+    }
+
+    for (n = 0; n < 3; ++n)
+    {
+        change_tree(btree, NUM_KEYS / 2, 75);
+
+        if (!check_tree(btree))
+            return itzam_false;
+    }
+
+    itzam_btree_close(btree);
+
+    // the key type is kept in the file, whatever comparator is given on opening
+    if (ITZAM_OKAY != itzam_btree_open(btree, filename, itzam_comparator_string, error_handler, itzam_false, itzam_false))
+        return itzam_false;
+
+    itzam_btree_set_durability(btree, ITZAM_DURABILITY_NONE, 0);
+
+    if (btree->m_key_type != key_type)
+    {
+        printf("ERROR: the file was reopened with keys of type %s\n", TYPE_NAMES[btree->m_key_type]);
+        return itzam_false;
+    }
+
+    change_tree(btree, NUM_KEYS / 2, 25);
+
+    return check_tree(btree);
+}
+
+static itzam_error last_error;
+
+static void record_error(const char * function_name, itzam_error error)
+{
+    last_error = error;
+}
+
+/* trees given a built-in comparator search as if they had the key type; key types that do
+ * not fit the keys are refused
+ */
+static itzam_bool test_recognition()
+{
+    itzam_btree_options options;
+    itzam_btree btree;
+    itzam_bool result = itzam_true;
+
+    printf("\nRecognizing built-in comparators...\n");
+
+    if (ITZAM_OKAY != itzam_btree_create(&btree, filename, 25, sizeof(int64_t) * 2, itzam_comparator_uint64, error_handler))
+        return itzam_false;
+
+    if (btree.m_key_type != ITZAM_KEY_UINT64)
+    {
+        printf("ERROR: itzam_comparator_uint64 was not recognized\n");
+        result = itzam_false;
+    }
+
+    itzam_btree_close(&btree);
+
+    /* refusals are reported to the handler given, before any file is created
+     */
+    itzam_btree_options_init(&options);
+    options.m_key_type = ITZAM_KEY_INT64;
+    last_error = ITZAM_ERROR_SIGNATURE;
+
+    if (ITZAM_OKAY == itzam_btree_create_ex(&btree, filename, 25, sizeof(int32_t), NULL, record_error, &options))
+    {
+        printf("ERROR: 64-bit keys were accepted in 4 bytes\n");
+        itzam_btree_close(&btree);
+        result = itzam_false;
+    }
+
+    else if (last_error != ITZAM_ERROR_INVALID_DATAFILE_OBJECT)
+    {
+        printf("ERROR: the refusal of 64-bit keys in 4 bytes was not reported\n");
+        result = itzam_false;
+    }
+
+    if (ITZAM_OKAY == itzam_btree_create_varkey(&btree, filename, 0, 64, itzam_comparator_string, NULL, record_error, &options))
+    {
+        printf("ERROR: integer keys were accepted in slotted pages\n");
+        itzam_btree_close(&btree);
+        result = itzam_false;
+    }
+
+    return result;
+}
+
+/* the same comparison, made by the caller */
+static int compare_int32(const void * key1, const void * key2)
+{
+    int32_t k1 = *(const int32_t *)key1;
+    int32_t k2 = *(const int32_t *)key2;
+
+    return (k1 > k2) - (k1 < k2);
+}
+
+static int32_t timed_next;
+
+static itzam_bool timed_source(void * context, void * key)
+{
+    if (timed_next >= TIMED_KEYS)
+        return itzam_false;
+
+    *(int32_t *)key = timed_next * 2;
+    ++timed_next;
+
+    return itzam_true;
+}
+
+/* time lookups in a tree of int32 keys, searched by key type and by comparator */
+static double time_finds(itzam_key_type type)
+{
+    itzam_btree_options options;
+    itzam_btree btree;
+    clock_t start;
+    int32_t key, n;
+    int found = 0;
+
+    itzam_btree_options_init(&options);
+    options.m_key_type = type;
+
+    if (ITZAM_OKAY != itzam_btree_create_ex(&btree, filename, 200, sizeof(int32_t), compare_int32, error_handler, &options))
+        return 0.0;
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    timed_next = 0;
+    itzam_btree_bulk_load(&btree, timed_source, NULL, 1.0);
+
+    init_test_prng(1325);
+    start = clock();
+
+    for (n = 0; n < TIMED_KEYS; ++n)
+    {
+        key = random_int32(TIMED_KEYS * 2);
+
+        if (itzam_btree_find(&btree, &key, NULL))
+            ++found;
+    }
+
+    itzam_btree_close(&btree);
+
+    if ((found < TIMED_KEYS / 3) || (found > TIMED_KEYS * 2 / 3))
+        printf("ERROR: found %d of %d keys\n", found, TIMED_KEYS);
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+itzam_bool test_btree_intkeys()
+{
+    static const uint16_t orders[]  = { 5, 25, 200 };
+
+    itzam_btree btree;
+    double custom_time, builtin_time;
+    int t, o;
+
+    printf("\nItzam/C B-Tree Test\nBuilt-In Integer Keys\n");
+
+    for (t = ITZAM_KEY_INT32; t <= ITZAM_KEY_UINT64; ++t)
+    {
+        key_type  = (itzam_key_type)t;
+        key_width = (t <= ITZAM_KEY_UINT32) ? sizeof(int32_t) : sizeof(int64_t);
+
+        for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+        {
+            // packed keys in one tree, and keys followed by a payload in a B+tree
+            record_size = (o % 2) ? key_width + PAYLOAD : key_width;
+
+            printf("%s keys in %d-byte records, order %d%s\n", TYPE_NAMES[t], (int)record_size, (int)orders[o], (o % 2) ? ", linked leaves" : "");
+
+            create_tree(&btree, orders[o], (o % 2) ? itzam_true : itzam_false);
+
+            if (!test_changes(&btree))
+                return itzam_false;
+
+            itzam_btree_close(&btree);
+        }
+    }
+
+    if (!test_recognition())
+        return itzam_false;
+
+    printf("\nFinding %d int32 keys in a tree of order 200...\n", TIMED_KEYS);
+
+    custom_time  = time_finds(ITZAM_KEY_CUSTOM);
+    builtin_time = time_finds(ITZAM_KEY_INT32);
+
+    printf("    %.3f seconds with a comparator, %.3f seconds by key type\n", custom_time, builtin_time);
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_intkeys())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
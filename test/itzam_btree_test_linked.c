@@ -0,0 +1,625 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY    100000
+#define NUM_OPS    40000
+#define NUM_PROBES 10000
+#define BATCH_SIZE 1000
+
+static const char * filename = "linked.itz";
+
+#include "itzam_test_model.h"
+
+/*----------------------------------------------------------
+ * walks the tree on disk; every key is in a leaf at the same depth, separators bound
+ * the subtrees on either side, and the leaves are chained in key order
+ */
+static int leaf_depth;
+static itzam_ref last_leaf;
+static int32_t last_key;
+static itzam_bool any_key;
+
+static int64_t check_page(itzam_btree * btree, itzam_ref where, itzam_ref parent, int depth, const int32_t * low, const int32_t * high)
+{
+    itzam_byte * data = (itzam_byte *)malloc(btree->m_header->m_sizeof_page);
+    itzam_btree_page_header * header = (itzam_btree_page_header *)data;
+    int32_t * keys;
+    itzam_ref * links;
+    itzam_ref * siblings;
+    int64_t result = 0;
+    int64_t child;
+    int n;
+
+    if ((ITZAM_OKAY != itzam_datafile_seek(btree->m_datafile, where))
+     || (ITZAM_OKAY != itzam_datafile_read(btree->m_datafile, data, btree->m_header->m_sizeof_page)))
+    {
+        printf("ERROR: page at %ld could not be read\n", (long)where);
+        free(data);
+        return -1;
+    }
+
+    keys     = (int32_t *)(data + sizeof(itzam_btree_page_header));
+    links    = (itzam_ref *)(data + sizeof(itzam_btree_page_header) + btree->m_header->m_sizeof_key * btree->m_header->m_order);
+    siblings = links + btree->m_header->m_order + 1;
+
+    if ((header->m_where != where) || (header->m_parent != parent))
+    {
+        printf("ERROR: page at %ld has bad location or parent\n", (long)where);
+        result = -1;
+    }
+    else if ((header->m_key_count > btree->m_header->m_order)
+          || ((parent != ITZAM_NULL_REF) && (header->m_key_count < btree->m_min_keys)))
+    {
+        printf("ERROR: page at %ld holds %d keys\n", (long)where, (int)header->m_key_count);
+        result = -1;
+    }
+    else
+    {
+        // a separator may equal the first key to its right
+        for (n = 0; (result >= 0) && (n < header->m_key_count); ++n)
+        {
+            if (((n > 0) && (keys[n - 1] >= keys[n])) || ((low != NULL) && (keys[n] < *low)) || ((high != NULL) && (keys[n] >= *high)))
+            {
+                printf("ERROR: page at %ld has keys out of order\n", (long)where);
+                result = -1;
+            }
+        }
+
+        if ((result >= 0) && (links[0] == ITZAM_NULL_REF))
+        {
+            if (leaf_depth < 0)
+                leaf_depth = depth;
+            else if (leaf_depth != depth)
+            {
+                printf("ERROR: leaves at depths %d and %d\n", leaf_depth, depth);
+                result = -1;
+            }
+
+            // leaves are visited left to right, so each must link back to the one before
+            if (siblings[0] != last_leaf)
+            {
+                printf("ERROR: leaf at %ld links back to %ld, not %ld\n", (long)where, (long)siblings[0], (long)last_leaf);
+                result = -1;
+            }
+
+            if ((header->m_key_count > 0) && any_key && (keys[0] <= last_key))
+            {
+                printf("ERROR: leaf at %ld starts at or before the last key\n", (long)where);
+                result = -1;
+            }
+
+            if (header->m_key_count > 0)
+            {
+                last_key = keys[header->m_key_count - 1];
+                any_key = itzam_true;
+            }
+
+            if (last_leaf != ITZAM_NULL_REF)
+            {
+                itzam_ref * prev_data = (itzam_ref *)malloc(btree->m_header->m_sizeof_page);
+
+                itzam_datafile_seek(btree->m_datafile, last_leaf);
+                itzam_datafile_read(btree->m_datafile, prev_data, btree->m_header->m_sizeof_page);
+
+                if (((itzam_ref *)((itzam_byte *)prev_data + ((itzam_byte *)siblings - data)))[1] != where)
+                {
+                    printf("ERROR: leaf at %ld does not link forward to %ld\n", (long)last_leaf, (long)where);
+                    result = -1;
+                }
+
+                free(prev_data);
+            }
+
+            last_leaf = where;
+
+            if (result >= 0)
+                result = header->m_key_count;
+        }
+        else
+        {
+            if ((siblings[0] != ITZAM_NULL_REF) || (siblings[1] != ITZAM_NULL_REF))
+            {
+                printf("ERROR: inner page at %ld has sibling links\n", (long)where);
+                result = -1;
+            }
+
+            for (n = 0; (result >= 0) && (n <= header->m_key_count); ++n)
+            {
+                child = check_page(btree, links[n], where, depth + 1,
+                                   (n > 0) ? &keys[n - 1] : low,
+                                   (n < header->m_key_count) ? &keys[n] : high);
+
+                if (child < 0)
+                    result = -1;
+                else
+                    result += child;
+            }
+        }
+    }
+
+    free(data);
+
+    return result;
+}
+
+static itzam_bool check_tree(itzam_btree * btree)
+{
+    int64_t count;
+
+    leaf_depth = -1;
+    last_leaf  = ITZAM_NULL_REF;
+    any_key    = itzam_false;
+
+    count = check_page(btree, btree->m_header->m_root_where, ITZAM_NULL_REF, 0, NULL, NULL);
+
+    if (count < 0)
+        return itzam_false;
+
+    if ((uint64_t)count != itzam_btree_count(btree))
+    {
+        printf("ERROR: tree holds %ld keys, but its count is %ld\n", (long)count, (long)itzam_btree_count(btree));
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/* the tree agrees with the model, walked both ways with a cursor and probed with finds */
+static itzam_bool check_keys(itzam_btree * btree)
+{
+    itzam_btree_cursor cursor;
+    int32_t key, found_key, n;
+
+    build_model();
+
+    if (itzam_btree_count(btree) != (uint64_t)model_count)
+    {
+        printf("ERROR: tree holds %ld keys, expected %d\n", (long)itzam_btree_count(btree), model_count);
+        return itzam_false;
+    }
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    n = 0;
+
+    if (model_count > 0)
+    {
+        do
+        {
+            if ((n >= model_count) || (ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[n]))
+            {
+                printf("ERROR: cursor disagrees with the model at position %d\n", n);
+                return itzam_false;
+            }
+
+            ++n;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+    }
+
+    if (n != model_count)
+    {
+        printf("ERROR: cursor visited %d keys, expected %d\n", n, model_count);
+        return itzam_false;
+    }
+
+    // and backwards, along the chain of leaves
+    n = model_count - 1;
+
+    if (itzam_btree_cursor_last(&cursor))
+    {
+        do
+        {
+            if ((n < 0) || (ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[n]))
+            {
+                printf("ERROR: backward cursor disagrees with the model at position %d\n", n);
+                return itzam_false;
+            }
+
+            --n;
+        }
+        while (itzam_btree_cursor_prev(&cursor));
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    if (n != -1)
+    {
+        printf("ERROR: backward cursor stopped at position %d\n", n);
+        return itzam_false;
+    }
+
+    for (n = 0; n < NUM_PROBES; ++n)
+    {
+        key = random_int32(MAX_KEY);
+
+        if (!itzam_btree_find(btree, &key, &found_key) != !present[key])
+        {
+            printf("ERROR: find of %d disagrees with the model\n", key);
+            return itzam_false;
+        }
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+static itzam_bool test_random(itzam_btree * btree)
+{
+    int32_t key, n;
+    itzam_state state;
+
+    printf("Random inserts and removes...\n");
+
+    memset(present, 0, sizeof(present));
+
+    for (n = 0; n < NUM_OPS; ++n)
+    {
+        key = random_int32(MAX_KEY / 4);
+
+        // lean towards inserts in the first half, and towards removals in the second
+        if (random_int32(NUM_OPS) >= n)
+        {
+            state = itzam_btree_insert(btree, &key);
+
+            if ((state == ITZAM_OKAY) != !present[key])
+            {
+                printf("ERROR: insert of %d returned %s\n", key, STATE_MESSAGES[state]);
+                return itzam_false;
+            }
+
+            present[key] = itzam_true;
+        }
+        else
+        {
+            state = itzam_btree_remove(btree, &key);
+
+            if ((state == ITZAM_OKAY) == !present[key])
+            {
+                printf("ERROR: remove of %d returned %s\n", key, STATE_MESSAGES[state]);
+                return itzam_false;
+            }
+
+            present[key] = itzam_false;
+        }
+
+        if ((n % (NUM_OPS / 10) == 0) && !check_tree(btree))
+            return itzam_false;
+    }
+
+    return check_tree(btree) && check_keys(btree);
+}
+
+static itzam_bool test_seek(itzam_btree * btree)
+{
+    itzam_btree_cursor cursor;
+    int32_t key, found_key, expected, n;
+    itzam_bool result;
+
+    printf("Seeking...\n");
+
+    build_model();
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    for (n = 0; n < NUM_PROBES; ++n)
+    {
+        key = random_int32(MAX_KEY / 4 + 2) - 1;
+
+        // alternately the first key not below the probe, and the last key before it
+        if (n & 1)
+        {
+            expected = lower_bound(key);
+            result = itzam_btree_cursor_seek(&cursor, &key, ITZAM_KEY_GE);
+
+            if (expected == model_count)
+                expected = -1;
+        }
+        else
+        {
+            expected = lower_bound(key) - 1;
+            result = itzam_btree_cursor_seek(&cursor, &key, ITZAM_KEY_LT);
+        }
+
+        if (!result != (expected < 0))
+        {
+            printf("ERROR: seek for %d returned %d\n", key, (int)(result != 0));
+            return itzam_false;
+        }
+
+        if (result && ((ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[expected])))
+        {
+            printf("ERROR: seek for %d read %d, expected %d\n", key, found_key, model[expected]);
+            return itzam_false;
+        }
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    return itzam_true;
+}
+
+static itzam_bool test_batch(itzam_btree * btree)
+{
+    int32_t keys[BATCH_SIZE];
+    itzam_state results[BATCH_SIZE];
+    int32_t n, round;
+
+    printf("Batches...\n");
+
+    for (round = 0; round < 20; ++round)
+    {
+        for (n = 0; n < BATCH_SIZE; ++n)
+            keys[n] = random_int32(MAX_KEY / 4);
+
+        if (round & 1)
+        {
+            itzam_btree_remove_batch(btree, keys, BATCH_SIZE, results);
+
+            for (n = 0; n < BATCH_SIZE; ++n)
+                present[keys[n]] = itzam_false;
+        }
+        else
+        {
+            itzam_btree_insert_batch(btree, keys, BATCH_SIZE, results);
+
+            for (n = 0; n < BATCH_SIZE; ++n)
+                present[keys[n]] = itzam_true;
+        }
+
+        if (!check_tree(btree))
+            return itzam_false;
+    }
+
+    return check_keys(btree);
+}
+
+/* key source for bulk loads; every third key */
+static itzam_bool next_key(void * context, void * key)
+{
+    int32_t * next = (int32_t *)context;
+
+    if (*next >= MAX_KEY)
+        return itzam_false;
+
+    *(int32_t *)key = *next;
+    *next += 3;
+
+    return itzam_true;
+}
+
+static itzam_bool test_bulk(uint16_t order)
+{
+    static const double fills[] = { 0.5, 0.75, 1.0 };
+
+    itzam_btree btree;
+    int32_t next, key;
+    int f;
+
+    printf("Bulk loads...\n");
+
+    for (f = 0; f < sizeof(fills) / sizeof(fills[0]); ++f)
+    {
+        create_tree(&btree, order, itzam_true);
+
+        next = 0;
+
+        if (ITZAM_OKAY != itzam_btree_bulk_load(&btree, next_key, &next, fills[f]))
+        {
+            printf("ERROR: bulk load failed\n");
+            return itzam_false;
+        }
+
+        for (key = 0; key < MAX_KEY; ++key)
+            present[key] = (key % 3) == 0;
+
+        if (!check_tree(&btree) || !check_keys(&btree))
+            return itzam_false;
+
+        itzam_btree_close(&btree);
+    }
+
+    return itzam_true;
+}
+
+static itzam_bool test_speed()
+{
+    itzam_btree btree;
+    itzam_btree_cursor cursor;
+    int32_t key, next, pass;
+    double times[2];
+    clock_t start;
+    int linked;
+
+    for (linked = 0; linked < 2; ++linked)
+    {
+        create_tree(&btree, 25, linked ? itzam_true : itzam_false);
+
+        next = 0;
+        itzam_btree_bulk_load(&btree, next_key, &next, 1.0);
+
+        start = clock();
+
+        for (pass = 0; pass < 20; ++pass)
+        {
+            itzam_btree_cursor_create(&cursor, &btree);
+
+            do
+                itzam_btree_cursor_read(&cursor, &key);
+            while (itzam_btree_cursor_next(&cursor));
+
+            itzam_btree_cursor_free(&cursor);
+        }
+
+        times[linked] = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        itzam_btree_close(&btree);
+    }
+
+    printf("\n%10.3f seconds for full scans with parent links\n%10.3f seconds for full scans with linked leaves\n", times[0], times[1]);
+
+    return itzam_true;
+}
+
+itzam_bool test_btree_linked()
+{
+    static const uint16_t orders[] = { 4, 5, 6, 25 };
+
+    itzam_btree btree;
+    int o;
+
+    printf("\nItzam/C B-Tree Test\nLinked Leaves\n");
+
+    for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+    {
+        printf("\nOrder %d\n", orders[o]);
+
+        create_tree(&btree, orders[o], itzam_true);
+
+        if (!test_random(&btree) || !test_seek(&btree) || !test_batch(&btree))
+            return itzam_false;
+
+        itzam_btree_close(&btree);
+
+        if (!test_bulk(orders[o]))
+            return itzam_false;
+    }
+
+    if (!test_speed())
+        return itzam_false;
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_linked())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
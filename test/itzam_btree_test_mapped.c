@@ -0,0 +1,409 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY    40000
+#define NUM_KEYS   20000
+#define BULK_KEYS  3000000
+
+static const char * filename = "mapped.itz";
+
+#include "itzam_test_model.h"
+
+/* every key is found, or not, as the model says */
+static itzam_bool check_tree(itzam_btree * btree)
+{
+    int32_t key, found_key;
+
+    for (key = 0; key < MAX_KEY; ++key)
+    {
+        found_key = -1;
+
+        if (!itzam_btree_find(btree, &key, &found_key) != !present[key])
+        {
+            printf("ERROR: %s %d\n", present[key] ? "lost" : "found", key);
+            return itzam_false;
+        }
+
+        if (present[key] && (found_key != key))
+        {
+            printf("ERROR: find returned %d for %d\n", found_key, key);
+            return itzam_false;
+        }
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* change the tree with reads mapped and not, and roll back a transaction that grew the file */
+static itzam_bool test_changes(itzam_btree * btree)
+{
+    int32_t key, n;
+
+    printf("Changing the tree with mapped reads...\n");
+
+    if (ITZAM_OKAY != itzam_btree_set_mapped(btree, itzam_true))
+        return itzam_false;
+
+    for (n = 0; n < 4; ++n)
+    {
+        change_tree(btree, NUM_KEYS / 2);
+
+        if (!check_tree(btree))
+            return itzam_false;
+
+        // every other round reads through the file, then maps it again
+        if (ITZAM_OKAY != itzam_btree_set_mapped(btree, (n % 2) ? itzam_true : itzam_false))
+            return itzam_false;
+    }
+
+    itzam_btree_set_mapped(btree, itzam_true);
+
+    printf("Rolling back a transaction...\n");
+
+    itzam_btree_transaction_start(btree);
+
+    for (n = 0; n < 2000; ++n)
+    {
+        key = random_int32(MAX_KEY);
+        itzam_btree_insert(btree, &key);
+    }
+
+    itzam_btree_transaction_rollback(btree);
+
+    if (!check_tree(btree))
+        return itzam_false;
+
+    change_tree(btree, 2000);
+
+    return check_tree(btree);
+}
+
+/* a bulk load that takes the file past the end of the first map */
+static int32_t bulk_next;
+
+static itzam_bool bulk_source(void * context, void * key)
+{
+    if (bulk_next >= BULK_KEYS)
+        return itzam_false;
+
+    *(int32_t *)key = bulk_next++;
+
+    return itzam_true;
+}
+
+static itzam_bool test_growth(itzam_btree * btree)
+{
+    itzam_ref before = btree->m_datafile->m_map_size;
+    int32_t key, found_key, n;
+
+    printf("Growing the file past the map...\n");
+
+    bulk_next = 0;
+
+    if (ITZAM_OKAY != itzam_btree_bulk_load(btree, bulk_source, NULL, 0.5))
+        return itzam_false;
+
+    for (n = 0; n < 100000; ++n)
+    {
+        key = random_int32(BULK_KEYS);
+
+        if (!itzam_btree_find(btree, &key, &found_key) || (found_key != key))
+        {
+            printf("ERROR: lost %d after the bulk load\n", key);
+            return itzam_false;
+        }
+    }
+
+    key = BULK_KEYS;
+
+    if (itzam_btree_find(btree, &key, &found_key))
+    {
+        printf("ERROR: found %d after the bulk load\n", key);
+        return itzam_false;
+    }
+
+    printf("    map grew from %lu to %lu bytes\n", (unsigned long)before, (unsigned long)btree->m_datafile->m_map_size);
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * readers find keys through the map while a writer changes others
+ */
+static volatile int writer_running = 1;
+static volatile int reader_failed = 0;
+
+static void * writer(void * arg)
+{
+    itzam_btree * btree = (itzam_btree *)arg;
+    unsigned int state = 1;
+    int32_t key;
+
+    while (writer_running)
+    {
+        // odd keys belong to the writer
+        key = (int32_t)(rand_r(&state) % (MAX_KEY / 2)) * 2 + 1;
+
+        if (rand_r(&state) & 1)
+            itzam_btree_insert(btree, &key);
+        else
+            itzam_btree_remove(btree, &key);
+    }
+
+    return NULL;
+}
+
+static void * reader(void * arg)
+{
+    itzam_btree * btree = (itzam_btree *)arg;
+    unsigned int state = (unsigned int)(size_t)&state;
+    int32_t key, found_key, n;
+
+    for (n = 0; (n < 100000) && !reader_failed; ++n)
+    {
+        // even keys do not change
+        key = (int32_t)(rand_r(&state) % (MAX_KEY / 2)) * 2;
+
+        if (!itzam_btree_find(btree, &key, &found_key) != !present[key])
+            reader_failed = 1;
+    }
+
+    return NULL;
+}
+
+static itzam_bool test_concurrent(itzam_btree * btree)
+{
+    pthread_t writer_thread, reader_threads[4];
+    int n;
+
+    printf("Finding keys while another thread writes...\n");
+
+    writer_running = 1;
+    reader_failed = 0;
+
+    pthread_create(&writer_thread, NULL, writer, btree);
+
+    for (n = 0; n < 4; ++n)
+        pthread_create(&reader_threads[n], NULL, reader, btree);
+
+    for (n = 0; n < 4; ++n)
+        pthread_join(reader_threads[n], NULL);
+
+    writer_running = 0;
+    pthread_join(writer_thread, NULL);
+
+    if (reader_failed)
+    {
+        printf("ERROR: a reader disagreed with the model\n");
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/* random finds with a small cache, through the file and through the map */
+static void test_speed(itzam_btree * btree)
+{
+    int32_t key, n, pass;
+    clock_t start;
+
+    printf("\nFinding keys with a 64-page cache\n");
+
+    itzam_btree_set_cache_size(btree, 64);
+
+    for (pass = 0; pass < 2; ++pass)
+    {
+        itzam_btree_set_mapped(btree, pass ? itzam_true : itzam_false);
+
+        start = clock();
+
+        for (n = 0; n < 1000000; ++n)
+        {
+            key = random_int32(MAX_KEY);
+            itzam_btree_find(btree, &key, NULL);
+        }
+
+        printf("    %-8s %.2f seconds\n", pass ? "mapped" : "file", (double)(clock() - start) / CLOCKS_PER_SEC);
+    }
+}
+
+itzam_bool test_btree_mapped()
+{
+    static const uint16_t orders[] = { 5, 6, 25 };
+
+    itzam_btree btree;
+    int o, linked;
+
+    printf("\nItzam/C B-Tree Test\nMapped Reads\n");
+
+    for (linked = 0; linked < 2; ++linked)
+    {
+        for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+        {
+            printf("\nOrder %d%s\n", orders[o], linked ? ", linked leaves" : "");
+
+            create_tree(&btree, orders[o], linked ? itzam_true : itzam_false);
+
+            if (!test_changes(&btree))
+                return itzam_false;
+
+            if (o == sizeof(orders) / sizeof(orders[0]) - 1)
+            {
+                if (!test_concurrent(&btree))
+                    return itzam_false;
+
+                if (!linked)
+                    test_speed(&btree);
+            }
+
+            itzam_btree_close(&btree);
+        }
+    }
+
+    // a fresh tree, for the bulk load
+    printf("\nOrder 25, bulk loaded\n");
+
+    create_tree(&btree, 25, itzam_false);
+    itzam_btree_set_mapped(&btree, itzam_true);
+
+    if (!test_growth(&btree))
+        return itzam_false;
+
+    itzam_btree_close(&btree);
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_mapped())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
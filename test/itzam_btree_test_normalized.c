@@ -0,0 +1,438 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define NUM_TUPLES  20000
+#define NUM_PAIRS   200000
+#define MAX_NAME    8
+#define MAX_KEY_SIZE (2 * MAX_NAME + 1 + ITZAM_KEY_INT64_LENGTH + ITZAM_KEY_INT32_LENGTH + 1)
+
+static const char * filename = "normalized.itz";
+
+/* a key of several parts; names hold the bytes that need escaping, and the numbers reach
+ * both ends of their ranges
+ */
+typedef struct
+{
+    char    m_name[MAX_NAME + 1];
+    int64_t m_time;
+    int32_t m_sequence;
+}
+tuple;
+
+static tuple tuples[NUM_TUPLES];
+
+static void make_tuple(tuple * t)
+{
+    static const char alphabet[] = "\x01\x02\x03" "ab~\xff";
+    static const int64_t times[] = { INT64_MIN, -1, 0, 1, INT64_MAX };
+
+    int length = random_int32(MAX_NAME + 1);
+    int n;
+
+    for (n = 0; n < length; ++n)
+        t->m_name[n] = alphabet[random_int32(sizeof(alphabet) - 1)];
+
+    t->m_name[length] = 0;
+
+    if (random_int32(4) == 0)
+        t->m_time = times[random_int32(5)];
+    else
+        t->m_time = ((int64_t)random_int32(2000000) - 1000000) * 1000003;
+
+    t->m_sequence = (random_int32(2) ? 1 : -1) * random_int32(2147483647);
+}
+
+/* the order of tuples, part by part */
+static int compare_tuples(const void * a, const void * b)
+{
+    const tuple * t1 = (const tuple *)a;
+    const tuple * t2 = (const tuple *)b;
+    int result = strcmp(t1->m_name, t2->m_name);
+
+    if (result == 0)
+        result = (t1->m_time > t2->m_time) - (t1->m_time < t2->m_time);
+
+    if (result == 0)
+        result = (t1->m_sequence > t2->m_sequence) - (t1->m_sequence < t2->m_sequence);
+
+    return (result > 0) - (result < 0);
+}
+
+static void encode(const tuple * t, char * key)
+{
+    itzam_int offset = 0;
+
+    offset = itzam_key_append_string(key, offset, t->m_name);
+    offset = itzam_key_append_int64(key, offset, t->m_time);
+    itzam_key_append_int32(key, offset, t->m_sequence);
+}
+
+static itzam_bool decode(const char * key, tuple * t)
+{
+    itzam_int offset = 0;
+
+    offset = itzam_key_read_string(key, offset, t->m_name, sizeof(t->m_name));
+    offset = itzam_key_read_int64(key, offset, &t->m_time);
+    offset = itzam_key_read_int32(key, offset, &t->m_sequence);
+
+    return ((offset >= 0) && (key[offset] == 0)) ? itzam_true : itzam_false;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* encoded keys order as the tuples do, and decode to them */
+static itzam_bool test_encoding()
+{
+    static const int32_t int32s[] = { INT32_MIN, -65536, -1, 0, 1, 127, 128, INT32_MAX };
+    static const uint64_t uint64s[] = { 0, 1, 127, 128, 0x7fffffffffffffffull, 0x8000000000000000ull, UINT64_MAX };
+
+    char key1[MAX_KEY_SIZE], key2[MAX_KEY_SIZE], name[4];
+    tuple t1, t2, back;
+    uint64_t u64;
+    int n, comparison;
+
+    printf("Comparing encodings...\n");
+
+    for (n = 0; n < NUM_PAIRS; ++n)
+    {
+        make_tuple(&t1);
+
+        // neighbours often share a name or a time, so that later parts decide
+        t2 = t1;
+
+        switch (random_int32(3))
+        {
+            case 0:
+                make_tuple(&t2);
+                break;
+            case 1:
+                t2.m_time = ((int64_t)random_int32(2000000) - 1000000) * 1000003;
+            default:
+                t2.m_sequence = (random_int32(2) ? 1 : -1) * random_int32(2147483647);
+                break;
+        }
+
+        encode(&t1, key1);
+        encode(&t2, key2);
+
+        comparison = strcmp(key1, key2);
+
+        if (((comparison > 0) - (comparison < 0)) != compare_tuples(&t1, &t2))
+        {
+            printf("ERROR: encodings of (%s, %lld, %d) and (%s, %lld, %d) are out of order\n",
+                   t1.m_name, (long long)t1.m_time, t1.m_sequence, t2.m_name, (long long)t2.m_time, t2.m_sequence);
+            return itzam_false;
+        }
+
+        if (!decode(key1, &back) || (compare_tuples(&t1, &back) != 0))
+        {
+            printf("ERROR: (%s, %lld, %d) did not decode\n", t1.m_name, (long long)t1.m_time, t1.m_sequence);
+            return itzam_false;
+        }
+    }
+
+    for (n = 1; n < sizeof(int32s) / sizeof(int32s[0]); ++n)
+    {
+        itzam_key_append_int32(key1, 0, int32s[n - 1]);
+        itzam_key_append_int32(key2, 0, int32s[n]);
+
+        if (memcmp(key1, key2, ITZAM_KEY_INT32_LENGTH) >= 0)
+        {
+            printf("ERROR: %d does not encode below %d\n", int32s[n - 1], int32s[n]);
+            return itzam_false;
+        }
+    }
+
+    for (n = 1; n < sizeof(uint64s) / sizeof(uint64s[0]); ++n)
+    {
+        itzam_key_append_uint64(key1, 0, uint64s[n - 1]);
+        itzam_key_append_uint64(key2, 0, uint64s[n]);
+
+        if ((memcmp(key1, key2, ITZAM_KEY_INT64_LENGTH) >= 0) || (itzam_key_read_uint64(key2, 0, &u64) != ITZAM_KEY_INT64_LENGTH) || (u64 != uint64s[n]))
+        {
+            printf("ERROR: %llu does not encode below %llu\n", (unsigned long long)uint64s[n - 1], (unsigned long long)uint64s[n]);
+            return itzam_false;
+        }
+    }
+
+    // a string cut short, and a number where a string belongs, are not read
+    itzam_key_append_string(key1, 0, "ab");
+    key1[2] = 0;
+
+    if ((itzam_key_read_string(key1, 0, name, sizeof(name)) != -1) || (itzam_key_read_int32(key1, 0, NULL) != -1))
+    {
+        printf("ERROR: a malformed key was read\n");
+        return itzam_false;
+    }
+
+    // a short buffer takes what it can
+    itzam_key_append_string(key1, 0, "abcdef");
+
+    if ((itzam_key_read_string(key1, 0, name, sizeof(name)) != 7) || (strcmp(name, "abc") != 0))
+    {
+        printf("ERROR: a long string was not cut short\n");
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/* trees of encoded keys return them in the order of their tuples */
+static itzam_bool test_tree(itzam_btree * btree, const char * description)
+{
+    char key[MAX_KEY_SIZE];
+    itzam_btree_cursor cursor;
+    tuple t;
+    int unique, n;
+
+    printf("%s...\n", description);
+
+    if (btree->m_key_type != ITZAM_KEY_STRING)
+    {
+        printf("ERROR: keys were not searched as strings\n");
+        return itzam_false;
+    }
+
+    for (n = 0; n < NUM_TUPLES; ++n)
+    {
+        make_tuple(&tuples[n]);
+        memset(key, 0, sizeof(key));
+        encode(&tuples[n], key);
+        itzam_btree_insert(btree, key);
+    }
+
+    qsort(tuples, NUM_TUPLES, sizeof(tuple), compare_tuples);
+
+    for (n = 1, unique = 1; n < NUM_TUPLES; ++n)
+    {
+        if (compare_tuples(&tuples[unique - 1], &tuples[n]) != 0)
+            tuples[unique++] = tuples[n];
+    }
+
+    if (itzam_btree_count(btree) != unique)
+    {
+        printf("ERROR: %d tuples, %d keys\n", unique, (int)itzam_btree_count(btree));
+        return itzam_false;
+    }
+
+    for (n = 0; n < unique; ++n)
+    {
+        memset(key, 0, sizeof(key));
+        encode(&tuples[n], key);
+
+        if (!itzam_btree_find(btree, key, NULL))
+        {
+            printf("ERROR: lost (%s, %lld, %d)\n", tuples[n].m_name, (long long)tuples[n].m_time, tuples[n].m_sequence);
+            return itzam_false;
+        }
+    }
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    n = 0;
+
+    if (itzam_btree_cursor_valid(&cursor))
+    {
+        do
+        {
+            itzam_btree_cursor_read(&cursor, key);
+
+            if ((n >= unique) || !decode(key, &t) || (compare_tuples(&t, &tuples[n]) != 0))
+            {
+                printf("ERROR: key %d of the cursor is not the next tuple\n", n);
+                return itzam_false;
+            }
+
+            ++n;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    if (n != unique)
+    {
+        printf("ERROR: the cursor saw %d of %d keys\n", n, unique);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+itzam_bool test_btree_normalized()
+{
+    itzam_btree_options options;
+    itzam_btree btree;
+    itzam_state state;
+
+    printf("\nItzam/C B-Tree Test\nNormalized Keys\n\n");
+
+    if (!test_encoding())
+        return itzam_false;
+
+    itzam_btree_options_init(&options);
+    options.m_compress_keys = itzam_true;
+
+    state = itzam_btree_create_varkey(&btree, filename, 0, MAX_KEY_SIZE, itzam_comparator_string, NULL, error_handler, &options);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    if (!test_tree(&btree, "Storing tuples as variable-length keys, with prefixes compressed"))
+        return itzam_false;
+
+    itzam_btree_close(&btree);
+
+    itzam_btree_options_init(&options);
+    options.m_key_type = ITZAM_KEY_STRING;
+
+    state = itzam_btree_create_ex(&btree, filename, 25, MAX_KEY_SIZE, NULL, error_handler, &options);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    if (!test_tree(&btree, "Storing tuples as fixed-length keys"))
+        return itzam_false;
+
+    itzam_btree_close(&btree);
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_normalized())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
@@ -0,0 +1,467 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY    50000
+#define NUM_OPS    40000
+#define BATCH_SIZE 1000
+
+static const char * filename = "parents.itz";
+
+#include "itzam_test_model.h"
+
+static void create_links_tree(itzam_btree * btree, uint16_t order, itzam_bool linked, itzam_bool parent_links)
+{
+    itzam_btree_options options;
+
+    itzam_btree_options_init(&options);
+    options.m_linked_leaves = linked;
+    options.m_parent_links  = parent_links;
+
+    create_tree_with(btree, order, &options);
+}
+
+/*----------------------------------------------------------
+ * walks the tree on disk; leaves are at one depth, separators bound the subtrees on
+ * either side, and each page names its parent only if the tree keeps parent links
+ */
+static int leaf_depth;
+
+static int64_t check_page(itzam_btree * btree, itzam_ref where, itzam_ref parent, int depth, const int32_t * low, const int32_t * high)
+{
+    itzam_byte * data = (itzam_byte *)malloc(btree->m_header->m_sizeof_page);
+    itzam_btree_page_header * header = (itzam_btree_page_header *)data;
+    itzam_ref expected = btree->m_parent_links ? parent : ITZAM_NULL_REF;
+    int32_t * keys;
+    itzam_ref * links;
+    int64_t result = 0;
+    int64_t child;
+    int n;
+
+    if ((ITZAM_OKAY != itzam_datafile_seek(btree->m_datafile, where))
+     || (ITZAM_OKAY != itzam_datafile_read(btree->m_datafile, data, btree->m_header->m_sizeof_page)))
+    {
+        printf("ERROR: page at %ld could not be read\n", (long)where);
+        free(data);
+        return -1;
+    }
+
+    keys  = (int32_t *)(data + sizeof(itzam_btree_page_header));
+    links = (itzam_ref *)(data + sizeof(itzam_btree_page_header) + btree->m_header->m_sizeof_key * btree->m_header->m_order);
+
+    if ((header->m_where != where) || (header->m_parent != expected))
+    {
+        printf("ERROR: page at %ld names parent %ld, not %ld\n", (long)where, (long)header->m_parent, (long)expected);
+        result = -1;
+    }
+    else if ((header->m_key_count > btree->m_header->m_order)
+          || ((parent != ITZAM_NULL_REF) && (header->m_key_count < btree->m_min_keys)))
+    {
+        printf("ERROR: page at %ld holds %d keys\n", (long)where, (int)header->m_key_count);
+        result = -1;
+    }
+    else
+    {
+        // with linked leaves, a separator may equal the first key to its right
+        for (n = 0; (result >= 0) && (n < header->m_key_count); ++n)
+        {
+            if (((n > 0) && (keys[n - 1] >= keys[n])) || ((low != NULL) && (keys[n] < *low)) || ((high != NULL) && (keys[n] >= *high)))
+            {
+                printf("ERROR: page at %ld has keys out of order\n", (long)where);
+                result = -1;
+            }
+        }
+
+        if ((result >= 0) && (links[0] == ITZAM_NULL_REF))
+        {
+            if (leaf_depth < 0)
+                leaf_depth = depth;
+            else if (leaf_depth != depth)
+            {
+                printf("ERROR: leaves at depths %d and %d\n", leaf_depth, depth);
+                result = -1;
+            }
+
+            if (result >= 0)
+                result = header->m_key_count;
+        }
+        else if (result >= 0)
+        {
+            // separators in a linked tree are copies of keys in the leaves
+            if (!btree->m_linked_leaves)
+                result = header->m_key_count;
+
+            for (n = 0; (result >= 0) && (n <= header->m_key_count); ++n)
+            {
+                child = check_page(btree, links[n], where, depth + 1,
+                                   (n > 0) ? &keys[n - 1] : low,
+                                   (n < header->m_key_count) ? &keys[n] : high);
+
+                if (child < 0)
+                    result = -1;
+                else
+                    result += child;
+            }
+        }
+    }
+
+    free(data);
+
+    return result;
+}
+
+/* the structure is sound, and finds and cursors agree with the model */
+static itzam_bool check_tree(itzam_btree * btree)
+{
+    itzam_btree_cursor cursor;
+    int32_t key, cursor_key, expected;
+    int64_t count;
+
+    leaf_depth = -1;
+
+    count = check_page(btree, btree->m_header->m_root_where, ITZAM_NULL_REF, 0, NULL, NULL);
+
+    if (count < 0)
+        return itzam_false;
+
+    if ((count != present_count) || (itzam_btree_count(btree) != (uint64_t)present_count))
+    {
+        printf("ERROR: tree holds %ld keys, count is %ld, model has %d\n", (long)count, (long)itzam_btree_count(btree), present_count);
+        return itzam_false;
+    }
+
+    for (key = 0; key < MAX_KEY; key += 7)
+    {
+        if (!itzam_btree_find(btree, &key, NULL) != !present[key])
+        {
+            printf("ERROR: %s %d\n", present[key] ? "lost" : "found", key);
+            return itzam_false;
+        }
+    }
+
+    // cursors climb back up through parents they remember, in both directions
+    if (ITZAM_OKAY == itzam_btree_cursor_create(&cursor, btree))
+    {
+        expected = 0;
+
+        do
+        {
+            while ((expected < MAX_KEY) && !present[expected])
+                ++expected;
+
+            if (itzam_btree_cursor_valid(&cursor) && (ITZAM_OKAY == itzam_btree_cursor_read(&cursor, &cursor_key)))
+            {
+                if (cursor_key != expected)
+                {
+                    printf("ERROR: cursor read %d, not %d\n", cursor_key, expected);
+                    itzam_btree_cursor_free(&cursor);
+                    return itzam_false;
+                }
+
+                ++expected;
+            }
+        }
+        while (itzam_btree_cursor_next(&cursor));
+
+        expected = MAX_KEY - 1;
+
+        while (itzam_btree_cursor_prev(&cursor))
+        {
+            while ((expected >= 0) && !present[expected])
+                --expected;
+
+            itzam_btree_cursor_read(&cursor, &cursor_key);
+
+            if (cursor_key != expected)
+            {
+                printf("ERROR: reverse cursor read %d, not %d\n", cursor_key, expected);
+                itzam_btree_cursor_free(&cursor);
+                return itzam_false;
+            }
+
+            --expected;
+        }
+
+        itzam_btree_cursor_free(&cursor);
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* single inserts and removes, then batches, growing and shrinking the tree */
+static itzam_bool test_changes(itzam_btree * btree)
+{
+    int32_t keys[BATCH_SIZE];
+    itzam_state results[BATCH_SIZE];
+    int32_t key, n, b;
+
+    printf("Inserting and removing keys...\n");
+
+    // grow the tree for the first half, then shrink it
+    for (n = 0; n < NUM_OPS; ++n)
+        change_key(btree, random_int32(MAX_KEY), (n < NUM_OPS / 2) ? 3 : 1);
+
+    if (!check_tree(btree))
+        return itzam_false;
+
+    printf("Inserting and removing batches...\n");
+
+    for (b = 0; b < 10; ++b)
+        change_batch(btree, keys, BATCH_SIZE, (b % 2) ? itzam_false : itzam_true, results);
+
+    if (!check_tree(btree))
+        return itzam_false;
+
+    printf("Removing every key...\n");
+
+    for (key = 0; key < MAX_KEY; ++key)
+    {
+        if (present[key] && (ITZAM_OKAY != remove_key(btree, key)))
+        {
+            printf("ERROR: could not remove %d\n", key);
+            return itzam_false;
+        }
+    }
+
+    return check_tree(btree);
+}
+
+/* a bulk-loaded tree, whose right edge is repaired from a path rather than parent links */
+static int32_t bulk_next;
+
+static itzam_bool bulk_source(void * context, void * key)
+{
+    if (bulk_next >= MAX_KEY)
+        return itzam_false;
+
+    present[bulk_next] = itzam_true;
+    ++present_count;
+
+    *(int32_t *)key = bulk_next;
+    bulk_next += 3;
+
+    return itzam_true;
+}
+
+static itzam_bool test_bulk(itzam_btree * btree)
+{
+    printf("Bulk loading...\n");
+
+    bulk_next = 0;
+
+    if (ITZAM_OKAY != itzam_btree_bulk_load(btree, bulk_source, NULL, 0.9))
+        return itzam_false;
+
+    return check_tree(btree);
+}
+
+/* the same inserts into small pages, with and without parent links */
+static void test_reads(uint16_t order)
+{
+    itzam_btree btree;
+    uint64_t reads;
+    int32_t key, n;
+    int links;
+
+    printf("\nPages read per insert at order %d\n", order);
+
+    for (links = 1; links >= 0; --links)
+    {
+        create_links_tree(&btree, order, itzam_false, links ? itzam_true : itzam_false);
+        init_test_prng(1325);
+
+        for (n = 0; n < NUM_OPS; ++n)
+        {
+            key = random_int32(MAX_KEY);
+            itzam_btree_insert(&btree, &key);
+        }
+
+        reads = btree.m_cache.m_hits + btree.m_cache.m_misses;
+
+        printf("    %-16s %.2f\n", links ? "parent links" : "no parent links", (double)reads / NUM_OPS);
+
+        itzam_btree_close(&btree);
+    }
+}
+
+itzam_bool test_btree_parents()
+{
+    static const uint16_t orders[] = { 4, 5, 25 };
+
+    itzam_btree btree;
+    int o, linked, links;
+
+    printf("\nItzam/C B-Tree Test\nTrees Without Parent Links\n");
+
+    for (links = 0; links < 2; ++links)
+    {
+        for (linked = 0; linked < 2; ++linked)
+        {
+            for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+            {
+                printf("\nOrder %d%s%s\n", orders[o], linked ? ", linked leaves" : "", links ? ", parent links" : "");
+
+                create_links_tree(&btree, orders[o], linked ? itzam_true : itzam_false, links ? itzam_true : itzam_false);
+
+                if (!test_changes(&btree) || !test_bulk(&btree))
+                    return itzam_false;
+
+                // the format is kept in the file
+                itzam_btree_close(&btree);
+
+                if (ITZAM_OKAY != itzam_btree_open(&btree, filename, itzam_comparator_int32, error_handler, itzam_false, itzam_false))
+                    return itzam_false;
+
+                if (!btree.m_parent_links != !links)
+                {
+                    printf("ERROR: the file forgot whether it keeps parent links\n");
+                    return itzam_false;
+                }
+
+                if (!check_tree(&btree))
+                    return itzam_false;
+
+                itzam_btree_close(&btree);
+            }
+        }
+    }
+
+    test_reads(4);
+    test_reads(25);
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_parents())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
@@ -0,0 +1,542 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY    200000
+#define NUM_KEYS   50000
+#define NUM_PROBES 20000
+
+static const char * filename = "range.itz";
+
+#include "itzam_test_model.h"
+
+/* the model index a seek should reach, or -1 when there is none */
+static int32_t expected_index(int32_t key, itzam_seek_mode mode)
+{
+    int32_t n = lower_bound(key);
+    itzam_bool equal = (n < model_count) && (model[n] == key);
+
+    switch (mode)
+    {
+        case ITZAM_KEY_GE:
+            return (n < model_count) ? n : -1;
+        case ITZAM_KEY_GT:
+            n += equal ? 1 : 0;
+            return (n < model_count) ? n : -1;
+        case ITZAM_KEY_LE:
+            n += equal ? 1 : 0;
+            return n - 1;
+        default:
+            return n - 1;
+    }
+}
+
+/*----------------------------------------------------------
+ * range scan visitor; checks keys against the model as they arrive
+ */
+typedef struct t_scan_state
+{
+    int32_t m_next;
+    int32_t m_limit;
+    itzam_bool m_okay;
+}
+scan_state;
+
+static itzam_bool visit(void * context, const void * key)
+{
+    scan_state * state = (scan_state *)context;
+
+    if ((state->m_next >= model_count) || (model[state->m_next] != *(const int32_t *)key))
+        state->m_okay = itzam_false;
+
+    ++state->m_next;
+
+    return (state->m_limit == 0) || (state->m_next < state->m_limit);
+}
+
+/* the same, for descending scans; m_next counts down */
+static itzam_bool visit_reverse(void * context, const void * key)
+{
+    scan_state * state = (scan_state *)context;
+
+    if ((state->m_next < 0) || (model[state->m_next] != *(const int32_t *)key))
+        state->m_okay = itzam_false;
+
+    --state->m_next;
+
+    return state->m_next >= state->m_limit;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+static itzam_bool test_seek(itzam_btree * btree)
+{
+    static const char * mode_names[] = { "GE", "GT", "LE", "LT" };
+    itzam_btree_cursor cursor;
+    int32_t key, found_key;
+    int32_t expected, n, step;
+    itzam_seek_mode mode;
+    itzam_bool result;
+
+    printf("Seeking...\n");
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    for (n = 0; n < NUM_PROBES; ++n)
+    {
+        key      = random_int32(MAX_KEY + 2) - 1;
+        mode     = (itzam_seek_mode)random_int32(4);
+        expected = expected_index(key, mode);
+        result   = itzam_btree_cursor_seek(&cursor, &key, mode);
+
+        if (!result != (expected < 0))
+        {
+            printf("ERROR: seek %s %d returned %d\n", mode_names[mode], key, (int)(result != 0));
+            return itzam_false;
+        }
+
+        if (!result)
+            continue;
+
+        // the cursor can carry on forward from where the seek left it
+        for (step = 0; step < 10; ++step)
+        {
+            if (ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key) || (found_key != model[expected + step]))
+            {
+                printf("ERROR: seek %s %d, step %d read %d, expected %d\n", mode_names[mode], key, step, found_key, model[expected + step]);
+                return itzam_false;
+            }
+
+            if (!itzam_btree_cursor_next(&cursor))
+            {
+                if (expected + step + 1 != model_count)
+                {
+                    printf("ERROR: cursor ended early after seek %s %d\n", mode_names[mode], key);
+                    return itzam_false;
+                }
+
+                break;
+            }
+        }
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    return itzam_true;
+}
+
+static itzam_bool test_scan(itzam_btree * btree)
+{
+    scan_state state;
+    int32_t low, high, n;
+    uint64_t count;
+
+    printf("Scanning ranges...\n");
+
+    for (n = 0; n < NUM_PROBES / 10; ++n)
+    {
+        low  = random_int32(MAX_KEY);
+        high = low + random_int32(MAX_KEY / 20);
+
+        state.m_next  = lower_bound(low);
+        state.m_limit = 0;
+        state.m_okay  = itzam_true;
+
+        count = itzam_btree_scan_range(btree, &low, &high, visit, &state);
+
+        if (!state.m_okay || (count != (uint64_t)(lower_bound(high) - lower_bound(low))))
+        {
+            printf("ERROR: scan of [%d, %d) visited %d keys, expected %d\n", low, high, (int)count, lower_bound(high) - lower_bound(low));
+            return itzam_false;
+        }
+    }
+
+    // open ends, and a visitor that stops early
+    state.m_next  = 0;
+    state.m_limit = 0;
+    state.m_okay  = itzam_true;
+
+    if ((itzam_btree_scan_range(btree, NULL, NULL, visit, &state) != (uint64_t)model_count) || !state.m_okay)
+    {
+        printf("ERROR: full scan failed\n");
+        return itzam_false;
+    }
+
+    state.m_next  = 0;
+    state.m_limit = 100;
+    state.m_okay  = itzam_true;
+
+    if ((itzam_btree_scan_range(btree, NULL, NULL, visit, &state) != 100) || !state.m_okay)
+    {
+        printf("ERROR: stopped scan failed\n");
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+static itzam_bool test_reverse(itzam_btree * btree)
+{
+    itzam_btree_cursor cursor;
+    scan_state state;
+    int32_t key, found_key, low, high;
+    int32_t expected, n, step;
+    uint64_t count;
+
+    printf("Moving backwards...\n");
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    // every key, from the last to the first
+    n = model_count - 1;
+
+    if (itzam_btree_cursor_last(&cursor))
+    {
+        do
+        {
+            if ((n < 0) || (ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[n]))
+            {
+                printf("ERROR: backward walk disagrees with the model at position %d\n", n);
+                return itzam_false;
+            }
+
+            --n;
+        }
+        while (itzam_btree_cursor_prev(&cursor));
+    }
+
+    // a cursor past the beginning stays there
+    if ((n != -1) || itzam_btree_cursor_prev(&cursor) || itzam_btree_cursor_next(&cursor))
+    {
+        printf("ERROR: backward walk ended at position %d\n", n);
+        return itzam_false;
+    }
+
+    // back and forth after seeks
+    for (n = 0; n < NUM_PROBES; ++n)
+    {
+        key      = random_int32(MAX_KEY);
+        expected = expected_index(key, ITZAM_KEY_LE);
+
+        if (!itzam_btree_cursor_seek(&cursor, &key, ITZAM_KEY_LE) != (expected < 0))
+        {
+            printf("ERROR: seek LE %d disagrees with the model\n", key);
+            return itzam_false;
+        }
+
+        for (step = 0; (expected >= 0) && (step < 10); ++step)
+        {
+            if ((step & 3) == 3)
+            {
+                // a step forward and back again
+                if ((expected + 1 < model_count) && (!itzam_btree_cursor_next(&cursor) || !itzam_btree_cursor_prev(&cursor)))
+                {
+                    printf("ERROR: cursor could not turn around at %d\n", model[expected]);
+                    return itzam_false;
+                }
+            }
+
+            if ((ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[expected]))
+            {
+                printf("ERROR: after seek LE %d, step %d read %d, expected %d\n", key, step, found_key, model[expected]);
+                return itzam_false;
+            }
+
+            if (!itzam_btree_cursor_prev(&cursor) != (expected == 0))
+            {
+                printf("ERROR: cursor_prev at %d disagrees with the model\n", model[expected]);
+                return itzam_false;
+            }
+
+            --expected;
+        }
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    // descending scans of random ranges
+    for (n = 0; n < NUM_PROBES / 10; ++n)
+    {
+        low  = random_int32(MAX_KEY);
+        high = low + random_int32(MAX_KEY / 20);
+
+        state.m_next  = lower_bound(high) - 1;
+        state.m_limit = -1;
+        state.m_okay  = itzam_true;
+
+        count = itzam_btree_scan_range_reverse(btree, &low, &high, visit_reverse, &state);
+
+        if (!state.m_okay || (count != (uint64_t)(lower_bound(high) - lower_bound(low))))
+        {
+            printf("ERROR: descending scan of [%d, %d) visited %d keys, expected %d\n", low, high, (int)count, lower_bound(high) - lower_bound(low));
+            return itzam_false;
+        }
+    }
+
+    // the last hundred keys
+    state.m_next  = model_count - 1;
+    state.m_limit = model_count - 100;
+    state.m_okay  = itzam_true;
+
+    if ((itzam_btree_scan_range_reverse(btree, NULL, NULL, visit_reverse, &state) != 100) || !state.m_okay)
+    {
+        printf("ERROR: descending scan of the last keys failed\n");
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+static itzam_bool test_speed(itzam_btree * btree)
+{
+    scan_state state;
+    int32_t low, high, n;
+    clock_t start;
+    double full_time, range_time;
+
+    // a hundred narrow ranges, against filtering a full scan for each of them
+    start = clock();
+
+    for (n = 0; n < 100; ++n)
+    {
+        itzam_btree_cursor cursor;
+        int32_t key;
+
+        low  = random_int32(MAX_KEY);
+        high = low + 100;
+
+        itzam_btree_cursor_create(&cursor, btree);
+
+        do
+        {
+            itzam_btree_cursor_read(&cursor, &key);
+
+            if (key >= high)
+                break;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+
+        itzam_btree_cursor_free(&cursor);
+    }
+
+    full_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+
+    for (n = 0; n < 100; ++n)
+    {
+        low  = random_int32(MAX_KEY);
+        high = low + 100;
+
+        state.m_next  = lower_bound(low);
+        state.m_limit = 0;
+        state.m_okay  = itzam_true;
+
+        itzam_btree_scan_range(btree, &low, &high, visit, &state);
+    }
+
+    range_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("\n%10.3f seconds scanning from the first key\n%10.3f seconds scanning ranges\n", full_time, range_time);
+
+    // the hundred largest keys, kept in a ring while scanning every key, against reading
+    // them backwards from the end
+    start = clock();
+
+    for (n = 0; n < 100; ++n)
+    {
+        itzam_btree_cursor cursor;
+        int32_t ring[100];
+        int32_t ring_next = 0;
+
+        itzam_btree_cursor_create(&cursor, btree);
+
+        do
+        {
+            itzam_btree_cursor_read(&cursor, &ring[ring_next]);
+            ring_next = (ring_next + 1) % 100;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+
+        itzam_btree_cursor_free(&cursor);
+    }
+
+    full_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+
+    for (n = 0; n < 100; ++n)
+    {
+        state.m_next  = model_count - 1;
+        state.m_limit = model_count - 100;
+        state.m_okay  = itzam_true;
+
+        itzam_btree_scan_range_reverse(btree, NULL, NULL, visit_reverse, &state);
+    }
+
+    range_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%10.3f seconds finding the last 100 keys with a full scan\n%10.3f seconds finding them with a descending scan\n", full_time, range_time);
+
+    return itzam_true;
+}
+
+itzam_bool test_btree_range()
+{
+    static const uint16_t orders[] = { 5, 6, 25 };
+
+    itzam_btree btree;
+    int o;
+
+    printf("\nItzam/C B-Tree Test\nCursor Seeks and Range Scans\n");
+
+    for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+    {
+        printf("\nOrder %d\n", orders[o]);
+
+        create_tree(&btree, orders[o], itzam_false);
+        fill_tree(&btree, NUM_KEYS);
+        build_model();
+
+        if (!test_seek(&btree) || !test_scan(&btree) || !test_reverse(&btree))
+            return itzam_false;
+
+        if ((o == sizeof(orders) / sizeof(orders[0]) - 1) && !test_speed(&btree))
+            return itzam_false;
+
+        itzam_btree_close(&btree);
+    }
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_range())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
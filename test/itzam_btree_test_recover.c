@@ -0,0 +1,527 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY       20000
+#define NUM_TRANS     60
+#define TRAN_SIZE     300
+#define NUM_THREADS   4
+#define THREAD_TRANS  100
+#define POLICY_TRANS  200
+
+static const char * filename = "recover.itz";
+
+/*----------------------------------------------------------
+ * apply random inserts and removes to a B-tree and its model
+ */
+static void random_changes(itzam_btree * btree, itzam_bool * present, int count)
+{
+    itzam_state state;
+    int32_t key;
+    int n;
+
+    for (n = 0; n < count; ++n)
+    {
+        key = random_int32(MAX_KEY);
+
+        if (present[key])
+            state = itzam_btree_remove(btree, &key);
+        else
+            state = itzam_btree_insert(btree, &key);
+
+        if (state != ITZAM_OKAY)
+            not_okay(state);
+
+        present[key] = present[key] ? itzam_false : itzam_true;
+    }
+}
+
+/*----------------------------------------------------------
+ * child process: commits and rolls back transactions, copying the committed
+ * state to shared memory, then dies in the middle of a transaction
+ */
+static void crashing_writer(itzam_bool * committed)
+{
+    itzam_btree btree;
+    itzam_state state;
+    itzam_bool * present = (itzam_bool *)calloc(MAX_KEY, sizeof(itzam_bool));
+    int t;
+
+    state = itzam_btree_create(&btree, filename, 25, sizeof(int32_t), itzam_comparator_int32, error_handler);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    // a few changes outside any transaction
+    random_changes(&btree, present, TRAN_SIZE);
+    memcpy(committed, present, MAX_KEY * sizeof(itzam_bool));
+
+    for (t = 0; t < NUM_TRANS; ++t)
+    {
+        state = itzam_btree_transaction_start(&btree);
+
+        if (state != ITZAM_OKAY)
+            not_okay(state);
+
+        random_changes(&btree, present, TRAN_SIZE);
+
+        if (t % 4 == 3)
+        {
+            state = itzam_btree_transaction_rollback(&btree);
+            memcpy(present, committed, MAX_KEY * sizeof(itzam_bool));
+        }
+        else
+        {
+            state = itzam_btree_transaction_commit(&btree);
+            memcpy(committed, present, MAX_KEY * sizeof(itzam_bool));
+        }
+
+        if (state != ITZAM_OKAY)
+            not_okay(state);
+    }
+
+    // fail part of the way through a transaction, without closing anything
+    state = itzam_btree_transaction_start(&btree);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    random_changes(&btree, present, TRAN_SIZE * 4);
+
+    _exit(EXIT_SUCCESS);
+}
+
+/*----------------------------------------------------------
+ * check a B-tree against the committed state
+ */
+static itzam_bool verify(itzam_btree * btree, const itzam_bool * committed)
+{
+    itzam_bool result = itzam_true;
+    uint64_t expected = 0;
+    int32_t key, rec;
+
+    for (key = 0; key < MAX_KEY; ++key)
+    {
+        if (committed[key])
+            ++expected;
+
+        if (!itzam_btree_find(btree, &key, &rec) != !committed[key])
+        {
+            printf("key %d is %s\n", key, committed[key] ? "missing" : "present, but was not committed");
+            result = itzam_false;
+        }
+    }
+
+    if (itzam_btree_count(btree) != expected)
+    {
+        printf("count is %lu, expected %lu\n", (unsigned long)itzam_btree_count(btree), (unsigned long)expected);
+        result = itzam_false;
+    }
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ * threads sharing one B-tree commit concurrently, so that their commits share
+ * flushes of the log
+ */
+typedef struct t_thread_args
+{
+    itzam_btree * m_btree;
+    int32_t       m_first;
+}
+thread_args;
+
+static void * committer(void * arg)
+{
+    thread_args * args = (thread_args *)arg;
+    itzam_state state;
+    int32_t key;
+    int t;
+
+    for (t = 0; t < THREAD_TRANS; ++t)
+    {
+        key = args->m_first + t;
+
+        state = itzam_btree_transaction_start(args->m_btree);
+
+        if (state == ITZAM_OKAY)
+            state = itzam_btree_insert(args->m_btree, &key);
+
+        if (state == ITZAM_OKAY)
+            state = itzam_btree_transaction_commit(args->m_btree);
+
+        if (state != ITZAM_OKAY)
+            not_okay(state);
+    }
+
+    return NULL;
+}
+
+/*----------------------------------------------------------
+ * commits under each durability policy, reporting how long they took and how
+ * many times the log was flushed
+ */
+static const char * POLICY_NAMES [] =
+{
+    "none",
+    "commit",
+    "periodic",
+    "write-behind"
+};
+
+static itzam_bool test_policies(itzam_btree * btree, int32_t first)
+{
+    itzam_state state;
+    uint64_t flushes_before, flushes_after;
+    struct timespec start, end;
+    double elapsed;
+    int32_t key = first;
+    int policy, t;
+
+    printf("\n%-14s%12s%12s\n", "durability", "commits/s", "flushes");
+
+    for (policy = ITZAM_DURABILITY_NONE; policy <= ITZAM_DURABILITY_WRITE_BEHIND; ++policy)
+    {
+        state = itzam_btree_set_durability(btree, (itzam_durability)policy, 20);
+
+        if (state != ITZAM_OKAY)
+            not_okay(state);
+
+        itzam_log_get_stats(btree->m_datafile, NULL, &flushes_before);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (t = 0; t < POLICY_TRANS; ++t, ++key)
+        {
+            state = itzam_btree_transaction_start(btree);
+
+            if (state == ITZAM_OKAY)
+                state = itzam_btree_insert(btree, &key);
+
+            if (state == ITZAM_OKAY)
+                state = itzam_btree_transaction_commit(btree);
+
+            if (state != ITZAM_OKAY)
+                not_okay(state);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        itzam_log_get_stats(btree->m_datafile, NULL, &flushes_after);
+
+        elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%-14s%12.0f%12lu\n", POLICY_NAMES[policy], POLICY_TRANS / elapsed, (unsigned long)(flushes_after - flushes_before));
+
+        // only waiting commits flush the log themselves
+        if ((policy == ITZAM_DURABILITY_NONE) && (flushes_after != flushes_before))
+        {
+            printf("ERROR: log was flushed with durability none\n");
+            return itzam_false;
+        }
+
+        if ((policy == ITZAM_DURABILITY_COMMIT) && (flushes_after - flushes_before != POLICY_TRANS))
+        {
+            printf("ERROR: each commit should flush the log\n");
+            return itzam_false;
+        }
+    }
+
+    return itzam_true;
+}
+
+/* a page changed in place inside a transaction has its before image on stable
+ * storage first, long before the commit flushes the log */
+static itzam_bool test_write_ahead(itzam_btree * btree, int32_t key)
+{
+    itzam_state state;
+    itzam_lsn durable;
+
+    printf("Overwriting pages in a transaction...\n");
+
+    state = itzam_btree_set_durability(btree, ITZAM_DURABILITY_COMMIT, 0);
+
+    if (state == ITZAM_OKAY)
+        state = itzam_btree_transaction_start(btree);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    durable = btree->m_datafile->m_log.m_durable;
+
+    state = itzam_btree_insert(btree, &key);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    if (btree->m_datafile->m_log.m_durable <= durable)
+    {
+        printf("ERROR: a page was overwritten before the log held its old contents\n");
+        return itzam_false;
+    }
+
+    state = itzam_btree_transaction_commit(btree);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+itzam_bool test_btree_recover()
+{
+    itzam_btree btree;
+    itzam_state state;
+    itzam_bool * committed;
+    char * log_name;
+    pthread_t threads[NUM_THREADS];
+    thread_args args[NUM_THREADS];
+    uint64_t commits, flushes;
+    int32_t key;
+    pid_t pid;
+    int n, status;
+
+    // banner for this test
+    printf("\nItzam/C B-Tree Test\nWrite-Ahead Log and Recovery\n");
+
+    committed = (itzam_bool *)mmap(NULL, MAX_KEY * sizeof(itzam_bool), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (committed == MAP_FAILED)
+        return itzam_false;
+
+    log_name = (char *)malloc(strlen(filename) + 16);
+    sprintf(log_name, "%s.itzamlog", filename);
+
+    printf("Running a process that fails during a transaction...\n");
+
+    fflush(stdout);
+    pid = fork();
+
+    if (pid == 0)
+        crashing_writer(committed);
+
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid))
+        return itzam_false;
+
+    if (!itzam_datafile_exists(log_name))
+    {
+        printf("ERROR: no log was left behind\n");
+        return itzam_false;
+    }
+
+    // shared memory named for the file outlives the failed process
+    shm_unlink("/recover_itz_ItzamSharedDatafile");
+    shm_unlink("/recover_itz-ItzamBTreeHeader");
+    shm_unlink("/recover_itz-ItzamBTreeRoot");
+
+    printf("Recovering...\n");
+
+    state = itzam_btree_open(&btree, filename, itzam_comparator_int32, error_handler, itzam_true, itzam_false);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    if (!verify(&btree, committed))
+        return itzam_false;
+
+    printf("Committing from %d threads...\n", NUM_THREADS);
+
+    for (n = 0; n < NUM_THREADS; ++n)
+    {
+        args[n].m_btree = &btree;
+        args[n].m_first = MAX_KEY + n * THREAD_TRANS;
+        pthread_create(&threads[n], NULL, committer, &args[n]);
+    }
+
+    for (n = 0; n < NUM_THREADS; ++n)
+        pthread_join(threads[n], NULL);
+
+    itzam_log_get_stats(btree.m_datafile, &commits, &flushes);
+    printf("%10lu commits\n%10lu log flushes\n", (unsigned long)commits, (unsigned long)flushes);
+
+    for (key = MAX_KEY; key < MAX_KEY + NUM_THREADS * THREAD_TRANS; ++key)
+    {
+        if (!itzam_btree_find(&btree, &key, &n))
+        {
+            printf("ERROR: key %d committed by a thread is missing\n", key);
+            return itzam_false;
+        }
+    }
+
+    if ((commits != NUM_THREADS * THREAD_TRANS) || (flushes > commits))
+    {
+        printf("ERROR: commits were not counted correctly\n");
+        return itzam_false;
+    }
+
+    if (!test_policies(&btree, MAX_KEY + NUM_THREADS * THREAD_TRANS))
+        return itzam_false;
+
+    if (!test_write_ahead(&btree, MAX_KEY + NUM_THREADS * THREAD_TRANS + 4 * POLICY_TRANS))
+        return itzam_false;
+
+    state = itzam_btree_close(&btree);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    // the last close writes everything to the datafile
+    if (itzam_datafile_exists(log_name))
+    {
+        printf("ERROR: log remains after close\n");
+        return itzam_false;
+    }
+
+    // everything committed under every policy is in the file
+    state = itzam_btree_open(&btree, filename, itzam_comparator_int32, error_handler, itzam_false, itzam_true);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    for (key = MAX_KEY; key < MAX_KEY + NUM_THREADS * THREAD_TRANS + 4 * POLICY_TRANS; ++key)
+    {
+        if (!itzam_btree_find(&btree, &key, &n))
+        {
+            printf("ERROR: key %d is missing after reopening\n", key);
+            return itzam_false;
+        }
+    }
+
+    itzam_btree_close(&btree);
+
+    printf("\nOkay\n");
+
+    free(log_name);
+    munmap(committed, MAX_KEY * sizeof(itzam_bool));
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_recover())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
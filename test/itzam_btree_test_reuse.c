@@ -0,0 +1,382 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY     20000
+#define NUM_ROUNDS  12
+#define ROUND_OPS   4000
+#define NUM_CURSORS 3
+
+static const char * filename = "reuse.itz";
+
+#include "itzam_test_model.h"
+
+/* the model as it was when a transaction began */
+static itzam_bool saved[MAX_KEY];
+static int32_t saved_count = 0;
+
+/* number of levels below the root, following the leftmost links on disk */
+static int tree_depth(itzam_btree * btree)
+{
+    itzam_byte * data = (itzam_byte *)malloc(btree->m_header->m_sizeof_page);
+    itzam_ref * links = (itzam_ref *)(data + sizeof(itzam_btree_page_header) + btree->m_header->m_sizeof_key * btree->m_header->m_order);
+    itzam_ref where = btree->m_root.m_links[0];
+    int result = 0;
+
+    while ((where != ITZAM_NULL_REF)
+        && (ITZAM_OKAY == itzam_datafile_seek(btree->m_datafile, where))
+        && (ITZAM_OKAY == itzam_datafile_read(btree->m_datafile, data, btree->m_header->m_sizeof_page)))
+    {
+        where = links[0];
+        ++result;
+    }
+
+    free(data);
+
+    return result;
+}
+
+static int count_blocks(void * block)
+{
+    int result = 0;
+
+    for (; block != NULL; block = *(void **)block)
+        ++result;
+
+    return result;
+}
+
+static int count_memory(itzam_btree_cursor_memory * memory)
+{
+    int result = 0;
+
+    for (; memory != NULL; memory = memory->m_prev)
+        ++result;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ * finds agree with the model, and several cursors, open at once and stepped in
+ * turn, read the keys in order in both directions
+ */
+static itzam_bool check_tree(itzam_btree * btree)
+{
+    itzam_btree_cursor cursors[NUM_CURSORS];
+    int32_t expected[NUM_CURSORS];
+    int32_t key;
+    itzam_bool moving;
+    int c, depth;
+
+    if (itzam_btree_count(btree) != (uint64_t)present_count)
+    {
+        printf("ERROR: count is %ld, model has %d\n", (long)itzam_btree_count(btree), present_count);
+        return itzam_false;
+    }
+
+    for (key = 0; key < MAX_KEY; key += 3)
+    {
+        if (!itzam_btree_find(btree, &key, NULL) != !present[key])
+        {
+            printf("ERROR: %s %d\n", present[key] ? "lost" : "found", key);
+            return itzam_false;
+        }
+    }
+
+    if (present_count == 0)
+        return itzam_true;
+
+    for (c = 0; c < NUM_CURSORS; ++c)
+    {
+        if (ITZAM_OKAY != itzam_btree_cursor_create(&cursors[c], btree))
+            return itzam_false;
+
+        expected[c] = 0;
+    }
+
+    // forward, each cursor a different number of keys ahead of the next
+    do
+    {
+        moving = itzam_false;
+
+        for (c = 0; c < NUM_CURSORS; ++c)
+        {
+            while ((expected[c] < MAX_KEY) && !present[expected[c]])
+                ++expected[c];
+
+            if (expected[c] >= MAX_KEY)
+                continue;
+
+            itzam_btree_cursor_read(&cursors[c], &key);
+
+            if (key != expected[c])
+            {
+                printf("ERROR: cursor %d read %d, not %d\n", c, key, expected[c]);
+                return itzam_false;
+            }
+
+            ++expected[c];
+
+            if ((c == 0) || (expected[c] + c * 50 < expected[c - 1]) || (expected[c - 1] >= MAX_KEY))
+                itzam_btree_cursor_next(&cursors[c]);
+            else
+                --expected[c];
+
+            moving = itzam_true;
+        }
+    }
+    while (moving);
+
+    // back again, after which no cursor holds more positions than the tree has levels
+    depth = tree_depth(btree);
+
+    for (c = 0; c < NUM_CURSORS; ++c)
+    {
+        expected[c] = MAX_KEY - 1;
+
+        while (itzam_btree_cursor_prev(&cursors[c]))
+        {
+            while ((expected[c] >= 0) && !present[expected[c]])
+                --expected[c];
+
+            itzam_btree_cursor_read(&cursors[c], &key);
+
+            if (key != expected[c])
+            {
+                printf("ERROR: reverse cursor %d read %d, not %d\n", c, key, expected[c]);
+                return itzam_false;
+            }
+
+            --expected[c];
+        }
+
+        if (count_memory(cursors[c].m_parent_memory) + count_memory(cursors[c].m_spare_memory) > depth)
+        {
+            printf("ERROR: cursor %d holds %d positions in a tree %d levels deep\n", c,
+                   count_memory(cursors[c].m_parent_memory) + count_memory(cursors[c].m_spare_memory), depth);
+            return itzam_false;
+        }
+
+        itzam_btree_cursor_free(&cursors[c]);
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* rounds of inserts and removes in transactions, some of them rolled back; the blocks
+ * used by splits are recycled, so the slab never holds more than the deepest split needs
+ */
+static itzam_bool test_rounds(itzam_btree * btree)
+{
+    int32_t n, round;
+    int depth, blocks;
+
+    for (round = 0; round < NUM_ROUNDS; ++round)
+    {
+        memcpy(saved, present, sizeof(present));
+        saved_count = present_count;
+
+        itzam_btree_transaction_start(btree);
+
+        // grow the tree for the first half of the rounds, then shrink it
+        for (n = 0; n < ROUND_OPS; ++n)
+            change_key(btree, random_int32(MAX_KEY), (round < NUM_ROUNDS / 2) ? 3 : 1);
+
+        if (round % 3 == 2)
+        {
+            itzam_btree_transaction_rollback(btree);
+            memcpy(present, saved, sizeof(present));
+            present_count = saved_count;
+        }
+        else
+            itzam_btree_transaction_commit(btree);
+
+        if (!check_tree(btree))
+            return itzam_false;
+
+        depth  = tree_depth(btree);
+        blocks = count_blocks(btree->m_slab);
+
+        // a split holds a sibling and a temporary at each level, and a new root two pages
+        if (blocks > 2 * depth + 4)
+        {
+            printf("ERROR: %d blocks kept for a tree %d levels deep\n", blocks, depth);
+            return itzam_false;
+        }
+
+        printf("    round %2d: %5d keys, %d levels, %d blocks%s\n", round, present_count, depth + 1, blocks,
+               (round % 3 == 2) ? ", rolled back" : "");
+    }
+
+    return itzam_true;
+}
+
+itzam_bool test_btree_reuse()
+{
+    static const uint16_t orders[] = { 4, 5, 25 };
+
+    itzam_btree btree;
+    int o, linked;
+
+    printf("\nItzam/C B-Tree Test\nReuse of Pages, Temporaries and Cursor Positions\n");
+
+    for (linked = 0; linked < 2; ++linked)
+    {
+        for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+        {
+            printf("\nOrder %d%s\n", orders[o], linked ? ", linked leaves" : "");
+
+            create_tree(&btree, orders[o], linked ? itzam_true : itzam_false);
+
+            if (!test_rounds(&btree))
+                return itzam_false;
+
+            itzam_btree_close(&btree);
+
+            if (ITZAM_OKAY != itzam_btree_open(&btree, filename, itzam_comparator_int32, error_handler, itzam_false, itzam_false))
+                return itzam_false;
+
+            if (!check_tree(&btree))
+                return itzam_false;
+
+            itzam_btree_close(&btree);
+        }
+    }
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_reuse())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
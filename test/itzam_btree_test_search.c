@@ -0,0 +1,402 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY     20000
+#define NUM_KEYS    10000
+#define NUM_CHANGES 2000
+#define NUM_PROBES  10000
+
+static const char * filename = "search.itz";
+
+#include "itzam_test_model.h"
+
+/* a comparator Itzam does not recognize, so pages are searched by the chosen strategy
+ * rather than as built-in integer keys; it counts the comparisons made
+ */
+static uint64_t comparisons = 0;
+
+static int compare_int32(const void * key1, const void * key2)
+{
+    int32_t k1 = *(const int32_t *)key1;
+    int32_t k2 = *(const int32_t *)key2;
+
+    ++comparisons;
+
+    return (k1 > k2) - (k1 < k2);
+}
+
+static const char * strategy_names[] = { "automatic", "linear", "binary" };
+
+/*----------------------------------------------------------
+ * checks
+ */
+
+/* the strategy is recorded in the header, and governs how pages are searched */
+static itzam_bool check_strategy(itzam_btree * btree, itzam_search_strategy strategy)
+{
+    if ((itzam_search_strategy)(btree->m_header->m_flags & ITZAM_BTREE_FLAG_SEARCH_MASK) != strategy)
+    {
+        printf("ERROR: header records the %s strategy\n", strategy_names[btree->m_header->m_flags & ITZAM_BTREE_FLAG_SEARCH_MASK]);
+        return itzam_false;
+    }
+
+    if ((btree->m_binary_search != itzam_false) != (strategy == ITZAM_SEARCH_BINARY))
+    {
+        printf("ERROR: pages are not searched by the %s strategy\n", strategy_names[strategy]);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+/* the tree agrees with the model, through finds, a cursor walked both ways, and seeks */
+static itzam_bool check_keys(itzam_btree * btree)
+{
+    itzam_btree_cursor cursor;
+    int32_t key, found_key, expected, n;
+    itzam_bool result;
+
+    build_model();
+
+    if (itzam_btree_count(btree) != (uint64_t)model_count)
+    {
+        printf("ERROR: tree holds %ld keys, expected %d\n", (long)itzam_btree_count(btree), model_count);
+        return itzam_false;
+    }
+
+    for (key = 0; key < MAX_KEY; ++key)
+    {
+        if (!itzam_btree_find(btree, &key, &found_key) != !present[key])
+        {
+            printf("ERROR: find of %d disagrees with the model\n", key);
+            return itzam_false;
+        }
+    }
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    n = 0;
+
+    if (model_count > 0)
+    {
+        do
+        {
+            if ((n >= model_count) || (ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[n]))
+            {
+                printf("ERROR: cursor disagrees with the model at position %d\n", n);
+                return itzam_false;
+            }
+
+            ++n;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+    }
+
+    if (n != model_count)
+    {
+        printf("ERROR: cursor visited %d keys, expected %d\n", n, model_count);
+        return itzam_false;
+    }
+
+    n = model_count - 1;
+
+    if (itzam_btree_cursor_last(&cursor))
+    {
+        do
+        {
+            if ((n < 0) || (ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[n]))
+            {
+                printf("ERROR: backward cursor disagrees with the model at position %d\n", n);
+                return itzam_false;
+            }
+
+            --n;
+        }
+        while (itzam_btree_cursor_prev(&cursor));
+    }
+
+    if (n != -1)
+    {
+        printf("ERROR: backward cursor stopped at position %d\n", n);
+        return itzam_false;
+    }
+
+    for (n = 0; n < NUM_PROBES; ++n)
+    {
+        key = random_int32(MAX_KEY + 2) - 1;
+
+        // alternately the first key not below the probe, and the last key before it
+        if (n & 1)
+        {
+            expected = lower_bound(key);
+            result = itzam_btree_cursor_seek(&cursor, &key, ITZAM_KEY_GE);
+
+            if (expected == model_count)
+                expected = -1;
+        }
+        else
+        {
+            expected = lower_bound(key) - 1;
+            result = itzam_btree_cursor_seek(&cursor, &key, ITZAM_KEY_LT);
+        }
+
+        if (!result != (expected < 0))
+        {
+            printf("ERROR: seek for %d returned %d\n", key, (int)(result != 0));
+            return itzam_false;
+        }
+
+        if (result && ((ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &found_key)) || (found_key != model[expected])))
+        {
+            printf("ERROR: seek for %d read %d, expected %d\n", key, found_key, model[expected]);
+            return itzam_false;
+        }
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    return itzam_true;
+}
+
+/* comparisons made by each find, on average */
+static double comparisons_per_find(itzam_btree * btree)
+{
+    int32_t key, found_key, n;
+
+    comparisons = 0;
+
+    for (n = 0; n < NUM_PROBES; ++n)
+    {
+        key = random_int32(MAX_KEY);
+        itzam_btree_find(btree, &key, &found_key);
+    }
+
+    return (double)comparisons / NUM_PROBES;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* a tree built and changed with one strategy, which must still be in effect once the
+ * tree is reopened; returns the comparisons made by each find after reopening, or a
+ * negative number if the tree is wrong
+ */
+static double test_strategy(uint16_t order, itzam_search_strategy strategy)
+{
+    itzam_btree btree;
+    itzam_btree_options options;
+    itzam_state state;
+    double result;
+
+    printf("    %s search\n", strategy_names[strategy]);
+
+    itzam_btree_options_init(&options);
+    options.m_search = strategy;
+
+    state = itzam_btree_create_ex(&btree, filename, order, sizeof(int32_t), compare_int32, error_handler, &options);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    memset(present, 0, sizeof(present));
+    present_count = 0;
+
+    fill_tree(&btree, NUM_KEYS);
+    change_tree(&btree, NUM_CHANGES);
+
+    if (!check_strategy(&btree, strategy) || !check_keys(&btree))
+        return -1.0;
+
+    itzam_btree_close(&btree);
+
+    // the choice is kept in the file
+    state = itzam_btree_open(&btree, filename, compare_int32, error_handler, itzam_false, itzam_false);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(&btree, ITZAM_DURABILITY_NONE, 0);
+
+    if (!check_strategy(&btree, strategy) || !check_keys(&btree))
+        return -1.0;
+
+    change_tree(&btree, NUM_CHANGES);
+
+    if (!check_keys(&btree))
+        return -1.0;
+
+    result = comparisons_per_find(&btree);
+
+    itzam_btree_close(&btree);
+
+    return result;
+}
+
+itzam_bool test_btree_search()
+{
+    static const uint16_t orders[] = { 5, 200 };
+
+    double linear, binary;
+    int o;
+
+    printf("\nItzam/C B-Tree Test\nSearch Strategies\n");
+
+    for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+    {
+        printf("\nOrder %d\n", orders[o]);
+
+        linear = test_strategy(orders[o], ITZAM_SEARCH_LINEAR);
+
+        if (linear < 0.0)
+            return itzam_false;
+
+        binary = test_strategy(orders[o], ITZAM_SEARCH_BINARY);
+
+        if (binary < 0.0)
+            return itzam_false;
+
+        printf("    %.1f comparisons per find by linear search, %.1f by binary search\n", linear, binary);
+
+        // bisecting a large page takes far fewer comparisons than scanning it
+        if ((orders[o] >= ITZAM_BTREE_BINARY_SEARCH_ORDER) && (binary >= linear))
+        {
+            printf("ERROR: binary search made no fewer comparisons than linear search\n");
+            return itzam_false;
+        }
+    }
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_search())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
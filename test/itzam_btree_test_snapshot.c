@@ -0,0 +1,482 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY    20000
+#define NUM_KEYS   10000
+#define HALF_KEY   (MAX_KEY / 2)
+
+static const char * filename = "snapshot.itz";
+
+#include "itzam_test_model.h"
+
+/* which keys were in the tree when each snapshot began */
+static itzam_bool before[2][MAX_KEY];
+
+/*----------------------------------------------------------
+ * checking a snapshot against the keys it should see
+ */
+typedef struct t_scan_check
+{
+    const itzam_bool * m_model;
+    int32_t m_next;     /* next key the scan should visit */
+    int32_t m_high;
+    int32_t m_count;
+    int32_t m_stop;     /* stop after this many keys */
+    itzam_bool m_okay;
+}
+scan_check;
+
+static int32_t next_key(const itzam_bool * model, int32_t key, int32_t high)
+{
+    while ((key < high) && !model[key])
+        ++key;
+
+    return key;
+}
+
+static itzam_bool check_visit(void * context, const void * key)
+{
+    scan_check * check = (scan_check *)context;
+
+    if (*(const int32_t *)key != check->m_next)
+    {
+        printf("ERROR: snapshot scan visited %d, expected %d\n", *(const int32_t *)key, check->m_next);
+        check->m_okay = itzam_false;
+        return itzam_false;
+    }
+
+    check->m_next = next_key(check->m_model, check->m_next + 1, check->m_high);
+
+    return (++check->m_count != check->m_stop);
+}
+
+static itzam_bool check_snapshot(itzam_btree_snapshot * snapshot, const itzam_bool * model)
+{
+    scan_check check;
+    int32_t key, found_key, low, high, expected, n;
+    uint64_t visited;
+
+    // every key
+    for (key = 0, expected = 0; key < MAX_KEY; ++key)
+    {
+        if (!itzam_btree_snapshot_find(snapshot, &key, &found_key) != !model[key])
+        {
+            printf("ERROR: snapshot %s %d\n", model[key] ? "lost" : "found", key);
+            return itzam_false;
+        }
+
+        if (model[key])
+        {
+            ++expected;
+
+            if (found_key != key)
+            {
+                printf("ERROR: snapshot returned %d for %d\n", found_key, key);
+                return itzam_false;
+            }
+        }
+    }
+
+    if (itzam_btree_snapshot_count(snapshot) != (uint64_t)expected)
+    {
+        printf("ERROR: snapshot counts %lu keys, expected %d\n", (unsigned long)itzam_btree_snapshot_count(snapshot), expected);
+        return itzam_false;
+    }
+
+    // a full scan, then random ranges, some cut short by the visitor
+    for (n = 0; n < 100; ++n)
+    {
+        low  = (n == 0) ? 0 : random_int32(MAX_KEY);
+        high = (n == 0) ? MAX_KEY : low + random_int32(MAX_KEY - low + 1);
+
+        check.m_model = model;
+        check.m_next  = next_key(model, low, high);
+        check.m_high  = high;
+        check.m_count = 0;
+        check.m_stop  = (n % 4 == 3) ? 1 + random_int32(100) : -1;
+        check.m_okay  = itzam_true;
+
+        visited = itzam_btree_snapshot_scan(snapshot, (n == 0) ? NULL : &low, (n == 0) ? NULL : &high, check_visit, &check);
+
+        if (!check.m_okay)
+            return itzam_false;
+
+        if ((check.m_count != check.m_stop) && (check.m_next != high))
+        {
+            printf("ERROR: snapshot scan of [%d,%d) stopped before %d\n", low, high, check.m_next);
+            return itzam_false;
+        }
+
+        if (visited != (uint64_t)check.m_count)
+        {
+            printf("ERROR: snapshot scan returned %lu, visited %d\n", (unsigned long)visited, check.m_count);
+            return itzam_false;
+        }
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* two overlapping snapshots, each seeing the tree as it was when it began */
+static itzam_bool test_overlapping(itzam_btree * btree)
+{
+    itzam_btree_snapshot first, second;
+
+    printf("Overlapping snapshots...\n");
+
+    if (ITZAM_OKAY != itzam_btree_snapshot_begin(btree, &first))
+        return itzam_false;
+
+    memcpy(before[0], present, sizeof(present));
+
+    change_tree(btree, 200);
+
+    if (!check_snapshot(&first, before[0]))
+        return itzam_false;
+
+    if (ITZAM_OKAY != itzam_btree_snapshot_begin(btree, &second))
+        return itzam_false;
+
+    memcpy(before[1], present, sizeof(present));
+
+    change_tree(btree, 200);
+
+    if (!check_snapshot(&first, before[0]) || !check_snapshot(&second, before[1]))
+        return itzam_false;
+
+    itzam_btree_snapshot_end(&first);
+
+    change_tree(btree, 200);
+
+    if (!check_snapshot(&second, before[1]))
+        return itzam_false;
+
+    itzam_btree_snapshot_end(&second);
+
+    // a new snapshot sees every change so far
+    if (ITZAM_OKAY != itzam_btree_snapshot_begin(btree, &first))
+        return itzam_false;
+
+    if (!check_snapshot(&first, present))
+        return itzam_false;
+
+    itzam_btree_snapshot_end(&first);
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * snapshots taken while another thread writes; the writer changes keys in pairs, k and
+ * k + HALF_KEY, with one batch per pair, so a consistent snapshot always holds both or neither
+ */
+static volatile int writer_running = 1;
+static volatile long writer_ops = 0;
+
+static void * writer(void * arg)
+{
+    itzam_btree * btree = (itzam_btree *)arg;
+    unsigned int state = 1;
+    itzam_state results[2];
+    int32_t keys[2];
+
+    while (writer_running)
+    {
+        keys[0] = (int32_t)(rand_r(&state) % HALF_KEY);
+        keys[1] = keys[0] + HALF_KEY;
+
+        if (rand_r(&state) & 1)
+            itzam_btree_insert_batch(btree, keys, 2, results);
+        else
+            itzam_btree_remove_batch(btree, keys, 2, results);
+
+        ++writer_ops;
+    }
+
+    return NULL;
+}
+
+typedef struct t_pair_check
+{
+    itzam_bool m_seen[MAX_KEY];
+    int32_t m_last;
+    uint64_t m_count;
+    itzam_bool m_okay;
+}
+pair_check;
+
+static itzam_bool pair_visit(void * context, const void * key)
+{
+    pair_check * check = (pair_check *)context;
+    int32_t k = *(const int32_t *)key;
+
+    if (k <= check->m_last)
+        check->m_okay = itzam_false;
+
+    check->m_seen[k] = itzam_true;
+    check->m_last = k;
+    ++check->m_count;
+
+    // give the writer time to change what the scan has yet to read
+    if ((check->m_count % 500) == 0)
+        usleep(1000);
+
+    return itzam_true;
+}
+
+static itzam_bool test_concurrent(itzam_btree * btree)
+{
+    static pair_check check;
+
+    itzam_btree_snapshot snapshot;
+    pthread_t thread;
+    int32_t key, n, pair;
+    long ops_before;
+    itzam_bool okay = itzam_true;
+
+    printf("Snapshots while another thread writes...\n");
+
+    // start with whole pairs
+    for (key = 0; key < HALF_KEY; ++key)
+    {
+        if (random_int32(2))
+        {
+            pair = key + HALF_KEY;
+            itzam_btree_insert(btree, &key);
+            itzam_btree_insert(btree, &pair);
+        }
+        else
+        {
+            pair = key + HALF_KEY;
+            itzam_btree_remove(btree, &key);
+            itzam_btree_remove(btree, &pair);
+        }
+    }
+
+    writer_running = 1;
+    pthread_create(&thread, NULL, writer, btree);
+
+    while (writer_ops == 0)
+        sched_yield();
+
+    ops_before = writer_ops;
+
+    for (n = 0; okay && (n < 10); ++n)
+    {
+        if (ITZAM_OKAY != itzam_btree_snapshot_begin(btree, &snapshot))
+        {
+            okay = itzam_false;
+            break;
+        }
+
+        memset(&check, 0, sizeof(check));
+        check.m_last = -1;
+        check.m_okay = itzam_true;
+
+        itzam_btree_snapshot_scan(&snapshot, NULL, NULL, pair_visit, &check);
+
+        if (!check.m_okay || (check.m_count != itzam_btree_snapshot_count(&snapshot)))
+        {
+            printf("ERROR: snapshot scan read %lu keys out of order or of %lu\n", (unsigned long)check.m_count, (unsigned long)itzam_btree_snapshot_count(&snapshot));
+            okay = itzam_false;
+        }
+
+        for (key = 0; okay && (key < HALF_KEY); ++key)
+        {
+            if (!check.m_seen[key] != !check.m_seen[key + HALF_KEY])
+            {
+                printf("ERROR: snapshot saw half of the pair %d, %d\n", key, key + HALF_KEY);
+                okay = itzam_false;
+            }
+        }
+
+        // finds agree with the scan, whatever the writer has done since
+        for (key = 0; okay && (key < MAX_KEY); key += 7)
+        {
+            if (!itzam_btree_snapshot_find(&snapshot, &key, NULL) != !check.m_seen[key])
+            {
+                printf("ERROR: snapshot find of %d disagrees with its scan\n", key);
+                okay = itzam_false;
+            }
+        }
+
+        itzam_btree_snapshot_end(&snapshot);
+    }
+
+    printf("    %ld writes during 10 snapshots\n", writer_ops - ops_before);
+
+    writer_running = 0;
+    pthread_join(thread, NULL);
+
+    if (okay && (writer_ops == ops_before))
+    {
+        printf("ERROR: snapshots held off the writer\n");
+        okay = itzam_false;
+    }
+
+    return okay;
+}
+
+itzam_bool test_btree_snapshot()
+{
+    static const uint16_t orders[] = { 5, 6, 25 };
+
+    itzam_btree btree;
+    int o, linked;
+
+    printf("\nItzam/C B-Tree Test\nSnapshot Reads\n");
+
+    for (linked = 0; linked < 2; ++linked)
+    {
+        for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+        {
+            printf("\nOrder %d%s\n", orders[o], linked ? ", linked leaves" : "");
+
+            create_tree(&btree, orders[o], linked ? itzam_true : itzam_false);
+            fill_tree(&btree, NUM_KEYS);
+
+            if (!test_overlapping(&btree))
+                return itzam_false;
+
+            if ((o == sizeof(orders) / sizeof(orders[0]) - 1) && !test_concurrent(&btree))
+                return itzam_false;
+
+            itzam_btree_close(&btree);
+        }
+    }
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_snapshot())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
@@ -0,0 +1,434 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY    20000
+#define NUM_KEYS   10000
+
+static const char * filename = "stable.itz";
+
+#include "itzam_test_model.h"
+
+/* untouched keys were present when a walk started, and have not been inserted or
+ * removed since
+ */
+static itzam_bool untouched[MAX_KEY];
+
+/* one random change, to one key or to a batch */
+static itzam_bool change_once(itzam_btree * btree)
+{
+    int32_t keys[MODEL_BATCH_SIZE];
+    itzam_state results[MODEL_BATCH_SIZE];
+    int32_t n, count;
+    itzam_state state;
+
+    switch (random_int32(4))
+    {
+        case 0:
+            keys[0] = random_int32(MAX_KEY);
+            state = insert_key(btree, keys[0]);
+
+            if ((state != ITZAM_OKAY) && (state != ITZAM_DUPLICATE))
+            {
+                printf("ERROR: insert with an open cursor returned %s\n", STATE_MESSAGES[state]);
+                return itzam_false;
+            }
+
+            untouched[keys[0]] = itzam_false;
+            break;
+
+        case 1:
+            keys[0] = random_int32(MAX_KEY);
+            state = remove_key(btree, keys[0]);
+
+            if ((state != ITZAM_OKAY) && (state != ITZAM_NOT_FOUND))
+            {
+                printf("ERROR: remove with an open cursor returned %s\n", STATE_MESSAGES[state]);
+                return itzam_false;
+            }
+
+            untouched[keys[0]] = itzam_false;
+            break;
+
+        default:
+            count = 1 + random_int32(MODEL_BATCH_SIZE);
+            change_batch(btree, keys, count, random_int32(2) ? itzam_true : itzam_false, results);
+
+            for (n = 0; n < count; ++n)
+                untouched[keys[n]] = itzam_false;
+
+            break;
+    }
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* walk the whole tree, changing it between steps; every key read must be in the tree
+ * when it is read and beyond the last one read, and no untouched key may be skipped
+ */
+static itzam_bool test_walk(itzam_btree * btree, itzam_bool backwards)
+{
+    itzam_btree_cursor cursor;
+    int32_t key, last, expected, visited = 0;
+    itzam_bool more;
+
+    printf("Walking %s while changing the tree...\n", backwards ? "backwards" : "forwards");
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    memcpy(untouched, present, sizeof(present));
+
+    more = backwards ? itzam_btree_cursor_last(&cursor) : itzam_btree_cursor_reset(&cursor);
+    expected = backwards ? MAX_KEY - 1 : 0;
+    last = backwards ? MAX_KEY : -1;
+
+    while (more)
+    {
+        if (ITZAM_OKAY != itzam_btree_cursor_read(&cursor, &key))
+            break;
+
+        if (!present[key] || (backwards ? (key >= last) : (key <= last)))
+        {
+            printf("ERROR: cursor read %d after %d, %s\n", key, last, present[key] ? "out of order" : "which is not in the tree");
+            return itzam_false;
+        }
+
+        // no untouched key between the last one and this one
+        for (; backwards ? (expected > key) : (expected < key); expected += backwards ? -1 : 1)
+        {
+            if (untouched[expected])
+            {
+                printf("ERROR: cursor skipped %d\n", expected);
+                return itzam_false;
+            }
+        }
+
+        expected += backwards ? -1 : 1;
+        last = key;
+        ++visited;
+
+        if (!change_once(btree))
+            return itzam_false;
+
+        more = backwards ? itzam_btree_cursor_prev(&cursor) : itzam_btree_cursor_next(&cursor);
+    }
+
+    for (; backwards ? (expected >= 0) : (expected < MAX_KEY); expected += backwards ? -1 : 1)
+    {
+        if (untouched[expected])
+        {
+            printf("ERROR: cursor stopped before %d\n", expected);
+            return itzam_false;
+        }
+    }
+
+    // past the end, the cursor stays there
+    if (itzam_btree_cursor_next(&cursor) || itzam_btree_cursor_prev(&cursor))
+    {
+        printf("ERROR: cursor moved from past the end\n");
+        return itzam_false;
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    printf("    %d keys read\n", visited);
+
+    return itzam_true;
+}
+
+/* a key removed from under a cursor is replaced by the one after it */
+static itzam_bool test_removed(itzam_btree * btree)
+{
+    itzam_btree_cursor cursor;
+    int32_t key, found_key, n;
+
+    printf("Removing the key under a cursor...\n");
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    for (n = 0; n < 1000; ++n)
+    {
+        key = random_int32(MAX_KEY);
+
+        if (!itzam_btree_cursor_seek(&cursor, &key, ITZAM_KEY_GE))
+            continue;
+
+        itzam_btree_cursor_read(&cursor, &key);
+        itzam_btree_remove(btree, &key);
+        present[key] = itzam_false;
+
+        // the next key in the model, if any
+        while ((key < MAX_KEY) && !present[key])
+            ++key;
+
+        if (itzam_btree_cursor_read(&cursor, &found_key) != ((key < MAX_KEY) ? ITZAM_OKAY : ITZAM_NOT_FOUND))
+        {
+            printf("ERROR: read after removal disagrees with the model\n");
+            return itzam_false;
+        }
+
+        if ((key < MAX_KEY) && (found_key != key))
+        {
+            printf("ERROR: read %d after removal, expected %d\n", found_key, key);
+            return itzam_false;
+        }
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * a writer thread runs while a slow full scan is in progress; it must make progress
+ */
+static volatile int writer_running = 1;
+static volatile long writer_ops = 0;
+
+static void * writer(void * arg)
+{
+    itzam_btree * btree = (itzam_btree *)arg;
+    unsigned int state = 1;
+    int32_t key;
+
+    while (writer_running)
+    {
+        key = (int32_t)(rand_r(&state) % MAX_KEY);
+
+        if (rand_r(&state) & 1)
+            itzam_btree_insert(btree, &key);
+        else
+            itzam_btree_remove(btree, &key);
+
+        ++writer_ops;
+    }
+
+    return NULL;
+}
+
+typedef struct t_scan_state
+{
+    int32_t m_last;
+    int32_t m_count;
+    itzam_bool m_okay;
+}
+scan_state;
+
+static itzam_bool slow_visit(void * context, const void * key)
+{
+    scan_state * state = (scan_state *)context;
+
+    if (*(const int32_t *)key <= state->m_last)
+        state->m_okay = itzam_false;
+
+    state->m_last = *(const int32_t *)key;
+
+    if ((++state->m_count % 500) == 0)
+        usleep(1000);
+
+    return itzam_true;
+}
+
+static itzam_bool test_concurrent(itzam_btree * btree)
+{
+    pthread_t thread;
+    scan_state state;
+    long ops_before;
+
+    printf("Scanning while another thread writes...\n");
+
+    writer_running = 1;
+    pthread_create(&thread, NULL, writer, btree);
+
+    // let the writer start
+    while (writer_ops == 0)
+        sched_yield();
+
+    state.m_last  = -1;
+    state.m_count = 0;
+    state.m_okay  = itzam_true;
+
+    ops_before = writer_ops;
+    itzam_btree_scan_range(btree, NULL, NULL, slow_visit, &state);
+
+    printf("    %ld writes during a scan of %d keys\n", writer_ops - ops_before, state.m_count);
+
+    if (!state.m_okay || (writer_ops == ops_before))
+    {
+        printf("ERROR: scan %s\n", state.m_okay ? "held off the writer" : "read keys out of order");
+        writer_running = 0;
+        pthread_join(thread, NULL);
+        return itzam_false;
+    }
+
+    writer_running = 0;
+    pthread_join(thread, NULL);
+
+    return itzam_true;
+}
+
+itzam_bool test_btree_stable()
+{
+    static const uint16_t orders[] = { 5, 6, 25 };
+
+    itzam_btree btree;
+    int o, linked;
+
+    printf("\nItzam/C B-Tree Test\nCursors During Changes\n");
+
+    for (linked = 0; linked < 2; ++linked)
+    {
+        for (o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o)
+        {
+            printf("\nOrder %d%s\n", orders[o], linked ? ", linked leaves" : "");
+
+            create_tree(&btree, orders[o], linked ? itzam_true : itzam_false);
+            fill_tree(&btree, NUM_KEYS);
+
+            if (!test_walk(&btree, itzam_false) || !test_walk(&btree, itzam_true) || !test_removed(&btree))
+                return itzam_false;
+
+            if ((o == sizeof(orders) / sizeof(orders[0]) - 1) && !test_concurrent(&btree))
+                return itzam_false;
+
+            itzam_btree_close(&btree);
+        }
+    }
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_stable())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
@@ -155,18 +155,48 @@ itzam_bool test_btree_thread(itzam_btree * btree, int maxkey, int test_size, int
         return itzam_false;
 }
 
+itzam_bool test_find_thread(itzam_btree * btree, int maxkey, int test_size, int * completed)
+{
+    int32_t key;
+    int i;
+
+    if (btree == NULL)
+        return itzam_false;
+
+    for (i = 0; i < test_size; ++i)
+    {
+        key = (int32_t)random_int32((int32_t)maxkey);
+        itzam_btree_find(btree, (const void *)&key, NULL);
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    if (completed != NULL)
+        (*completed)++;
+
+    pthread_mutex_unlock(&mutex);
+
+    return itzam_true;
+}
+
 struct threadArgs
 {
     itzam_btree * btree;
     int maxkey;
     int test_size;
     int * completed;
+    itzam_bool find_only;
 };
 
 void * threadProc(void * a)
 {
     struct threadArgs * args = (struct threadArgs *)a;
-    test_btree_thread(args->btree, args->maxkey, args->test_size, args->completed);
+
+    if (args->find_only)
+        test_find_thread(args->btree, args->maxkey, args->test_size, args->completed);
+    else
+        test_btree_thread(args->btree, args->maxkey, args->test_size, args->completed);
+
     return NULL;
 }
 
@@ -249,23 +279,45 @@ static itzam_bool test_threaded()
         args[n].maxkey = maxkey;
         args[n].test_size = test_size;
         args[n].completed = &completed;
+        args[n].find_only = itzam_false;
         pthread_create(&thread[n], &attr, threadProc, &args[n]);
     }
 
     while (completed < num_threads)
         usleep(100000);
 
-    itzam_btree_close(&btree);
-
-    free(thread);
-    free(args);
-
     /* stats
      */
     time_t melapsed = time(NULL) - start;
 
     printf("done\n\n%8d seconds run time\n\n", (int)melapsed);
 
+    /* now a read-only load; finds share the index and should run in parallel
+     */
+    printf("Performing multi-thread find test... ");
+    fflush(stdout);
+
+    completed = 0;
+    start = time(NULL);
+
+    for (n = 0; n < num_threads; ++n)
+    {
+        args[n].find_only = itzam_true;
+        pthread_create(&thread[n], &attr, threadProc, &args[n]);
+    }
+
+    while (completed < num_threads)
+        usleep(100000);
+
+    melapsed = time(NULL) - start;
+
+    printf("done\n\n%8d seconds run time\n\n", (int)melapsed);
+
+    itzam_btree_close(&btree);
+
+    free(thread);
+    free(args);
+
     return itzam_true;
 }
 
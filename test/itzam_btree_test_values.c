@@ -0,0 +1,536 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY        10000
+#define NUM_KEYS       10000
+#define MAX_KEY_SIZE   64
+#define MAX_VALUE_SIZE 5000
+
+static const char * filename = "values.itz";
+static const char * plain_filename = "values-plain.itz";
+
+/* the model: whether each key is present, and which version of its value it holds */
+static itzam_bool present[MAX_KEY];
+static int32_t version[MAX_KEY];
+
+static void make_key(int32_t n, char * key)
+{
+    sprintf(key, "key-%06d", n);
+}
+
+/* the value for a version of a key; most are short, and one in seven is long */
+static itzam_int make_value(int32_t n, int32_t v, char * value)
+{
+    uint32_t hash = ((uint32_t)n * 2654435761u) ^ ((uint32_t)v * 40503u);
+    itzam_int length = (hash % 7) ? (itzam_int)(hash % 48) : 200 + (itzam_int)(hash % (MAX_VALUE_SIZE - 200));
+    itzam_int i;
+
+    for (i = 0; i < length; ++i)
+        value[i] = (char)(hash >> (i % 24)) + (char)i;
+
+    return length;
+}
+
+static itzam_error last_error;
+
+static void record_error(const char * function_name, itzam_error error)
+{
+    last_error = error;
+}
+
+static void create_tree(itzam_btree * btree, uint32_t page_size, itzam_int inline_values, itzam_bool compress)
+{
+    itzam_btree_options options;
+    itzam_state state;
+
+    itzam_btree_options_init(&options);
+    options.m_inline_values = inline_values;
+    options.m_compress_keys = compress;
+
+    state = itzam_btree_create_varkey(btree, filename, page_size, MAX_KEY_SIZE, itzam_comparator_string, NULL, error_handler, &options);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(btree, ITZAM_DURABILITY_NONE, 0);
+
+    memset(present, 0, sizeof(present));
+}
+
+static itzam_bool put_value(itzam_btree * btree, int32_t n, int32_t v)
+{
+    char key[MAX_KEY_SIZE], value[MAX_VALUE_SIZE];
+    itzam_int length = make_value(n, v, value);
+
+    make_key(n, key);
+
+    return (ITZAM_OKAY == itzam_btree_put(btree, key, value, length)) ? itzam_true : itzam_false;
+}
+
+static void change_tree(itzam_btree * btree, int changes, int removals)
+{
+    char key[MAX_KEY_SIZE];
+    int32_t n;
+
+    while (changes-- > 0)
+    {
+        n = random_int32(MAX_KEY);
+
+        if (random_int32(100) >= removals)
+        {
+            if (put_value(btree, n, version[n] + 1))
+            {
+                present[n] = itzam_true;
+                ++version[n];
+            }
+        }
+        else
+        {
+            make_key(n, key);
+
+            if (ITZAM_OKAY == itzam_btree_remove(btree, key))
+                present[n] = itzam_false;
+        }
+    }
+}
+
+/* every key has the value the model says, or none, and cursors see every key once */
+static itzam_bool check_tree(itzam_btree * btree)
+{
+    char key[MAX_KEY_SIZE], expected[MAX_VALUE_SIZE], value[MAX_VALUE_SIZE];
+    itzam_btree_cursor cursor;
+    itzam_int expected_length, length;
+    itzam_state state;
+    uint64_t count = 0;
+    int32_t n;
+
+    for (n = 0; n < MAX_KEY; ++n)
+    {
+        make_key(n, key);
+        length = -1;
+
+        state = itzam_btree_get(btree, key, value, MAX_VALUE_SIZE, &length);
+
+        if ((state == ITZAM_OKAY) != !!present[n])
+        {
+            printf("ERROR: %s %d\n", present[n] ? "lost" : "found", n);
+            return itzam_false;
+        }
+
+        if (present[n])
+        {
+            expected_length = make_value(n, version[n], expected);
+
+            if ((length != expected_length) || (memcmp(value, expected, length) != 0))
+            {
+                printf("ERROR: %s has a value of %d bytes, not version %d of %d bytes\n", key, (int)length, (int)version[n], (int)expected_length);
+                return itzam_false;
+            }
+
+            // keys come back without their values
+            if (!itzam_btree_find(btree, key, value) || (strcmp(key, value) != 0))
+            {
+                printf("ERROR: find returned %s for %s\n", value, key);
+                return itzam_false;
+            }
+
+            ++count;
+        }
+    }
+
+    if (count != itzam_btree_count(btree))
+    {
+        printf("ERROR: %d keys in the model, %d in the tree\n", (int)count, (int)itzam_btree_count(btree));
+        return itzam_false;
+    }
+
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    n = 0;
+
+    if (itzam_btree_cursor_valid(&cursor))
+    {
+        do
+        {
+            itzam_btree_cursor_read(&cursor, value);
+
+            if ((n > 0) && (strcmp(key, value) >= 0))
+            {
+                printf("ERROR: cursor went from %s to %s\n", key, value);
+                return itzam_false;
+            }
+
+            strcpy(key, value);
+            ++n;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    if (n != count)
+    {
+        printf("ERROR: cursor saw %d of %d keys\n", n, (int)count);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+static long file_size(const char * name)
+{
+    long result = -1;
+    FILE * file = fopen(name, "rb");
+
+    if (file != NULL)
+    {
+        fseek(file, 0, SEEK_END);
+        result = ftell(file);
+        fclose(file);
+    }
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* put, replace and remove values, roll back a transaction, and reopen the file */
+static itzam_bool test_changes(itzam_btree * btree)
+{
+    int32_t n;
+
+    printf("Putting values...\n");
+
+    for (n = 0; n < 4; ++n)
+    {
+        change_tree(btree, NUM_KEYS / 2, 20);
+
+        if (!check_tree(btree))
+            return itzam_false;
+    }
+
+    printf("Removing values...\n");
+
+    for (n = 0; n < 4; ++n)
+    {
+        change_tree(btree, NUM_KEYS / 2, 75);
+
+        if (!check_tree(btree))
+            return itzam_false;
+    }
+
+    printf("Rolling back a transaction...\n");
+
+    itzam_btree_transaction_start(btree);
+
+    for (n = 0; n < 2000; ++n)
+    {
+        char key[MAX_KEY_SIZE];
+        int32_t k = random_int32(MAX_KEY);
+
+        if (random_int32(2))
+            put_value(btree, k, version[k] + 1000);
+        else
+        {
+            make_key(k, key);
+            itzam_btree_remove(btree, key);
+        }
+    }
+
+    itzam_btree_transaction_rollback(btree);
+
+    if (!check_tree(btree))
+        return itzam_false;
+
+    printf("Reopening the file...\n");
+
+    itzam_btree_close(btree);
+
+    if (ITZAM_OKAY != itzam_btree_open(btree, filename, itzam_comparator_string, error_handler, itzam_false, itzam_false))
+        return itzam_false;
+
+    itzam_btree_set_durability(btree, ITZAM_DURABILITY_NONE, 0);
+
+    return check_tree(btree);
+}
+
+/* a long value replaced by one of the same length is rewritten in its record */
+static itzam_bool test_replace(itzam_btree * btree)
+{
+    static const char * key = "replaced";
+
+    char value[MAX_VALUE_SIZE], returned[MAX_VALUE_SIZE];
+    itzam_int length = 0;
+    long size;
+
+    printf("Replacing a long value...\n");
+
+    memset(value, 'a', MAX_VALUE_SIZE);
+
+    if (ITZAM_OKAY != itzam_btree_put(btree, key, value, MAX_VALUE_SIZE))
+        return itzam_false;
+
+    size = file_size(filename);
+
+    memset(value, 'b', MAX_VALUE_SIZE);
+
+    if (ITZAM_OKAY != itzam_btree_put(btree, key, value, MAX_VALUE_SIZE))
+        return itzam_false;
+
+    if (size != file_size(filename))
+    {
+        printf("ERROR: replacing a value of the same length wrote a new record\n");
+        return itzam_false;
+    }
+
+    if ((ITZAM_OKAY != itzam_btree_get(btree, key, returned, MAX_VALUE_SIZE, &length))
+     || (length != MAX_VALUE_SIZE) || (memcmp(value, returned, length) != 0))
+    {
+        printf("ERROR: the replaced value did not come back\n");
+        return itzam_false;
+    }
+
+    // a short buffer takes what it can hold, and the length says how much there is
+    memset(returned, 0, MAX_VALUE_SIZE);
+
+    if ((ITZAM_OKAY != itzam_btree_get(btree, key, returned, 10, &length))
+     || (length != MAX_VALUE_SIZE) || (memcmp(value, returned, 10) != 0) || (returned[10] != 0))
+    {
+        printf("ERROR: a short buffer was not filled as far as it goes\n");
+        return itzam_false;
+    }
+
+    length = 0;
+
+    if ((ITZAM_OKAY != itzam_btree_get(btree, key, NULL, 0, &length)) || (length != MAX_VALUE_SIZE))
+    {
+        printf("ERROR: the length of a value was not reported\n");
+        return itzam_false;
+    }
+
+    // an empty value is still a value
+    if ((ITZAM_OKAY != itzam_btree_put(btree, key, NULL, 0))
+     || (ITZAM_OKAY != itzam_btree_get(btree, key, returned, MAX_VALUE_SIZE, &length)) || (length != 0))
+    {
+        printf("ERROR: an empty value did not come back\n");
+        return itzam_false;
+    }
+
+    return (ITZAM_OKAY == itzam_btree_remove(btree, key)) ? itzam_true : itzam_false;
+}
+
+/* keys without values, and keys too long to carry a reference, are refused */
+static itzam_bool test_refusals(itzam_btree * btree)
+{
+    char key[MAX_KEY_SIZE + 1100];
+    itzam_btree plain;
+    itzam_bool result = itzam_true;
+
+    printf("Refusing what does not fit...\n");
+
+    itzam_btree_set_error_handler(btree, record_error);
+
+    last_error = ITZAM_ERROR_SIGNATURE;
+
+    if ((ITZAM_OKAY == itzam_btree_insert(btree, "bare")) || (last_error != ITZAM_ERROR_VALUES))
+    {
+        printf("ERROR: a key without a value was inserted\n");
+        result = itzam_false;
+    }
+
+    memset(key, 'x', sizeof(key) - 1);
+    key[sizeof(key) - 1] = 0;
+    last_error = ITZAM_ERROR_SIGNATURE;
+
+    if ((ITZAM_OKAY == itzam_btree_put(btree, key, key, sizeof(key))) || (last_error != ITZAM_ERROR_TOO_LONG))
+    {
+        printf("ERROR: a key of %d bytes was not refused\n", (int)sizeof(key));
+        result = itzam_false;
+    }
+
+    itzam_btree_set_error_handler(btree, error_handler);
+
+    if (ITZAM_OKAY != itzam_btree_create_varkey(&plain, plain_filename, 0, MAX_KEY_SIZE, itzam_comparator_string, NULL, record_error, NULL))
+        return itzam_false;
+
+    last_error = ITZAM_ERROR_SIGNATURE;
+
+    if ((ITZAM_OKAY == itzam_btree_put(&plain, "key", "value", 6)) || (last_error != ITZAM_ERROR_VALUES))
+    {
+        printf("ERROR: a value was put in a tree of keys\n");
+        result = itzam_false;
+    }
+
+    itzam_btree_close(&plain);
+
+    return result;
+}
+
+itzam_bool test_btree_values()
+{
+    static const uint32_t page_sizes[]      = { 2048, 0, 0 };
+    static const itzam_int inline_values[]  = { 16, 64, 1024 };
+    static const itzam_bool compress[]      = { itzam_false, itzam_true, itzam_false };
+
+    itzam_btree btree;
+    int p;
+
+    printf("\nItzam/C B-Tree Test\nKeys with Values\n");
+
+    for (p = 0; p < sizeof(page_sizes) / sizeof(page_sizes[0]); ++p)
+    {
+        printf("\nPages of %d bytes, values of up to %d bytes in the page%s\n",
+               page_sizes[p] ? (int)page_sizes[p] : (int)ITZAM_BTREE_VARKEY_PAGE_DEFAULT, (int)inline_values[p],
+               compress[p] ? ", with shared prefixes compressed" : "");
+
+        memset(version, 0, sizeof(version));
+        create_tree(&btree, page_sizes[p], inline_values[p], compress[p]);
+
+        if (!test_refusals(&btree))
+            return itzam_false;
+
+        if (!test_replace(&btree))
+            return itzam_false;
+
+        if (!test_changes(&btree))
+            return itzam_false;
+
+        itzam_btree_close(&btree);
+    }
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_values())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
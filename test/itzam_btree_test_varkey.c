@@ -0,0 +1,607 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define MAX_KEY    20000
+#define NUM_KEYS   20000
+#define MAX_KEY_SIZE 1024
+
+static const char * filename = "varkey.itz";
+static const char * fixed_filename = "varkey-fixed.itz";
+
+static itzam_bool present[MAX_KEY];
+
+/* keys in the style of paths, which share long prefixes */
+static itzam_bool prefixed = itzam_false;
+
+#define TENANTS 7
+
+/* the key for a number; most keys are short, and one in thirteen is long */
+static void make_key(int32_t n, char * key, itzam_int max_key_size)
+{
+    uint32_t hash = (uint32_t)n * 2654435761u;
+    int length = (n % 13) ? 8 + (int)(hash % 24) : 8 + (int)(hash % (max_key_size - 8));
+    int i;
+
+    if (prefixed)
+    {
+        i = sprintf(key, "tenant-%02d/orders/2026/%06d/", n % TENANTS, n);
+        length += i;
+
+        if (length > max_key_size)
+            length = max_key_size;
+    }
+    else
+        i = sprintf(key, "%06d", n);
+
+    for (; i < length - 1; ++i)
+        key[i] = 'a' + (char)((hash >> (i % 24)) % 26);
+
+    key[length - 1] = 0;
+}
+
+static itzam_error last_error;
+
+static void record_error(const char * function_name, itzam_error error)
+{
+    last_error = error;
+}
+
+static void create_tree(itzam_btree * btree, const char * name, uint32_t page_size, itzam_int max_key_size, itzam_bool compress)
+{
+    itzam_btree_options options;
+    itzam_state state;
+
+    itzam_btree_options_init(&options);
+    options.m_compress_keys = compress;
+
+    state = itzam_btree_create_varkey(btree, name, page_size, max_key_size, itzam_comparator_string, NULL, error_handler, &options);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(btree, ITZAM_DURABILITY_NONE, 0);
+
+    memset(present, 0, sizeof(present));
+}
+
+static void change_tree(itzam_btree * btree, int changes, itzam_int max_key_size, int removals)
+{
+    char key[MAX_KEY_SIZE + 1];
+    int32_t n;
+
+    while (changes-- > 0)
+    {
+        n = random_int32(MAX_KEY);
+        make_key(n, key, max_key_size);
+
+        if (random_int32(100) >= removals)
+        {
+            if (ITZAM_OKAY == itzam_btree_insert(btree, key))
+                present[n] = itzam_true;
+        }
+        else
+        {
+            if (ITZAM_OKAY == itzam_btree_remove(btree, key))
+                present[n] = itzam_false;
+        }
+    }
+}
+
+/* every key is found, or not, as the model says, and cursors see them all in order */
+static itzam_bool check_tree(itzam_btree * btree, itzam_int max_key_size)
+{
+    char key[MAX_KEY_SIZE + 1], found_key[MAX_KEY_SIZE + 1], prev_key[MAX_KEY_SIZE + 1];
+    itzam_btree_cursor cursor;
+    uint64_t count = 0;
+    int32_t n;
+
+    for (n = 0; n < MAX_KEY; ++n)
+    {
+        make_key(n, key, max_key_size);
+        found_key[0] = 0;
+
+        if (!itzam_btree_find(btree, key, found_key) != !present[n])
+        {
+            printf("ERROR: %s %d\n", present[n] ? "lost" : "found", n);
+            return itzam_false;
+        }
+
+        if (present[n])
+        {
+            if (strcmp(found_key, key) != 0)
+            {
+                printf("ERROR: find returned %s for %s\n", found_key, key);
+                return itzam_false;
+            }
+
+            ++count;
+        }
+    }
+
+    if (count != itzam_btree_count(btree))
+    {
+        printf("ERROR: %d keys in the model, %d in the tree\n", (int)count, (int)itzam_btree_count(btree));
+        return itzam_false;
+    }
+
+    // forward, then back, checking order and count
+    if (ITZAM_OKAY != itzam_btree_cursor_create(&cursor, btree))
+        return itzam_false;
+
+    n = 0;
+
+    if (itzam_btree_cursor_valid(&cursor))
+    {
+        do
+        {
+            itzam_btree_cursor_read(&cursor, key);
+
+            if ((n > 0) && (strcmp(prev_key, key) >= 0))
+            {
+                printf("ERROR: cursor went from %s to %s\n", prev_key, key);
+                return itzam_false;
+            }
+
+            strcpy(prev_key, key);
+            ++n;
+        }
+        while (itzam_btree_cursor_next(&cursor));
+    }
+
+    if (n != count)
+    {
+        printf("ERROR: cursor saw %d of %d keys\n", n, (int)count);
+        return itzam_false;
+    }
+
+    n = 0;
+
+    if (itzam_btree_cursor_last(&cursor))
+    {
+        do
+        {
+            itzam_btree_cursor_read(&cursor, key);
+
+            if ((n > 0) && (strcmp(prev_key, key) <= 0))
+            {
+                printf("ERROR: cursor went back from %s to %s\n", prev_key, key);
+                return itzam_false;
+            }
+
+            strcpy(prev_key, key);
+            ++n;
+        }
+        while (itzam_btree_cursor_prev(&cursor));
+    }
+
+    itzam_btree_cursor_free(&cursor);
+
+    if (n != count)
+    {
+        printf("ERROR: cursor saw %d of %d keys going back\n", n, (int)count);
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+static long file_size(const char * name)
+{
+    long result = -1;
+    FILE * file = fopen(name, "rb");
+
+    if (file != NULL)
+    {
+        fseek(file, 0, SEEK_END);
+        result = ftell(file);
+        fclose(file);
+    }
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* grow and shrink the tree, roll back a transaction, and reopen the file */
+static itzam_bool test_changes(itzam_btree * btree, itzam_int max_key_size)
+{
+    char key[MAX_KEY_SIZE + 1];
+    int32_t n;
+
+    printf("Growing the tree...\n");
+
+    for (n = 0; n < 4; ++n)
+    {
+        change_tree(btree, NUM_KEYS / 2, max_key_size, 25);
+
+        if (!check_tree(btree, max_key_size))
+            return itzam_false;
+    }
+
+    printf("Shrinking the tree...\n");
+
+    for (n = 0; n < 4; ++n)
+    {
+        change_tree(btree, NUM_KEYS / 2, max_key_size, 75);
+
+        if (!check_tree(btree, max_key_size))
+            return itzam_false;
+    }
+
+    printf("Rolling back a transaction...\n");
+
+    itzam_btree_transaction_start(btree);
+
+    for (n = 0; n < 2000; ++n)
+    {
+        make_key(random_int32(MAX_KEY), key, max_key_size);
+
+        if (random_int32(2))
+            itzam_btree_insert(btree, key);
+        else
+            itzam_btree_remove(btree, key);
+    }
+
+    itzam_btree_transaction_rollback(btree);
+
+    if (!check_tree(btree, max_key_size))
+        return itzam_false;
+
+    printf("Reopening the file...\n");
+
+    itzam_btree_close(btree);
+
+    if (ITZAM_OKAY != itzam_btree_open(btree, filename, itzam_comparator_string, error_handler, itzam_false, itzam_false))
+        return itzam_false;
+
+    itzam_btree_set_durability(btree, ITZAM_DURABILITY_NONE, 0);
+
+    if (!check_tree(btree, max_key_size))
+        return itzam_false;
+
+    // the same pages, read in place
+    itzam_btree_set_mapped(btree, itzam_true);
+
+    if (!check_tree(btree, max_key_size))
+        return itzam_false;
+
+    itzam_btree_set_mapped(btree, itzam_false);
+
+    printf("Emptying the tree...\n");
+
+    for (n = 0; n < MAX_KEY; ++n)
+    {
+        if (present[n])
+        {
+            make_key(n, key, max_key_size);
+
+            if (ITZAM_OKAY != itzam_btree_remove(btree, key))
+                return itzam_false;
+
+            present[n] = itzam_false;
+        }
+    }
+
+    if (btree->m_root.m_header->m_key_count != 0)
+    {
+        printf("ERROR: the empty tree has %d keys in its root\n", btree->m_root.m_header->m_key_count);
+        return itzam_false;
+    }
+
+    change_tree(btree, NUM_KEYS / 4, max_key_size, 25);
+
+    return check_tree(btree, max_key_size);
+}
+
+/* keys that are too long, and batches, are refused */
+static itzam_bool test_refusals(itzam_btree * btree, itzam_int max_key_size)
+{
+    char key[MAX_KEY_SIZE + 1];
+    itzam_bool result = itzam_true;
+
+    printf("Refusing what does not fit...\n");
+
+    itzam_btree_set_error_handler(btree, record_error);
+
+    memset(key, 'x', max_key_size);
+    key[max_key_size] = 0;
+    last_error = ITZAM_ERROR_SIGNATURE;
+
+    if ((ITZAM_OKAY == itzam_btree_insert(btree, key)) || (last_error != ITZAM_ERROR_TOO_LONG))
+    {
+        printf("ERROR: a key of %d bytes was not refused\n", (int)max_key_size + 1);
+        result = itzam_false;
+    }
+
+    key[max_key_size - 1] = 0;
+
+    if (ITZAM_OKAY != itzam_btree_insert(btree, key))
+    {
+        printf("ERROR: a key of %d bytes was refused\n", (int)max_key_size);
+        result = itzam_false;
+    }
+
+    last_error = ITZAM_ERROR_SIGNATURE;
+
+    if ((ITZAM_OKAY == itzam_btree_insert_batch(btree, key, 1, NULL)) || (last_error != ITZAM_ERROR_VARKEY))
+    {
+        printf("ERROR: a batch was not refused\n");
+        result = itzam_false;
+    }
+
+    itzam_btree_remove(btree, key);
+    itzam_btree_set_error_handler(btree, error_handler);
+
+    return result;
+}
+
+/* the same keys, padded to a fixed length and not */
+static void test_size(itzam_int max_key_size)
+{
+    char * key = (char *)calloc(1, max_key_size);
+    itzam_btree fixed, varkey;
+    int32_t n;
+
+    printf("Comparing with padded keys...\n");
+
+    if (ITZAM_OKAY != itzam_btree_create(&fixed, fixed_filename, 25, max_key_size, itzam_comparator_string, error_handler))
+        return;
+
+    create_tree(&varkey, filename, 0, max_key_size, itzam_false);
+
+    itzam_btree_set_durability(&fixed, ITZAM_DURABILITY_NONE, 0);
+
+    for (n = 0; n < NUM_KEYS; ++n)
+    {
+        memset(key, 0, max_key_size);
+        make_key(n, key, max_key_size);
+        itzam_btree_insert(&fixed, key);
+        itzam_btree_insert(&varkey, key);
+    }
+
+    printf("    %d keys of up to %d bytes: %ld bytes padded (order %d), %ld bytes slotted (order %d)\n",
+           NUM_KEYS, (int)max_key_size,
+           file_size(fixed_filename), fixed.m_header->m_order,
+           file_size(filename), varkey.m_header->m_order);
+
+    itzam_btree_close(&fixed);
+    itzam_btree_close(&varkey);
+
+    free(key);
+}
+
+static itzam_bool count_key(void * context, const void * key)
+{
+    ++*(int *)context;
+    return itzam_true;
+}
+
+/* keys that share prefixes, stored whole and compressed */
+static itzam_bool test_compression(itzam_int max_key_size)
+{
+    static const char * misses[] = { "", "a", "tenant-", "tenant-03/", "tenant-03/orders/2026/", "tenant-99", "zzz" };
+
+    char key[MAX_KEY_SIZE + 1];
+    itzam_btree plain, compressed;
+    itzam_bool result = itzam_true;
+    long plain_size, compressed_size;
+    int count = 0;
+    int32_t n;
+
+    printf("Comparing with compressed keys...\n");
+
+    create_tree(&plain, fixed_filename, 0, max_key_size, itzam_false);
+    create_tree(&compressed, filename, 0, max_key_size, itzam_true);
+
+    for (n = 0; n < NUM_KEYS; ++n)
+    {
+        make_key(n, key, max_key_size);
+        itzam_btree_insert(&plain, key);
+        itzam_btree_insert(&compressed, key);
+    }
+
+    // keys below, between and above the prefixes pages share are not there
+    for (n = 0; n < sizeof(misses) / sizeof(misses[0]); ++n)
+    {
+        if (itzam_btree_find(&compressed, misses[n], NULL))
+        {
+            printf("ERROR: found \"%s\"\n", misses[n]);
+            result = itzam_false;
+        }
+    }
+
+    if (itzam_btree_scan_range(&compressed, "tenant-03/", "tenant-04/", count_key, &count) != NUM_KEYS / TENANTS)
+    {
+        printf("ERROR: a scan of one tenant saw %d keys\n", count);
+        result = itzam_false;
+    }
+
+    itzam_btree_close(&plain);
+    itzam_btree_close(&compressed);
+
+    plain_size = file_size(fixed_filename);
+    compressed_size = file_size(filename);
+
+    printf("    %d keys of up to %d bytes: %ld bytes whole, %ld bytes compressed\n",
+           NUM_KEYS, (int)max_key_size, plain_size, compressed_size);
+
+    if (compressed_size >= plain_size)
+    {
+        printf("ERROR: compression saved nothing\n");
+        result = itzam_false;
+    }
+
+    return result;
+}
+
+itzam_bool test_btree_varkey()
+{
+    static const uint32_t page_sizes[]    = { 2048, 4096, 0, 2048, 0 };
+    static const itzam_int max_key_sizes[] = { 200, 512, MAX_KEY_SIZE, 200, MAX_KEY_SIZE };
+    static const itzam_bool compress[]     = { itzam_false, itzam_false, itzam_false, itzam_true, itzam_true };
+
+    itzam_btree btree;
+    int p;
+
+    printf("\nItzam/C B-Tree Test\nVariable-Length Keys\n");
+
+    for (p = 0; p < sizeof(page_sizes) / sizeof(page_sizes[0]); ++p)
+    {
+        printf("\nPages of %d bytes, keys of up to %d bytes%s\n", page_sizes[p] ? (int)page_sizes[p] : (int)ITZAM_BTREE_VARKEY_PAGE_DEFAULT, (int)max_key_sizes[p],
+               compress[p] ? ", with shared prefixes compressed" : "");
+
+        prefixed = compress[p];
+        create_tree(&btree, filename, page_sizes[p], max_key_sizes[p], compress[p]);
+
+        if (!test_refusals(&btree, max_key_sizes[p]))
+            return itzam_false;
+
+        if (!test_changes(&btree, max_key_sizes[p]))
+            return itzam_false;
+
+        itzam_btree_close(&btree);
+    }
+
+    printf("\n");
+    prefixed = itzam_false;
+    test_size(MAX_KEY_SIZE);
+
+    prefixed = itzam_true;
+
+    if (!test_compression(MAX_KEY_SIZE))
+        return itzam_false;
+
+    printf("\nOkay\n");
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_btree_varkey())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
@@ -0,0 +1,698 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error
+ */
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/* errors expected from damaged records are noted rather than fatal */
+static itzam_error last_error;
+static int error_count;
+
+static void record_error(const char * function_name, itzam_error error)
+{
+    last_error = error;
+    ++error_count;
+}
+
+/*----------------------------------------------------------
+ * test parameters
+ */
+#define NUM_RECORDS  200
+#define MAX_LENGTH   5000
+#define NUM_KEYS     5000
+
+static const char * filename = "checksum.itz";
+static const char * btree_filename = "checksum-btree.itz";
+static const char * old_filename = "checksum-0501.itz";
+
+static itzam_ref where[NUM_RECORDS];
+static itzam_int length[NUM_RECORDS];
+
+/* the contents of a record, which change with its version */
+static void make_record(int n, int v, itzam_byte * record, itzam_int len)
+{
+    itzam_int i;
+
+    for (i = 0; i < len; ++i)
+        record[i] = (itzam_byte)((n * 31 + v * 7 + i * 13) ^ (i >> 8));
+}
+
+/* flip bits of one byte of a file, as a failing disk might */
+static void damage(const char * name, itzam_ref pos, int bits)
+{
+    FILE * file = fopen(name, "r+b");
+    int byte;
+
+    if ((file == NULL) || fseek(file, (long)pos, SEEK_SET) || ((byte = fgetc(file)) == EOF))
+    {
+        printf("ERROR: could not damage %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    fseek(file, (long)pos, SEEK_SET);
+    fputc(byte ^ bits, file);
+    fclose(file);
+}
+
+static void open_datafile(itzam_datafile * datafile, const char * name)
+{
+    itzam_state state = itzam_datafile_open(datafile, name, itzam_false, itzam_false);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_datafile_set_error_handler(datafile, error_handler);
+}
+
+/* read a record by position, expecting it to be intact (v >= 0) or reported as damaged */
+static itzam_bool check_record(itzam_datafile * datafile, int n, int v)
+{
+    static itzam_byte expected[MAX_LENGTH], record[MAX_LENGTH];
+    itzam_bool result = itzam_true;
+    itzam_state state;
+
+    last_error  = ITZAM_ERROR_SIGNATURE;
+    error_count = 0;
+    itzam_datafile_set_error_handler(datafile, record_error);
+
+    state = itzam_datafile_read_at(datafile, where[n], record, length[n]);
+
+    itzam_datafile_set_error_handler(datafile, error_handler);
+
+    if (v < 0)
+    {
+        if ((state == ITZAM_OKAY) || (last_error != ITZAM_ERROR_CHECKSUM) || (error_count != 1))
+        {
+            printf("ERROR: damage to record %d was not reported\n", n);
+            result = itzam_false;
+        }
+    }
+    else
+    {
+        make_record(n, v, expected, length[n]);
+
+        if ((state != ITZAM_OKAY) || memcmp(expected, record, length[n]))
+        {
+            printf("ERROR: record %d was not read intact\n", n);
+            result = itzam_false;
+        }
+    }
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+
+/* the checksum is CRC-32C, whichever way it is computed */
+static itzam_bool test_crc32c()
+{
+    static itzam_byte data[3 * MAX_LENGTH];
+    uint32_t expected, found;
+    itzam_int start, len, cut, i;
+    int n, k;
+
+    printf("Checking CRC-32C...\n");
+
+    if (itzam_crc32c(0, "123456789", 9) != 0xE3069283)
+    {
+        printf("ERROR: CRC-32C of the standard check string is %08x\n", itzam_crc32c(0, "123456789", 9));
+        return itzam_false;
+    }
+
+    for (i = 0; i < (itzam_int)sizeof(data); ++i)
+        data[i] = (itzam_byte)random_int32(256);
+
+    for (n = 0; n < 2000; ++n)
+    {
+        start = random_int32(16);
+        len   = random_int32((int32_t)sizeof(data) - 16);
+        cut   = (len > 0) ? random_int32((int32_t)len) : 0;
+
+        /* one bit at a time, as the polynomial is defined */
+        expected = 0xFFFFFFFF;
+
+        for (i = 0; i < len; ++i)
+        {
+            expected ^= data[start + i];
+
+            for (k = 0; k < 8; ++k)
+                expected = (expected & 1) ? ((expected >> 1) ^ 0x82F63B78) : (expected >> 1);
+        }
+
+        expected = ~expected;
+
+        /* in two pieces, to check that one continues from another */
+        found = itzam_crc32c(itzam_crc32c(0, data + start, cut), data + start + cut, len - cut);
+
+        if (found != expected)
+        {
+            printf("ERROR: CRC-32C of %d bytes is %08x, expected %08x\n", (int)len, found, expected);
+            return itzam_false;
+        }
+    }
+
+    return itzam_true;
+}
+
+/* damaged records are reported by every kind of read, and intact ones are not */
+static itzam_bool test_records()
+{
+    static itzam_byte record[MAX_LENGTH + sizeof(itzam_record_header)], expected[MAX_LENGTH];
+    itzam_datafile datafile;
+    itzam_bool result = itzam_true;
+    itzam_state state;
+    itzam_int half;
+    FILE * file;
+    void * data;
+    int n, reads, mapped;
+
+    printf("Checking records...\n");
+
+    state = itzam_datafile_create(&datafile, filename);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_datafile_set_error_handler(&datafile, error_handler);
+
+    /* checksums are written whether or not they are verified */
+    itzam_datafile_set_checksums(&datafile, ITZAM_CHECKSUM_NONE);
+
+    for (n = 0; n < NUM_RECORDS; ++n)
+    {
+        length[n] = 2 + random_int32(MAX_LENGTH - 1);
+        make_record(n, 0, record, length[n]);
+
+        where[n] = itzam_datafile_write(&datafile, record, length[n], ITZAM_NULL_REF);
+
+        if (where[n] == ITZAM_NULL_REF)
+            not_okay(ITZAM_FAILED);
+    }
+
+    /* change the second half of a record, then all of another, keeping their checksums */
+    half = length[1] / 2;
+    make_record(1, 1, record, length[1]);
+
+    if (ITZAM_OKAY != itzam_datafile_overwrite(&datafile, record + half, length[1] - half, where[1], half))
+        not_okay(ITZAM_FAILED);
+
+    make_record(2, 1, record, length[2]);
+
+    if (ITZAM_OKAY != itzam_datafile_overwrite(&datafile, record, length[2], where[2], 0))
+        not_okay(ITZAM_FAILED);
+
+    itzam_datafile_close(&datafile);
+
+    open_datafile(&datafile, filename);
+
+    make_record(1, 0, expected, length[1]);
+    make_record(1, 1, record, length[1]);
+    memcpy(expected + half, record + half, length[1] - half);
+
+    if ((ITZAM_OKAY != itzam_datafile_read_at(&datafile, where[1], record, length[1])) || memcmp(expected, record, length[1]))
+    {
+        printf("ERROR: a record changed in part was not read intact\n");
+        result = itzam_false;
+    }
+
+    for (n = 2; n < NUM_RECORDS; ++n)
+        result &= check_record(&datafile, n, (n == 2) ? 1 : 0);
+
+    itzam_datafile_close(&datafile);
+
+    /* damage data and header fields; a record that lost its checksum flag is damaged too, and
+     * lengths that are impossible, or would reach past the record, are never followed
+     */
+    damage(filename, where[3] + sizeof(itzam_record_header) + length[3] - 1, 0x10);
+    damage(filename, where[4] + sizeof(itzam_record_header), 0x10);
+    damage(filename, where[5] + 6, 0x10);
+    damage(filename, where[6] + offsetof(itzam_record_header, m_flags), 0x40);
+    damage(filename, where[7] + offsetof(itzam_record_header, m_rec_len), 0x01);
+    damage(filename, where[8] + offsetof(itzam_record_header, m_rec_len) + sizeof(itzam_int) - 1, 0x80);
+
+    for (mapped = 0; mapped < 2; ++mapped)
+    {
+        open_datafile(&datafile, filename);
+
+        if (mapped && (ITZAM_OKAY != itzam_datafile_set_mapped(&datafile, itzam_true)))
+            not_okay(ITZAM_FAILED);
+
+        result &= check_record(&datafile, 2, 1);
+
+        for (n = 3; n <= 8; ++n)
+            result &= check_record(&datafile, n, -1);
+
+        result &= check_record(&datafile, 9, 0);
+
+        itzam_datafile_close(&datafile);
+    }
+
+    open_datafile(&datafile, filename);
+
+    /* without verification, damage goes unnoticed */
+    itzam_datafile_set_checksums(&datafile, ITZAM_CHECKSUM_NONE);
+
+    if (ITZAM_OKAY != itzam_datafile_read_at(&datafile, where[3], record, length[3]))
+    {
+        printf("ERROR: a record was verified when checksums were not\n");
+        result = itzam_false;
+    }
+
+    itzam_datafile_set_checksums(&datafile, ITZAM_CHECKSUM_VERIFY);
+
+    /* reading part of a record checks all of it */
+    itzam_datafile_set_error_handler(&datafile, record_error);
+    error_count = 0;
+
+    if ((ITZAM_OKAY == itzam_datafile_read_at(&datafile, where[3], record, length[3] - 1)) || (error_count != 1))
+    {
+        printf("ERROR: part of a damaged record was read\n");
+        result = itzam_false;
+    }
+
+    itzam_datafile_set_error_handler(&datafile, error_handler);
+    make_record(9, 0, expected, length[9]);
+
+    if ((ITZAM_OKAY != itzam_datafile_read_at(&datafile, where[9], record, length[9] / 2)) || memcmp(expected, record, length[9] / 2))
+    {
+        printf("ERROR: part of a record was not read intact\n");
+        result = itzam_false;
+    }
+
+    /* sequential reads report damaged records and move on */
+    itzam_datafile_set_error_handler(&datafile, record_error);
+    itzam_datafile_rewind(&datafile);
+    error_count = 0;
+    reads = 0;
+
+    for (n = 0; n < NUM_RECORDS; ++n)
+    {
+        if (ITZAM_OKAY == itzam_datafile_read(&datafile, record, MAX_LENGTH))
+            ++reads;
+    }
+
+    if ((reads != NUM_RECORDS - 6) || (error_count != 6))
+    {
+        printf("ERROR: sequential reads found %d records and %d damaged\n", reads, error_count);
+        result = itzam_false;
+    }
+
+    for (n = 3; n <= 8; n += 5)
+    {
+        error_count = 0;
+        itzam_datafile_seek(&datafile, where[n]);
+
+        if ((ITZAM_OKAY == itzam_datafile_read_alloc(&datafile, &data, NULL)) || (error_count != 1) || (last_error != ITZAM_ERROR_CHECKSUM))
+        {
+            printf("ERROR: damage to record %d was not reported by itzam_datafile_read_alloc\n", n);
+            result = itzam_false;
+        }
+    }
+
+    itzam_datafile_set_error_handler(&datafile, error_handler);
+
+    /* the buffer path; a record read whole with its header is checked, without a report */
+    for (n = 2; n < 10; ++n)
+    {
+        file = fopen(filename, "rb");
+
+        if ((file == NULL) || fseek(file, (long)where[n], SEEK_SET)
+         || (fread(record, 1, sizeof(itzam_record_header) + length[n], file) != sizeof(itzam_record_header) + length[n]))
+            not_okay(ITZAM_FAILED);
+
+        fclose(file);
+
+        if ((itzam_datafile_record_data(&datafile, record, length[n]) == NULL) != ((n >= 3) && (n <= 8)))
+        {
+            printf("ERROR: itzam_datafile_record_data misjudged record %d\n", n);
+            result = itzam_false;
+        }
+    }
+
+    itzam_datafile_close(&datafile);
+
+    return result;
+}
+
+/* a file of version 5.1, whose record headers have no checksums, is read and changed in
+ * its own format
+ */
+static itzam_bool test_old_format()
+{
+    static itzam_byte record[MAX_LENGTH], expected[MAX_LENGTH];
+    const size_t old_header = offsetof(itzam_record_header, m_checksum);
+    itzam_datafile_header file_header;
+    itzam_record_header header;
+    itzam_datafile datafile;
+    itzam_bool result = itzam_true;
+    itzam_ref pos;
+    FILE * file;
+    int n, reads;
+
+    printf("Checking a file of version 5.1...\n");
+
+    memset(&file_header, 0, sizeof(file_header));
+    file_header.m_signature        = ITZAM_DATAFILE_SIGNATURE;
+    file_header.m_version          = ITZAM_DATAFILE_VERSION_0501;
+    file_header.m_dellist_ref      = ITZAM_NULL_REF;
+    file_header.m_schema_ref       = ITZAM_NULL_REF;
+    file_header.m_index_list_ref   = ITZAM_NULL_REF;
+    file_header.m_transaction_tail = ITZAM_NULL_REF;
+
+    file = fopen(old_filename, "wb");
+
+    if ((file == NULL) || (fwrite(&file_header, sizeof(file_header), 1, file) != 1))
+        not_okay(ITZAM_FAILED);
+
+    pos = sizeof(file_header);
+
+    for (n = 0; n < 20; ++n)
+    {
+        length[n] = 1 + random_int32(MAX_LENGTH);
+        where[n]  = pos;
+        make_record(n, 0, record, length[n]);
+
+        memset(&header, 0, sizeof(header));
+        header.m_signature = ITZAM_RECORD_SIGNATURE;
+        header.m_flags     = ITZAM_RECORD_IN_USE;
+        header.m_length    = length[n];
+        header.m_rec_len   = length[n];
+
+        if ((fwrite(&header, old_header, 1, file) != 1) || (fwrite(record, length[n], 1, file) != 1))
+            not_okay(ITZAM_FAILED);
+
+        pos += old_header + length[n];
+    }
+
+    fclose(file);
+
+    /* change it: remove a record, add two, one of which may reuse its space, and change one */
+    open_datafile(&datafile, old_filename);
+
+    if ((ITZAM_OKAY != itzam_datafile_seek(&datafile, where[5])) || (ITZAM_OKAY != itzam_datafile_remove(&datafile)))
+        not_okay(ITZAM_FAILED);
+
+    for (n = 20; n < 22; ++n)
+    {
+        length[n] = 1 + random_int32(length[5]);
+        make_record(n, 0, record, length[n]);
+        where[n] = itzam_datafile_write(&datafile, record, length[n], ITZAM_NULL_REF);
+
+        if (where[n] == ITZAM_NULL_REF)
+            not_okay(ITZAM_FAILED);
+    }
+
+    make_record(7, 1, record, length[7]);
+
+    if (ITZAM_OKAY != itzam_datafile_overwrite(&datafile, record, length[7], where[7], 0))
+        not_okay(ITZAM_FAILED);
+
+    itzam_datafile_close(&datafile);
+
+    /* the file keeps its version and layout, with or without mapped reads */
+    file = fopen(old_filename, "rb");
+
+    if ((file == NULL) || (fread(&file_header, sizeof(file_header), 1, file) != 1) || (file_header.m_version != ITZAM_DATAFILE_VERSION_0501))
+    {
+        printf("ERROR: a file of version 5.1 changed its version\n");
+        result = itzam_false;
+    }
+
+    if (file != NULL)
+        fclose(file);
+
+    for (n = 0; n < 2; ++n)
+    {
+        open_datafile(&datafile, old_filename);
+        itzam_datafile_set_mapped(&datafile, n ? itzam_true : itzam_false);
+
+        for (reads = 0; reads < 22; ++reads)
+        {
+            if (reads != 5)
+                result &= check_record(&datafile, reads, (reads == 7) ? 1 : 0);
+        }
+
+        itzam_datafile_close(&datafile);
+    }
+
+    open_datafile(&datafile, old_filename);
+    itzam_datafile_set_error_handler(&datafile, record_error);
+    itzam_datafile_rewind(&datafile);
+    error_count = 0;
+    reads = 0;
+
+    for (n = 0; n < 22; ++n)
+    {
+        if (ITZAM_OKAY == itzam_datafile_read(&datafile, record, MAX_LENGTH))
+            ++reads;
+    }
+
+    itzam_datafile_set_error_handler(&datafile, error_handler);
+
+    make_record(21, 0, expected, length[21]);
+
+    if ((reads != 21) || (ITZAM_OKAY != itzam_datafile_read_at(&datafile, where[21], record, length[21])) || memcmp(expected, record, length[21]))
+    {
+        printf("ERROR: sequential reads of a file of version 5.1 found %d records\n", reads);
+        result = itzam_false;
+    }
+
+    itzam_datafile_close(&datafile);
+
+    return result;
+}
+
+/* a damaged page is reported, whether pages are read through the cache or in place */
+static itzam_bool test_btree()
+{
+    itzam_btree btree;
+    itzam_bool result = itzam_true;
+    itzam_record_header header;
+    itzam_ref pos, root, target = ITZAM_NULL_REF;
+    int32_t key, found_key;
+    int pages = 0, misses, pass;
+    FILE * file;
+
+    printf("Checking B-tree pages...\n");
+
+    if (ITZAM_OKAY != itzam_btree_create(&btree, btree_filename, 25, sizeof(int32_t), itzam_comparator_int32, error_handler))
+        not_okay(ITZAM_FAILED);
+
+    for (key = 0; key < NUM_KEYS; ++key)
+    {
+        if (ITZAM_OKAY != itzam_btree_insert(&btree, &key))
+            not_okay(ITZAM_FAILED);
+    }
+
+    root = btree.m_header->m_root_where;
+    itzam_btree_close(&btree);
+
+    /* pick a page in the middle of the file, other than the root */
+    file = fopen(btree_filename, "rb");
+
+    for (pos = sizeof(itzam_datafile_header);
+         (file != NULL) && !fseek(file, (long)pos, SEEK_SET) && (fread(&header, sizeof(header), 1, file) == 1);
+         pos += sizeof(header) + header.m_length)
+    {
+        if ((header.m_flags & ITZAM_RECORD_IN_USE) && (header.m_flags & ITZAM_RECORD_BTREE_PAGE) && (pos != root))
+        {
+            if (!(header.m_flags & ITZAM_RECORD_CHECKSUM))
+            {
+                printf("ERROR: a page was written without a checksum\n");
+                result = itzam_false;
+            }
+
+            if (++pages == 20)
+                target = pos;
+        }
+    }
+
+    if (file != NULL)
+        fclose(file);
+
+    if (target == ITZAM_NULL_REF)
+    {
+        printf("ERROR: no page was found to damage\n");
+        return itzam_false;
+    }
+
+    damage(btree_filename, target + sizeof(itzam_record_header) + 16, 0x10);
+
+    /* once through the cache, then reading pages in place with every visit checked */
+    for (pass = 0; pass < 2; ++pass)
+    {
+        if (ITZAM_OKAY != itzam_btree_open(&btree, btree_filename, itzam_comparator_int32, error_handler, itzam_false, itzam_false))
+            not_okay(ITZAM_FAILED);
+
+        if (pass == 1)
+        {
+            itzam_btree_set_mapped(&btree, itzam_true);
+            itzam_btree_set_checksums(&btree, ITZAM_CHECKSUM_MAPPED);
+        }
+
+        itzam_btree_set_error_handler(&btree, record_error);
+        error_count = 0;
+        last_error  = ITZAM_ERROR_SIGNATURE;
+        misses      = 0;
+
+        for (key = 0; key < NUM_KEYS; ++key)
+        {
+            if (!itzam_btree_find(&btree, &key, &found_key) || (found_key != key))
+                ++misses;
+        }
+
+        if ((misses == 0) || (misses == NUM_KEYS) || (error_count == 0) || (last_error != ITZAM_ERROR_CHECKSUM))
+        {
+            printf("ERROR: damage to a page was not reported (%s)\n", pass ? "mapped" : "cached");
+            result = itzam_false;
+        }
+        else
+            printf("%8d keys not found behind a damaged page (%s)\n", misses, pass ? "mapped" : "cached");
+
+        itzam_btree_close(&btree);
+    }
+
+    return result;
+}
+
+itzam_bool test_datafile_checksum()
+{
+    itzam_bool result = itzam_true;
+
+    // banner for this test
+    printf("\nItzam/C Datafile Test\nRecord Checksums\n\n");
+
+    result &= test_crc32c();
+    result &= test_records();
+    result &= test_old_format();
+    result &= test_btree();
+
+    if (result)
+        printf("\nOkay\n");
+
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_datafile_checksum())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
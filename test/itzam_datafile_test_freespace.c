@@ -0,0 +1,394 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+#include "../src/itzam.h"
+#include "itzam_errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*----------------------------------------------------------
+ * embedded random number generator; ala Park and Miller
+ */
+static int32_t seed = 1325;
+
+void init_test_prng(int32_t s)
+{
+    seed = s;
+}
+
+int32_t random_int32(int32_t limit)
+{
+    static const int32_t IA   = 16807;
+    static const int32_t IM   = 2147483647;
+    static const int32_t IQ   = 127773;
+    static const int32_t IR   = 2836;
+    static const int32_t MASK = 123459876;
+
+    int32_t k;
+    int32_t result;
+
+    seed ^= MASK;
+    k = seed / IQ;
+    seed = IA * (seed - k * IQ) - IR * k;
+
+    if (seed < 0L)
+        seed += IM;
+
+    result = (seed % limit);
+    seed ^= MASK;
+
+    return result;
+}
+
+/*----------------------------------------------------------
+ *  Reports an itzam error, closing the test file if it is open
+ */
+static itzam_datafile * open_datafile = NULL;
+
+void not_okay(itzam_state state)
+{
+    fprintf(stderr, "\nItzam problem: %s\n", STATE_MESSAGES[state]);
+
+    if (open_datafile != NULL)
+    {
+        itzam_datafile * datafile = open_datafile;
+        open_datafile = NULL;
+        itzam_datafile_close(datafile);
+    }
+
+    exit(EXIT_FAILURE);
+}
+
+void error_handler(const char * function_name, itzam_error error)
+{
+    fprintf(stderr, "Itzam error in %s: %s\n", function_name, ERROR_STRINGS[error]);
+    exit(EXIT_FAILURE);
+}
+
+/*----------------------------------------------------------
+ * records of mixed sizes, each filled with a byte that identifies it
+ */
+#define NUM_SLOTS    2000
+#define REC_LEN_BASE 10
+#define REC_LEN_EXT  1000
+
+typedef struct t_slot_type
+{
+    itzam_ref m_where;
+    itzam_int m_length;
+    char      m_fill;
+}
+slot_type;
+
+static slot_type slots[NUM_SLOTS];
+static slot_type saved[NUM_SLOTS];
+
+static itzam_int live_bytes()
+{
+    itzam_int result = 0;
+    int n;
+
+    for (n = 0; n < NUM_SLOTS; ++n)
+    {
+        if (slots[n].m_where != ITZAM_NULL_REF)
+            result += slots[n].m_length + sizeof(itzam_record_header);
+    }
+
+    return result;
+}
+
+static void random_op(itzam_datafile * datafile)
+{
+    int n = random_int32(NUM_SLOTS);
+    char * record;
+
+    if (slots[n].m_where != ITZAM_NULL_REF)
+    {
+        if (ITZAM_OKAY != itzam_datafile_seek(datafile, slots[n].m_where))
+            not_okay(ITZAM_FAILED);
+
+        if (ITZAM_OKAY != itzam_datafile_remove(datafile))
+            not_okay(ITZAM_FAILED);
+
+        slots[n].m_where = ITZAM_NULL_REF;
+    }
+    else
+    {
+        slots[n].m_length = REC_LEN_BASE + (itzam_int)random_int32(REC_LEN_EXT);
+        slots[n].m_fill   = 'A' + random_int32(26);
+
+        record = (char *)malloc(slots[n].m_length);
+        memset(record, slots[n].m_fill, slots[n].m_length);
+
+        slots[n].m_where = itzam_datafile_write(datafile, record, slots[n].m_length, ITZAM_NULL_REF);
+
+        if (slots[n].m_where == ITZAM_NULL_REF)
+            not_okay(ITZAM_FAILED);
+
+        free(record);
+    }
+}
+
+/* every record must be readable with its own contents
+ */
+static itzam_bool verify_records(itzam_datafile * datafile)
+{
+    char * record;
+    itzam_int len_read;
+    int n, i;
+
+    for (n = 0; n < NUM_SLOTS; ++n)
+    {
+        if (slots[n].m_where == ITZAM_NULL_REF)
+            continue;
+
+        if (ITZAM_OKAY != itzam_datafile_seek(datafile, slots[n].m_where))
+            return itzam_false;
+
+        if (ITZAM_OKAY != itzam_datafile_read_alloc(datafile, (void **)&record, &len_read))
+            return itzam_false;
+
+        if (len_read != slots[n].m_length)
+        {
+            printf("ERROR: record %d has length %d, expected %d\n", n, (int)len_read, (int)slots[n].m_length);
+            return itzam_false;
+        }
+
+        for (i = 0; i < len_read; ++i)
+        {
+            if (record[i] != slots[n].m_fill)
+            {
+                printf("ERROR: record %d does not match\n", n);
+                return itzam_false;
+            }
+        }
+
+        free(record);
+    }
+
+    return itzam_true;
+}
+
+/* every byte of the file must belong to a record, so that the file can be read sequentially
+ */
+static itzam_bool verify_layout(const char * filename, itzam_int * file_size)
+{
+    itzam_record_header header;
+    itzam_int pos = sizeof(itzam_datafile_header);
+    int live = 0, expected = 0, n;
+    FILE * file = fopen(filename, "rb");
+
+    if (file == NULL)
+        return itzam_false;
+
+    while ((fseek(file, (long)pos, SEEK_SET) == 0) && (fread(&header, sizeof(header), 1, file) == 1))
+    {
+        if (header.m_signature != ITZAM_RECORD_SIGNATURE)
+        {
+            printf("ERROR: invalid record header at %ld\n", (long)pos);
+            fclose(file);
+            return itzam_false;
+        }
+
+        if ((header.m_flags & ITZAM_RECORD_IN_USE) && !(header.m_flags & ITZAM_RECORD_DELLIST))
+            ++live;
+
+        pos += sizeof(header) + header.m_length;
+    }
+
+    fclose(file);
+
+    for (n = 0; n < NUM_SLOTS; ++n)
+    {
+        if (slots[n].m_where != ITZAM_NULL_REF)
+            ++expected;
+    }
+
+    if (live != expected)
+    {
+        printf("ERROR: found %d active records, expected %d\n", live, expected);
+        return itzam_false;
+    }
+
+    *file_size = pos;
+
+    return itzam_true;
+}
+
+/*----------------------------------------------------------
+ * tests
+ */
+itzam_bool test_datafile_freespace()
+{
+    itzam_datafile datafile;
+    itzam_state    state;
+    char *         filename  = "freespace.itz";
+    int            test_size = 200000;
+    int            n, i;
+    itzam_int      max_live  = 0;
+    itzam_int      file_size = 0;
+    itzam_bool     result;
+
+    // banner for this test
+    printf("\nItzam/C Datafile Test\nReuse of Space from Deleted Records of Mixed Sizes\n");
+    printf("\nParameters:\n%8d record slots\n%8d record length range\n%8d operations\n", NUM_SLOTS, REC_LEN_EXT, test_size);
+
+    for (n = 0; n < NUM_SLOTS; ++n)
+        slots[n].m_where = ITZAM_NULL_REF;
+
+    state = itzam_datafile_create(&datafile, filename);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    open_datafile = &datafile;
+    itzam_datafile_set_error_handler(&datafile, error_handler);
+
+    printf("\nPerforming random writes and removes...\n");
+
+    for (n = 0; n < test_size; ++n)
+    {
+        // every so often, undo a few operations
+        if (n % 1000 == 999)
+        {
+            memcpy(saved, slots, sizeof(slots));
+
+            state = itzam_datafile_transaction_start(&datafile);
+
+            if (state != ITZAM_OKAY)
+                not_okay(state);
+
+            for (i = 0; i < 20; ++i)
+                random_op(&datafile);
+
+            state = itzam_datafile_transaction_rollback(&datafile);
+
+            if (state != ITZAM_OKAY)
+                not_okay(state);
+
+            memcpy(slots, saved, sizeof(slots));
+        }
+        else
+            random_op(&datafile);
+
+        if (live_bytes() > max_live)
+            max_live = live_bytes();
+
+        // close and reopen half-way, to make sure the deleted list was saved
+        if (n == test_size / 2)
+        {
+            open_datafile = NULL;
+            state = itzam_datafile_close(&datafile);
+
+            if (state != ITZAM_OKAY)
+                not_okay(state);
+
+            state = itzam_datafile_open(&datafile, filename, itzam_false, itzam_false);
+
+            if (state != ITZAM_OKAY)
+                not_okay(state);
+
+            open_datafile = &datafile;
+            itzam_datafile_set_error_handler(&datafile, error_handler);
+        }
+    }
+
+    printf("Verifying records...\n");
+
+    result = verify_records(&datafile);
+
+    open_datafile = NULL;
+    state = itzam_datafile_close(&datafile);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    if (!result)
+        return itzam_false;
+
+    printf("Verifying file layout...\n");
+
+    if (!verify_layout(filename, &file_size))
+        return itzam_false;
+
+    printf("\n%10ld bytes in largest set of active records\n%10ld bytes in file\n", (long)max_live, (long)file_size);
+
+    // freed space is reused, so the file stays in proportion to the data it holds
+    if (file_size > 2 * max_live)
+    {
+        printf("ERROR: file has grown beyond its contents\n");
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+int main(int argc, char* argv[])
+{
+    int result = EXIT_FAILURE;
+
+    itzam_set_default_error_handler(error_handler);
+
+    init_test_prng((long)time(NULL));
+
+    if (test_datafile_freespace())
+        result = EXIT_SUCCESS;
+
+    return result;
+}
@@ -103,7 +103,13 @@ static const char * ERROR_STRINGS [] =
     "global shared memory requires Administrator or user with SeCreateGlobalPrivilege",
     "cannot create global shared memory",
     "another process or thread has already created shared objects for this datafile",
-    "invalid operation for read only file"
+    "invalid operation for read only file",
+    "record too long",
+    "write-ahead log could not be written or read",
+    "file could not be mapped into memory",
+    "operation not supported for variable-length keys",
+    "operation does not suit whether the B-tree stores values",
+    "record does not match its checksum"
 };
 
 static const char * STATE_MESSAGES [] =
@@ -118,7 +124,9 @@ static const char * STATE_MESSAGES [] =
     "exceeded maximum file size on 32-bit system",
     "unable to write data record for index",
     "sizeof(size_t) smaller than required for file references; possibly 64-bit DB on 32-bit platform",
-    "invalid operation for read only file"
+    "invalid operation for read only file",
+    "record too long for overwrite",
+    "keys not in sorted order"
 };
 
 #endif
\ No newline at end of file
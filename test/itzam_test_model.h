@@ -0,0 +1,236 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+/*-----------------------------------------------------------------------------
+ * A model of the int32_t keys a test B-tree holds, changed alongside the tree so
+ * that a test can check what the tree returns, and a sorted copy of it for tests
+ * of cursors and seeks. Include this after defining
+ * MAX_KEY, which bounds the keys, and filename, and after defining random_int32,
+ * not_okay and error_handler.
+ */
+#if !defined(ITZAM_TEST_MODEL_H)
+#define ITZAM_TEST_MODEL_H
+
+#if !defined(MAX_KEY)
+#error "define MAX_KEY before including itzam_test_model.h"
+#endif
+
+#define MODEL_BATCH_SIZE 100
+
+/* which keys are in the tree, and how many */
+static itzam_bool present[MAX_KEY];
+static int32_t present_count = 0;
+
+/* the same keys in order, as of the last build_model() */
+static int32_t model[MAX_KEY];
+static int32_t model_count = 0;
+
+/* a new, empty tree of int32_t keys with the given options; the log is never flushed */
+static inline void create_tree_with(itzam_btree * btree, uint16_t order, const itzam_btree_options * options)
+{
+    itzam_btree_options choices = *options;
+    itzam_state state;
+
+    state = itzam_btree_create_ex(btree, filename, order, sizeof(int32_t), itzam_comparator_int32, error_handler, &choices);
+
+    if (state != ITZAM_OKAY)
+        not_okay(state);
+
+    itzam_btree_set_durability(btree, ITZAM_DURABILITY_NONE, 0);
+
+    memset(present, 0, sizeof(present));
+    present_count = 0;
+}
+
+static inline void create_tree(itzam_btree * btree, uint16_t order, itzam_bool linked)
+{
+    itzam_btree_options options;
+
+    itzam_btree_options_init(&options);
+    options.m_linked_leaves = linked;
+
+    create_tree_with(btree, order, &options);
+}
+
+/* single changes; the model follows the tree only when the change is made */
+static inline itzam_state insert_key(itzam_btree * btree, int32_t key)
+{
+    itzam_state result = itzam_btree_insert(btree, &key);
+
+    if (result == ITZAM_OKAY)
+    {
+        present[key] = itzam_true;
+        ++present_count;
+    }
+
+    return result;
+}
+
+static inline itzam_state remove_key(itzam_btree * btree, int32_t key)
+{
+    itzam_state result = itzam_btree_remove(btree, &key);
+
+    if (result == ITZAM_OKAY)
+    {
+        present[key] = itzam_false;
+        --present_count;
+    }
+
+    return result;
+}
+
+/* inserts key, with odds of insert_odds in 4, or removes it */
+static inline itzam_state change_key(itzam_btree * btree, int32_t key, int insert_odds)
+{
+    if (random_int32(4) < insert_odds)
+        return insert_key(btree, key);
+    else
+        return remove_key(btree, key);
+}
+
+/* count random keys, inserted or removed as a batch; results are those of the batch */
+static inline void change_batch(itzam_btree * btree, int32_t * keys, int32_t count, itzam_bool insert, itzam_state * results)
+{
+    int32_t n;
+
+    if (count <= 0)
+        return;
+
+    for (n = 0; n < count; ++n)
+        keys[n] = random_int32(MAX_KEY);
+
+    if (insert)
+        itzam_btree_insert_batch(btree, keys, count, results);
+    else
+        itzam_btree_remove_batch(btree, keys, count, results);
+
+    for (n = 0; n < count; ++n)
+    {
+        if (results[n] == ITZAM_OKAY)
+        {
+            present[keys[n]] = insert;
+            present_count += insert ? 1 : -1;
+        }
+    }
+}
+
+/* count random keys inserted */
+static inline void fill_tree(itzam_btree * btree, int32_t count)
+{
+    while (count-- > 0)
+        insert_key(btree, random_int32(MAX_KEY));
+}
+
+/* random changes, one key or one batch at a time */
+static inline void change_tree(itzam_btree * btree, int changes)
+{
+    int32_t keys[MODEL_BATCH_SIZE];
+    itzam_state results[MODEL_BATCH_SIZE];
+
+    while (changes-- > 0)
+    {
+        switch (random_int32(4))
+        {
+            case 0:
+                insert_key(btree, random_int32(MAX_KEY));
+                break;
+
+            case 1:
+                remove_key(btree, random_int32(MAX_KEY));
+                break;
+
+            default:
+                change_batch(btree, keys, 1 + random_int32(MODEL_BATCH_SIZE), random_int32(2) ? itzam_true : itzam_false, results);
+                break;
+        }
+    }
+}
+
+/* sorts the keys present into model[] */
+static inline void build_model()
+{
+    int32_t key;
+
+    model_count = 0;
+
+    for (key = 0; key < MAX_KEY; ++key)
+    {
+        if (present[key])
+            model[model_count++] = key;
+    }
+}
+
+/* index of the first model key not less than key */
+static inline int32_t lower_bound(int32_t key)
+{
+    int32_t lo = 0, hi = model_count;
+
+    while (lo < hi)
+    {
+        int32_t mid = lo + (hi - lo) / 2;
+
+        if (model[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+#endif
@@ -0,0 +1,167 @@
+/*
+    Itzam/C (version 6.0) is an embedded database engine written in Standard C.
+
+    Copyright 2011 Scott Robert Ladd. All rights reserved.
+
+    Older versions of Itzam/C are:
+        Copyright 2002, 2004, 2006, 2008 Scott Robert Ladd. All rights reserved.
+
+    Ancestral code, from Java and C++ books by the author, is:
+        Copyright 1992, 1994, 1996, 2001 Scott Robert Ladd.  All rights reserved.
+
+    Itzam/C is user-supported open source software. It's continued development is dependent on
+    financial support from the community. You can provide funding by visiting the Itzam/C
+    website at:
+
+        http://www.coyotegulch.com
+
+    You may license Itzam/C in one of two fashions:
+
+    1) Simplified BSD License (FreeBSD License)
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1.  Redistributions of source code must retain the above copyright notice, this list of
+        conditions and the following disclaimer.
+
+    2.  Redistributions in binary form must reproduce the above copyright notice, this list
+        of conditions and the following disclaimer in the documentation and/or other materials
+        provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY SCOTT ROBERT LADD ``AS IS'' AND ANY EXPRESS OR IMPLIED
+    WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+    FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SCOTT ROBERT LADD OR
+    CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+    ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+    The views and conclusions contained in the software and documentation are those of the
+    authors and should not be interpreted as representing official policies, either expressed
+    or implied, of Scott Robert Ladd.
+
+    2) Closed-Source Proprietary License
+
+    If your project is a closed-source or proprietary project, the Simplified BSD License may
+    not be appropriate or desirable. In such cases, contact the Itzam copyright holder to
+    arrange your purchase of an appropriate license.
+
+    The author can be contacted at:
+
+          scott.ladd@coyotegulch.com
+          scott.ladd@gmail.com
+          http:www.coyotegulch.com
+*/
+
+/*-----------------------------------------------------------------------------
+ * Walks a B-tree of int32_t keys on disk, checking page fill, key order, parent
+ * links and depth, and that the keys found match the tree's count.
+ */
+#if !defined(ITZAM_TEST_WALK_H)
+#define ITZAM_TEST_WALK_H
+
+static int leaf_depth;
+
+static inline int64_t check_page(itzam_btree * btree, itzam_ref where, itzam_ref parent, int depth, const int32_t * low, const int32_t * high)
+{
+    itzam_byte * data = (itzam_byte *)malloc(btree->m_header->m_sizeof_page);
+    itzam_btree_page_header * header = (itzam_btree_page_header *)data;
+    int32_t * keys;
+    itzam_ref * links;
+    int64_t result = 0;
+    int64_t child;
+    int n;
+
+    if ((ITZAM_OKAY != itzam_datafile_seek(btree->m_datafile, where))
+     || (ITZAM_OKAY != itzam_datafile_read(btree->m_datafile, data, btree->m_header->m_sizeof_page)))
+    {
+        printf("ERROR: page at %ld could not be read\n", (long)where);
+        free(data);
+        return -1;
+    }
+
+    keys  = (int32_t *)(data + sizeof(itzam_btree_page_header));
+    links = (itzam_ref *)(data + sizeof(itzam_btree_page_header) + btree->m_header->m_sizeof_key * btree->m_header->m_order);
+
+    if ((header->m_where != where) || (header->m_parent != parent))
+    {
+        printf("ERROR: page at %ld has bad location or parent\n", (long)where);
+        result = -1;
+    }
+    else if ((header->m_key_count > btree->m_header->m_order)
+          || ((parent != ITZAM_NULL_REF) && (header->m_key_count < btree->m_min_keys)))
+    {
+        printf("ERROR: page at %ld holds %d keys\n", (long)where, (int)header->m_key_count);
+        result = -1;
+    }
+    else
+    {
+        for (n = 0; (result >= 0) && (n < header->m_key_count); ++n)
+        {
+            if (((n > 0) && (keys[n - 1] >= keys[n])) || ((low != NULL) && (keys[n] <= *low)) || ((high != NULL) && (keys[n] >= *high)))
+            {
+                printf("ERROR: page at %ld has keys out of order\n", (long)where);
+                result = -1;
+            }
+        }
+
+        if ((result >= 0) && (links[0] == ITZAM_NULL_REF))
+        {
+            if (leaf_depth < 0)
+                leaf_depth = depth;
+            else if (leaf_depth != depth)
+            {
+                printf("ERROR: leaves at depths %d and %d\n", leaf_depth, depth);
+                result = -1;
+            }
+
+            if (result >= 0)
+                result = header->m_key_count;
+        }
+        else
+        {
+            for (n = 0; (result >= 0) && (n <= header->m_key_count); ++n)
+            {
+                child = check_page(btree, links[n], where, depth + 1,
+                                   (n > 0) ? &keys[n - 1] : low,
+                                   (n < header->m_key_count) ? &keys[n] : high);
+
+                if (child < 0)
+                    result = -1;
+                else
+                    result += child;
+            }
+
+            if (result >= 0)
+                result += header->m_key_count;
+        }
+    }
+
+    free(data);
+
+    return result;
+}
+
+static inline itzam_bool check_tree(itzam_btree * btree)
+{
+    int64_t count;
+
+    leaf_depth = -1;
+    count = check_page(btree, btree->m_header->m_root_where, ITZAM_NULL_REF, 0, NULL, NULL);
+
+    if (count < 0)
+        return itzam_false;
+
+    if ((uint64_t)count != itzam_btree_count(btree))
+    {
+        printf("ERROR: tree holds %ld keys, but its count is %ld\n", (long)count, (long)itzam_btree_count(btree));
+        return itzam_false;
+    }
+
+    return itzam_true;
+}
+
+#endif